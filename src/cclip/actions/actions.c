@@ -22,24 +22,18 @@
 #include "actions.h"
 #include "common/macros.h"
 
-static const struct {
-    const char* const name;
-    action_func_t* const action;
-} actions[] = {
-    #define DEFINE_ACTION_TABLE(name, ...) { #name, action_##name },
+static const struct action actions[] = {
+    #define DEFINE_ACTION_TABLE(action, remote_, ...) \
+        { .name = #action, .func = action_##action, .remote = remote_ },
     FOR_LIST_OF_ACTIONS(DEFINE_ACTION_TABLE)
 };
 
-action_func_t* match_action(const char* input) {
-    action_func_t* f = NULL;
-
+const struct action* match_action(const char* input) {
     for (size_t i = 0; i < SIZEOF_ARRAY(actions); i++) {
         if (STREQ(input, actions[i].name)) {
-            f = actions[i].action;
-            break;
+            return &actions[i];
         }
     }
 
-    return f;
+    return NULL;
 }
-
@@ -18,24 +18,46 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 #include <sqlite3.h>
 
+/* second argument is true if action can be served by cclipd (see client.h) */
 #define FOR_LIST_OF_ACTIONS(DO) \
-    DO(list) \
-    DO(get) \
-    DO(copy) \
-    DO(delete) \
-    DO(tag) \
-    DO(tags) \
-    DO(vacuum) \
-    DO(wipe) \
+    DO(list, true) \
+    DO(get, true) \
+    DO(search, true) \
+    DO(grep, false) \
+    DO(pick, false) \
+    DO(copy, false) \
+    DO(delete, false) \
+    DO(tag, false) \
+    DO(tags, false) \
+    DO(vacuum, false) \
+    DO(backup, false) \
+    DO(export, false) \
+    DO(import, false) \
+    DO(wipe, false) \
+    DO(batch, false) \
+    DO(add, false) \
+    DO(watch, true) \
 
+/*
+ * If action can be served by cclipd and we are connected to it,
+ * db is NULL and action is expected to use client_request() instead.
+ */
 typedef void action_func_t(int argc, char** argv, struct sqlite3* db) __attribute__((noreturn));
 
 #define DEFINE_ACTION_FUNCTION(name, ...) action_func_t action_##name;
 FOR_LIST_OF_ACTIONS(DEFINE_ACTION_FUNCTION)
 
-action_func_t* match_action(const char* input);
+struct action {
+    const char* name;
+    action_func_t* func;
+    bool remote;
+};
+
+const struct action* match_action(const char* input);
 
 /* some helper macros */
 #define RESET_GETOPT() ({ optind = 0; })
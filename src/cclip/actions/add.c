@@ -0,0 +1,455 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "../utils.h"
+#include "../client.h"
+#include "collections/vec.h"
+#include "preview.h"
+#include "db.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "log.h"
+
+#define ADD_MAX_TAGS 16
+#define ADD_DEFAULT_MIME_TYPE "text/plain"
+#define ADD_READ_SIZE (64 * 1024)
+/*
+ * In bulk mode entries are inserted in batches, each one is committed after this many
+ * entries or milliseconds, or as soon as reading the next entry would block. The write
+ * lock is never held while waiting for input, so a slow writer can't stall cclipd.
+ */
+#define ADD_BATCH_ENTRIES 10000
+#define ADD_BATCH_MS 1000
+
+enum {
+    STMT_INSERT,
+    STMT_INSERT_FTS,
+    STMT_ADD_TAG,
+    STMT_TAG_ENTRY,
+    STMT_COUNT,
+};
+
+static const char* const statements_sql[STMT_COUNT] = {
+    [STMT_INSERT] = DB_INSERT_SQL,
+    [STMT_INSERT_FTS] = DB_FTS_INSERT_SQL,
+    [STMT_ADD_TAG] = TOSTRING(
+        INSERT OR IGNORE INTO tags ( name ) VALUES ( @tag_name )
+    ),
+    [STMT_TAG_ENTRY] = TOSTRING(
+        INSERT OR IGNORE INTO history_tags ( tag_id, entry_id ) VALUES (
+            ( SELECT id FROM tags WHERE name = @tag_name ), @entry_id
+        )
+    ),
+};
+
+struct pending_notify {
+    enum proto_change_type type;
+    int64_t id;
+};
+
+struct add {
+    struct sqlite3* db;
+    struct sqlite3_stmt* stmts[STMT_COUNT];
+
+    const char* mime_type;
+    const char* tags[ADD_MAX_TAGS];
+    int ntags;
+    size_t preview_len;
+
+    bool in_transaction;
+    /* cclipd is only told about changes after they are committed and visible to it */
+    VEC(struct pending_notify) notify;
+};
+
+/* stdin is read by hand so that we know whether the next entry has arrived yet */
+struct input {
+    VEC(uint8_t) buf;
+    size_t pos; /* start of unparsed data */
+    bool eof;
+};
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip add [-b] [-t MIME] [-T TAG]... [-P PREVIEW_LEN]\n"
+        "\n"
+        "Command line options:\n"
+        "    -t, --mime MIME    MIME type of the entry, default is " ADD_DEFAULT_MIME_TYPE "\n"
+        "    -T, --tag TAG      Tag added entries with TAG, can be supplied multiple times\n"
+        "    -P PREVIEW_LEN     Max length of generated preview in bytes, default is 128\n"
+        "    -b, --bulk         Read multiple entries, each preceded by a line\n"
+        "                       with its size in bytes and optional MIME type\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void add_notify(struct add* a, enum proto_change_type type, int64_t id) {
+    VEC_APPEND(&a->notify, &((struct pending_notify){ .type = type, .id = id }));
+}
+
+static bool step_stmt(struct add* a, int stmt_index) {
+    struct sqlite3_stmt* stmt = a->stmts[stmt_index];
+
+    const int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "failed to tag entry: %s", sqlite3_errmsg(a->db));
+        return false;
+    }
+
+    return true;
+}
+
+/* same steps as cclipd takes for every clipboard entry, see process_queue_entry() */
+static bool add_entry(struct add* a, const void* data, size_t size, const char* mime_type) {
+    char* preview = generate_preview(data, size, mime_type, a->preview_len);
+    bool ret = false;
+
+    const struct db_entry entry = {
+        .data = data,
+        .data_size = size,
+        .data_hash = db_hash_data(data, size),
+        .preview = preview,
+        .mime_type = mime_type,
+        .timestamp = time(NULL),
+    };
+    int64_t id;
+    bool inserted;
+    if (!db_insert_entry(a->db, a->stmts[STMT_INSERT], a->stmts[STMT_INSERT_FTS],
+                         &entry, &id, &inserted)) {
+        goto out;
+    }
+    add_notify(a, inserted ? PROTO_CHANGE_INSERT : PROTO_CHANGE_BUMP, id);
+
+    for (int i = 0; i < a->ntags; i++) {
+        STMT_BIND(a->stmts[STMT_ADD_TAG], text, "@tag_name", a->tags[i], -1, SQLITE_STATIC);
+        STMT_BIND(a->stmts[STMT_TAG_ENTRY], text, "@tag_name", a->tags[i], -1, SQLITE_STATIC);
+        STMT_BIND(a->stmts[STMT_TAG_ENTRY], int64, "@entry_id", id);
+        if (!step_stmt(a, STMT_ADD_TAG) || !step_stmt(a, STMT_TAG_ENTRY)) {
+            goto out;
+        }
+        if (sqlite3_changes(a->db) > 0) {
+            add_notify(a, PROTO_CHANGE_TAG, id);
+        }
+    }
+
+    printf("%li\n", id);
+    ret = true;
+
+out:
+    free(preview);
+    return ret;
+}
+
+static bool begin(struct add* a) {
+    if (!db_begin_write(a->db)) {
+        return false;
+    }
+    a->in_transaction = true;
+    return true;
+}
+
+static bool commit(struct add* a) {
+    a->in_transaction = false;
+    if (sqlite3_exec(a->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to commit: %s", sqlite3_errmsg(a->db));
+        sqlite3_exec(a->db, "ROLLBACK", NULL, NULL, NULL);
+        return false;
+    }
+
+    VEC_FOREACH(&a->notify, i) {
+        const struct pending_notify* n = VEC_AT(&a->notify, i);
+        client_notify(a->db, n->type, n->id);
+    }
+    VEC_CLEAR(&a->notify);
+
+    return true;
+}
+
+/* reads another chunk of stdin, blocks until something arrives */
+static bool input_fill(struct input* in) {
+    if (in->pos > 0) {
+        VEC_ERASE_N(&in->buf, 0, in->pos);
+        in->pos = 0;
+    }
+
+    VEC_RESERVE(&in->buf, VEC_SIZE(&in->buf) + ADD_READ_SIZE);
+    ssize_t n;
+    do {
+        n = read(0, &in->buf.data[in->buf.size], ADD_READ_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        log_print(ERR, "failed to read stdin: %s", strerror(errno));
+        return false;
+    }
+
+    in->buf.size += n;
+    in->eof = (n == 0);
+    return true;
+}
+
+static bool input_ready(void) {
+    struct pollfd pfd = { .fd = 0, .events = POLLIN };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/*
+ * Parses next entry out of buffered input, returns 1 on success,
+ * 0 if more input is needed and -1 if input is malformed.
+ * Returned pointers are valid until next input_fill().
+ */
+static int input_next_entry(struct input* in, const char* default_mime_type,
+                            const uint8_t** data, size_t* size, const char** mime_type) {
+    uint8_t* line = &in->buf.data[in->pos];
+    const size_t avail = VEC_SIZE(&in->buf) - in->pos;
+    uint8_t* newline = memchr(line, '\n', avail);
+    if (newline == NULL) {
+        return 0;
+    }
+    const size_t line_len = newline - line;
+
+    /* header is parsed in place, so copy it out first in case entry is not complete */
+    char header[256];
+    if (line_len >= sizeof(header)) {
+        log_print(ERR, "entry header is too long");
+        return -1;
+    }
+    memcpy(header, line, line_len);
+    header[line_len] = '\0';
+
+    char* mime = strchr(header, ' ');
+    if (mime != NULL) {
+        *mime++ = '\0';
+    }
+
+    int64_t n;
+    if (!str_to_int64(header, &n) || n <= 0) {
+        log_print(ERR, "invalid entry size: %s", header);
+        return -1;
+    }
+
+    if (avail - line_len - 1 < (uint64_t)n) {
+        return 0;
+    }
+
+    /* MIME type is stored in place of the header line, entry data follows it */
+    if (mime != NULL) {
+        const size_t mime_len = strlen(mime);
+        memcpy(line, mime, mime_len + 1);
+        *mime_type = (const char*)line;
+    } else {
+        *mime_type = default_mime_type;
+    }
+    *data = newline + 1;
+    *size = n;
+    in->pos += line_len + 1 + n;
+
+    return 1;
+}
+
+static bool add_single(struct add* a) {
+    struct input in = {0};
+    bool ret = false;
+
+    /* all data is read before taking the write lock */
+    do {
+        if (!input_fill(&in)) {
+            goto out;
+        }
+    } while (!in.eof);
+
+    if (VEC_SIZE(&in.buf) == 0) {
+        log_print(ERR, "no data on stdin");
+        goto out;
+    }
+
+    ret = begin(a) && add_entry(a, in.buf.data, in.buf.size, a->mime_type) && commit(a);
+
+out:
+    VEC_FREE(&in.buf);
+    return ret;
+}
+
+/* each entry is preceded by a line "SIZE [MIME]", entries are not separated otherwise */
+static bool add_bulk(struct add* a) {
+    struct input in = {0};
+    bool ret = false;
+
+    int64_t batch_entries = 0, batch_start = 0;
+    while (true) {
+        const uint8_t* data;
+        size_t size;
+        const char* mime_type;
+        const int n = input_next_entry(&in, a->mime_type, &data, &size, &mime_type);
+        if (n < 0) {
+            goto out;
+        } else if (n > 0) {
+            if (!a->in_transaction) {
+                if (!begin(a)) {
+                    goto out;
+                }
+                batch_entries = 0;
+                batch_start = now_ms();
+            }
+
+            if (!add_entry(a, data, size, mime_type)) {
+                goto out;
+            }
+            batch_entries += 1;
+
+            if ((batch_entries >= ADD_BATCH_ENTRIES || now_ms() - batch_start >= ADD_BATCH_MS)
+                && !commit(a)) {
+                goto out;
+            }
+            continue;
+        }
+
+        if (in.eof) {
+            if (in.pos < VEC_SIZE(&in.buf)) {
+                log_print(ERR, "unexpected end of input");
+                goto out;
+            }
+            break;
+        }
+
+        /* don't keep the lock while waiting for the rest of input */
+        if (a->in_transaction && !input_ready() && !commit(a)) {
+            goto out;
+        }
+        if (!input_fill(&in)) {
+            goto out;
+        }
+    }
+
+    ret = !a->in_transaction || commit(a);
+
+out:
+    VEC_FREE(&in.buf);
+    return ret;
+}
+
+void action_add(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+    struct add a = {
+        .db = db,
+        .mime_type = ADD_DEFAULT_MIME_TYPE,
+        .preview_len = PREVIEW_DEFAULT_LEN,
+    };
+
+    bool bulk = false;
+
+    static const struct option long_options[] = {
+        { "mime", required_argument, NULL, 't' },
+        { "tag", required_argument, NULL, 'T' },
+        { "bulk", no_argument, NULL, 'b' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt_long(argc, argv, ":t:T:P:bh", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            a.mime_type = optarg;
+            break;
+        case 'T':
+            if (a.ntags >= ADD_MAX_TAGS) {
+                log_print(ERR, "too many tags (max %d)", ADD_MAX_TAGS);
+                OUT(1);
+            } else if (!is_tag_valid(optarg)) {
+                log_print(ERR, "invalid tag");
+                OUT(1);
+            }
+            a.tags[a.ntags++] = optarg;
+            break;
+        case 'P': {
+            int64_t len;
+            if (!str_to_int64(optarg, &len) || len < 1) {
+                log_print(ERR, "PREVIEW_LEN must be a positive integer, got %s", optarg);
+                OUT(1);
+            }
+            a.preview_len = len;
+            break;
+        }
+        case 'b':
+            bulk = true;
+            break;
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    if (argc > 0) {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+
+    for (int i = 0; i < STMT_COUNT; i++) {
+        if (!db_prepare_stmt(db, statements_sql[i], &a.stmts[i])) {
+            OUT(1);
+        }
+    }
+
+    if (!(bulk ? add_bulk(&a) : add_single(&a))) {
+        OUT(1);
+    }
+
+out:
+    if (a.in_transaction) {
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    for (int i = 0; i < STMT_COUNT; i++) {
+        sqlite3_finalize(a.stmts[i]);
+    }
+    VEC_FREE(&a.notify);
+    client_disconnect();
+    sqlite3_close(db);
+    exit(retcode);
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "../client.h"
+#include "backup.h"
+#include "proto.h"
+#include "log.h"
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip backup [FILE]\n"
+        "\n"
+        "Command line options:\n"
+        "    FILE  copy database to FILE instead of asking cclipd to make a backup\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+/* cclipd does it in the background and rotates old backups, we just wait for it */
+static int backup_by_daemon(struct sqlite3* db) {
+    const char* db_path = sqlite3_db_filename(db, "main");
+    if (db_path == NULL || db_path[0] == '\0' || !client_connect(db_path)) {
+        log_print(ERR, "cclipd is not running, specify FILE to back up database directly");
+        return 1;
+    }
+
+    struct proto_msg msg = {0};
+    proto_msg_reset(&msg, PROTO_BACKUP);
+    const int ret = client_request(&msg);
+    proto_msg_free(&msg);
+
+    client_disconnect();
+    return ret;
+}
+
+static int backup_to_file(struct sqlite3* db, const char* path) {
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        log_print(ERR, "%s already exists", path);
+        return 1;
+    }
+
+    struct backup* b = backup_start(db, path);
+    if (b == NULL) {
+        return 1;
+    }
+
+    /* copying everything in one step keeps one read transaction, so writers can't restart it */
+    const int rc = backup_step(b, -1);
+    if (rc != SQLITE_DONE) {
+        if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            log_print(ERR, "database is locked");
+        }
+        backup_finish(b, false);
+        return 1;
+    }
+
+    return backup_finish(b, true) ? 0 : 1;
+}
+
+void action_backup(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt(argc, argv, ":h")) != -1) {
+        switch (opt) {
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    if (argc > 1) {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+
+    OUT(argc == 1 ? backup_to_file(db, argv[0]) : backup_by_daemon(db));
+
+out:
+    sqlite3_close(db);
+    exit(retcode);
+}
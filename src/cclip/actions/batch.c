@@ -0,0 +1,477 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdio.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "../utils.h"
+#include "../client.h"
+#include "collections/string.h"
+#include "collections/vec.h"
+#include "query.h"
+#include "db.h"
+#include "macros.h"
+#include "xmalloc.h"
+#include "log.h"
+
+/* different get field lists need different statements, but scripts rarely use many */
+#define BATCH_STMT_CACHE_SIZE 16
+
+struct cached_stmt {
+    char* sql;
+    struct sqlite3_stmt* stmt;
+};
+
+struct pending_notify {
+    enum proto_change_type type;
+    int64_t id;
+};
+
+struct batch {
+    struct sqlite3* db;
+
+    struct cached_stmt cache[BATCH_STMT_CACHE_SIZE];
+    int ncached;
+
+    int64_t commit_every;
+    int64_t uncommitted; /* writes since BEGIN */
+    bool in_transaction;
+    /* cclipd is only told about changes after they are committed and visible to it */
+    VEC(struct pending_notify) notify;
+
+    struct string result;
+    char error[256];
+};
+
+static struct sqlite3_stmt* prepare_cached(struct batch* b, const char* sql) {
+    for (int i = 0; i < b->ncached; i++) {
+        if (STREQ(b->cache[i].sql, sql)) {
+            sqlite3_reset(b->cache[i].stmt);
+            sqlite3_clear_bindings(b->cache[i].stmt);
+            return b->cache[i].stmt;
+        }
+    }
+
+    struct sqlite3_stmt* stmt = NULL;
+    if (!db_prepare_stmt(b->db, sql, &stmt)) {
+        return NULL;
+    }
+
+    /* evict the oldest statement if cache is full */
+    if (b->ncached == BATCH_STMT_CACHE_SIZE) {
+        free(b->cache[0].sql);
+        sqlite3_finalize(b->cache[0].stmt);
+        memmove(&b->cache[0], &b->cache[1], sizeof(b->cache[0]) * (BATCH_STMT_CACHE_SIZE - 1));
+        b->ncached -= 1;
+    }
+    b->cache[b->ncached++] = (struct cached_stmt){
+        .sql = xstrdup(sql),
+        .stmt = stmt,
+    };
+
+    return stmt;
+}
+
+static bool exec_simple(struct batch* b, const char* sql) {
+    struct sqlite3_stmt* stmt = prepare_cached(b, sql);
+    if (stmt == NULL) {
+        return false;
+    }
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_print(ERR, "failed to execute %s: %s", sql, sqlite3_errmsg(b->db));
+        return false;
+    }
+    sqlite3_reset(stmt);
+
+    return true;
+}
+
+static bool commit(struct batch* b) {
+    if (!b->in_transaction) {
+        return true;
+    }
+
+    if (!exec_simple(b, "COMMIT")) {
+        return false;
+    }
+    b->in_transaction = false;
+    b->uncommitted = 0;
+
+    VEC_FOREACH(&b->notify, i) {
+        const struct pending_notify* n = VEC_AT(&b->notify, i);
+        client_notify(b->db, n->type, n->id);
+    }
+    VEC_CLEAR(&b->notify);
+
+    return true;
+}
+
+static bool begin_write(struct batch* b) {
+    if (!b->in_transaction) {
+        if (!db_begin_write(b->db)) {
+            return false;
+        }
+        b->in_transaction = true;
+    }
+
+    return true;
+}
+
+static bool end_write(struct batch* b, enum proto_change_type type, int64_t id) {
+    *VEC_EMPLACE_BACK(&b->notify) = (struct pending_notify){ .type = type, .id = id };
+    b->uncommitted += 1;
+
+    return true;
+}
+
+#define FAIL(...) ({ \
+    snprintf(b->error, sizeof(b->error), __VA_ARGS__); \
+    return false; \
+})
+
+static bool do_delete(struct batch* b, int64_t id, char* args) {
+    if (args[0] != '\0') {
+        FAIL("extra arguments");
+    }
+
+    struct sqlite3_stmt* stmt = prepare_cached(b, "DELETE FROM history WHERE id = @entry_id");
+    if (stmt == NULL) {
+        FAIL("failed to prepare statement");
+    }
+    STMT_BIND(stmt, int64, "@entry_id", id);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        FAIL("sqlite error: %s", sqlite3_errmsg(b->db));
+    }
+    if (sqlite3_changes(b->db) == 0) {
+        FAIL("table was not modified, does id %li exist?", id);
+    }
+
+    return end_write(b, PROTO_CHANGE_DELETE, id);
+}
+
+static bool do_tag(struct batch* b, int64_t id, char* tag) {
+    if (!is_tag_valid(tag)) {
+        FAIL("invalid tag");
+    }
+
+    static const char sql_insert_into_tags[] = TOSTRING(
+        INSERT OR IGNORE INTO tags ( name ) VALUES ( @tag_name );
+    );
+    static const char sql_insert_into_history_tags[] = TOSTRING(
+        INSERT INTO history_tags ( tag_id, entry_id ) VALUES (
+            ( SELECT id FROM tags WHERE name = @tag_name ), @entry_id
+        );
+    );
+
+    struct sqlite3_stmt* stmt = prepare_cached(b, sql_insert_into_tags);
+    if (stmt == NULL) {
+        FAIL("failed to prepare statement");
+    }
+    STMT_BIND(stmt, text, "@tag_name", tag, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        FAIL("failed to add tag into tags table: %s", sqlite3_errmsg(b->db));
+    }
+
+    stmt = prepare_cached(b, sql_insert_into_history_tags);
+    if (stmt == NULL) {
+        FAIL("failed to prepare statement");
+    }
+    STMT_BIND(stmt, text, "@tag_name", tag, -1, SQLITE_STATIC);
+    STMT_BIND(stmt, int64, "@entry_id", id);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        FAIL("failed to add tag to entry: %s (duplicate tag?)", sqlite3_errmsg(b->db));
+    }
+
+    return end_write(b, PROTO_CHANGE_TAG, id);
+}
+
+static bool do_untag(struct batch* b, int64_t id, char* tag) {
+    struct sqlite3_stmt* stmt;
+    if (tag[0] != '\0') {
+        stmt = prepare_cached(b, TOSTRING(
+            DELETE FROM history_tags WHERE entry_id = @entry_id AND tag_id = (
+                SELECT id FROM tags WHERE name = @tag_name
+            );
+        ));
+        if (stmt == NULL) {
+            FAIL("failed to prepare statement");
+        }
+        STMT_BIND(stmt, text, "@tag_name", tag, -1, SQLITE_STATIC);
+    } else {
+        stmt = prepare_cached(b, TOSTRING(
+            DELETE FROM history_tags WHERE entry_id = @entry_id;
+        ));
+        if (stmt == NULL) {
+            FAIL("failed to prepare statement");
+        }
+    }
+    STMT_BIND(stmt, int64, "@entry_id", id);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        FAIL("failed to delete tags from entry: %s", sqlite3_errmsg(b->db));
+    }
+    if (sqlite3_changes(b->db) < 1) {
+        FAIL("table was not modified, either tag or entry do not exist");
+    }
+
+    return end_write(b, PROTO_CHANGE_TAG, id);
+}
+
+static bool do_get(struct batch* b, int64_t id, char* fields) {
+    struct get_query q = { .id = id };
+    if (fields[0] != '\0') {
+        q.nfields = build_field_list(fields, q.fields);
+        if (q.nfields < 1) {
+            FAIL("invalid field list");
+        }
+    }
+
+    struct string sql = {0};
+    if (!get_query_build_sql(&q, &sql)) {
+        string_free(&sql);
+        FAIL("failed to build query");
+    }
+    struct sqlite3_stmt* stmt = prepare_cached(b, sql.str);
+    string_free(&sql);
+    if (stmt == NULL) {
+        FAIL("failed to prepare statement");
+    }
+    get_query_bind(&q, stmt);
+
+    int ret = sqlite3_step(stmt);
+    if (ret == SQLITE_DONE) {
+        FAIL("no entry found with id %li", id);
+    } else if (ret != SQLITE_ROW) {
+        FAIL("sqlite error: %s", sqlite3_errmsg(b->db));
+    }
+
+    const int ncols = sqlite3_column_count(stmt);
+    for (int i = 0; i < ncols; i++) {
+        string_appendn(&b->result, sqlite3_column_blob(stmt, i), sqlite3_column_bytes(stmt, i));
+        if (q.nfields > 0) {
+            string_append(&b->result, (i < ncols - 1) ? "\t" : "\n");
+        }
+    }
+    sqlite3_reset(stmt);
+
+    return true;
+}
+
+#undef FAIL
+
+/* Runs single command, output (if any) is put into b->result, error message into b->error */
+static bool run_command(struct batch* b, char* line) {
+    char* cmd = line + strspn(line, " \t");
+    char* id_str = cmd + strcspn(cmd, " \t");
+    if (*id_str != '\0') {
+        *id_str++ = '\0';
+        id_str += strspn(id_str, " \t");
+    }
+    char* args = id_str + strcspn(id_str, " \t");
+    if (*args != '\0') {
+        *args++ = '\0';
+        args += strspn(args, " \t");
+    }
+
+    int64_t id;
+    if (!str_to_int64(id_str, &id)) {
+        snprintf(b->error, sizeof(b->error), "invalid id: %s", id_str);
+        return false;
+    }
+
+    if (STREQ(cmd, "get")) {
+        return do_get(b, id, args);
+    }
+
+    bool (*write_func)(struct batch* b, int64_t id, char* args);
+    if (STREQ(cmd, "delete")) {
+        write_func = do_delete;
+    } else if (STREQ(cmd, "tag")) {
+        write_func = do_tag;
+    } else if (STREQ(cmd, "untag")) {
+        write_func = do_untag;
+    } else {
+        snprintf(b->error, sizeof(b->error), "unknown command: %s", cmd);
+        return false;
+    }
+
+    if (!begin_write(b)) {
+        snprintf(b->error, sizeof(b->error), "failed to begin transaction");
+        return false;
+    }
+
+    /* a failed command must not undo earlier commands in the same transaction */
+    if (!exec_simple(b, "SAVEPOINT command")) {
+        snprintf(b->error, sizeof(b->error), "failed to create savepoint");
+        return false;
+    }
+    const bool success = write_func(b, id, args);
+    for (int i = 0; i < b->ncached; i++) {
+        sqlite3_reset(b->cache[i].stmt);
+    }
+    if (!success && !exec_simple(b, "ROLLBACK TO command")) {
+        return false;
+    }
+    if (!exec_simple(b, "RELEASE command")) {
+        return false;
+    }
+
+    if (b->commit_every > 0 && b->uncommitted >= b->commit_every && !commit(b)) {
+        snprintf(b->error, sizeof(b->error), "failed to commit transaction");
+        return false;
+    }
+
+    return success;
+}
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip batch [-0s] [-c N]\n"
+        "\n"
+        "Command line options:\n"
+        "    -0    Commands are separated by NUL instead of newline\n"
+        "    -s    Enable secure delete pragma\n"
+        "    -c N  Commit every N writes (default 1000, 0 to commit once at the end)\n"
+        "\n"
+        "Reads commands from stdin, one per line:\n"
+        "    get ID [FIELDS]\n"
+        "    delete ID\n"
+        "    tag ID TAG\n"
+        "    untag ID [TAG]\n"
+        "For every command, prints \"ok LENGTH\" or \"error LENGTH\" line to stdout,\n"
+        "followed by LENGTH bytes of output or error message and a newline.\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+void action_batch(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+    char* line = NULL;
+    size_t line_size = 0;
+
+    struct batch b = {
+        .db = db,
+        .commit_every = 1000,
+    };
+    VEC_INIT(&b.notify);
+
+    char delim = '\n';
+    bool secure_delete = false;
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt(argc, argv, ":0sc:h")) != -1) {
+        switch (opt) {
+        case '0':
+            delim = '\0';
+            break;
+        case 's':
+            secure_delete = true;
+            break;
+        case 'c':
+            if (!str_to_int64(optarg, &b.commit_every) || b.commit_every < 0) {
+                log_print(ERR, "N must be a non-negative integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    if (argc > 0) {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+
+    if (secure_delete && !db_set_secure_delete(db, true)) {
+        OUT(1);
+    }
+
+    ssize_t len;
+    while ((len = getdelim(&line, &line_size, delim, stdin)) > 0) {
+        if (line[len - 1] == delim) {
+            line[--len] = '\0';
+        }
+        if (line[strspn(line, " \t")] == '\0') {
+            continue;
+        }
+
+        string_clear(&b.result);
+        b.error[0] = '\0';
+        const bool success = run_command(&b, line);
+        if (!success) {
+            retcode = 1;
+        }
+
+        const char* out = success ? (b.result.str != NULL ? b.result.str : "") : b.error;
+        const size_t out_len = success ? b.result.len : strlen(b.error);
+        fprintf(stdout, "%s %zu\n", success ? "ok" : "error", out_len);
+        fwrite(out, 1, out_len, stdout);
+        fputc('\n', stdout);
+        if (ferror(stdout)) {
+            log_print(ERR, "failed to write output");
+            OUT(1);
+        }
+    }
+    if (ferror(stdin)) {
+        log_print(ERR, "failed to read commands from stdin");
+        OUT(1);
+    }
+
+    if (!commit(&b)) {
+        OUT(1);
+    }
+
+out:
+    if (b.in_transaction) {
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    for (int i = 0; i < b.ncached; i++) {
+        free(b.cache[i].sql);
+        sqlite3_finalize(b.cache[i].stmt);
+    }
+    VEC_FREE(&b.notify);
+    string_free(&b.result);
+    free(line);
+    fflush(stdout);
+    sqlite3_close(db);
+    client_disconnect();
+    exit(retcode);
+}
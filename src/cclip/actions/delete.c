@@ -24,6 +24,7 @@
 
 #include "actions.h"
 #include "../utils.h"
+#include "../client.h"
 #include "db.h"
 #include "log.h"
 
@@ -101,6 +102,7 @@ void action_delete(int argc, char** argv, struct sqlite3* db) {
             log_print(ERR, "table was not modified, does id %li exist?", entry_id);
             OUT(1);
         }
+        client_notify(db, PROTO_CHANGE_DELETE, entry_id);
     } else {
         log_print(ERR, "sqlite error: %s", sqlite3_errmsg(db));
         OUT(1);
@@ -109,6 +111,7 @@ void action_delete(int argc, char** argv, struct sqlite3* db) {
 out:
     sqlite3_finalize(stmt);
     sqlite3_close(db);
+    client_disconnect();
     exit(retcode);
 }
 
@@ -0,0 +1,165 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "../archive.h"
+#include "db.h"
+#include "macros.h"
+#include "log.h"
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip export [-z] [FILE]\n"
+        "\n"
+        "Command line options:\n"
+        "    -z    compress archive with zstd\n"
+        "    FILE  file to write archive to, stdout if omitted or -\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+void action_export(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+    struct sqlite3_stmt* stmt = NULL;
+    struct archive_writer* w = NULL;
+    int fd = -1;
+
+    bool compress = false;
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt(argc, argv, ":zh")) != -1) {
+        switch (opt) {
+        case 'z':
+            if (!archive_zstd_supported()) {
+                log_print(ERR, "cclip was built without zstd support");
+                OUT(1);
+            }
+            compress = true;
+            break;
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    if (argc > 1) {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+
+    if (argc == 0 || STREQ(argv[0], "-")) {
+        if (isatty(1)) {
+            log_print(ERR, "refusing to write archive to a terminal");
+            OUT(1);
+        }
+        fd = 1;
+    } else {
+        fd = open(argv[0], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            log_print(ERR, "failed to open %s: %s", argv[0], strerror(errno));
+            OUT(1);
+        }
+    }
+
+    w = archive_writer_open(fd, compress);
+    if (w == NULL) {
+        OUT(1);
+    }
+
+    /* tags can't contain newlines, see is_tag_valid() */
+    const char* sql = TOSTRING(
+        SELECT data_hash, timestamp, mime_type, preview, data, (
+            SELECT group_concat(tags.name, char(10))
+            FROM history_tags JOIN tags ON tags.id = history_tags.tag_id
+            WHERE history_tags.entry_id = history.id
+        )
+        FROM history
+        ORDER BY timestamp, id
+    );
+    if (!db_prepare_stmt(db, sql, &stmt)) {
+        OUT(1);
+    }
+
+    /* whole export must see the same state of the db */
+    if (sqlite3_exec(db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to begin transaction: %s", sqlite3_errmsg(db));
+        OUT(1);
+    }
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* tags = (const char*)sqlite3_column_text(stmt, 5);
+        const struct archive_entry e = {
+            .data_hash = sqlite3_column_int64(stmt, 0),
+            .timestamp = sqlite3_column_int64(stmt, 1),
+            .mime_type = (const char*)sqlite3_column_text(stmt, 2),
+            .preview = (const char*)sqlite3_column_text(stmt, 3),
+            .tags = tags != NULL ? tags : "",
+            .data = sqlite3_column_blob(stmt, 4),
+            .data_size = sqlite3_column_bytes(stmt, 4),
+        };
+        if (!archive_write_entry(w, &e)) {
+            OUT(1);
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "failed to read entries: %s", sqlite3_errmsg(db));
+        OUT(1);
+    }
+
+    const bool ok = archive_writer_close(w);
+    w = NULL;
+    if (!ok) {
+        OUT(1);
+    }
+
+out:
+    if (w != NULL) {
+        archive_writer_abort(w);
+    }
+    if (fd > 1) {
+        close(fd);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    exit(retcode);
+}
@@ -24,8 +24,11 @@
 
 #include "actions.h"
 #include "../utils.h"
+#include "../client.h"
 #include "collections/string.h"
+#include "query.h"
 #include "db.h"
+#include "io.h"
 #include "xmalloc.h"
 #include "log.h"
 
@@ -45,6 +48,7 @@ static void print_help(void) {
 void action_get(int argc, char** argv, struct sqlite3* db) {
     int retcode = 0;
     struct sqlite3_stmt* stmt = NULL;
+    struct string sql = {0};
 
     RESET_GETOPT();
     int opt;
@@ -83,124 +87,62 @@ void action_get(int argc, char** argv, struct sqlite3* db) {
         OUT(1);
     }
 
-    int64_t entry_id;
-    if (!get_id(id_str, &entry_id)) {
+    struct get_query q = {0};
+    if (!get_id(id_str, &q.id)) {
         OUT(1);
     }
 
-    if (fields_str == NULL) {
-        const char* sql = "SELECT data FROM history WHERE id = @entry_id";
-
-        if (!db_prepare_stmt(db, sql, &stmt)) {
+    if (fields_str != NULL) {
+        q.nfields = build_field_list(fields_str, q.fields);
+        if (q.nfields < 1) {
             OUT(1);
         }
+    }
+
+    if (db == NULL) {
+        struct proto_msg msg = {0};
+        proto_msg_reset(&msg, PROTO_GET);
+        get_query_encode(&q, &msg);
+        OUT(client_request(&msg));
+    }
+
+    if (!get_query_build_sql(&q, &sql)) {
+        OUT(1);
+    }
+
+    if (!db_prepare_stmt(db, sql.str, &stmt)) {
+        OUT(1);
+    }
 
-        STMT_BIND(stmt, int64, "@entry_id", entry_id);
+    get_query_bind(&q, stmt);
 
-        int ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW) {
+    int ret = sqlite3_step(stmt);
+    if (ret == SQLITE_ROW) {
+        if (q.nfields == 0) {
             struct iovec iov = {
                 .iov_base = (void*)sqlite3_column_blob(stmt, 0),
                 .iov_len = sqlite3_column_bytes(stmt, 0),
             };
             writev_full(1, &iov, 1);
-        } else if (ret == SQLITE_DONE) {
-            log_print(ERR, "no entry found with id %li", entry_id);
-            OUT(1);
         } else {
-            log_print(ERR, "sqlite error: %s", sqlite3_errmsg(db));
-            OUT(1);
-        }
-    } else {
-        enum select_fields fields[SELECT_FIELDS_COUNT];
-        int nfields = build_field_list(fields_str, fields);
-        if (nfields < 1) {
-            OUT(1);
-        }
-
-        struct string sql = {0};
-        string_reserve(&sql, 512);
-
-        string_append(&sql, "SELECT ");
-
-        bool has_field_tags = false;
-        for (int i = 0; i < nfields; i++) {
-            switch (fields[i]) {
-            case FIELD_ID:
-                string_append(&sql, " h.id,");
-                break;
-            case FIELD_PREVIEW:
-                string_append(&sql, " h.preview,");
-                break;
-            case FIELD_MIME_TYPE:
-                string_append(&sql, " h.mime_type,");
-                break;
-            case FIELD_DATA_SIZE:
-                string_append(&sql, " h.data_size,");
-                break;
-            case FIELD_TIMESTAMP:
-                string_append(&sql, " h.timestamp,");
-                break;
-            case FIELD_TAGS:
-                has_field_tags = true;
-                string_append(&sql, " GROUP_CONCAT(t.name, ',') AS tags,");
-                break;
-            default:
-                log_print(ERR, "invalid field enum value: %d (BUG)", fields[i]);
-                OUT(1);
-            }
-        }
-        sql.str[sql.len - 1] = ' ';
-
-        string_append(&sql, " FROM history AS h ");
-
-        if (has_field_tags) {
-            string_append(&sql, " LEFT JOIN history_tags AS ht ON h.id = ht.entry_id ");
-            string_append(&sql, " LEFT JOIN tags AS t ON ht.tag_id = t.id ");
-        }
-
-        string_append(&sql, " WHERE h.id = @entry_id ");
-
-        if (has_field_tags) {
-            string_append(&sql, " GROUP BY h.id ");
-        }
-
-        int ret;
-
-        if (!db_prepare_stmt(db, sql.str, &stmt)) {
-            OUT(1);
-        }
-
-        STMT_BIND(stmt, int64, "@entry_id", entry_id);
-
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW) {
             const int ncols = sqlite3_column_count(stmt);
             struct iovec* iov = xmalloc(sizeof(*iov) * (ncols * 2));
-            for (int i = 0; i < ncols; i++) {
-                iov[i * 2] = (struct iovec){
-                    .iov_base = (void*)sqlite3_column_blob(stmt, i),
-                    .iov_len = sqlite3_column_bytes(stmt, i),
-                };
-                iov[(i * 2) + 1] = (struct iovec){
-                    .iov_base = (i < ncols - 1) ? "\t" : "\n",
-                    .iov_len = 1,
-                };
-            }
-
+            query_row_to_iov(stmt, ncols, iov);
             writev_full(1, iov, ncols * 2);
-        } else if (ret == SQLITE_DONE) {
-            log_print(ERR, "no entry found with id %li", entry_id);
-            OUT(1);
-        } else {
-            log_print(ERR, "sqlite error: %s", sqlite3_errmsg(db));
-            OUT(1);
         }
+    } else if (ret == SQLITE_DONE) {
+        log_print(ERR, "no entry found with id %li", q.id);
+        OUT(1);
+    } else {
+        log_print(ERR, "sqlite error: %s", sqlite3_errmsg(db));
+        OUT(1);
     }
 
 out:
+    string_free(&sql);
     sqlite3_finalize(stmt);
     sqlite3_close(db);
+    client_disconnect();
     exit(retcode);
 }
 
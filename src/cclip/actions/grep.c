@@ -0,0 +1,575 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* memmem */
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <regex.h>
+#include <stdio.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "../utils.h"
+#include "collections/string.h"
+#include "query.h"
+#include "db.h"
+#include "io.h"
+#include "macros.h"
+#include "xmalloc.h"
+#include "log.h"
+
+/*
+ * Entries are split into chunks of consecutive ids in output (timestamp) order.
+ * Worker threads take chunks in increasing order, each with its own read-only
+ * connection, and main thread prints chunks as soon as they are finished.
+ */
+#define GREP_CHUNK_SIZE 256
+#define GREP_MAX_THREADS 64
+
+struct matcher {
+    bool use_regex;
+    regex_t regex;
+    /* data can only match if it contains this string, NULL if unknown */
+    char* literal;
+    size_t literal_len;
+};
+
+struct grep_state {
+    const char* db_path;
+    struct matcher matcher;
+
+    int64_t* ids;
+    size_t nids;
+    bool* matched; /* one per id */
+
+    size_t nchunks;
+    bool* chunk_done; /* protected by lock */
+    atomic_size_t next_chunk;
+    atomic_bool stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool failed; /* protected by lock */
+};
+
+/*
+ * Finds the longest run of plain characters in extended regex pattern that must be
+ * present in every match. Gives up on alternation since then nothing is required.
+ * This errs on the side of returning shorter (or no) literal.
+ */
+static char* required_literal(const char* pattern, size_t* len) {
+    if (strchr(pattern, '|') != NULL) {
+        return NULL;
+    }
+
+    const size_t pattern_len = strlen(pattern);
+    char* best = NULL;
+    size_t best_len = 0;
+    char* run = xmalloc(pattern_len + 1);
+    size_t run_len = 0;
+    int depth = 0;
+
+    #define END_RUN() ({ \
+        if (run_len > best_len) { \
+            free(best); \
+            best = xmalloc(run_len + 1); \
+            memcpy(best, run, run_len); \
+            best_len = run_len; \
+        } \
+        run_len = 0; \
+    })
+
+    for (size_t i = 0; i < pattern_len; i++) {
+        const char c = pattern[i];
+        switch (c) {
+        case '*':
+        case '?':
+        case '{':
+            /* preceding character is optional */
+            if (run_len > 0) {
+                run_len -= 1;
+            }
+            END_RUN();
+            if (c == '{') {
+                while (i < pattern_len && pattern[i] != '}') {
+                    i += 1;
+                }
+            }
+            break;
+        case '+':
+            END_RUN();
+            break;
+        case '[':
+            END_RUN();
+            i += 1;
+            if (i < pattern_len && pattern[i] == '^') {
+                i += 1;
+            }
+            if (i < pattern_len && pattern[i] == ']') {
+                i += 1;
+            }
+            while (i < pattern_len && pattern[i] != ']') {
+                /* [:class:], [=equiv=] and [.coll.] can contain ']', skip them whole */
+                if (pattern[i] == '[' && i + 1 < pattern_len && strchr(":=.", pattern[i + 1]) != NULL) {
+                    const char delim = pattern[i + 1];
+                    i += 2;
+                    while (i + 1 < pattern_len && !(pattern[i] == delim && pattern[i + 1] == ']')) {
+                        i += 1;
+                    }
+                    i += 2;
+                } else {
+                    i += 1;
+                }
+            }
+            break;
+        case '(':
+            END_RUN();
+            depth += 1;
+            break;
+        case ')':
+            END_RUN();
+            depth -= 1;
+            break;
+        case '.':
+        case '^':
+        case '$':
+            END_RUN();
+            break;
+        case '\\':
+            i += 1;
+            if (i < pattern_len && strchr(".[]()*+?{}^$\\", pattern[i]) != NULL && depth == 0) {
+                /* escaped special characters are literal, but can still be made optional */
+                const char next = (i + 1 < pattern_len) ? pattern[i + 1] : '\0';
+                if (next == '*' || next == '?' || next == '{') {
+                    END_RUN();
+                } else {
+                    run[run_len++] = pattern[i];
+                }
+            } else {
+                /* GNU extensions like \w, \b */
+                END_RUN();
+            }
+            break;
+        default:
+            if (depth == 0) {
+                run[run_len++] = c;
+            }
+            break;
+        }
+    }
+    END_RUN();
+
+    #undef END_RUN
+
+    free(run);
+    *len = best_len;
+    return best;
+}
+
+/* Escapes pattern so it can be matched literally as extended regex */
+static char* escape_pattern(const char* pattern) {
+    struct string s = {0};
+    for (const char* p = pattern; *p != '\0'; p++) {
+        if (strchr(".[]()*+?{}|^$\\", *p) != NULL) {
+            string_append(&s, "\\");
+        }
+        string_appendn(&s, p, 1);
+    }
+    char* res = xstrdup(s.str != NULL ? s.str : "");
+    string_free(&s);
+    return res;
+}
+
+static bool matcher_init(struct matcher* m, const char* pattern, bool fixed, bool icase) {
+    *m = (struct matcher){0};
+
+    /* memmem does case sensitive comparison, which is only useful when not ignoring case */
+    if (fixed && !icase) {
+        m->use_regex = false;
+        m->literal = xstrdup(pattern);
+        m->literal_len = strlen(pattern);
+        return true;
+    }
+
+    char* escaped = NULL;
+    if (fixed) {
+        escaped = escape_pattern(pattern);
+        pattern = escaped;
+    } else if (!icase) {
+        m->literal = required_literal(pattern, &m->literal_len);
+    }
+
+    const int flags = REG_EXTENDED | REG_NOSUB | (icase ? REG_ICASE : 0);
+    int ret = regcomp(&m->regex, pattern, flags);
+    free(escaped);
+    if (ret != 0) {
+        char err[256];
+        regerror(ret, &m->regex, err, sizeof(err));
+        log_print(ERR, "invalid pattern: %s", err);
+        free(m->literal);
+        m->literal = NULL;
+        return false;
+    }
+    m->use_regex = true;
+
+    log_print(DEBUG, "prefilter literal: %.*s",
+              (int)m->literal_len, m->literal != NULL ? m->literal : "");
+    return true;
+}
+
+static void matcher_free(struct matcher* m) {
+    if (m->use_regex) {
+        regfree(&m->regex);
+    }
+    free(m->literal);
+}
+
+/* data must be followed by NUL byte which is not counted in size */
+static bool matcher_match(const struct matcher* m, const char* data, size_t size) {
+    if (m->literal_len > 0 && memmem(data, size, m->literal, m->literal_len) == NULL) {
+        return false;
+    }
+    if (!m->use_regex) {
+        return true;
+    }
+
+#ifdef REG_STARTEND
+    /* glibc extension that allows matching data that contains NUL */
+    regmatch_t match = { .rm_so = 0, .rm_eo = size };
+    return regexec(&m->regex, data, 1, &match, REG_STARTEND) == 0;
+#else
+    /* without it, match is done up to the first NUL */
+    return regexec(&m->regex, data, 0, NULL, 0) == 0;
+#endif
+}
+
+static void mark_chunk_done(struct grep_state* s, size_t chunk) {
+    pthread_mutex_lock(&s->lock);
+    s->chunk_done[chunk] = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * Reads data of entry id into *buf, which is grown as needed and reused between
+ * entries. Returns SQLITE_OK, SQLITE_NOTFOUND if entry no longer exists or error code.
+ * Blob handle is moved from row to row, which is cheaper than stepping a statement
+ * and, unlike sqlite3_column_blob(), never copies overflow pages into a temporary buffer.
+ */
+static int read_entry(struct sqlite3* db, struct sqlite3_blob** blob, int64_t id,
+                      char** buf, size_t* buf_size, size_t* size) {
+    int ret;
+    if (*blob == NULL) {
+        ret = sqlite3_blob_open(db, "main", "history", "data", id, 0, blob);
+    } else {
+        ret = sqlite3_blob_reopen(*blob, id);
+    }
+    if (ret != SQLITE_OK) {
+        /* handle is unusable after failure, and SQLITE_ERROR here means there is no such row */
+        sqlite3_blob_close(*blob);
+        *blob = NULL;
+        return (ret == SQLITE_ERROR) ? SQLITE_NOTFOUND : ret;
+    }
+
+    *size = sqlite3_blob_bytes(*blob);
+    if (*buf_size < *size + 1) {
+        *buf_size = *size + 1;
+        *buf = xrealloc(*buf, *buf_size);
+    }
+    ret = sqlite3_blob_read(*blob, *buf, *size, 0);
+    (*buf)[*size] = '\0';
+
+    return ret;
+}
+
+static void* worker(void* data) {
+    struct grep_state* s = data;
+    struct sqlite3* db = NULL;
+    struct sqlite3_blob* blob = NULL;
+    char* buf = NULL;
+    size_t buf_size = 0;
+    bool failed = false;
+
+    db = db_open_readonly(s->db_path);
+    if (db == NULL) {
+        failed = true;
+        goto out;
+    }
+
+    size_t chunk;
+    while (!atomic_load(&s->stop) && (chunk = atomic_fetch_add(&s->next_chunk, 1)) < s->nchunks) {
+        const size_t start = chunk * GREP_CHUNK_SIZE;
+        const size_t end = MIN(start + GREP_CHUNK_SIZE, s->nids);
+
+        for (size_t i = start; i < end && !atomic_load(&s->stop); i++) {
+            size_t size;
+            int ret = read_entry(db, &blob, s->ids[i], &buf, &buf_size, &size);
+            if (ret == SQLITE_OK) {
+                s->matched[i] = matcher_match(&s->matcher, buf, size);
+            } else if (ret != SQLITE_NOTFOUND) {
+                /* SQLITE_NOTFOUND means entry was deleted after we listed ids, just skip it */
+                log_print(ERR, "failed to read entry %li: %s", s->ids[i], sqlite3_errstr(ret));
+                failed = true;
+                goto out;
+            }
+        }
+
+        mark_chunk_done(s, chunk);
+    }
+
+out:
+    if (failed) {
+        pthread_mutex_lock(&s->lock);
+        s->failed = true;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+    free(buf);
+    sqlite3_blob_close(blob);
+    sqlite3_close(db);
+    return NULL;
+}
+
+static bool list_ids(struct sqlite3* db, const char* mime_type, struct grep_state* s) {
+    struct sqlite3_stmt* stmt = NULL;
+    bool success = false;
+
+    const char* sql = (mime_type != NULL)
+        ? "SELECT id FROM history WHERE mime_type GLOB @mime_type ORDER BY timestamp DESC, id DESC"
+        : "SELECT id FROM history ORDER BY timestamp DESC, id DESC";
+    if (!db_prepare_stmt(db, sql, &stmt)) {
+        goto out;
+    }
+    if (mime_type != NULL) {
+        STMT_BIND(stmt, text, "@mime_type", mime_type, -1, SQLITE_STATIC);
+    }
+
+    size_t cap = 0;
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (s->nids >= cap) {
+            cap = (cap == 0) ? 1024 : cap * 2;
+            s->ids = xrealloc(s->ids, cap * sizeof(s->ids[0]));
+        }
+        s->ids[s->nids++] = sqlite3_column_int64(stmt, 0);
+    }
+    if (ret != SQLITE_DONE) {
+        log_print(ERR, "failed to list entries: %s", sqlite3_errmsg(db));
+        goto out;
+    }
+
+    success = true;
+
+out:
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip grep [-Fi] [-m PATTERN] [-l N] [-j N] PATTERN [FIELDS]\n"
+        "\n"
+        "Command line options:\n"
+        "    -F          Treat PATTERN as a fixed string instead of extended regex\n"
+        "    -i          Ignore case\n"
+        "    -m PATTERN  Only search entries with MIME type matching glob PATTERN\n"
+        "    -l N        Print at most N entries\n"
+        "    -j N        Use N threads (default: number of CPUs)\n"
+        "    PATTERN     Pattern to search for in entry data\n"
+        "    FIELDS      Comma-separated list of fields to print\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+void action_grep(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+    struct sqlite3_stmt* stmt = NULL;
+    struct string sql = {0};
+    pthread_t threads[GREP_MAX_THREADS];
+    int nthreads = 0;
+    bool matcher_ready = false;
+
+    struct grep_state s = {
+        .db_path = sqlite3_db_filename(db, "main"),
+    };
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+
+    bool fixed = false;
+    bool icase = false;
+    const char* mime_type = NULL;
+    int64_t limit = -1;
+    int64_t jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt(argc, argv, ":Fim:l:j:h")) != -1) {
+        switch (opt) {
+        case 'F':
+            fixed = true;
+            break;
+        case 'i':
+            icase = true;
+            break;
+        case 'm':
+            mime_type = optarg;
+            break;
+        case 'l':
+            if (!str_to_int64(optarg, &limit) || limit < 0) {
+                log_print(ERR, "limit must be a non-negative integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'j':
+            if (!str_to_int64(optarg, &jobs) || jobs < 1) {
+                log_print(ERR, "number of threads must be a positive integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    struct get_query q = {0};
+    char default_fields[] = "rowid,mime_type,preview";
+    if (argc < 1) {
+        log_print(ERR, "not enough arguments");
+        OUT(1);
+    } else if (argc == 1) {
+        q.nfields = build_field_list(default_fields, q.fields);
+    } else if (argc == 2) {
+        q.nfields = build_field_list(argv[1], q.fields);
+    } else {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+    if (q.nfields < 1) {
+        OUT(1);
+    }
+
+    if (!matcher_init(&s.matcher, argv[0], fixed, icase)) {
+        OUT(1);
+    }
+    matcher_ready = true;
+
+    if (!get_query_build_sql(&q, &sql) || !db_prepare_stmt(db, sql.str, &stmt)) {
+        OUT(1);
+    }
+
+    if (!list_ids(db, mime_type, &s)) {
+        OUT(1);
+    }
+    if (s.nids == 0 || limit == 0) {
+        OUT(0);
+    }
+
+    s.matched = xcalloc(s.nids, sizeof(s.matched[0]));
+    s.nchunks = (s.nids + GREP_CHUNK_SIZE - 1) / GREP_CHUNK_SIZE;
+    s.chunk_done = xcalloc(s.nchunks, sizeof(s.chunk_done[0]));
+
+    jobs = MIN(jobs, MIN(GREP_MAX_THREADS, (int64_t)s.nchunks));
+    log_print(DEBUG, "searching %zu entries in %zu chunks with %li threads", s.nids, s.nchunks, jobs);
+    for (; nthreads < jobs; nthreads++) {
+        int ret = pthread_create(&threads[nthreads], NULL, worker, &s);
+        if (ret != 0) {
+            log_print(ERR, "failed to create thread: %s", strerror(ret));
+            atomic_store(&s.stop, true);
+            OUT(1);
+        }
+    }
+
+    const int ncols = sqlite3_column_count(stmt);
+    struct iovec* iov = xmalloc(sizeof(*iov) * (ncols * 2));
+    int64_t printed = 0;
+    for (size_t chunk = 0; chunk < s.nchunks; chunk++) {
+        pthread_mutex_lock(&s.lock);
+        while (!s.chunk_done[chunk] && !s.failed) {
+            pthread_cond_wait(&s.cond, &s.lock);
+        }
+        const bool failed = s.failed;
+        pthread_mutex_unlock(&s.lock);
+        if (failed) {
+            free(iov);
+            OUT(1);
+        }
+
+        const size_t start = chunk * GREP_CHUNK_SIZE;
+        const size_t end = MIN(start + GREP_CHUNK_SIZE, s.nids);
+        for (size_t i = start; i < end; i++) {
+            if (!s.matched[i]) {
+                continue;
+            }
+
+            q.id = s.ids[i];
+            get_query_bind(&q, stmt);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                query_row_to_iov(stmt, ncols, iov);
+                if (!writev_full(1, iov, ncols * 2)) {
+                    free(iov);
+                    OUT(1);
+                }
+                printed += 1;
+            }
+            sqlite3_reset(stmt);
+
+            if (limit >= 0 && printed >= limit) {
+                free(iov);
+                OUT(0);
+            }
+        }
+    }
+    free(iov);
+
+out:
+    atomic_store(&s.stop, true);
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (matcher_ready) {
+        matcher_free(&s.matcher);
+    }
+    free(s.ids);
+    free(s.matched);
+    free(s.chunk_done);
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.lock);
+    string_free(&sql);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    exit(retcode);
+}
@@ -0,0 +1,466 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "../archive.h"
+#include "../cliphist.h"
+#include "../client.h"
+#include "../utils.h"
+#include "collections/vec.h"
+#include "preview.h"
+#include "db.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "log.h"
+
+/*
+ * Entries are inserted in big transactions, each one is committed after this many
+ * entries, bytes of payload or milliseconds, whichever comes first. Time limit keeps
+ * cclipd from waiting for the lock for too long.
+ */
+#define IMPORT_BATCH_ENTRIES 10000
+#define IMPORT_BATCH_BYTES (64 * 1024 * 1024)
+#define IMPORT_BATCH_MS 1000
+
+enum {
+    STMT_INSERT,
+    STMT_BUMP,
+    STMT_FIND,
+    STMT_REMEMBER_ID,
+    STMT_INDEX_BATCH,
+    STMT_FORGET_IDS,
+    STMT_ADD_TAG,
+    STMT_TAG_ENTRY,
+    STMT_COUNT,
+};
+
+static const char* const statements_sql[STMT_COUNT] = {
+    [STMT_INSERT] = TOSTRING(
+        INSERT INTO history ( data, data_hash, data_size, preview, mime_type, timestamp )
+        VALUES ( @data, @data_hash, @data_size, @preview, @mime_type, @timestamp )
+        ON CONFLICT ( data_hash ) DO NOTHING
+        RETURNING id
+    ),
+    /* when merging histories, the most recent copy of an entry wins */
+    [STMT_BUMP] = TOSTRING(
+        UPDATE history SET timestamp = @timestamp
+        WHERE data_hash = @data_hash AND timestamp < @timestamp
+        RETURNING id
+    ),
+    [STMT_FIND] = TOSTRING(
+        SELECT id FROM history WHERE data_hash = @data_hash
+    ),
+    /* new entries are added to search index all at once when batch is committed */
+    [STMT_REMEMBER_ID] = TOSTRING(
+        INSERT INTO temp.import_ids ( id ) VALUES ( @id )
+    ),
+    [STMT_INDEX_BATCH] = DB_FTS_INSERT_MANY_SQL("SELECT id FROM temp.import_ids"),
+    [STMT_FORGET_IDS] = TOSTRING(
+        DELETE FROM temp.import_ids
+    ),
+    [STMT_ADD_TAG] = TOSTRING(
+        INSERT OR IGNORE INTO tags ( name ) VALUES ( @tag_name )
+    ),
+    [STMT_TAG_ENTRY] = TOSTRING(
+        INSERT OR IGNORE INTO history_tags ( tag_id, entry_id ) VALUES (
+            ( SELECT id FROM tags WHERE name = @tag_name ), @entry_id
+        )
+    ),
+};
+
+struct pending_notify {
+    enum proto_change_type type;
+    int64_t id;
+};
+
+struct import {
+    struct sqlite3* db;
+    struct sqlite3_stmt* stmts[STMT_COUNT];
+
+    /* cclipd is only told about changes after they are committed and visible to it */
+    VEC(struct pending_notify) notify;
+
+    int64_t total, inserted, bumped;
+};
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip import [-f FORMAT] [FILE]\n"
+        "\n"
+        "Command line options:\n"
+        "    -f FORMAT  format of FILE, one of:\n"
+        "                 cclip     archive created by cclip export (default),\n"
+        "                           stdin if FILE is omitted or -\n"
+        "                 cliphist  cliphist database, its default location if FILE is omitted\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+/* entries come either from cclip archive or from another clipboard manager's database */
+struct import_source {
+    struct archive_reader* archive;
+    struct cliphist_reader* cliphist;
+};
+
+static int read_entry(struct import_source* src, struct archive_entry* e) {
+    return (src->archive != NULL) ? archive_read_entry(src->archive, e)
+                                  : cliphist_read_entry(src->cliphist, e);
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void add_notify(struct import* im, enum proto_change_type type, int64_t id) {
+    VEC_APPEND(&im->notify, &((struct pending_notify){ .type = type, .id = id }));
+}
+
+/* returns id of the first row or 0 if there is none, -1 on error */
+static int64_t step_id(struct import* im, int stmt_index) {
+    struct sqlite3_stmt* stmt = im->stmts[stmt_index];
+    int64_t id = 0;
+
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        id = sqlite3_column_int64(stmt, 0);
+        rc = sqlite3_step(stmt);
+    }
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "failed to import entry: %s", sqlite3_errmsg(im->db));
+        id = -1;
+    }
+
+    sqlite3_reset(stmt);
+    return id;
+}
+
+static bool import_tags(struct import* im, int64_t id, const char* tags) {
+    char* copy = xstrdup(tags);
+    bool ret = false;
+
+    char* saveptr = NULL;
+    for (char* tag = strtok_r(copy, "\n", &saveptr); tag != NULL;
+         tag = strtok_r(NULL, "\n", &saveptr)) {
+        if (!is_tag_valid(tag)) {
+            log_print(WARN, "skipping invalid tag %s of entry %li", tag, id);
+            continue;
+        }
+
+        STMT_BIND(im->stmts[STMT_ADD_TAG], text, "@tag_name", tag, -1, SQLITE_STATIC);
+        if (step_id(im, STMT_ADD_TAG) < 0) {
+            goto out;
+        }
+
+        STMT_BIND(im->stmts[STMT_TAG_ENTRY], text, "@tag_name", tag, -1, SQLITE_STATIC);
+        STMT_BIND(im->stmts[STMT_TAG_ENTRY], int64, "@entry_id", id);
+        if (step_id(im, STMT_TAG_ENTRY) < 0) {
+            goto out;
+        }
+        if (sqlite3_changes(im->db) > 0) {
+            add_notify(im, PROTO_CHANGE_TAG, id);
+        }
+    }
+
+    ret = true;
+
+out:
+    free(copy);
+    return ret;
+}
+
+static bool import_entry(struct import* im, const struct archive_entry* e) {
+    struct sqlite3_stmt* stmt = im->stmts[STMT_INSERT];
+    STMT_BIND(stmt, blob, "@data", e->data, e->data_size, SQLITE_STATIC);
+    STMT_BIND(stmt, int64, "@data_hash", e->data_hash);
+    STMT_BIND(stmt, int64, "@data_size", e->data_size);
+    STMT_BIND(stmt, text, "@preview", e->preview, -1, SQLITE_STATIC);
+    STMT_BIND(stmt, text, "@mime_type", e->mime_type, -1, SQLITE_STATIC);
+    STMT_BIND(stmt, int64, "@timestamp", e->timestamp);
+
+    int64_t id = step_id(im, STMT_INSERT);
+    if (id < 0) {
+        return false;
+    } else if (id > 0) {
+        STMT_BIND(im->stmts[STMT_REMEMBER_ID], int64, "@id", id);
+        if (step_id(im, STMT_REMEMBER_ID) < 0) {
+            return false;
+        }
+        add_notify(im, PROTO_CHANGE_INSERT, id);
+        im->inserted += 1;
+    } else {
+        /* already in the db */
+        stmt = im->stmts[STMT_BUMP];
+        STMT_BIND(stmt, int64, "@data_hash", e->data_hash);
+        STMT_BIND(stmt, int64, "@timestamp", e->timestamp);
+        if ((id = step_id(im, STMT_BUMP)) < 0) {
+            return false;
+        } else if (id > 0) {
+            add_notify(im, PROTO_CHANGE_BUMP, id);
+            im->bumped += 1;
+        }
+    }
+
+    if (e->tags[0] == '\0') {
+        return true;
+    }
+
+    if (id == 0) {
+        STMT_BIND(im->stmts[STMT_FIND], int64, "@data_hash", e->data_hash);
+        if ((id = step_id(im, STMT_FIND)) <= 0) {
+            return false;
+        }
+    }
+
+    return import_tags(im, id, e->tags);
+}
+
+static bool commit(struct import* im) {
+    if (step_id(im, STMT_INDEX_BATCH) < 0 || step_id(im, STMT_FORGET_IDS) < 0) {
+        return false;
+    }
+
+    if (sqlite3_exec(im->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to commit: %s", sqlite3_errmsg(im->db));
+        return false;
+    }
+
+    VEC_FOREACH(&im->notify, i) {
+        const struct pending_notify* n = VEC_AT(&im->notify, i);
+        client_notify(im->db, n->type, n->id);
+    }
+    VEC_CLEAR(&im->notify);
+
+    return true;
+}
+
+void action_import(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+    struct import im = { .db = db };
+    struct import_source src = {0};
+    bool in_transaction = false;
+    bool synchronous_off = false;
+    int autocheckpoint = -1;
+    int fd = -1;
+
+    bool cliphist = false;
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt(argc, argv, ":f:h")) != -1) {
+        switch (opt) {
+        case 'f':
+            if (STREQ(optarg, "cclip")) {
+                cliphist = false;
+            } else if (STREQ(optarg, "cliphist")) {
+                cliphist = true;
+            } else {
+                log_print(ERR, "unknown format: %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    if (argc > 1) {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+
+    if (cliphist) {
+        const char* path = (argc > 0) ? argv[0] : cliphist_default_path();
+        if (path == NULL) {
+            log_print(ERR, "cliphist database location is unknown, specify it explicitly");
+            OUT(1);
+        }
+
+        src.cliphist = cliphist_reader_open(path, PREVIEW_DEFAULT_LEN);
+        if (src.cliphist == NULL) {
+            OUT(1);
+        }
+    } else {
+        if (argc == 0 || STREQ(argv[0], "-")) {
+            fd = 0;
+        } else {
+            fd = open(argv[0], O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                log_print(ERR, "failed to open %s: %s", argv[0], strerror(errno));
+                OUT(1);
+            }
+        }
+
+        src.archive = archive_reader_open(fd);
+        if (src.archive == NULL) {
+            OUT(1);
+        }
+    }
+
+    /*
+     * Commits are not synced during import, only the final checkpoint is. A crash can
+     * lose imported entries, but they can just be imported again, as can the rest.
+     * Automatic checkpoints would copy unsynced WAL frames into the database file
+     * without syncing them either, so they are off until then and WAL grows instead.
+     */
+    struct sqlite3_stmt* stmt = NULL;
+    if (db_prepare_stmt(db, "PRAGMA wal_autocheckpoint", &stmt)
+        && sqlite3_step(stmt) == SQLITE_ROW) {
+        autocheckpoint = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    if (autocheckpoint < 0 || sqlite3_wal_autocheckpoint(db, 0) != SQLITE_OK) {
+        log_print(WARN, "failed to disable automatic checkpoints, import will be synced");
+        autocheckpoint = -1;
+    } else if (sqlite3_exec(db, "PRAGMA synchronous = OFF", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(WARN, "failed to disable synchronous: %s", sqlite3_errmsg(db));
+    } else {
+        synchronous_off = true;
+    }
+
+    /* every insert fires triggers and needs a statement journal, keep them out of files */
+    if (db_get_profile()->temp_store == 0
+        && sqlite3_exec(db, "PRAGMA temp_store = MEMORY", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(WARN, "failed to set temp_store: %s", sqlite3_errmsg(db));
+    }
+
+    const char* create_sql = TOSTRING(
+        CREATE TEMP TABLE import_ids ( id INTEGER PRIMARY KEY )
+    );
+    if (sqlite3_exec(db, create_sql, NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to create temporary table: %s", sqlite3_errmsg(db));
+        OUT(1);
+    }
+
+    for (int i = 0; i < STMT_COUNT; i++) {
+        if (!db_prepare_stmt(db, statements_sql[i], &im.stmts[i])) {
+            OUT(1);
+        }
+    }
+
+    const bool show_progress = isatty(2);
+    int64_t batch_entries = 0, batch_bytes = 0, batch_start = 0;
+    while (true) {
+        struct archive_entry e;
+        const int ret = read_entry(&src, &e);
+        if (ret < 0) {
+            OUT(1);
+        } else if (ret == 0) {
+            break;
+        }
+
+        if (!in_transaction) {
+            if (!db_begin_write(db)) {
+                OUT(1);
+            }
+            in_transaction = true;
+            batch_entries = batch_bytes = 0;
+            batch_start = now_ms();
+        }
+
+        if (!import_entry(&im, &e)) {
+            OUT(1);
+        }
+        im.total += 1;
+        batch_entries += 1;
+        batch_bytes += e.data_size;
+
+        if (batch_entries >= IMPORT_BATCH_ENTRIES || batch_bytes >= IMPORT_BATCH_BYTES
+            || now_ms() - batch_start >= IMPORT_BATCH_MS) {
+            in_transaction = false;
+            if (!commit(&im)) {
+                OUT(1);
+            }
+            log_print(DEBUG, "committed batch of %li entries", batch_entries);
+            if (show_progress) {
+                fprintf(stderr, "\rimporting: %li entries", im.total);
+            }
+        }
+    }
+
+    if (in_transaction) {
+        in_transaction = false;
+        if (!commit(&im)) {
+            OUT(1);
+        }
+    }
+    if (show_progress) {
+        fprintf(stderr, "\rimported %li entries: %li new, %li updated\n",
+                im.total, im.inserted, im.bumped);
+    }
+
+out:
+    if (in_transaction) {
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    if (autocheckpoint >= 0) {
+        sqlite3_wal_autocheckpoint(db, autocheckpoint);
+    }
+    if (synchronous_off) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA synchronous = %d", db_get_profile()->synchronous);
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+            log_print(WARN, "failed to restore synchronous: %s", sqlite3_errmsg(db));
+        }
+        /* this is what makes the import durable, and also keeps WAL from staying huge */
+        if (sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE)", NULL, NULL, NULL) != SQLITE_OK) {
+            log_print(WARN, "failed to checkpoint database: %s", sqlite3_errmsg(db));
+        }
+    }
+    for (int i = 0; i < STMT_COUNT; i++) {
+        sqlite3_finalize(im.stmts[i]);
+    }
+    VEC_FREE(&im.notify);
+    if (src.archive != NULL) {
+        archive_reader_close(src.archive);
+    }
+    cliphist_reader_close(src.cliphist);
+    if (fd > 0) {
+        close(fd);
+    }
+    client_disconnect();
+    sqlite3_close(db);
+    exit(retcode);
+}
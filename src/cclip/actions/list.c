@@ -18,6 +18,7 @@
 
 #include <sys/uio.h>
 #include <limits.h>
+#include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
@@ -28,21 +29,52 @@
 
 #include "actions.h"
 #include "../utils.h"
+#include "../client.h"
 #include "collections/string.h"
+#include "query.h"
+#include "snapshot.h"
 #include "db.h"
-#include "macros.h"
+#include "io.h"
 #include "xmalloc.h"
 #include "log.h"
 
+static bool add_tags(struct list_query* q, enum tag_match match, char* tags) {
+    for (char* tag = strtok(tags, ","); tag != NULL; tag = strtok(NULL, ",")) {
+        if (q->ntags >= LIST_QUERY_MAX_TAGS) {
+            log_print(ERR, "too many tags (max %d)", LIST_QUERY_MAX_TAGS);
+            return false;
+        }
+        q->tags[q->ntags++] = (struct tag_filter){ .match = match, .name = tag };
+    }
+
+    return true;
+}
+
 static void print_help(void) {
     static const char help[] =
         "Usage:\n"
-        "    cclip list [-t] [-T TAG] [FIELDS]\n"
+        "    cclip list [-t] [-T TAG]... [FILTERS] [-S SEQ] [-l N] [-o N] [-b ID] [-a ID] [FIELDS]\n"
         "\n"
         "Command line options:\n"
-        "    -t      Only list entries with non-empty tag\n"
-        "    -T TAG  Only list entries that have matching TAG (implies -t)\n"
-        "    FIELDS  Comma-separated list of fields to print\n"
+        "    -t                 Only list entries with non-empty tag\n"
+        "    -T TAG             Only list entries that have matching TAG (implies -t),\n"
+        "                       can be supplied multiple times to require all of them\n"
+        "    --any-tag TAGS     Only list entries that have any of comma-separated TAGS\n"
+        "    --not-tag TAGS     Only list entries that have none of comma-separated TAGS\n"
+        "    -m, --mime PATTERN Only list entries with MIME type matching glob PATTERN\n"
+        "    --text-only        Only list entries with text/* MIME type\n"
+        "    -f, --from TIME    Only list entries copied at or after TIME\n"
+        "    -u, --until TIME   Only list entries copied at or before TIME\n"
+        "                       TIME is unix timestamp or duration ago (30s, 15m, 2h, 7d, 1w)\n"
+        "    --min-size SIZE    Only list entries at least SIZE bytes big (K, M, G suffixes)\n"
+        "    --max-size SIZE    Only list entries at most SIZE bytes big\n"
+        "    -S, --since SEQ    Only list changes made after change sequence number SEQ,\n"
+        "                       can not be combined with -t, -T or FILTERS\n"
+        "    -l, --limit N      List at most N entries\n"
+        "    -o, --offset N     Skip first N entries\n"
+        "    -b, --before-id ID Only list entries older than entry ID\n"
+        "    -a, --after-id ID  Only list entries newer than entry ID\n"
+        "    FIELDS             Comma-separated list of fields to print\n"
     ;
 
     fputs(help, stdout);
@@ -50,21 +82,122 @@ static void print_help(void) {
 
 void action_list(int argc, char** argv, struct sqlite3* db) {
     int retcode = 0;
-    struct sqlite3_stmt* stmt = NULL;
 
-    bool print_only_tagged = false;
-    const char* tag = NULL;
+    struct list_query q = {
+        .from = -1,
+        .until = -1,
+        .min_size = -1,
+        .max_size = -1,
+        .since = -1,
+        .limit = -1,
+        .before_id = -1,
+        .after_id = -1,
+    };
+
+    enum {
+        OPT_TEXT_ONLY = 256,
+        OPT_MIN_SIZE,
+        OPT_MAX_SIZE,
+        OPT_ANY_TAG,
+        OPT_NOT_TAG,
+    };
+    static const struct option long_options[] = {
+        { "any-tag", required_argument, NULL, OPT_ANY_TAG },
+        { "not-tag", required_argument, NULL, OPT_NOT_TAG },
+        { "mime", required_argument, NULL, 'm' },
+        { "text-only", no_argument, NULL, OPT_TEXT_ONLY },
+        { "from", required_argument, NULL, 'f' },
+        { "until", required_argument, NULL, 'u' },
+        { "min-size", required_argument, NULL, OPT_MIN_SIZE },
+        { "max-size", required_argument, NULL, OPT_MAX_SIZE },
+        { "since", required_argument, NULL, 'S' },
+        { "limit", required_argument, NULL, 'l' },
+        { "offset", required_argument, NULL, 'o' },
+        { "before-id", required_argument, NULL, 'b' },
+        { "after-id", required_argument, NULL, 'a' },
+        { 0 },
+    };
 
     RESET_GETOPT();
     int opt;
-    while ((opt = getopt(argc, argv, ":T:th")) != -1) {
+    while ((opt = getopt_long(argc, argv, ":T:tm:f:u:S:l:o:b:a:h", long_options, NULL)) != -1) {
         switch (opt) {
+        case 'S':
+            if (!str_to_int64(optarg, &q.since) || q.since < 0) {
+                log_print(ERR, "SEQ must be a non-negative integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'm':
+            q.mime_type = optarg;
+            break;
+        case OPT_TEXT_ONLY:
+            q.text_only = true;
+            break;
+        case 'f':
+            if (!str_to_timestamp(optarg, &q.from)) {
+                OUT(1);
+            }
+            break;
+        case 'u':
+            if (!str_to_timestamp(optarg, &q.until)) {
+                OUT(1);
+            }
+            break;
+        case OPT_MIN_SIZE:
+            if (!str_to_size(optarg, &q.min_size)) {
+                OUT(1);
+            }
+            break;
+        case OPT_MAX_SIZE:
+            if (!str_to_size(optarg, &q.max_size)) {
+                OUT(1);
+            }
+            break;
+        case 'l':
+            if (!str_to_int64(optarg, &q.limit) || q.limit < 0) {
+                log_print(ERR, "limit must be a non-negative integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'o':
+            if (!str_to_int64(optarg, &q.offset) || q.offset < 0) {
+                log_print(ERR, "offset must be a non-negative integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'b':
+            if (!str_to_int64(optarg, &q.before_id) || q.before_id < 0) {
+                log_print(ERR, "ID must be a non-negative integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'a':
+            if (!str_to_int64(optarg, &q.after_id) || q.after_id < 0) {
+                log_print(ERR, "ID must be a non-negative integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
         case 'T':
-            tag = optarg;
-            print_only_tagged = true;
+            if (q.ntags >= LIST_QUERY_MAX_TAGS) {
+                log_print(ERR, "too many tags (max %d)", LIST_QUERY_MAX_TAGS);
+                OUT(1);
+            }
+            q.tags[q.ntags++] = (struct tag_filter){ .match = TAG_MATCH_ALL, .name = optarg };
+            q.only_tagged = true;
+            break;
+        case OPT_ANY_TAG:
+            if (!add_tags(&q, TAG_MATCH_ANY, optarg)) {
+                OUT(1);
+            }
+            break;
+        case OPT_NOT_TAG:
+            if (!add_tags(&q, TAG_MATCH_NONE, optarg)) {
+                OUT(1);
+            }
             break;
         case 't':
-            print_only_tagged = true;
+            q.only_tagged = true;
             break;
         case 'h':
             print_help();
@@ -83,123 +216,62 @@ void action_list(int argc, char** argv, struct sqlite3* db) {
     argc = argc - optind;
     argv = &argv[optind];
 
-    enum select_fields fields[SELECT_FIELDS_COUNT];
-    int nfields = 0;
     if (argc < 1) {
         static char default_fields[] = "rowid,mime_type,preview";
-        nfields = build_field_list(default_fields, fields);
+        q.nfields = build_field_list(default_fields, q.fields);
     } else if (argc == 1) {
-        nfields = build_field_list(argv[0], fields);
+        q.nfields = build_field_list(argv[0], q.fields);
     } else {
         log_print(ERR, "extra arguments on the command line");
         OUT(1);
     }
 
-    if (nfields < 1) {
+    if (q.nfields < 1) {
         OUT(1);
     }
 
-    struct string sql = {0};
-    string_reserve(&sql, 512);
-
-    string_append(&sql, "SELECT DISTINCT");
-
-    bool print_tags = false;
-    for (int i = 0; i < nfields; i++) {
-        switch (fields[i]) {
-        case FIELD_ID:
-            string_append(&sql, " h.id,");
-            break;
-        case FIELD_PREVIEW:
-            string_append(&sql, " h.preview,");
-            break;
-        case FIELD_MIME_TYPE:
-            string_append(&sql, " h.mime_type,");
-            break;
-        case FIELD_DATA_SIZE:
-            string_append(&sql, " h.data_size,");
-            break;
-        case FIELD_TIMESTAMP:
-            string_append(&sql, " h.timestamp,");
-            break;
-        case FIELD_TAGS:
-            print_tags = true;
-            string_append(&sql, " group_concat(t.name, ',') AS tags,");
-            break;
-        default:
-            log_print(ERR, "invalid field enum value: %d (BUG)", fields[i]);
-            OUT(1);
-        }
-    }
-    sql.str[sql.len - 1] = ' ';
-
-    string_append(&sql, " FROM history AS h ");
-
-    if (print_tags || print_only_tagged) {
-        string_append(&sql, print_only_tagged ? " INNER " : " LEFT ");
-        string_append(&sql, " JOIN history_tags AS ht ON h.id = ht.entry_id ");
-
-        string_append(&sql, print_only_tagged ? " INNER " : " LEFT ");
-        string_append(&sql, " JOIN tags AS t ON ht.tag_id = t.id ");
-
-        if (tag != NULL) {
-            /* FIXME: probably very inefficient idk */
-            static const char stupid_filter[] = TOSTRING(
-                WHERE h.id IN (
-                    SELECT ht2.entry_id
-                    FROM history_tags AS ht2
-                    INNER JOIN tags AS t2 ON ht2.tag_id = t2.id
-                    WHERE t2.name = @tag_name
-                )
-            );
-            string_appendn(&sql, stupid_filter, strlen(stupid_filter));
-        }
-
-        if (print_tags) {
-            string_append(&sql, " GROUP BY h.id ");
-        }
+    if (q.since >= 0 && (q.limit >= 0 || q.offset > 0)) {
+        /* client would miss changes and have no way to know it */
+        log_print(ERR, "-S can not be combined with -l or -o");
+        OUT(1);
     }
 
-    string_append(&sql, " ORDER BY h.timestamp DESC");
-
-    int rc;
-
-    if (!db_prepare_stmt(db, sql.str, &stmt)) {
+    const bool filtered = q.only_tagged || q.ntags > 0 || q.mime_type != NULL || q.text_only
+        || q.from >= 0 || q.until >= 0 || q.min_size >= 0 || q.max_size >= 0;
+    if (q.since >= 0 && filtered) {
+        /* entries that stop matching after tag change or bump would never be reported as gone */
+        log_print(ERR, "-S can not be combined with filters");
         OUT(1);
     }
 
-    if (tag != NULL) {
-        STMT_BIND(stmt, text, "@tag_name", tag, -1, SQLITE_STATIC);
+    if (db == NULL) {
+        struct proto_msg msg = {0};
+        proto_msg_reset(&msg, PROTO_LIST);
+        list_query_encode(&q, &msg);
+        OUT(client_request(&msg));
     }
 
-    /* field + tab + field + tab + field + newline */
-    const int ncols = sqlite3_column_count(stmt);
-    struct iovec* iov = xmalloc(sizeof(*iov) * (ncols * 2));
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        for (int i = 0; i < ncols; i++) {
-            iov[i * 2] = (struct iovec){
-                .iov_base = (void *)sqlite3_column_blob(stmt, i),
-                .iov_len = sqlite3_column_bytes(stmt, i),
-            };
-            iov[(i * 2) + 1] = (struct iovec){
-                .iov_base = (i < ncols - 1) ? "\t" : "\n",
-                .iov_len = 1,
-            };
-        }
+    struct query_runner runner;
+    query_runner_init(&runner, db, 1);
 
-        if (!writev_full(1, iov, ncols * 2)) {
-            log_print(ERR, "failed to write row: %s", strerror(errno));
-            OUT(1);
+    /* cclipd might have already done all the work for us */
+    int snapshot_fd;
+    if (list_query_is_default(&q) && (snapshot_fd = snapshot_open(&runner)) >= 0) {
+        const bool ok = snapshot_send(snapshot_fd, 1);
+        close(snapshot_fd);
+        if (!ok) {
+            log_print(ERR, "failed to write output: %s", strerror(errno));
         }
+        OUT(ok ? 0 : 1);
     }
-    if (rc != SQLITE_DONE) {
-        log_print(ERR, "failed to list rows: %s", sqlite3_errmsg(db));
+
+    if (!list_query_run(&q, &runner)) {
+        log_print(ERR, "%s", runner.error);
         OUT(1);
     }
 
 out:
-    sqlite3_finalize(stmt);
     sqlite3_close(db);
+    client_disconnect();
     exit(retcode);
 }
-
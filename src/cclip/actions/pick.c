@@ -0,0 +1,982 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* wcwidth */
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <locale.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "collections/string.h"
+#include "db.h"
+#include "io.h"
+#include "macros.h"
+#include "xmalloc.h"
+#include "log.h"
+
+#define PICK_MAX_QUERY 255
+
+/* scoring, loosely modeled after fzf */
+#define SCORE_MATCH 16
+#define PENALTY_GAP_START 3
+#define PENALTY_GAP_EXTENSION 1
+#define BONUS_BOUNDARY 8
+#define BONUS_CAMEL 7
+#define BONUS_CONSECUTIVE 4
+#define BONUS_FIRST_CHAR_MULTIPLIER 2
+
+struct pick_entry {
+    int64_t id;
+    /*
+     * Bit (c & 63) is set for every case-folded byte c in the text, so most
+     * entries that can not match are rejected with a single AND.
+     */
+    uint64_t mask;
+    size_t text, mime; /* offsets into arena */
+    size_t folded; /* offset of lowercase copy of text into folded arena */
+    uint32_t text_len;
+};
+
+struct pick_match {
+    uint32_t entry;
+    int32_t score;
+};
+
+/*
+ * Every time query grows, new level is created by filtering the previous one,
+ * so entries that did not match shorter query are never looked at again.
+ * Shrinking the query just pops levels.
+ */
+struct pick_level {
+    size_t query_len;
+    struct pick_match* matches; /* in the same order as entries, for cache locality */
+    size_t nmatches;
+    /* matches in display order, but only first nsorted are sorted, see sort_level() */
+    struct pick_match* sorted;
+    size_t nsorted;
+};
+
+struct pick_term {
+    const char* str;
+    size_t len;
+    bool case_sensitive;
+};
+
+struct picker {
+    int tty;
+    struct termios saved_termios;
+    bool termios_saved;
+    int rows, cols;
+
+    struct sqlite3* db;
+    struct sqlite3_stmt* preview_stmt;
+
+    struct string arena;
+    struct string folded_arena;
+    struct pick_entry* entries;
+    size_t nentries;
+
+    char query[PICK_MAX_QUERY + 1];
+    size_t query_len;
+    /* shortest length query had since last update, levels longer than this are stale */
+    size_t query_edit_len;
+
+    struct pick_level levels[PICK_MAX_QUERY + 1];
+    size_t nlevels;
+
+    size_t cursor, scroll;
+
+    int64_t preview_id; /* -1 if preview is not loaded */
+    int preview_width;
+    struct string* preview_lines;
+    int npreview_lines;
+
+    struct string frame;
+};
+
+static volatile sig_atomic_t got_sigwinch = 0;
+static volatile sig_atomic_t got_sigterm = 0;
+
+static void signal_handler(int signum) {
+    if (signum == SIGWINCH) {
+        got_sigwinch = 1;
+    } else {
+        got_sigterm = 1;
+    }
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static inline char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline bool is_alnum(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+static uint64_t text_mask(const char* text, size_t len) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < len; i++) {
+        mask |= 1ULL << (fold(text[i]) & 63);
+    }
+    return mask;
+}
+
+static int32_t boundary_bonus(const char* text, size_t i) {
+    const char c = text[i];
+    if (!is_alnum(c)) {
+        return 0;
+    }
+    if (i == 0) {
+        return BONUS_BOUNDARY;
+    }
+
+    const char prev = text[i - 1];
+    if (!is_alnum(prev)) {
+        return BONUS_BOUNDARY;
+    } else if (prev >= 'a' && prev <= 'z' && c >= 'A' && c <= 'Z') {
+        return BONUS_CAMEL;
+    } else if (!(prev >= '0' && prev <= '9') && c >= '0' && c <= '9') {
+        return BONUS_CAMEL;
+    }
+    return 0;
+}
+
+/*
+ * Returns score or -1 if term is not a subsequence of text. Like fzf v1, finds
+ * the first occurrence, then walks back from its end to find the shortest window
+ * and only scores that. Matched positions are marked in highlight if not NULL.
+ * Scanning is done with memchr and memrchr, which are vectorized in libc.
+ */
+static int32_t match_term(const char* text, const char* folded, size_t len,
+                          const struct pick_term* t, bool* highlight) {
+    const char* haystack = t->case_sensitive ? text : folded;
+
+    const char* p = haystack;
+    for (size_t ti = 0; ti < t->len; ti++) {
+        p = memchr(p, t->str[ti], &haystack[len] - p);
+        if (p == NULL) {
+            return -1;
+        }
+        p += 1;
+    }
+    const size_t end = p - haystack;
+
+    for (size_t ti = t->len; ti-- > 0;) {
+        p = memrchr(haystack, t->str[ti], p - haystack);
+    }
+    const size_t start = p - haystack;
+
+    /* greedy match inside the window, jumping over gaps instead of walking them */
+    int32_t score = 0;
+    int32_t consecutive_bonus = 0;
+    size_t i = start;
+    for (size_t ti = 0; ti < t->len; ti++) {
+        p = memchr(&haystack[i], t->str[ti], end - i);
+        const size_t pos = p - haystack;
+        const size_t gap = pos - i;
+        if (ti > 0 && gap > 0) {
+            score -= PENALTY_GAP_START + (gap - 1) * PENALTY_GAP_EXTENSION;
+            consecutive_bonus = 0;
+        }
+
+        int32_t bonus = boundary_bonus(text, pos);
+        if (consecutive_bonus > 0) {
+            bonus = MAX(bonus, consecutive_bonus);
+        }
+        consecutive_bonus = MAX(bonus, BONUS_CONSECUTIVE);
+        if (ti == 0) {
+            bonus *= BONUS_FIRST_CHAR_MULTIPLIER;
+        }
+        score += SCORE_MATCH + bonus;
+
+        if (highlight != NULL) {
+            highlight[pos] = true;
+        }
+        i = pos + 1;
+    }
+
+    return score;
+}
+
+/* Splits query into space separated terms, all of which must match (smart case per term) */
+static int split_query(char* query, size_t query_len, struct pick_term terms[], uint64_t* mask) {
+    int nterms = 0;
+    *mask = 0;
+
+    size_t i = 0;
+    while (i < query_len) {
+        while (i < query_len && query[i] == ' ') {
+            i += 1;
+        }
+        if (i >= query_len) {
+            break;
+        }
+
+        struct pick_term* t = &terms[nterms++];
+        t->str = &query[i];
+        t->case_sensitive = false;
+        while (i < query_len && query[i] != ' ') {
+            if (query[i] >= 'A' && query[i] <= 'Z') {
+                t->case_sensitive = true;
+            }
+            i += 1;
+        }
+        t->len = &query[i] - t->str;
+    }
+
+    /* case insensitive terms are compared against folded text, fold them once here */
+    for (int n = 0; n < nterms; n++) {
+        struct pick_term* t = &terms[n];
+        if (!t->case_sensitive) {
+            for (size_t j = 0; j < t->len; j++) {
+                ((char*)t->str)[j] = fold(t->str[j]);
+            }
+        }
+        *mask |= text_mask(t->str, t->len);
+    }
+
+    return nterms;
+}
+
+static int compare_matches(const void* a, const void* b) {
+    const struct pick_match* ma = a;
+    const struct pick_match* mb = b;
+    if (ma->score != mb->score) {
+        return (ma->score > mb->score) ? -1 : 1;
+    }
+    /* entries are loaded newest first, so prefer more recent entries on ties */
+    return (ma->entry > mb->entry) - (ma->entry < mb->entry);
+}
+
+static void push_level(struct picker* p) {
+    const struct pick_level* prev = &p->levels[p->nlevels - 1];
+    struct pick_level* level = &p->levels[p->nlevels++];
+    const double start = now_ms();
+
+    char query[PICK_MAX_QUERY + 1];
+    memcpy(query, p->query, p->query_len);
+    struct pick_term terms[PICK_MAX_QUERY / 2 + 1];
+    uint64_t mask;
+    const int nterms = split_query(query, p->query_len, terms, &mask);
+
+    level->query_len = p->query_len;
+    level->matches = xmalloc(MAX(prev->nmatches, (size_t)1) * sizeof(level->matches[0]));
+    level->nmatches = 0;
+
+    for (size_t i = 0; i < prev->nmatches; i++) {
+        const uint32_t entry_idx = prev->matches[i].entry;
+        const struct pick_entry* e = &p->entries[entry_idx];
+        if ((e->mask & mask) != mask) {
+            continue;
+        }
+
+        const char* text = &p->arena.str[e->text];
+        const char* folded = &p->folded_arena.str[e->folded];
+        int32_t score = 0;
+        for (int n = 0; n < nterms; n++) {
+            const int32_t term_score = match_term(text, folded, e->text_len, &terms[n], NULL);
+            if (term_score < 0) {
+                goto next;
+            }
+            score += term_score;
+        }
+
+        level->matches[level->nmatches++] = (struct pick_match){
+            .entry = entry_idx,
+            .score = score,
+        };
+    next:;
+    }
+
+    level->sorted = NULL;
+    level->nsorted = 0;
+
+    log_print(DEBUG, "filtered %zu -> %zu entries in %.2fms",
+              prev->nmatches, level->nmatches, now_ms() - start);
+}
+
+static void swap_matches(struct pick_match* a, struct pick_match* b) {
+    const struct pick_match tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/* Rearranges m so that first k elements are the smallest ones, in no particular order */
+static void select_matches(struct pick_match* m, size_t n, size_t k) {
+    size_t lo = 0;
+    size_t hi = n;
+    while (hi - lo > 1) {
+        /* median of three as pivot, moved to the end */
+        const size_t mid = lo + (hi - lo) / 2;
+        if (compare_matches(&m[mid], &m[lo]) < 0) {
+            swap_matches(&m[mid], &m[lo]);
+        }
+        if (compare_matches(&m[hi - 1], &m[lo]) < 0) {
+            swap_matches(&m[hi - 1], &m[lo]);
+        }
+        if (compare_matches(&m[mid], &m[hi - 1]) < 0) {
+            swap_matches(&m[mid], &m[hi - 1]);
+        }
+
+        size_t store = lo;
+        for (size_t i = lo; i < hi - 1; i++) {
+            if (compare_matches(&m[i], &m[hi - 1]) < 0) {
+                swap_matches(&m[i], &m[store++]);
+            }
+        }
+        swap_matches(&m[store], &m[hi - 1]);
+
+        if (store == k) {
+            return;
+        } else if (store < k) {
+            lo = store + 1;
+        } else {
+            hi = store;
+        }
+    }
+}
+
+/*
+ * Makes sure first n matches are in display order. Only what is on screen needs
+ * to be sorted, which is much cheaper than sorting every match on every keystroke.
+ */
+static void sort_level(struct pick_level* level, size_t n) {
+    if (n <= level->nsorted) {
+        return;
+    }
+    if (level->sorted == NULL) {
+        level->sorted = xmalloc(MAX(level->nmatches, (size_t)1) * sizeof(level->sorted[0]));
+        memcpy(level->sorted, level->matches, level->nmatches * sizeof(level->sorted[0]));
+    }
+
+    /* sort ahead a bit so scrolling does not do this on every line */
+    n = MIN(MAX(n, MAX(level->nsorted * 2, (size_t)256)), level->nmatches);
+
+    struct pick_match* rest = &level->sorted[level->nsorted];
+    const size_t nrest = level->nmatches - level->nsorted;
+    const size_t k = n - level->nsorted;
+    select_matches(rest, nrest, k);
+    qsort(rest, k, sizeof(rest[0]), compare_matches);
+    level->nsorted = n;
+}
+
+static void update_levels(struct picker* p) {
+    while (p->nlevels > 1 && p->levels[p->nlevels - 1].query_len > p->query_edit_len) {
+        p->nlevels -= 1;
+        free(p->levels[p->nlevels].matches);
+        free(p->levels[p->nlevels].sorted);
+    }
+    if (p->levels[p->nlevels - 1].query_len != p->query_len) {
+        push_level(p);
+        p->cursor = 0;
+        p->scroll = 0;
+    }
+    p->query_edit_len = p->query_len;
+
+    const size_t nmatches = p->levels[p->nlevels - 1].nmatches;
+    if (p->cursor >= nmatches) {
+        p->cursor = (nmatches > 0) ? nmatches - 1 : 0;
+    }
+}
+
+static bool load_entries(struct picker* p) {
+    struct sqlite3_stmt* stmt = NULL;
+    bool success = false;
+    const double start = now_ms();
+
+    static const char sql[] =
+        "SELECT id, preview, mime_type FROM history ORDER BY timestamp DESC, id DESC";
+    if (!db_prepare_stmt(p->db, sql, &stmt)) {
+        goto out;
+    }
+
+    size_t capacity = 0;
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (p->nentries >= capacity) {
+            capacity = (capacity == 0) ? 1024 : capacity * 2;
+            p->entries = xrealloc(p->entries, capacity * sizeof(p->entries[0]));
+        }
+
+        const char* preview = (const char*)sqlite3_column_text(stmt, 1);
+        const int preview_len = sqlite3_column_bytes(stmt, 1);
+        const char* mime = (const char*)sqlite3_column_text(stmt, 2);
+
+        struct pick_entry* e = &p->entries[p->nentries++];
+        e->id = sqlite3_column_int64(stmt, 0);
+        e->mask = text_mask(preview, preview_len);
+        e->text = p->arena.len;
+        e->text_len = preview_len;
+        e->folded = p->folded_arena.len;
+        for (int i = 0; i < preview_len; i++) {
+            const char c = fold(preview[i]);
+            string_appendn(&p->folded_arena, &c, 1);
+        }
+        string_appendn(&p->folded_arena, "", 1);
+        string_appendn(&p->arena, preview, preview_len);
+        string_appendn(&p->arena, "", 1);
+        e->mime = p->arena.len;
+        string_append(&p->arena, mime);
+        string_appendn(&p->arena, "", 1);
+    }
+    if (ret != SQLITE_DONE) {
+        log_print(ERR, "failed to load entries: %s", sqlite3_errmsg(p->db));
+        goto out;
+    }
+
+    struct pick_level* level = &p->levels[p->nlevels++];
+    level->query_len = 0;
+    level->nmatches = p->nentries;
+    level->matches = xmalloc(MAX(p->nentries, (size_t)1) * sizeof(level->matches[0]));
+    for (size_t i = 0; i < p->nentries; i++) {
+        level->matches[i] = (struct pick_match){ .entry = i, .score = 0 };
+    }
+    /* all scores are 0, so it is already in order */
+    level->sorted = level->matches;
+    level->nsorted = p->nentries;
+
+    log_print(DEBUG, "loaded %zu entries in %.2fms", p->nentries, now_ms() - start);
+    success = true;
+
+out:
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+/*
+ * Appends at most width columns of text to out, replacing control characters.
+ * Returns number of columns used. If highlight is not NULL, highlighted bytes
+ * are printed in a different color.
+ */
+static int append_clipped(struct string* out, const char* text, size_t len, int width,
+                          const bool* highlight) {
+    int used = 0;
+    bool highlighted = false;
+    mbstate_t mbs = {0};
+
+    size_t i = 0;
+    while (i < len && used < width) {
+        wchar_t wc;
+        size_t n = mbrtowc(&wc, &text[i], len - i, &mbs);
+        int w;
+        const char* bytes = &text[i];
+        size_t nbytes = n;
+        if (n == (size_t)-1 || n == (size_t)-2 || n == 0) {
+            mbs = (mbstate_t){0};
+            n = 1;
+            bytes = "?";
+            nbytes = 1;
+            w = 1;
+        } else if ((w = wcwidth(wc)) < 0 || wc < 0x20) {
+            bytes = " ";
+            nbytes = 1;
+            w = 1;
+        }
+        if (used + w > width) {
+            break;
+        }
+
+        const bool hl = highlight != NULL && highlight[i];
+        if (hl != highlighted) {
+            string_append(out, hl ? "\033[32m" : "\033[39m");
+            highlighted = hl;
+        }
+        string_appendn(out, bytes, nbytes);
+
+        used += w;
+        i += n;
+    }
+    if (highlighted) {
+        string_append(out, "\033[39m");
+    }
+
+    return used;
+}
+
+static void free_preview(struct picker* p) {
+    for (int i = 0; i < p->npreview_lines; i++) {
+        string_free(&p->preview_lines[i]);
+    }
+    free(p->preview_lines);
+    p->preview_lines = NULL;
+    p->npreview_lines = 0;
+    p->preview_id = -1;
+}
+
+/* Breaks text into at most max_lines lines no wider than width */
+static void wrap_preview(struct picker* p, const char* text, size_t len, int width, int max_lines) {
+    p->preview_lines = xcalloc(max_lines, sizeof(p->preview_lines[0]));
+
+    struct string* line = &p->preview_lines[p->npreview_lines++];
+    int col = 0;
+    mbstate_t mbs = {0};
+    size_t i = 0;
+    while (i < len) {
+        wchar_t wc;
+        size_t n = mbrtowc(&wc, &text[i], len - i, &mbs);
+        const char* bytes = &text[i];
+        size_t nbytes = n;
+        int w;
+        if (n == (size_t)-1 || n == (size_t)-2 || n == 0) {
+            mbs = (mbstate_t){0};
+            n = 1;
+            bytes = "?";
+            nbytes = 1;
+            w = 1;
+        } else if (wc == '\n') {
+            w = -1;
+        } else if (wc == '\t') {
+            bytes = "        ";
+            w = nbytes = MIN(8 - (col % 8), width - col);
+        } else if ((w = wcwidth(wc)) < 0 || wc < 0x20) {
+            bytes = "?";
+            nbytes = 1;
+            w = 1;
+        }
+
+        if (w < 0 || col + w > width) {
+            if (p->npreview_lines >= max_lines) {
+                break;
+            }
+            line = &p->preview_lines[p->npreview_lines++];
+            col = 0;
+            if (w < 0) {
+                i += n;
+                continue;
+            }
+        }
+
+        string_appendn(line, bytes, nbytes);
+        col += w;
+        i += n;
+    }
+}
+
+static void load_preview(struct picker* p, const struct pick_entry* e, int width, int height) {
+    if (p->preview_id == e->id && p->preview_width == width) {
+        return;
+    }
+    free_preview(p);
+    p->preview_id = e->id;
+    p->preview_width = width;
+
+    const double start = now_ms();
+    const char* mime = &p->arena.str[e->mime];
+    const bool is_text = strncmp(mime, "text/", 5) == 0;
+
+    /* every line takes at least one byte, every column at most 4 */
+    STMT_BIND(p->preview_stmt, int64, "@id", e->id);
+    STMT_BIND(p->preview_stmt, int64, "@max_bytes", is_text ? (int64_t)width * height * 4 : 0);
+    if (sqlite3_step(p->preview_stmt) != SQLITE_ROW) {
+        /* deleted since we loaded the list */
+        const char msg[] = "(entry no longer exists)";
+        wrap_preview(p, msg, strlen(msg), width, height);
+        goto out;
+    }
+
+    struct string header = {0};
+    string_appendf(&header, "%li  %s  %li bytes\n", e->id, mime,
+                   sqlite3_column_int64(p->preview_stmt, 0));
+    if (is_text) {
+        string_appendn(&header, sqlite3_column_blob(p->preview_stmt, 1),
+                       sqlite3_column_bytes(p->preview_stmt, 1));
+    } else {
+        string_append(&header, &p->arena.str[e->text]);
+    }
+    wrap_preview(p, header.str, header.len, width, height);
+    string_free(&header);
+
+out:
+    sqlite3_reset(p->preview_stmt);
+    log_print(DEBUG, "loaded preview for entry %li in %.2fms", e->id, now_ms() - start);
+}
+
+static void render(struct picker* p) {
+    struct pick_level* level = &p->levels[p->nlevels - 1];
+    struct string* f = &p->frame;
+    string_clear(f);
+
+    const int list_rows = MAX(p->rows - 1, 0);
+    const int list_width = (p->cols >= 40) ? p->cols / 2 : p->cols;
+    const int preview_width = p->cols - list_width - 1;
+
+    if (p->cursor < p->scroll) {
+        p->scroll = p->cursor;
+    } else if (list_rows > 0 && p->cursor >= p->scroll + list_rows) {
+        p->scroll = p->cursor - list_rows + 1;
+    }
+
+    sort_level(level, MIN(MAX(p->scroll + list_rows, p->cursor + 1), level->nmatches));
+
+    string_append(f, "\033[?25l\033[H");
+
+    /* prompt line */
+    char counter[64];
+    const int counter_len = snprintf(counter, sizeof(counter), "  %zu/%zu",
+                                     level->nmatches, p->nentries);
+    string_append(f, "> ");
+    const int query_cols = append_clipped(f, p->query, p->query_len,
+                                          MAX(p->cols - 2 - counter_len, 0), NULL);
+    if (2 + query_cols + counter_len <= p->cols) {
+        string_append(f, counter);
+    }
+    string_append(f, "\033[K");
+
+    const struct pick_entry* selected = NULL;
+    if (level->nmatches > 0) {
+        selected = &p->entries[level->sorted[p->cursor].entry];
+        if (preview_width > 0) {
+            load_preview(p, selected, preview_width, list_rows);
+        }
+    }
+
+    char query[PICK_MAX_QUERY + 1];
+    memcpy(query, p->query, p->query_len);
+    struct pick_term terms[PICK_MAX_QUERY / 2 + 1];
+    uint64_t mask;
+    const int nterms = split_query(query, p->query_len, terms, &mask);
+
+    for (int row = 0; row < list_rows; row++) {
+        string_appendf(f, "\r\n");
+
+        const size_t idx = p->scroll + row;
+        int used = 0;
+        if (idx < level->nmatches) {
+            const struct pick_entry* e = &p->entries[level->sorted[idx].entry];
+            const char* text = &p->arena.str[e->text];
+            const char* folded = &p->folded_arena.str[e->folded];
+
+            bool* highlight = xcalloc(e->text_len + 1, sizeof(bool));
+            for (int n = 0; n < nterms; n++) {
+                match_term(text, folded, e->text_len, &terms[n], highlight);
+            }
+
+            if (idx == p->cursor) {
+                string_append(f, "\033[7m");
+            }
+            string_append(f, (idx == p->cursor) ? "> " : "  ");
+            used = 2 + append_clipped(f, text, e->text_len, MAX(list_width - 2, 0), highlight);
+            free(highlight);
+        }
+        for (; used < list_width; used++) {
+            string_append(f, " ");
+        }
+        string_append(f, "\033[m");
+
+        if (preview_width > 0) {
+            string_append(f, "\xe2\x94\x82"); /* box drawings light vertical */
+            if (selected != NULL && row < p->npreview_lines) {
+                const struct string* line = &p->preview_lines[row];
+                string_appendn(f, line->str != NULL ? line->str : "", line->len);
+            }
+        }
+        string_append(f, "\033[K");
+    }
+
+    string_appendf(f, "\033[1;%dH\033[?25h", MIN(3 + query_cols, MAX(p->cols, 1)));
+
+    struct iovec iov = { .iov_base = f->str, .iov_len = f->len };
+    writev_full(p->tty, &iov, 1);
+}
+
+static void update_size(struct picker* p) {
+    struct winsize ws;
+    if (ioctl(p->tty, TIOCGWINSZ, &ws) < 0 || ws.ws_row == 0 || ws.ws_col == 0) {
+        ws.ws_row = 24;
+        ws.ws_col = 80;
+    }
+    p->rows = ws.ws_row;
+    p->cols = ws.ws_col;
+    p->preview_id = -1; /* rewrap */
+}
+
+static bool tty_setup(struct picker* p) {
+    p->tty = open("/dev/tty", O_RDWR | O_CLOEXEC);
+    if (p->tty < 0) {
+        log_print(ERR, "failed to open /dev/tty: %s", strerror(errno));
+        return false;
+    }
+
+    if (tcgetattr(p->tty, &p->saved_termios) < 0) {
+        log_print(ERR, "failed to get terminal attributes: %s", strerror(errno));
+        return false;
+    }
+    p->termios_saved = true;
+
+    struct termios raw = p->saved_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_oflag &= ~(OPOST);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(p->tty, TCSAFLUSH, &raw) < 0) {
+        log_print(ERR, "failed to set terminal attributes: %s", strerror(errno));
+        return false;
+    }
+
+    /* alternate screen */
+    static const char init[] = "\033[?1049h";
+    return write(p->tty, init, strlen(init)) >= 0;
+}
+
+static void tty_restore(struct picker* p) {
+    if (p->termios_saved) {
+        static const char fini[] = "\033[?25h\033[?1049l";
+        if (write(p->tty, fini, strlen(fini)) < 0) {
+            /* nothing to do about it */
+        }
+        tcsetattr(p->tty, TCSAFLUSH, &p->saved_termios);
+    }
+    if (p->tty >= 0) {
+        close(p->tty);
+    }
+}
+
+enum pick_result {
+    PICK_CONTINUE,
+    PICK_ACCEPT,
+    PICK_ABORT,
+};
+
+static void delete_last_char(struct picker* p) {
+    /* skip UTF-8 continuation bytes */
+    while (p->query_len > 0 && (p->query[--p->query_len] & 0xC0) == 0x80) {}
+}
+
+static void move_cursor(struct picker* p, long delta) {
+    const size_t nmatches = p->levels[p->nlevels - 1].nmatches;
+    if (nmatches == 0) {
+        return;
+    }
+
+    const long cursor = (long)p->cursor + delta;
+    p->cursor = (cursor < 0) ? 0 : MIN((size_t)cursor, nmatches - 1);
+}
+
+static enum pick_result handle_input(struct picker* p, const char* buf, size_t len) {
+    const long page = MAX(p->rows - 1, 1);
+
+    for (size_t i = 0; i < len; i++) {
+        const unsigned char c = buf[i];
+        if (c == '\033') {
+            if (i + 1 >= len) {
+                return PICK_ABORT; /* lone escape */
+            }
+            if (buf[i + 1] != '[' && buf[i + 1] != 'O') {
+                continue;
+            }
+
+            /* CSI or SS3 sequence: parameters then final byte */
+            size_t j = i + 2;
+            while (j < len && !(buf[j] >= 0x40 && buf[j] <= 0x7E)) {
+                j += 1;
+            }
+            if (j >= len) {
+                break;
+            }
+
+            const char* seq = &buf[i + 2];
+            const size_t seq_len = j - (i + 2) + 1;
+            if (seq_len == 1 && seq[0] == 'A') {
+                move_cursor(p, -1);
+            } else if (seq_len == 1 && seq[0] == 'B') {
+                move_cursor(p, 1);
+            } else if (seq_len == 2 && STRNEQ(seq, "5~", 2)) {
+                move_cursor(p, -page);
+            } else if (seq_len == 2 && STRNEQ(seq, "6~", 2)) {
+                move_cursor(p, page);
+            }
+            i = j;
+        } else if (c == '\r' || c == '\n') {
+            return PICK_ACCEPT;
+        } else if (c == 0x03 || c == 0x07) { /* ^C, ^G */
+            return PICK_ABORT;
+        } else if (c == 0x7F || c == 0x08) { /* backspace, ^H */
+            delete_last_char(p);
+        } else if (c == 0x15) { /* ^U */
+            p->query_len = 0;
+        } else if (c == 0x17) { /* ^W */
+            while (p->query_len > 0 && p->query[p->query_len - 1] == ' ') {
+                p->query_len -= 1;
+            }
+            while (p->query_len > 0 && p->query[p->query_len - 1] != ' ') {
+                p->query_len -= 1;
+            }
+        } else if (c == 0x10) { /* ^P */
+            move_cursor(p, -1);
+        } else if (c == 0x0E) { /* ^N */
+            move_cursor(p, 1);
+        } else if (c >= 0x20 && p->query_len < PICK_MAX_QUERY) {
+            p->query[p->query_len++] = c;
+        }
+        p->query_edit_len = MIN(p->query_edit_len, p->query_len);
+    }
+
+    return PICK_CONTINUE;
+}
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip pick [-q QUERY]\n"
+        "\n"
+        "Command line options:\n"
+        "    -q QUERY  Start with QUERY already typed\n"
+        "\n"
+        "Interactively select an entry and print its id to stdout.\n"
+        "Up/Down, ^P/^N, PgUp/PgDn to move, Enter to select, Esc or ^C to cancel,\n"
+        "^U to clear query, ^W to delete last word.\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+void action_pick(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+
+    struct picker p = {
+        .tty = -1,
+        .db = db,
+        .preview_id = -1,
+    };
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt(argc, argv, ":q:h")) != -1) {
+        switch (opt) {
+        case 'q':
+            p.query_len = MIN(strlen(optarg), (size_t)PICK_MAX_QUERY);
+            memcpy(p.query, optarg, p.query_len);
+            break;
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    if (argc > 0) {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+
+    /* needed for mbrtowc and wcwidth to understand UTF-8 */
+    setlocale(LC_CTYPE, "");
+
+    static const char preview_sql[] =
+        "SELECT data_size, substr(data, 1, @max_bytes) FROM history WHERE id = @id";
+    if (!db_prepare_stmt(db, preview_sql, &p.preview_stmt)) {
+        OUT(1);
+    }
+
+    if (!load_entries(&p)) {
+        OUT(1);
+    }
+
+    struct sigaction sa = { .sa_handler = signal_handler };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    if (!tty_setup(&p)) {
+        OUT(1);
+    }
+    update_size(&p);
+    update_levels(&p);
+
+    enum pick_result result = PICK_CONTINUE;
+    while (result == PICK_CONTINUE) {
+        render(&p);
+
+        char buf[256];
+        ssize_t n = read(p.tty, buf, sizeof(buf));
+        if (got_sigterm) {
+            result = PICK_ABORT;
+        } else if (got_sigwinch) {
+            got_sigwinch = 0;
+            update_size(&p);
+        } else if (n < 0 && errno != EINTR) {
+            log_print(ERR, "failed to read from terminal: %s", strerror(errno));
+            result = PICK_ABORT;
+        } else if (n == 0) {
+            result = PICK_ABORT;
+        } else if (n > 0) {
+            /* filter once per read, not once per pasted byte */
+            result = handle_input(&p, buf, n);
+            update_levels(&p);
+        }
+    }
+
+    tty_restore(&p);
+    p.tty = -1;
+    p.termios_saved = false;
+
+    const struct pick_level* level = &p.levels[p.nlevels - 1];
+    if (result == PICK_ACCEPT && level->nmatches > 0) {
+        printf("%li\n", p.entries[level->sorted[p.cursor].entry].id);
+    } else {
+        OUT(1);
+    }
+
+out:
+    tty_restore(&p);
+    free_preview(&p);
+    for (size_t i = 0; i < p.nlevels; i++) {
+        if (p.levels[i].sorted != p.levels[i].matches) {
+            free(p.levels[i].sorted);
+        }
+        free(p.levels[i].matches);
+    }
+    free(p.entries);
+    string_free(&p.arena);
+    string_free(&p.folded_arena);
+    string_free(&p.frame);
+    sqlite3_finalize(p.preview_stmt);
+    sqlite3_close(db);
+    exit(retcode);
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <getopt.h>
+#include <stdio.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "../utils.h"
+#include "../client.h"
+#include "query.h"
+#include "log.h"
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip search [-r] [-l N] QUERY\n"
+        "\n"
+        "Command line options:\n"
+        "    -r          Treat QUERY as FTS5 query syntax instead of a plain substring\n"
+        "    -l N        Print at most N results\n"
+        "    QUERY       Text to search for in text entries (at least 3 bytes)\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+void action_search(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+
+    struct search_query q = {
+        .limit = -1,
+    };
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt(argc, argv, ":rl:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            q.raw = true;
+            break;
+        case 'l':
+            if (!str_to_int64(optarg, &q.limit) || q.limit < 0) {
+                log_print(ERR, "limit must be a non-negative integer, got %s", optarg);
+                OUT(1);
+            }
+            break;
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    if (argc < 1) {
+        log_print(ERR, "not enough arguments");
+        OUT(1);
+    } else if (argc > 1) {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+    q.text = argv[0];
+
+    if (db == NULL) {
+        struct proto_msg msg = {0};
+        proto_msg_reset(&msg, PROTO_SEARCH);
+        search_query_encode(&q, &msg);
+        OUT(client_request(&msg));
+    }
+
+    struct query_runner runner;
+    query_runner_init(&runner, db, 1);
+    if (!search_query_run(&q, &runner)) {
+        log_print(ERR, "%s", runner.error);
+        OUT(1);
+    }
+
+out:
+    sqlite3_close(db);
+    client_disconnect();
+    exit(retcode);
+}
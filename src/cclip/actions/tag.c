@@ -24,6 +24,7 @@
 
 #include "actions.h"
 #include "../utils.h"
+#include "../client.h"
 #include "db.h"
 #include "macros.h"
 #include "log.h"
@@ -135,6 +136,11 @@ void action_tag(int argc, char** argv, struct sqlite3* db) {
             OUT(1);
         }
     } else /* if (!delete_tag) */ {
+        /* so that tag can't be cleaned up as orphaned before we reference it */
+        if (!db_begin_write(db)) {
+            OUT(1);
+        }
+
         const char* sql_insert_into_tags = TOSTRING(
             INSERT OR IGNORE INTO tags ( name ) VALUES ( @tag_name );
         );
@@ -171,11 +177,20 @@ void action_tag(int argc, char** argv, struct sqlite3* db) {
             log_print(ERR, "failed to add tag to entry: %s (duplicate tag?)", sqlite3_errmsg(db));
             OUT(1);
         }
+
+        /* uncommitted transaction is rolled back on close if anything above failed */
+        if (sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+            log_print(ERR, "failed to commit: %s", sqlite3_errmsg(db));
+            OUT(1);
+        }
     }
 
+    client_notify(db, PROTO_CHANGE_TAG, entry_id);
+
 out:
     sqlite3_finalize(stmt);
     sqlite3_close(db);
+    client_disconnect();
     exit(retcode);
 }
 
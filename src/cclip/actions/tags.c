@@ -27,8 +27,10 @@
 #include <sqlite3.h>
 
 #include "actions.h"
-#include "../utils.h"
+#include "../client.h"
+#include "../bulk.h"
 #include "db.h"
+#include "io.h"
 #include "macros.h"
 #include "log.h"
 
@@ -80,50 +82,55 @@ out:
     return retcode;
 }
 
-static int do_delete(struct sqlite3* db, const char* name) {
-    int retcode = 0;
-    struct sqlite3_stmt* stmt = NULL;
-
-    const char* sql = TOSTRING(
-        WITH tag_ids AS (
-            SELECT id FROM tags WHERE name = @name
-        ) DELETE FROM history_tags WHERE tag_id IN tag_ids;
-    );
-
-    if (!db_prepare_stmt(db, sql, &stmt)) {
-        OUT(1);
-    }
-
-    STMT_BIND(stmt, text, "@name", name, -1, SQLITE_STATIC);
-
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (rc != SQLITE_DONE) {
-        log_print(ERR, "failed to delete tag(s): %s", sqlite3_errmsg(db));
-        OUT(1);
-    }
+static void bind_name(struct sqlite3_stmt* stmt, const void* data) {
+    STMT_BIND(stmt, text, "@name", data, -1, SQLITE_STATIC);
+}
 
-    if (sqlite3_changes(db) == 0) {
+static int do_delete(struct sqlite3* db, const char* name) {
+    const struct bulk_delete op = {
+        .what = "tags",
+        .count_sql = TOSTRING(
+            SELECT count(*) FROM history_tags WHERE tag_id = (
+                SELECT id FROM tags WHERE name = @name
+            );
+        ),
+        .delete_sql = TOSTRING(
+            DELETE FROM history_tags WHERE ( tag_id, entry_id ) IN (
+                SELECT tag_id, entry_id FROM history_tags WHERE tag_id = (
+                    SELECT id FROM tags WHERE name = @name
+                ) LIMIT @limit
+            ) RETURNING entry_id;
+        ),
+        .bind = bind_name,
+        .data = name,
+        .notify = PROTO_CHANGE_TAG,
+    };
+
+    const int64_t deleted = bulk_delete(db, &op);
+    if (deleted < 0) {
+        return 1;
+    } else if (deleted == 0) {
         log_print(WARN, "no tags were deleted");
     }
 
-out:
-    sqlite3_finalize(stmt);
-    return retcode;
+    return 0;
 }
 
 static int do_wipe(struct sqlite3* db) {
-    const char* sql = TOSTRING(
-        DELETE FROM history_tags;
-    );
-
-    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
-        log_print(ERR, "failed to delete tags: %s", sqlite3_errmsg(db));
-        return 1;
-    }
-
-    return 0;
+    const struct bulk_delete op = {
+        .what = "tags",
+        .count_sql = TOSTRING(
+            SELECT count(*) FROM history_tags;
+        ),
+        .delete_sql = TOSTRING(
+            DELETE FROM history_tags WHERE entry_id IN (
+                SELECT DISTINCT entry_id FROM history_tags LIMIT @limit
+            ) RETURNING entry_id;
+        ),
+        .notify = PROTO_CHANGE_TAG,
+    };
+
+    return (bulk_delete(db, &op) < 0) ? 1 : 0;
 }
 
 void action_tags(int argc, char** argv, struct sqlite3* db) {
@@ -181,6 +188,7 @@ void action_tags(int argc, char** argv, struct sqlite3* db) {
 
 out:
     sqlite3_close(db);
+    client_disconnect();
     exit(retcode);
 }
 
@@ -18,11 +18,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
 #include <getopt.h>
 
 #include <sqlite3.h>
 
 #include "actions.h"
+#include "../client.h"
+#include "db.h"
 #include "log.h"
 
 static void print_help(void) {
@@ -37,6 +43,137 @@ static void print_help(void) {
     fputs(help, stdout);
 }
 
+static int64_t get_data_version(struct sqlite3* db) {
+    struct sqlite3_stmt* stmt = NULL;
+    int64_t version = -1;
+
+    if (db_prepare_stmt(db, "PRAGMA data_version", &stmt) && sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int64(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+/*
+ * Compacts db into a temporary file, then copies it back page by page with backup api.
+ * Unlike plain VACUUM this only blocks writers for the duration of the copy, and readers
+ * are never blocked thanks to WAL. Renaming the file over the db is not an option because
+ * open connections would keep using the old file and its WAL.
+ */
+static bool vacuum_online(struct sqlite3* db) {
+    bool ret = false;
+    struct sqlite3* compacted = NULL;
+    struct sqlite3* watcher = NULL;
+    struct sqlite3_stmt* stmt = NULL;
+    struct sqlite3_backup* backup = NULL;
+    char tmp_path[PATH_MAX] = "";
+
+    const char* db_path = sqlite3_db_filename(db, "main");
+    if (db_path == NULL || db_path[0] == '\0') {
+        log_print(ERR, "can't vacuum in-memory database");
+        return false;
+    }
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.vacuum", db_path) >= (int)sizeof(tmp_path)) {
+        log_print(ERR, "database path is too long");
+        return false;
+    }
+    if (unlink(tmp_path) < 0 && errno != ENOENT) {
+        log_print(ERR, "failed to remove stale %s: %s", tmp_path, strerror(errno));
+        goto out;
+    }
+
+    /* entries copied while we work are kept in memory by cclipd and saved afterwards */
+    if (!client_suspend_writes(db)) {
+        log_print(DEBUG, "cclipd is not running, vacuuming without suspending it");
+    }
+
+    /* VACUUM INTO picks this up, so older databases get converted as a side effect */
+    if (sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to set auto_vacuum: %s", sqlite3_errmsg(db));
+        goto out;
+    }
+
+    /*
+     * db can't be queried once it is the destination of a backup, so changes made by
+     * others are watched through a separate connection, whose data_version changes
+     * whenever anyone (including db) commits.
+     */
+    int rc = sqlite3_open_v2(db_path, &watcher, SQLITE_OPEN_READONLY, NULL);
+    if (rc != SQLITE_OK) {
+        log_print(ERR, "failed to open %s: %s", db_path, sqlite3_errstr(rc));
+        goto out;
+    }
+    const int64_t data_version = get_data_version(watcher);
+
+    if (!db_prepare_stmt(db, "VACUUM INTO ?", &stmt)) {
+        goto out;
+    }
+    sqlite3_bind_text(stmt, 1, tmp_path, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_print(ERR, "failed to compact database: %s", sqlite3_errmsg(db));
+        goto out;
+    }
+
+    rc = sqlite3_open_v2(tmp_path, &compacted, SQLITE_OPEN_READONLY, NULL);
+    if (rc != SQLITE_OK) {
+        log_print(ERR, "failed to open %s: %s", tmp_path, sqlite3_errstr(rc));
+        goto out;
+    }
+
+    backup = sqlite3_backup_init(db, "main", compacted, "main");
+    if (backup == NULL) {
+        log_print(ERR, "failed to start copying compacted database: %s", sqlite3_errmsg(db));
+        goto out;
+    }
+
+    /*
+     * Backup refuses a destination with an open transaction, but its first step takes
+     * the write lock on db and keeps it until the copy is finished. Copying nothing
+     * gets the lock, after which nobody can commit until compacted copy replaces db.
+     */
+    rc = sqlite3_backup_step(backup, 0);
+    if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+        log_print(ERR, "failed to lock database: %s", sqlite3_errstr(rc));
+        goto out;
+    }
+
+    /* someone other than cclipd wrote to db meanwhile, copying back would lose that */
+    if (get_data_version(watcher) != data_version) {
+        log_print(ERR, "database was modified during vacuum, try again");
+        goto out;
+    }
+
+    rc = sqlite3_backup_step(backup, -1);
+    sqlite3_backup_finish(backup);
+    backup = NULL;
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "failed to copy compacted database: %s", sqlite3_errstr(rc));
+        goto out;
+    }
+
+    /* file only shrinks once WAL is checkpointed, readers may still hold it back, that's ok */
+    if (sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE)", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(WARN, "failed to checkpoint database: %s", sqlite3_errmsg(db));
+    }
+
+    ret = true;
+
+out:
+    /* also releases the lock if copy was abandoned */
+    sqlite3_backup_finish(backup);
+    client_resume_writes();
+    client_disconnect();
+    sqlite3_finalize(stmt);
+    sqlite3_close(compacted);
+    sqlite3_close(watcher);
+    if (tmp_path[0] != '\0') {
+        unlink(tmp_path);
+    }
+    return ret;
+}
+
 void action_vacuum(int argc, char** argv, struct sqlite3* db) {
     int retcode = 0;
 
@@ -66,12 +203,16 @@ void action_vacuum(int argc, char** argv, struct sqlite3* db) {
         OUT(1);
     }
 
-    if (sqlite3_exec(db, "VACUUM", NULL, NULL, NULL) != SQLITE_OK) {
-        log_print(ERR, "sqlite error: %s", sqlite3_errmsg(db));
+    /* page size can't be changed online, rebuilding vacuums as well */
+    const struct db_profile* profile = db_get_profile();
+    const int page_size = db_get_page_size(db);
+    if (page_size < 0) {
         OUT(1);
+    } else if (profile->page_size > 0 && page_size != profile->page_size) {
+        OUT(db_rebuild(db, profile->page_size) ? 0 : 1);
     }
 
-    OUT(0);
+    OUT(vacuum_online(db) ? 0 : 1);
 
 out:
     sqlite3_close(db);
@@ -0,0 +1,342 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/inotify.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include <sqlite3.h>
+
+#include "actions.h"
+#include "../client.h"
+#include "collections/string.h"
+#include "collections/vec.h"
+#include "query.h"
+#include "db.h"
+#include "io.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "log.h"
+
+static void print_help(void) {
+    static const char help[] =
+        "Usage:\n"
+        "    cclip watch [FIELDS]\n"
+        "\n"
+        "Command line options:\n"
+        "    FIELDS  Comma-separated list of fields to print after event and id\n"
+    ;
+
+    fputs(help, stdout);
+}
+
+/*
+ * Fallback for when cclipd is not running: wait for the database or its WAL
+ * to be written to, and find out what changed by comparing with previous state.
+ */
+
+struct entry_state {
+    int64_t id;
+    int64_t timestamp;
+    char* tags;
+};
+
+struct state {
+    VEC(struct entry_state) entries; /* sorted by id */
+};
+
+static void state_free(struct state* state) {
+    VEC_FOREACH(&state->entries, i) {
+        free(state->entries.data[i].tags);
+    }
+    VEC_FREE(&state->entries);
+}
+
+static bool load_state(struct sqlite3* db, struct sqlite3_stmt* stmt, struct state* state) {
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* tags = (const char*)sqlite3_column_text(stmt, 2);
+        VEC_APPEND(&state->entries, &((struct entry_state){
+            .id = sqlite3_column_int64(stmt, 0),
+            .timestamp = sqlite3_column_int64(stmt, 1),
+            .tags = (tags != NULL) ? xstrdup(tags) : NULL,
+        }));
+    }
+    sqlite3_reset(stmt);
+
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "failed to read entries: %s", sqlite3_errmsg(db));
+        return false;
+    }
+    return true;
+}
+
+static bool print_change(struct sqlite3_stmt* get_stmt, enum proto_change_type type,
+                         int64_t id, int nfields) {
+    char prefix[64];
+    struct iovec iov[1 + SELECT_FIELDS_COUNT * 2] = {
+        [0] = {
+            .iov_base = prefix,
+            .iov_len = snprintf(prefix, sizeof(prefix), "%s\t%li%s", proto_change_name(type),
+                                id, (type == PROTO_CHANGE_DELETE || nfields == 0) ? "\n" : "\t"),
+        },
+    };
+    int niov = 1;
+
+    if (type != PROTO_CHANGE_DELETE && nfields > 0) {
+        STMT_BIND(get_stmt, int64, "@entry_id", id);
+        if (sqlite3_step(get_stmt) != SQLITE_ROW) {
+            /* already gone, will be reported as deleted next time */
+            sqlite3_reset(get_stmt);
+            return true;
+        }
+
+        const int ncols = sqlite3_column_count(get_stmt);
+        query_row_to_iov(get_stmt, ncols, &iov[1]);
+        niov += ncols * 2;
+    }
+
+    bool ret = writev_full(1, iov, niov);
+    if (!ret) {
+        log_print(ERR, "failed to write output: %s", strerror(errno));
+    }
+
+    if (niov > 1) {
+        sqlite3_reset(get_stmt);
+    }
+    return ret;
+}
+
+/* both states are sorted by id, so they can be compared in a single pass */
+static bool print_diff(const struct state* old, const struct state* new,
+                       struct sqlite3_stmt* get_stmt, int nfields) {
+    size_t i = 0, j = 0;
+    while (i < VEC_SIZE(&old->entries) || j < VEC_SIZE(&new->entries)) {
+        const struct entry_state* o = (i < VEC_SIZE(&old->entries)) ? &old->entries.data[i] : NULL;
+        const struct entry_state* n = (j < VEC_SIZE(&new->entries)) ? &new->entries.data[j] : NULL;
+
+        bool ok = true;
+        if (n == NULL || (o != NULL && o->id < n->id)) {
+            ok = print_change(get_stmt, PROTO_CHANGE_DELETE, o->id, nfields);
+            i += 1;
+        } else if (o == NULL || n->id < o->id) {
+            ok = print_change(get_stmt, PROTO_CHANGE_INSERT, n->id, nfields);
+            j += 1;
+        } else {
+            if (o->timestamp != n->timestamp) {
+                ok = print_change(get_stmt, PROTO_CHANGE_BUMP, n->id, nfields);
+            } else if (!STREQ(o->tags ? o->tags : "", n->tags ? n->tags : "")) {
+                ok = print_change(get_stmt, PROTO_CHANGE_TAG, n->id, nfields);
+            }
+            i += 1;
+            j += 1;
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int64_t get_data_version(struct sqlite3* db, struct sqlite3_stmt* stmt) {
+    int64_t version = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_reset(stmt);
+    return version;
+}
+
+static int watch_db(struct sqlite3* db, const struct get_query* q) {
+    int retcode = 0;
+    int inotify_fd = -1;
+    struct string sql = {0};
+    struct sqlite3_stmt* state_stmt = NULL;
+    struct sqlite3_stmt* version_stmt = NULL;
+    struct sqlite3_stmt* get_stmt = NULL;
+    struct state old = {0}, new = {0};
+
+    char db_path[PATH_MAX];
+    if (realpath(sqlite3_db_filename(db, "main"), db_path) == NULL) {
+        log_print(ERR, "failed to resolve database path: %s", strerror(errno));
+        OUT(1);
+    }
+    char db_dir[PATH_MAX];
+    strcpy(db_dir, db_path);
+    dirname(db_dir);
+    const char* db_name = basename(db_path);
+    char wal_name[NAME_MAX + 1];
+    snprintf(wal_name, sizeof(wal_name), "%s-wal", db_name);
+
+    const char* state_sql = TOSTRING(
+        SELECT h.id, h.timestamp, (
+            SELECT group_concat(t.name, ',') FROM history_tags AS ht
+            INNER JOIN tags AS t ON ht.tag_id = t.id
+            WHERE ht.entry_id = h.id
+        )
+        FROM history AS h
+        ORDER BY h.id
+    );
+    if (!db_prepare_stmt(db, state_sql, &state_stmt)) {
+        OUT(1);
+    }
+    if (!db_prepare_stmt(db, "PRAGMA data_version", &version_stmt)) {
+        OUT(1);
+    }
+    if (q->nfields > 0) {
+        if (!get_query_build_sql(q, &sql) || !db_prepare_stmt(db, sql.str, &get_stmt)) {
+            OUT(1);
+        }
+    }
+
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        log_print(ERR, "failed to init inotify: %s", strerror(errno));
+        OUT(1);
+    }
+    /* watch the directory, not files, because WAL is created and deleted on the fly */
+    const uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_DELETE;
+    if (inotify_add_watch(inotify_fd, db_dir, mask) < 0) {
+        log_print(ERR, "failed to watch %s: %s", db_dir, strerror(errno));
+        OUT(1);
+    }
+
+    int64_t data_version = get_data_version(db, version_stmt);
+    if (!load_state(db, state_stmt, &old)) {
+        OUT(1);
+    }
+
+    log_print(DEBUG, "watching %s for changes", db_path);
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t len = read(inotify_fd, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_print(ERR, "failed to read inotify events: %s", strerror(errno));
+            OUT(1);
+        }
+
+        bool relevant = false;
+        for (char* p = buf; p < buf + len; ) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            if (ev->len > 0 && (STREQ(ev->name, db_name) || STREQ(ev->name, wal_name))) {
+                relevant = true;
+            }
+            p += sizeof(*ev) + ev->len;
+        }
+        if (!relevant) {
+            continue;
+        }
+
+        /* only changes when someone else commits, filters out checkpoints and partial writes */
+        const int64_t new_data_version = get_data_version(db, version_stmt);
+        if (new_data_version == data_version) {
+            continue;
+        }
+        data_version = new_data_version;
+
+        if (!load_state(db, state_stmt, &new)) {
+            OUT(1);
+        }
+        if (!print_diff(&old, &new, get_stmt, q->nfields)) {
+            OUT(1);
+        }
+
+        state_free(&old);
+        old = new;
+        new = (struct state){0};
+    }
+
+out:
+    state_free(&old);
+    state_free(&new);
+    string_free(&sql);
+    sqlite3_finalize(state_stmt);
+    sqlite3_finalize(version_stmt);
+    sqlite3_finalize(get_stmt);
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+    return retcode;
+}
+
+void action_watch(int argc, char** argv, struct sqlite3* db) {
+    int retcode = 0;
+
+    struct get_query q = {0};
+
+    RESET_GETOPT();
+    int opt;
+    while ((opt = getopt(argc, argv, ":h")) != -1) {
+        switch (opt) {
+        case 'h':
+            print_help();
+            OUT(0);
+        case '?':
+            log_print(ERR, "unknown option: %c", optopt);
+            OUT(1);
+        case ':':
+            log_print(ERR, "missing arg for %c", optopt);
+            OUT(1);
+        default:
+            log_print(ERR, "error while parsing command line options");
+            OUT(1);
+        }
+    }
+    argc = argc - optind;
+    argv = &argv[optind];
+
+    if (argc < 1) {
+        static char default_fields[] = "mime_type,preview";
+        q.nfields = build_field_list(default_fields, q.fields);
+    } else if (argc == 1) {
+        q.nfields = build_field_list(argv[0], q.fields);
+        if (q.nfields < 1) {
+            OUT(1);
+        }
+    } else {
+        log_print(ERR, "extra arguments on the command line");
+        OUT(1);
+    }
+
+    if (db == NULL) {
+        struct proto_msg msg = {0};
+        proto_msg_reset(&msg, PROTO_WATCH);
+        get_query_encode(&q, &msg);
+        OUT(client_request(&msg));
+    }
+
+    OUT(watch_db(db, &q));
+
+out:
+    sqlite3_close(db);
+    client_disconnect();
+    exit(retcode);
+}
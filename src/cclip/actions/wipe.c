@@ -24,7 +24,10 @@
 #include <sqlite3.h>
 
 #include "actions.h"
+#include "../client.h"
+#include "../bulk.h"
 #include "db.h"
+#include "macros.h"
 #include "log.h"
 
 static void print_help(void) {
@@ -40,8 +43,13 @@ static void print_help(void) {
     fputs(help, stdout);
 }
 
+static void bind_max_id(struct sqlite3_stmt* stmt, const void* data) {
+    STMT_BIND(stmt, int64, "@max_id", *(const int64_t*)data);
+}
+
 void action_wipe(int argc, char** argv, struct sqlite3* db) {
     int retcode = 0;
+    struct sqlite3_stmt* stmt = NULL;
 
     bool preserve_tagged = true;
     bool secure_delete = false;
@@ -82,21 +90,56 @@ void action_wipe(int argc, char** argv, struct sqlite3* db) {
         OUT(1);
     }
 
-    const char* sql;
+    /* entries saved by cclipd while we are wiping are left alone */
+    if (!db_prepare_stmt(db, "SELECT coalesce(max(id), 0) FROM history", &stmt)) {
+        OUT(1);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        log_print(ERR, "sqlite error: %s", sqlite3_errmsg(db));
+        OUT(1);
+    }
+    const int64_t max_id = sqlite3_column_int64(stmt, 0);
+    /* don't keep read transaction open while deleting */
+    sqlite3_reset(stmt);
+
+    struct bulk_delete op = {
+        .what = "entries",
+        .bind = bind_max_id,
+        .data = &max_id,
+        .notify = PROTO_CHANGE_DELETE,
+    };
     if (preserve_tagged) {
-        sql = "DELETE FROM history WHERE id NOT IN ( SELECT entry_id FROM history_tags )";
+        op.count_sql = TOSTRING(
+            SELECT count(*) FROM history AS h WHERE h.id <= @max_id
+            AND NOT EXISTS ( SELECT 1 FROM history_tags WHERE entry_id = h.id );
+        );
+        op.delete_sql = TOSTRING(
+            DELETE FROM history WHERE id IN (
+                SELECT h.id FROM history AS h WHERE h.id > @after AND h.id <= @max_id
+                AND NOT EXISTS ( SELECT 1 FROM history_tags WHERE entry_id = h.id )
+                ORDER BY h.id LIMIT @limit
+            ) RETURNING id;
+        );
     } else {
-        sql = "DELETE FROM history";
+        op.count_sql = TOSTRING(
+            SELECT count(*) FROM history WHERE id <= @max_id;
+        );
+        op.delete_sql = TOSTRING(
+            DELETE FROM history WHERE id IN (
+                SELECT id FROM history WHERE id > @after AND id <= @max_id
+                ORDER BY id LIMIT @limit
+            ) RETURNING id;
+        );
     }
 
-    char* errmsg;
-    if (sqlite3_exec(db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
-        log_print(ERR, "sqlite error: %s", errmsg);
+    if (bulk_delete(db, &op) < 0) {
         OUT(1);
     }
 
 out:
+    sqlite3_finalize(stmt);
     sqlite3_close(db);
+    client_disconnect();
     exit(retcode);
 }
 
@@ -0,0 +1,438 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "archive.h"
+#include "collections/vec.h"
+#include "io.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "log.h"
+
+/* records are buffered up to this size, bigger payloads are written directly */
+#define ARCHIVE_BUFFER_SIZE (256 * 1024)
+/* guards against allocating absurd amounts of memory when reading corrupted archives */
+#define ARCHIVE_MAX_STRING_SIZE (16 * 1024 * 1024)
+#define ARCHIVE_MAX_DATA_SIZE (1024ull * 1024 * 1024)
+#define ARCHIVE_ZSTD_LEVEL 3
+
+struct archive_header {
+    char magic[8];
+    uint8_t version[4];
+    uint8_t flags[4];
+};
+
+static void put_le(uint8_t* dst, uint64_t val, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        dst[i] = val >> (i * 8);
+    }
+}
+
+static uint64_t get_le(const uint8_t* src, size_t size) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < size; i++) {
+        val |= (uint64_t)src[i] << (i * 8);
+    }
+    return val;
+}
+
+bool archive_zstd_supported(void) {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+struct archive_writer {
+    int fd;
+    uint64_t count;
+    VEC(uint8_t) buf;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx* zstd;
+    uint8_t* zbuf;
+    size_t zbuf_size;
+#endif
+};
+
+/* writes (compressing if needed) size bytes, end finishes the zstd stream */
+static bool writer_push(struct archive_writer* w, const void* data, size_t size, bool end) {
+#ifdef HAVE_ZSTD
+    if (w->zstd != NULL) {
+        ZSTD_inBuffer in = { .src = data, .size = size, .pos = 0 };
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out = { .dst = w->zbuf, .size = w->zbuf_size, .pos = 0 };
+            remaining = ZSTD_compressStream2(w->zstd, &out, &in,
+                                             end ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                log_print(ERR, "failed to compress archive: %s", ZSTD_getErrorName(remaining));
+                return false;
+            }
+            struct iovec iov = { .iov_base = w->zbuf, .iov_len = out.pos };
+            if (out.pos > 0 && !writev_full(w->fd, &iov, 1)) {
+                log_print(ERR, "failed to write archive: %s", strerror(errno));
+                return false;
+            }
+        } while (end ? remaining != 0 : in.pos < in.size);
+        return true;
+    }
+#endif
+
+    struct iovec iov = { .iov_base = (void*)data, .iov_len = size };
+    if (size > 0 && !writev_full(w->fd, &iov, 1)) {
+        log_print(ERR, "failed to write archive: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static bool writer_flush(struct archive_writer* w) {
+    const bool ret = writer_push(w, w->buf.data, w->buf.size, false);
+    VEC_CLEAR(&w->buf);
+    return ret;
+}
+
+static void writer_put_int(struct archive_writer* w, uint64_t val, size_t size) {
+    put_le(VEC_EMPLACE_BACK_N(&w->buf, size), val, size);
+}
+
+static void writer_put_str(struct archive_writer* w, const char* str) {
+    const size_t len = strlen(str);
+    writer_put_int(w, len, 4);
+    VEC_APPEND_N(&w->buf, (uint8_t*)str, len);
+}
+
+struct archive_writer* archive_writer_open(int fd, bool compress) {
+    struct archive_writer* w = xcalloc(1, sizeof(*w));
+    w->fd = fd;
+
+    if (compress) {
+#ifdef HAVE_ZSTD
+        w->zstd = ZSTD_createCCtx();
+        if (w->zstd == NULL) {
+            log_print(ERR, "failed to create zstd context");
+            goto err;
+        }
+        ZSTD_CCtx_setParameter(w->zstd, ZSTD_c_compressionLevel, ARCHIVE_ZSTD_LEVEL);
+        w->zbuf_size = ZSTD_CStreamOutSize();
+        w->zbuf = xmalloc(w->zbuf_size);
+#else
+        log_print(ERR, "cclip was built without zstd support");
+        goto err;
+#endif
+    }
+
+    struct archive_header header = { .magic = ARCHIVE_MAGIC };
+    put_le(header.version, ARCHIVE_VERSION, sizeof(header.version));
+    put_le(header.flags, compress ? ARCHIVE_FLAG_ZSTD : 0, sizeof(header.flags));
+
+    /* header is never compressed */
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    if (!writev_full(fd, &iov, 1)) {
+        log_print(ERR, "failed to write archive: %s", strerror(errno));
+        goto err;
+    }
+
+    return w;
+
+err:
+    archive_writer_abort(w);
+    return NULL;
+}
+
+bool archive_write_entry(struct archive_writer* w, const struct archive_entry* e) {
+    writer_put_int(w, ARCHIVE_RECORD_ENTRY, 1);
+    writer_put_int(w, e->data_hash, 8);
+    writer_put_int(w, e->timestamp, 8);
+    writer_put_str(w, e->mime_type);
+    writer_put_str(w, e->preview);
+    writer_put_str(w, e->tags);
+    writer_put_int(w, e->data_size, 8);
+
+    if (e->data_size >= ARCHIVE_BUFFER_SIZE) {
+        /* don't copy big payloads around */
+        if (!writer_flush(w) || !writer_push(w, e->data, e->data_size, false)) {
+            return false;
+        }
+    } else {
+        VEC_APPEND_N(&w->buf, (uint8_t*)e->data, e->data_size);
+        if (VEC_SIZE(&w->buf) >= ARCHIVE_BUFFER_SIZE && !writer_flush(w)) {
+            return false;
+        }
+    }
+
+    w->count += 1;
+    return true;
+}
+
+bool archive_writer_close(struct archive_writer* w) {
+    writer_put_int(w, ARCHIVE_RECORD_END, 1);
+    writer_put_int(w, w->count, 8);
+
+    const bool ret = writer_push(w, w->buf.data, w->buf.size, true);
+    archive_writer_abort(w);
+    return ret;
+}
+
+void archive_writer_abort(struct archive_writer* w) {
+#ifdef HAVE_ZSTD
+    ZSTD_freeCCtx(w->zstd);
+    free(w->zbuf);
+#endif
+    VEC_FREE(&w->buf);
+    free(w);
+}
+
+struct archive_reader {
+    int fd;
+    uint64_t count;
+
+    /* bytes read from fd */
+    uint8_t* in;
+    size_t in_pos, in_len;
+#ifdef HAVE_ZSTD
+    /* decompressed bytes, if archive is compressed */
+    ZSTD_DCtx* zstd;
+    uint8_t* out;
+    size_t out_size, out_pos, out_len;
+#endif
+
+    /* strings and payload of the current entry */
+    VEC(uint8_t) entry;
+};
+
+/* returns false on error or EOF, *eof tells which one */
+static bool reader_fill_raw(struct archive_reader* r, bool* eof) {
+    ssize_t ret;
+    do {
+        ret = read(r->fd, r->in, ARCHIVE_BUFFER_SIZE);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        log_print(ERR, "failed to read archive: %s", strerror(errno));
+        *eof = false;
+        return false;
+    } else if (ret == 0) {
+        *eof = true;
+        return false;
+    }
+
+    r->in_pos = 0;
+    r->in_len = ret;
+    return true;
+}
+
+static bool reader_read(struct archive_reader* r, void* dst, size_t size) {
+    uint8_t* p = dst;
+    bool eof = false;
+
+    while (size > 0) {
+#ifdef HAVE_ZSTD
+        if (r->zstd != NULL) {
+            if (r->out_pos == r->out_len) {
+                /* if output buffer was filled last time, decoder may still have more */
+                const bool pending = r->out_len == r->out_size;
+                if (r->in_pos == r->in_len && !pending && !reader_fill_raw(r, &eof)) {
+                    goto err;
+                }
+                ZSTD_inBuffer in = { .src = r->in, .size = r->in_len, .pos = r->in_pos };
+                ZSTD_outBuffer out = { .dst = r->out, .size = r->out_size, .pos = 0 };
+                const size_t ret = ZSTD_decompressStream(r->zstd, &out, &in);
+                if (ZSTD_isError(ret)) {
+                    log_print(ERR, "failed to decompress archive: %s", ZSTD_getErrorName(ret));
+                    return false;
+                }
+                r->in_pos = in.pos;
+                r->out_pos = 0;
+                r->out_len = out.pos;
+                continue;
+            }
+
+            const size_t n = MIN(size, r->out_len - r->out_pos);
+            memcpy(p, &r->out[r->out_pos], n);
+            r->out_pos += n;
+            p += n;
+            size -= n;
+            continue;
+        }
+#endif
+
+        if (r->in_pos == r->in_len && !reader_fill_raw(r, &eof)) {
+            goto err;
+        }
+        const size_t n = MIN(size, r->in_len - r->in_pos);
+        memcpy(p, &r->in[r->in_pos], n);
+        r->in_pos += n;
+        p += n;
+        size -= n;
+    }
+
+    return true;
+
+err:
+    if (eof) {
+        log_print(ERR, "archive is truncated");
+    }
+    return false;
+}
+
+static bool reader_get_int(struct archive_reader* r, uint64_t* val, size_t size) {
+    uint8_t buf[8];
+    if (!reader_read(r, buf, size)) {
+        return false;
+    }
+    *val = get_le(buf, size);
+    return true;
+}
+
+/* appends NUL terminated string to r->entry, returns its offset or -1 on error */
+static int64_t reader_get_str(struct archive_reader* r) {
+    uint64_t len;
+    if (!reader_get_int(r, &len, 4)) {
+        return -1;
+    } else if (len > ARCHIVE_MAX_STRING_SIZE) {
+        log_print(ERR, "archive is corrupted: string of size %lu", len);
+        return -1;
+    }
+
+    const size_t offset = VEC_SIZE(&r->entry);
+    uint8_t* str = VEC_EMPLACE_BACK_N(&r->entry, len + 1);
+    if (!reader_read(r, str, len)) {
+        return -1;
+    }
+    str[len] = '\0';
+
+    return offset;
+}
+
+struct archive_reader* archive_reader_open(int fd) {
+    struct archive_reader* r = xcalloc(1, sizeof(*r));
+    r->fd = fd;
+    r->in = xmalloc(ARCHIVE_BUFFER_SIZE);
+
+    struct archive_header header;
+    if (!reader_read(r, &header, sizeof(header))) {
+        goto err;
+    }
+    if (memcmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic)) != 0) {
+        log_print(ERR, "not a cclip archive");
+        goto err;
+    }
+
+    const uint32_t version = get_le(header.version, sizeof(header.version));
+    const uint32_t flags = get_le(header.flags, sizeof(header.flags));
+    if (version != ARCHIVE_VERSION) {
+        log_print(ERR, "unsupported archive version %u", version);
+        goto err;
+    }
+
+    if (flags & ARCHIVE_FLAG_ZSTD) {
+#ifdef HAVE_ZSTD
+        r->zstd = ZSTD_createDCtx();
+        if (r->zstd == NULL) {
+            log_print(ERR, "failed to create zstd context");
+            goto err;
+        }
+        r->out_size = ZSTD_DStreamOutSize();
+        r->out = xmalloc(r->out_size);
+#else
+        log_print(ERR, "archive is compressed, but cclip was built without zstd support");
+        goto err;
+#endif
+    }
+
+    return r;
+
+err:
+    archive_reader_close(r);
+    return NULL;
+}
+
+int archive_read_entry(struct archive_reader* r, struct archive_entry* e) {
+    uint64_t type, val;
+    if (!reader_get_int(r, &type, 1)) {
+        return -1;
+    }
+
+    if (type == ARCHIVE_RECORD_END) {
+        if (!reader_get_int(r, &val, 8)) {
+            return -1;
+        } else if (val != r->count) {
+            log_print(ERR, "archive is corrupted: has %lu entries, expected %lu", r->count, val);
+            return -1;
+        }
+        return 0;
+    } else if (type != ARCHIVE_RECORD_ENTRY) {
+        log_print(ERR, "archive is corrupted: unknown record type %lu", type);
+        return -1;
+    }
+
+    VEC_CLEAR(&r->entry);
+
+    if (!reader_get_int(r, &val, 8)) {
+        return -1;
+    }
+    e->data_hash = val;
+    if (!reader_get_int(r, &val, 8)) {
+        return -1;
+    }
+    e->timestamp = val;
+
+    const int64_t mime_type = reader_get_str(r);
+    const int64_t preview = mime_type < 0 ? -1 : reader_get_str(r);
+    const int64_t tags = preview < 0 ? -1 : reader_get_str(r);
+    if (tags < 0 || !reader_get_int(r, &e->data_size, 8)) {
+        return -1;
+    } else if (e->data_size > ARCHIVE_MAX_DATA_SIZE) {
+        log_print(ERR, "archive is corrupted: entry of size %lu", e->data_size);
+        return -1;
+    }
+
+    const size_t data = VEC_SIZE(&r->entry);
+    if (!reader_read(r, VEC_EMPLACE_BACK_N(&r->entry, e->data_size), e->data_size)) {
+        return -1;
+    }
+
+    /* only now, after r->entry stopped growing */
+    e->mime_type = (const char*)&r->entry.data[mime_type];
+    e->preview = (const char*)&r->entry.data[preview];
+    e->tags = (const char*)&r->entry.data[tags];
+    e->data = &r->entry.data[data];
+
+    r->count += 1;
+    return 1;
+}
+
+void archive_reader_close(struct archive_reader* r) {
+#ifdef HAVE_ZSTD
+    ZSTD_freeDCtx(r->zstd);
+    free(r->out);
+#endif
+    free(r->in);
+    VEC_FREE(&r->entry);
+    free(r);
+}
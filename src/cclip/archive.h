@@ -0,0 +1,82 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Archive format used by cclip export and cclip import.
+ *
+ * All integers are little endian. File starts with a header:
+ *     char magic[8] = ARCHIVE_MAGIC, u32 version = ARCHIVE_VERSION, u32 flags
+ * If flags has ARCHIVE_FLAG_ZSTD set, everything after the header is one zstd stream.
+ *
+ * Header is followed by records, each starting with u8 record type:
+ *     ARCHIVE_RECORD_ENTRY: i64 data_hash, i64 timestamp, str mime_type, str preview,
+ *                           str tags (separated by newlines), u64 data_size, data
+ *     ARCHIVE_RECORD_END:   u64 number of entries in archive
+ * where str is u32 length followed by that many bytes, without terminating NUL.
+ * Archive must end with ARCHIVE_RECORD_END, otherwise it is considered truncated.
+ */
+
+#define ARCHIVE_MAGIC "CCLIPEXP"
+#define ARCHIVE_VERSION 1
+
+#define ARCHIVE_FLAG_ZSTD (1u << 0)
+
+enum archive_record_type {
+    ARCHIVE_RECORD_END = 0,
+    ARCHIVE_RECORD_ENTRY = 1,
+};
+
+struct archive_entry {
+    int64_t data_hash;
+    int64_t timestamp;
+    const char* mime_type;
+    const char* preview;
+    const char* tags; /* separated by newlines, empty if there are none */
+    const void* data;
+    uint64_t data_size;
+};
+
+/* true if this build can read and write compressed archives */
+bool archive_zstd_supported(void);
+
+struct archive_writer;
+
+/* returns NULL on failure */
+struct archive_writer* archive_writer_open(int fd, bool compress);
+bool archive_write_entry(struct archive_writer* w, const struct archive_entry* e);
+/* writes end record and flushes everything, frees w */
+bool archive_writer_close(struct archive_writer* w);
+/* frees w without finishing the archive, for error paths */
+void archive_writer_abort(struct archive_writer* w);
+
+struct archive_reader;
+
+/* reads and checks the header, returns NULL on failure */
+struct archive_reader* archive_reader_open(int fd);
+/*
+ * Returns 1 and fills e if there is an entry, 0 at the end of archive, -1 on error.
+ * Pointers in e are valid until next call.
+ */
+int archive_read_entry(struct archive_reader* r, struct archive_entry* e);
+void archive_reader_close(struct archive_reader* r);
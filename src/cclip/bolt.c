@@ -0,0 +1,378 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "bolt.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "log.h"
+
+#define BOLT_MAGIC 0xED0CDAED
+#define BOLT_VERSION 2
+
+#define BOLT_PAGE_HEADER_SIZE 16
+#define BOLT_ELEMENT_SIZE 16
+#define BOLT_BUCKET_HEADER_SIZE 16
+/* checksum covers everything in meta before it */
+#define BOLT_META_CHECKSUM_OFFSET 56
+#define BOLT_META_SIZE 64
+
+#define BOLT_PAGE_BRANCH 0x01
+#define BOLT_PAGE_LEAF 0x02
+#define BOLT_PAGE_META 0x04
+
+#define BOLT_LEAF_BUCKET 0x01
+
+/* B+tree of a billion entries is nowhere near this deep, deeper means a loop in corrupted file */
+#define BOLT_MAX_DEPTH 32
+
+struct bolt_db {
+    const char* path;
+    int fd;
+    const uint8_t* map;
+    size_t map_size;
+
+    size_t page_size;
+    uint64_t root_pgid;
+    uint64_t high_water_pgid;
+};
+
+struct bolt_page {
+    const uint8_t* data;
+    size_t size;
+    unsigned flags;
+    unsigned count;
+};
+
+struct bolt_cursor {
+    struct bolt_db* db;
+    struct {
+        struct bolt_page page;
+        unsigned index;
+    } stack[BOLT_MAX_DEPTH];
+    int depth;
+};
+
+static uint64_t get_le(const uint8_t* src, size_t size) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < size; i++) {
+        val |= (uint64_t)src[i] << (i * 8);
+    }
+    return val;
+}
+
+static uint64_t fnv1a_64(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static bool page_from(const uint8_t* data, size_t size, struct bolt_page* page) {
+    if (size < BOLT_PAGE_HEADER_SIZE) {
+        return false;
+    }
+
+    page->data = data;
+    page->size = size;
+    page->flags = get_le(data + 8, 2);
+    page->count = get_le(data + 10, 2);
+
+    return BOLT_PAGE_HEADER_SIZE + (uint64_t)page->count * BOLT_ELEMENT_SIZE <= size;
+}
+
+static bool get_page(struct bolt_db* db, uint64_t pgid, struct bolt_page* page) {
+    /* first two pages are meta pages */
+    if (pgid < 2 || pgid >= db->high_water_pgid) {
+        goto corrupted;
+    }
+
+    const uint64_t offset = pgid * db->page_size;
+    if (offset + BOLT_PAGE_HEADER_SIZE > db->map_size) {
+        goto corrupted;
+    }
+
+    const uint64_t overflow = get_le(db->map + offset + 12, 4);
+    const uint64_t size = (overflow + 1) * db->page_size;
+    if (offset + size > db->map_size || !page_from(db->map + offset, size, page)) {
+        goto corrupted;
+    }
+
+    if (page->flags != BOLT_PAGE_BRANCH && page->flags != BOLT_PAGE_LEAF) {
+        goto corrupted;
+    }
+
+    return true;
+
+corrupted:
+    log_print(ERR, "%s: corrupted database, bad page %lu", db->path, pgid);
+    return false;
+}
+
+/* reads meta page at offset, returns txid + 1 or 0 if it's not valid */
+static uint64_t read_meta(struct bolt_db* db, size_t offset, size_t page_size) {
+    if (offset + BOLT_PAGE_HEADER_SIZE + BOLT_META_SIZE > db->map_size) {
+        return 0;
+    }
+
+    const uint8_t* page = db->map + offset;
+    const uint8_t* meta = page + BOLT_PAGE_HEADER_SIZE;
+    if (get_le(page + 8, 2) != BOLT_PAGE_META
+        || get_le(meta + 0, 4) != BOLT_MAGIC || get_le(meta + 4, 4) != BOLT_VERSION
+        || get_le(meta + 8, 4) != page_size
+        || get_le(meta + BOLT_META_CHECKSUM_OFFSET, 8)
+           != fnv1a_64(meta, BOLT_META_CHECKSUM_OFFSET)) {
+        return 0;
+    }
+
+    /* fresh file has txid 0, shift it so 0 can mean invalid */
+    return get_le(meta + 48, 8) + 1;
+}
+
+/* picks the newest valid meta page, as bbolt does */
+static bool load_meta(struct bolt_db* db) {
+    static const size_t page_sizes[] = { 4096, 8192, 16384, 32768, 65536 };
+
+    /* page size is recorded in meta, but second meta page can only be found if it's known */
+    size_t page_size = 0;
+    if (db->map_size >= BOLT_PAGE_HEADER_SIZE + BOLT_META_SIZE) {
+        page_size = get_le(db->map + BOLT_PAGE_HEADER_SIZE + 8, 4);
+        if (read_meta(db, 0, page_size) == 0) {
+            page_size = 0;
+        }
+    }
+
+    for (size_t i = 0; page_size == 0 && i < SIZEOF_ARRAY(page_sizes); i++) {
+        if (read_meta(db, page_sizes[i], page_sizes[i]) != 0) {
+            page_size = page_sizes[i];
+        }
+    }
+
+    if (page_size == 0) {
+        log_print(ERR, "%s: not a bbolt database", db->path);
+        return false;
+    }
+
+    const uint64_t txid0 = read_meta(db, 0, page_size);
+    const uint64_t txid1 = read_meta(db, page_size, page_size);
+    const uint8_t* meta = db->map + (txid1 > txid0 ? page_size : 0) + BOLT_PAGE_HEADER_SIZE;
+
+    db->page_size = page_size;
+    db->root_pgid = get_le(meta + 16, 8);
+    db->high_water_pgid = get_le(meta + 40, 8);
+
+    log_print(DEBUG, "%s: page size %zu, root page %lu, %lu pages",
+              db->path, db->page_size, db->root_pgid, db->high_water_pgid);
+
+    return true;
+}
+
+struct bolt_db* bolt_open(const char* path) {
+    struct bolt_db* db = xcalloc(1, sizeof(*db));
+    db->path = path;
+    db->map = MAP_FAILED;
+
+    db->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (db->fd < 0) {
+        log_print(ERR, "failed to open %s: %s", path, strerror(errno));
+        goto err;
+    }
+
+    /* bbolt writers hold an exclusive lock for as long as the database is open */
+    if (flock(db->fd, LOCK_SH | LOCK_NB) < 0) {
+        if (errno == EWOULDBLOCK) {
+            log_print(ERR, "%s is locked by another process", path);
+        } else {
+            log_print(ERR, "failed to lock %s: %s", path, strerror(errno));
+        }
+        goto err;
+    }
+
+    struct stat st;
+    if (fstat(db->fd, &st) < 0) {
+        log_print(ERR, "failed to stat %s: %s", path, strerror(errno));
+        goto err;
+    }
+    db->map_size = st.st_size;
+    if (db->map_size == 0) {
+        log_print(ERR, "%s: not a bbolt database", path);
+        goto err;
+    }
+
+    db->map = mmap(NULL, db->map_size, PROT_READ, MAP_SHARED, db->fd, 0);
+    if (db->map == MAP_FAILED) {
+        log_print(ERR, "failed to map %s: %s", path, strerror(errno));
+        goto err;
+    }
+
+    if (!load_meta(db)) {
+        goto err;
+    }
+
+    return db;
+
+err:
+    bolt_close(db);
+    return NULL;
+}
+
+void bolt_close(struct bolt_db* db) {
+    if (db == NULL) {
+        return;
+    }
+
+    if (db->map != MAP_FAILED) {
+        munmap((void*)db->map, db->map_size);
+    }
+    if (db->fd >= 0) {
+        close(db->fd);
+    }
+    free(db);
+}
+
+static bool cursor_push(struct bolt_cursor* c, const struct bolt_page* page) {
+    if (c->depth >= BOLT_MAX_DEPTH) {
+        log_print(ERR, "%s: corrupted database, tree is too deep", c->db->path);
+        return false;
+    }
+
+    c->stack[c->depth].page = *page;
+    c->stack[c->depth].index = 0;
+    c->depth += 1;
+
+    return true;
+}
+
+/* like bolt_cursor_next, but also returns nested buckets, with *is_bucket set to true */
+static int cursor_step(struct bolt_cursor* c, struct bolt_kv* kv, bool* is_bucket) {
+    while (c->depth > 0) {
+        const struct bolt_page* page = &c->stack[c->depth - 1].page;
+        const unsigned index = c->stack[c->depth - 1].index++;
+        if (index >= page->count) {
+            c->depth -= 1;
+            continue;
+        }
+
+        const uint64_t elem = BOLT_PAGE_HEADER_SIZE + (uint64_t)index * BOLT_ELEMENT_SIZE;
+        const uint8_t* p = page->data + elem;
+
+        if (page->flags == BOLT_PAGE_BRANCH) {
+            struct bolt_page child;
+            if (!get_page(c->db, get_le(p + 8, 8), &child) || !cursor_push(c, &child)) {
+                return -1;
+            }
+            continue;
+        }
+
+        /* positions are relative to the element itself */
+        const uint64_t key_offset = elem + get_le(p + 4, 4);
+        const uint64_t key_size = get_le(p + 8, 4);
+        const uint64_t value_size = get_le(p + 12, 4);
+        if (key_offset + key_size + value_size > page->size) {
+            log_print(ERR, "%s: corrupted database, bad leaf element", c->db->path);
+            return -1;
+        }
+
+        *is_bucket = get_le(p + 0, 4) & BOLT_LEAF_BUCKET;
+        kv->key = page->data + key_offset;
+        kv->key_size = key_size;
+        kv->value = page->data + key_offset + key_size;
+        kv->value_size = value_size;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static struct bolt_cursor* cursor_open(struct bolt_db* db, const struct bolt_page* root) {
+    struct bolt_cursor* c = xcalloc(1, sizeof(*c));
+    c->db = db;
+    cursor_push(c, root);
+    return c;
+}
+
+struct bolt_cursor* bolt_cursor_open(struct bolt_db* db, const char* bucket, bool* missing) {
+    *missing = false;
+
+    struct bolt_page root;
+    if (!get_page(db, db->root_pgid, &root)) {
+        return NULL;
+    }
+
+    /* top-level buckets are values of the root bucket */
+    struct bolt_cursor* c = cursor_open(db, &root);
+    const size_t bucket_len = strlen(bucket);
+    struct bolt_kv kv;
+    bool is_bucket;
+    int ret;
+    while ((ret = cursor_step(c, &kv, &is_bucket)) > 0) {
+        if (is_bucket && kv.key_size == bucket_len && memcmp(kv.key, bucket, bucket_len) == 0) {
+            break;
+        }
+    }
+    bolt_cursor_close(c);
+
+    if (ret <= 0) {
+        *missing = ret == 0;
+        return NULL;
+    } else if (kv.value_size < BOLT_BUCKET_HEADER_SIZE) {
+        log_print(ERR, "%s: corrupted database, bad bucket %s", db->path, bucket);
+        return NULL;
+    }
+
+    /* small buckets are stored inline, right after the header */
+    struct bolt_page page;
+    const uint64_t pgid = get_le(kv.value, 8);
+    if (pgid == 0) {
+        if (!page_from((const uint8_t*)kv.value + BOLT_BUCKET_HEADER_SIZE,
+                       kv.value_size - BOLT_BUCKET_HEADER_SIZE, &page)
+            || page.flags != BOLT_PAGE_LEAF) {
+            log_print(ERR, "%s: corrupted database, bad bucket %s", db->path, bucket);
+            return NULL;
+        }
+    } else if (!get_page(db, pgid, &page)) {
+        return NULL;
+    }
+
+    return cursor_open(db, &page);
+}
+
+int bolt_cursor_next(struct bolt_cursor* c, struct bolt_kv* kv) {
+    bool is_bucket;
+    int ret;
+    while ((ret = cursor_step(c, kv, &is_bucket)) > 0 && is_bucket) {
+        /* nested buckets are not supported, skip them */
+    }
+
+    return ret;
+}
+
+void bolt_cursor_close(struct bolt_cursor* c) {
+    free(c);
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Minimal read-only reader for bbolt (go.etcd.io/bbolt) database files,
+ * used to import history of clipboard managers that keep it in one (cliphist).
+ *
+ * File is mapped into memory and only ever read, so keys and values point directly
+ * into the mapping and stay valid until bolt_close(). Only top-level buckets can be
+ * opened, nested buckets inside them are skipped. Integers are assumed to be little
+ * endian, as bbolt writes them in native byte order and is in practice used on
+ * little endian machines only.
+ */
+
+struct bolt_db;
+struct bolt_cursor;
+
+struct bolt_kv {
+    const void* key;
+    size_t key_size;
+    const void* value;
+    size_t value_size;
+};
+
+/* takes a shared lock on the file, fails if bbolt writer holds it. returns NULL on failure */
+struct bolt_db* bolt_open(const char* path);
+void bolt_close(struct bolt_db* db);
+
+/* returns NULL if there is no such bucket or on error, *missing tells which one */
+struct bolt_cursor* bolt_cursor_open(struct bolt_db* db, const char* bucket, bool* missing);
+/*
+ * Returns 1 and fills kv with next key/value pair in key order, 0 at the end, -1 on error.
+ */
+int bolt_cursor_next(struct bolt_cursor* c, struct bolt_kv* kv);
+void bolt_cursor_close(struct bolt_cursor* c);
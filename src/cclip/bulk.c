@@ -0,0 +1,153 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "bulk.h"
+#include "client.h"
+#include "collections/vec.h"
+#include "db.h"
+#include "macros.h"
+#include "log.h"
+
+#define MIN_CHUNK 16
+#define MAX_CHUNK 16384
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int compare_ids(const void* a, const void* b) {
+    const int64_t x = *(const int64_t*)a;
+    const int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_progress(const struct bulk_delete* op, int64_t done, int64_t total, bool last) {
+    fprintf(stderr, "\rdeleting %s: %li/%li%s", op->what, done, total, last ? "\n" : "");
+}
+
+int64_t bulk_delete(struct sqlite3* db, const struct bulk_delete* op) {
+    struct sqlite3_stmt* count_stmt = NULL;
+    struct sqlite3_stmt* delete_stmt = NULL;
+    VEC(int64_t) changed = {0};
+    int64_t deleted = -1;
+
+    const bool show_progress = isatty(2);
+    int64_t total = 0;
+    if (show_progress) {
+        if (!db_prepare_stmt(db, op->count_sql, &count_stmt)) {
+            goto out;
+        }
+        if (op->bind != NULL) {
+            op->bind(count_stmt, op->data);
+        }
+        if (sqlite3_step(count_stmt) != SQLITE_ROW) {
+            log_print(ERR, "failed to count %s: %s", op->what, sqlite3_errmsg(db));
+            goto out;
+        }
+        total = sqlite3_column_int64(count_stmt, 0);
+        sqlite3_finalize(count_stmt);
+        count_stmt = NULL;
+    }
+
+    if (!db_prepare_stmt(db, op->delete_sql, &delete_stmt)) {
+        goto out;
+    }
+    if (op->bind != NULL) {
+        op->bind(delete_stmt, op->data);
+    }
+
+    int64_t done = 0;
+    int64_t after = -1;
+    int64_t chunk = 128;
+    while (true) {
+        STMT_BIND(delete_stmt, int64, "@limit", chunk);
+        STMT_BIND(delete_stmt, int64, "@after", after);
+
+        const int64_t start = now_ms();
+
+        if (!db_begin_write(db)) {
+            goto out;
+        }
+
+        int64_t nrows = 0;
+        int rc;
+        while ((rc = sqlite3_step(delete_stmt)) == SQLITE_ROW) {
+            int64_t id = sqlite3_column_int64(delete_stmt, 0);
+            VEC_APPEND(&changed, &id);
+            after = MAX(after, id);
+            nrows += 1;
+        }
+        sqlite3_reset(delete_stmt);
+        if (rc != SQLITE_DONE) {
+            log_print(ERR, "failed to delete %s: %s", op->what, sqlite3_errmsg(db));
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            goto out;
+        }
+
+        if (sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+            log_print(ERR, "failed to commit: %s", sqlite3_errmsg(db));
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            goto out;
+        }
+        const int64_t elapsed = now_ms() - start;
+
+        /* one entry can be returned several times (once per tag), notify only once */
+        qsort(changed.data, VEC_SIZE(&changed), sizeof(changed.data[0]), compare_ids);
+        VEC_FOREACH(&changed, i) {
+            if (i == 0 || changed.data[i] != changed.data[i - 1]) {
+                client_notify(db, op->notify, changed.data[i]);
+            }
+        }
+        VEC_CLEAR(&changed);
+
+        done += nrows;
+        if (show_progress) {
+            print_progress(op, done, MAX(total, done), false);
+        }
+        log_print(DEBUG, "deleted %li %s in %lims (chunk %li)", nrows, op->what, elapsed, chunk);
+
+        if (nrows < chunk) {
+            break;
+        }
+
+        if (elapsed < BULK_CHUNK_TARGET_MS / 2) {
+            chunk = MIN(chunk * 2, MAX_CHUNK);
+        } else if (elapsed > BULK_CHUNK_TARGET_MS) {
+            chunk = MAX(chunk / 2, MIN_CHUNK);
+        }
+        usleep(BULK_CHUNK_PAUSE_MS * 1000);
+    }
+
+    if (show_progress) {
+        print_progress(op, done, MAX(total, done), true);
+    }
+    deleted = done;
+
+out:
+    VEC_FREE(&changed);
+    sqlite3_finalize(count_stmt);
+    sqlite3_finalize(delete_stmt);
+    return deleted;
+}
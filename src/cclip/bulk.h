@@ -0,0 +1,55 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include <sqlite3.h>
+
+#include "proto.h"
+
+/*
+ * Bulk deletes are split into chunks, each committed separately, so that the
+ * write lock is never held for long and cclipd can keep saving new entries.
+ * Chunk size adapts so that every chunk takes about BULK_CHUNK_TARGET_MS.
+ */
+#define BULK_CHUNK_TARGET_MS 50
+/* pause between chunks to give other writers a chance to grab the lock */
+#define BULK_CHUNK_PAUSE_MS 10
+
+struct bulk_delete {
+    /* what is being deleted, used in progress output */
+    const char* what;
+    /* returns number of rows that will be deleted, for progress output */
+    const char* count_sql;
+    /*
+     * Deletes at most @limit rows (or rows of at most @limit entries)
+     * and returns id of every changed entry with RETURNING.
+     * If it uses @after, it is set to the biggest id returned so far.
+     */
+    const char* delete_sql;
+    /* binds other parameters of both statements, may be NULL */
+    void (*bind)(struct sqlite3_stmt* stmt, const void* data);
+    const void* data;
+    /* cclipd is notified once about every distinct returned id with this change type */
+    enum proto_change_type notify;
+};
+
+/* Returns number of deleted rows or -1 on error. Progress is shown if stderr is a terminal. */
+int64_t bulk_delete(struct sqlite3* db, const struct bulk_delete* op);
@@ -25,6 +25,7 @@
 #include <sqlite3.h>
 
 #include "actions/actions.h"
+#include "client.h"
 #include "xmalloc.h"
 #include "db.h"
 #include "log.h"
@@ -40,10 +41,13 @@ static void print_help_and_exit(FILE* stream, int rc) {
         "cclip - command line interface for cclip database\n"
         "\n"
         "Usage:\n"
-        "    cclip [-Vh] [-d DB_PATH] ACTION ACTION_ARGS\n"
+        "    cclip [-DVh] [-d DB_PATH] [-O PROFILE] ACTION ACTION_ARGS\n"
         "\n"
         "Command line options:\n"
         "    -d DB_PATH    specify path to database file\n"
+        "    -D            always access database directly, do not ask cclipd\n"
+        "    -O PROFILE    storage profile: default, blob-heavy, low-memory,\n"
+        "                  durable or fast\n"
         "    -V            display version and exit\n"
         "    -h            print this help message and exit\n"
         "\n"
@@ -58,6 +62,8 @@ static void print_help_and_exit(FILE* stream, int rc) {
 
 int main(int argc, char** argv) {
     const char* db_path = NULL;
+    const char* profile = NULL;
+    bool use_daemon = true;
     enum loglevel loglevel = WARN;
     struct sqlite3* db = NULL;
 
@@ -65,11 +71,17 @@ int main(int argc, char** argv) {
     putenv("POSIXLY_CORRECT=1");
 
     int opt;
-    while ((opt = getopt(argc, argv, ":d:vVh")) != -1) {
+    while ((opt = getopt(argc, argv, ":d:DO:vVh")) != -1) {
         switch (opt) {
         case 'd':
             db_path = xstrdup(optarg);
             break;
+        case 'D':
+            use_daemon = false;
+            break;
+        case 'O':
+            profile = optarg;
+            break;
         case 'v':
             loglevel += 1;
             break;
@@ -93,6 +105,11 @@ int main(int argc, char** argv) {
 
     log_init(2 /* stderr */, loglevel);
 
+    if (profile != NULL && !db_select_profile(profile)) {
+        log_print(ERR, "unknown storage profile: %s", profile);
+        goto err;
+    }
+
     argc = argc - optind;
     argv = &argv[optind];
     if (argc < 1) {
@@ -100,6 +117,17 @@ int main(int argc, char** argv) {
         goto err;
     }
 
+    const struct action* action = match_action(argv[0]);
+    if (action == NULL) {
+        log_print(ERR, "invalid action: %s", argv[0]);
+        goto err;
+    }
+
+    /* cclipd already has the database open and statements prepared, let it do the work */
+    if (action->remote && use_daemon && client_connect(db_path)) {
+        action->func(argc, argv, NULL);
+    }
+
     db = db_open(db_path, false);
     if (db == NULL) {
         log_print(ERR, "failed to open database");
@@ -117,15 +145,9 @@ int main(int argc, char** argv) {
         goto err;
     }
 
-    action_func_t* action = match_action(argv[0]);
-    if (action == NULL) {
-        log_print(ERR, "invalid action: %s", argv[0]);
-        goto err;
-    }
-
     /* delegate full control to action handler, including cleanup duties.
      * action handler should not return */
-    action(argc, argv, db);
+    action->func(argc, argv, db);
 
     assert(!"unreachable");
 
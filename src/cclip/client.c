@@ -0,0 +1,227 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "client.h"
+#include "proto.h"
+#include "snapshot.h"
+#include "db.h"
+#include "io.h"
+#include "log.h"
+
+/* replies can be arbitrarily big, but they are split into frames of limited size */
+#define MAX_REPLY_FRAME_SIZE PROTO_MAX_DATA_SIZE
+
+static int client_fd = -1;
+
+bool client_connect(const char* db_path) {
+    char real_db_path[PATH_MAX];
+    const char* path = db_get_path(db_path);
+    if (path == NULL || realpath(path, real_db_path) == NULL) {
+        return false;
+    }
+
+    const char* socket_path = proto_socket_path(real_db_path);
+    if (socket_path == NULL) {
+        return false;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        log_print(DEBUG, "failed to connect to cclipd at %s: %s", socket_path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    struct proto_msg msg = {0};
+    proto_msg_reset(&msg, PROTO_HELLO);
+    proto_put_u32(&msg, PROTO_VERSION);
+    proto_put_str(&msg, real_db_path);
+
+    if (!proto_send(fd, &msg) || !proto_recv(fd, &msg, MAX_REPLY_FRAME_SIZE)) {
+        log_print(DEBUG, "failed to greet cclipd");
+        goto err;
+    }
+
+    if (msg.type != PROTO_OK) {
+        const char* reason = NULL;
+        if (msg.type == PROTO_ERROR) {
+            proto_get_str(&msg, &reason);
+        }
+        log_print(DEBUG, "cclipd refused connection: %s", reason ? reason : "unknown reason");
+        goto err;
+    }
+
+    log_print(DEBUG, "connected to cclipd at %s", socket_path);
+    proto_msg_free(&msg);
+    client_fd = fd;
+    return true;
+
+err:
+    proto_msg_free(&msg);
+    close(fd);
+    return false;
+}
+
+void client_disconnect(void) {
+    if (client_fd >= 0) {
+        close(client_fd);
+        client_fd = -1;
+    }
+}
+
+int client_request(const struct proto_msg* request) {
+    int retcode = 1;
+    struct proto_msg reply = {0};
+    int passed_fd = -1;
+
+    if (!proto_send(client_fd, request)) {
+        log_print(ERR, "failed to send request to cclipd: %s", strerror(errno));
+        goto out;
+    }
+
+    while (proto_recv_fd(client_fd, &reply, MAX_REPLY_FRAME_SIZE, &passed_fd)) {
+        switch (reply.type) {
+        case PROTO_DATA: {
+            struct iovec iov = {
+                .iov_base = reply.payload.data,
+                .iov_len = reply.payload.size,
+            };
+            if (!writev_full(1, &iov, 1)) {
+                log_print(ERR, "failed to write output: %s", strerror(errno));
+                goto out;
+            }
+            break;
+        }
+        case PROTO_SNAPSHOT: {
+            if (passed_fd < 0) {
+                log_print(ERR, "cclipd sent snapshot without file descriptor");
+                goto out;
+            }
+            const bool ok = snapshot_send(passed_fd, 1);
+            close(passed_fd);
+            passed_fd = -1;
+            if (!ok) {
+                log_print(ERR, "failed to write output: %s", strerror(errno));
+                goto out;
+            }
+            break;
+        }
+        case PROTO_END:
+            retcode = 0;
+            goto out;
+        case PROTO_ERROR: {
+            const char* message = NULL;
+            proto_get_str(&reply, &message);
+            log_print(ERR, "%s", message ? message : "cclipd reported an error");
+            goto out;
+        }
+        default:
+            log_print(ERR, "unexpected message type %d from cclipd", reply.type);
+            goto out;
+        }
+    }
+
+    log_print(ERR, "lost connection to cclipd");
+
+out:
+    if (passed_fd >= 0) {
+        close(passed_fd);
+    }
+    proto_msg_free(&reply);
+    return retcode;
+}
+
+void client_notify(struct sqlite3* db, enum proto_change_type type, int64_t id) {
+    static bool connect_failed = false;
+
+    if (client_fd < 0) {
+        if (connect_failed) {
+            return;
+        }
+
+        const char* db_path = sqlite3_db_filename(db, "main");
+        if (db_path == NULL || db_path[0] == '\0' || !client_connect(db_path)) {
+            connect_failed = true;
+            return;
+        }
+    }
+
+    struct proto_msg msg = {0};
+    proto_msg_reset(&msg, PROTO_NOTIFY);
+    proto_put_u8(&msg, type);
+    proto_put_i64(&msg, id);
+
+    if (!proto_send(client_fd, &msg)) {
+        log_print(DEBUG, "failed to notify cclipd: %s", strerror(errno));
+        client_disconnect();
+        connect_failed = true;
+    }
+
+    proto_msg_free(&msg);
+}
+
+bool client_suspend_writes(struct sqlite3* db) {
+    if (client_fd < 0) {
+        const char* db_path = sqlite3_db_filename(db, "main");
+        if (db_path == NULL || db_path[0] == '\0' || !client_connect(db_path)) {
+            return false;
+        }
+    }
+
+    struct proto_msg msg = {0};
+    proto_msg_reset(&msg, PROTO_SUSPEND);
+    const bool ok = client_request(&msg) == 0;
+    proto_msg_free(&msg);
+
+    if (!ok) {
+        client_disconnect();
+    }
+    return ok;
+}
+
+void client_resume_writes(void) {
+    if (client_fd < 0) {
+        return;
+    }
+
+    struct proto_msg msg = {0};
+    proto_msg_reset(&msg, PROTO_RESUME);
+    if (client_request(&msg) != 0) {
+        /* cclipd resumes by itself once we disconnect */
+        client_disconnect();
+    }
+    proto_msg_free(&msg);
+}
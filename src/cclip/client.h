@@ -0,0 +1,52 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sqlite3.h>
+
+#include "proto.h"
+
+/*
+ * Connects to cclipd query server if it is running and serves the same database.
+ * Returns false if cclipd is not available, in which case db should be accessed directly.
+ */
+bool client_connect(const char* db_path);
+void client_disconnect(void);
+
+/*
+ * Sends request to cclipd and copies reply to stdout.
+ * Returns exit code suitable for action (0 on success, 1 on failure).
+ */
+int client_request(const struct proto_msg* request);
+
+/*
+ * Tells cclipd that entry id in db was changed, so that it can inform cclip watch clients.
+ * Connects to cclipd on first use. Does nothing if cclipd is not available.
+ */
+void client_notify(struct sqlite3* db, enum proto_change_type type, int64_t id);
+
+/*
+ * Asks cclipd to stop writing to db until client_resume_writes() is called or connection
+ * is closed. Connects to cclipd if needed. Returns false if cclipd is not available.
+ */
+bool client_suspend_writes(struct sqlite3* db);
+void client_resume_writes(void);
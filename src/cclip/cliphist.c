@@ -0,0 +1,327 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "cliphist.h"
+#include "bolt.h"
+#include "preview.h"
+#include "db.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "log.h"
+
+#define CLIPHIST_BUCKET "b"
+/* entries are handed to workers in chunks, while the caller consumes the previous one */
+#define CLIPHIST_CHUNK_SIZE 1024
+#define CLIPHIST_MAX_WORKERS 8
+
+struct item {
+    const void* data; /* points into the database mapping */
+    size_t data_size;
+    const char* mime_type;
+    uint64_t data_hash;
+    char* preview;
+};
+
+struct chunk {
+    struct item items[CLIPHIST_CHUNK_SIZE];
+    size_t count;
+    atomic_size_t next; /* next item to be picked up for processing */
+};
+
+struct cliphist_reader {
+    struct bolt_db* db;
+    struct bolt_cursor* cursor;
+    bool cursor_done;
+    int64_t timestamp;
+    size_t preview_len;
+
+    struct chunk chunks[2];
+    struct chunk* current; /* one the caller is reading from */
+    size_t current_index;
+    struct chunk* pending; /* one that is being processed, NULL if there's nothing left */
+
+    pthread_t workers[CLIPHIST_MAX_WORKERS];
+    int nworkers;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond; /* signalled when pending is set or on shutdown */
+    pthread_cond_t idle_cond; /* signalled when busy drops to 0 */
+    int busy;
+    bool stopping;
+};
+
+const char* cliphist_default_path(void) {
+    static char path[PATH_MAX];
+
+    const char* env_path = getenv("CLIPHIST_DB_PATH");
+    const char* xdg_cache_home = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    if (env_path != NULL) {
+        return env_path;
+    } else if (xdg_cache_home != NULL) {
+        snprintf(path, sizeof(path), "%s/cliphist/db", xdg_cache_home);
+    } else if (home != NULL) {
+        snprintf(path, sizeof(path), "%s/.cache/cliphist/db", home);
+    } else {
+        log_print(WARN, "HOME is not set");
+        return NULL;
+    }
+
+    return path;
+}
+
+/* cliphist stores everything it can decode as an image as one, and the rest as text */
+static const char* guess_mime_type(const uint8_t* data, size_t size) {
+    static const struct {
+        size_t offset;
+        const char* magic;
+        size_t magic_len;
+        const char* mime_type;
+    } signatures[] = {
+        { 0, "\x89PNG\r\n\x1a\n", 8, "image/png" },
+        { 0, "\xff\xd8\xff", 3, "image/jpeg" },
+        { 0, "GIF87a", 6, "image/gif" },
+        { 0, "GIF89a", 6, "image/gif" },
+        { 0, "BM", 2, "image/bmp" },
+        { 8, "WEBP", 4, "image/webp" },
+    };
+
+    for (size_t i = 0; i < SIZEOF_ARRAY(signatures); i++) {
+        const size_t end = signatures[i].offset + signatures[i].magic_len;
+        if (size >= end && memcmp(data + signatures[i].offset, signatures[i].magic,
+                                  signatures[i].magic_len) == 0) {
+            return signatures[i].mime_type;
+        }
+    }
+
+    return "text/plain";
+}
+
+static void process_item(struct cliphist_reader* r, struct item* item) {
+    item->mime_type = guess_mime_type(item->data, item->data_size);
+    item->data_hash = db_hash_data(item->data, item->data_size);
+    item->preview = generate_preview(item->data, item->data_size, item->mime_type,
+                                     r->preview_len);
+}
+
+static void* worker(void* data) {
+    struct cliphist_reader* r = data;
+
+    pthread_mutex_lock(&r->mutex);
+    while (!r->stopping) {
+        struct chunk* c = r->pending;
+        if (c == NULL || atomic_load(&c->next) >= c->count) {
+            pthread_cond_wait(&r->work_cond, &r->mutex);
+            continue;
+        }
+
+        r->busy += 1;
+        pthread_mutex_unlock(&r->mutex);
+
+        size_t i;
+        while ((i = atomic_fetch_add(&c->next, 1)) < c->count) {
+            process_item(r, &c->items[i]);
+        }
+
+        pthread_mutex_lock(&r->mutex);
+        if (--r->busy == 0) {
+            pthread_cond_signal(&r->idle_cond);
+        }
+    }
+    pthread_mutex_unlock(&r->mutex);
+
+    return NULL;
+}
+
+/* returns number of entries put in c, -1 on error */
+static int fill_chunk(struct cliphist_reader* r, struct chunk* c) {
+    for (size_t i = 0; i < c->count; i++) {
+        free(c->items[i].preview);
+    }
+    c->count = 0;
+    atomic_store(&c->next, 0);
+
+    while (c->count < CLIPHIST_CHUNK_SIZE && !r->cursor_done) {
+        struct bolt_kv kv;
+        const int ret = bolt_cursor_next(r->cursor, &kv);
+        if (ret < 0) {
+            return -1;
+        } else if (ret == 0) {
+            r->cursor_done = true;
+        } else if (kv.value_size > 0) {
+            c->items[c->count++] = (struct item){
+                .data = kv.value,
+                .data_size = kv.value_size,
+            };
+        }
+    }
+
+    return c->count;
+}
+
+static void submit_chunk(struct cliphist_reader* r, struct chunk* c) {
+    pthread_mutex_lock(&r->mutex);
+    r->pending = c;
+    pthread_cond_broadcast(&r->work_cond);
+    pthread_mutex_unlock(&r->mutex);
+}
+
+/* helps workers with whatever is left of pending chunk and waits for them to finish it */
+static struct chunk* finish_pending_chunk(struct cliphist_reader* r) {
+    struct chunk* c = r->pending;
+
+    size_t i;
+    while ((i = atomic_fetch_add(&c->next, 1)) < c->count) {
+        process_item(r, &c->items[i]);
+    }
+
+    pthread_mutex_lock(&r->mutex);
+    while (r->busy > 0) {
+        pthread_cond_wait(&r->idle_cond, &r->mutex);
+    }
+    r->pending = NULL;
+    pthread_mutex_unlock(&r->mutex);
+
+    return c;
+}
+
+struct cliphist_reader* cliphist_reader_open(const char* path, size_t preview_len) {
+    struct cliphist_reader* r = xcalloc(1, sizeof(*r));
+    r->preview_len = preview_len;
+    pthread_mutex_init(&r->mutex, NULL);
+    pthread_cond_init(&r->work_cond, NULL);
+    pthread_cond_init(&r->idle_cond, NULL);
+
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        log_print(ERR, "failed to stat %s: %s", path, strerror(errno));
+        goto err;
+    }
+    r->timestamp = st.st_mtime;
+
+    r->db = bolt_open(path);
+    if (r->db == NULL) {
+        goto err;
+    }
+
+    bool missing;
+    r->cursor = bolt_cursor_open(r->db, CLIPHIST_BUCKET, &missing);
+    if (r->cursor == NULL) {
+        if (missing) {
+            log_print(ERR, "%s: not a cliphist database", path);
+        }
+        goto err;
+    }
+
+    /* calling thread does its share of work while waiting for a chunk */
+    const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const int nworkers = MIN(MAX(ncpus - 1, 0), CLIPHIST_MAX_WORKERS);
+    for (int i = 0; i < nworkers; i++) {
+        const int ret = pthread_create(&r->workers[r->nworkers], NULL, worker, r);
+        if (ret != 0) {
+            log_print(WARN, "failed to create worker thread: %s", strerror(ret));
+            break;
+        }
+        r->nworkers += 1;
+    }
+    log_print(DEBUG, "started %d worker threads", r->nworkers);
+
+    const int ret = fill_chunk(r, &r->chunks[0]);
+    if (ret < 0) {
+        goto err;
+    } else if (ret > 0) {
+        submit_chunk(r, &r->chunks[0]);
+    }
+
+    return r;
+
+err:
+    cliphist_reader_close(r);
+    return NULL;
+}
+
+int cliphist_read_entry(struct cliphist_reader* r, struct archive_entry* e) {
+    if (r->current == NULL || r->current_index >= r->current->count) {
+        if (r->pending == NULL) {
+            return 0;
+        }
+
+        struct chunk* ready = finish_pending_chunk(r);
+        /* refill the other one while the caller is busy with this one */
+        struct chunk* next = (ready == &r->chunks[0]) ? &r->chunks[1] : &r->chunks[0];
+        const int ret = fill_chunk(r, next);
+        if (ret < 0) {
+            return -1;
+        } else if (ret > 0) {
+            submit_chunk(r, next);
+        }
+
+        r->current = ready;
+        r->current_index = 0;
+    }
+
+    const struct item* item = &r->current->items[r->current_index++];
+    *e = (struct archive_entry){
+        .data_hash = item->data_hash,
+        .timestamp = r->timestamp,
+        .mime_type = item->mime_type,
+        .preview = item->preview,
+        .tags = "",
+        .data = item->data,
+        .data_size = item->data_size,
+    };
+
+    return 1;
+}
+
+void cliphist_reader_close(struct cliphist_reader* r) {
+    if (r == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&r->mutex);
+    r->stopping = true;
+    pthread_cond_broadcast(&r->work_cond);
+    pthread_mutex_unlock(&r->mutex);
+    for (int i = 0; i < r->nworkers; i++) {
+        pthread_join(r->workers[i], NULL);
+    }
+
+    for (size_t i = 0; i < SIZEOF_ARRAY(r->chunks); i++) {
+        for (size_t j = 0; j < r->chunks[i].count; j++) {
+            free(r->chunks[i].items[j].preview);
+        }
+    }
+
+    pthread_mutex_destroy(&r->mutex);
+    pthread_cond_destroy(&r->work_cond);
+    pthread_cond_destroy(&r->idle_cond);
+    bolt_cursor_close(r->cursor);
+    bolt_close(r->db);
+    free(r);
+}
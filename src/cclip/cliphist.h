@@ -0,0 +1,47 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "archive.h"
+
+/*
+ * Reads history of cliphist (https://github.com/sentriz/cliphist), which keeps
+ * raw entries in a bbolt database, keyed by sequence number, without MIME types
+ * or timestamps. MIME type is guessed from content the same way cliphist does it,
+ * and all entries get modification time of the database as timestamp.
+ * They are returned oldest first, so new ids preserve their order.
+ *
+ * Hashes and previews are computed by a pool of worker threads, ahead of the caller.
+ */
+
+struct cliphist_reader;
+
+/* default location of cliphist database, NULL if it can't be determined */
+const char* cliphist_default_path(void);
+
+/* returns NULL on failure */
+struct cliphist_reader* cliphist_reader_open(const char* path, size_t preview_len);
+/*
+ * Returns 1 and fills e if there is an entry, 0 when there are no more, -1 on error.
+ * Pointers in e are valid until next call.
+ */
+int cliphist_read_entry(struct cliphist_reader* r, struct archive_entry* e);
+void cliphist_reader_close(struct cliphist_reader* r);
@@ -20,9 +20,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "utils.h"
-#include "macros.h"
 #include "log.h"
 
 bool str_to_int64(const char* str, int64_t* res) {
@@ -39,6 +39,61 @@ bool str_to_int64(const char* str, int64_t* res) {
     return false;
 }
 
+/* parses number with optional single character suffix from suffixes, multiplies it by factor */
+static bool str_to_scaled_int64(const char* str, const char* suffixes,
+                                const int64_t* factors, int64_t* res) {
+    char *endptr = NULL;
+
+    errno = 0;
+    int64_t n = strtoll(str, &endptr, 10);
+    if (errno != 0 || endptr == str || n < 0) {
+        return false;
+    }
+
+    if (*endptr == '\0') {
+        *res = n;
+        return true;
+    }
+
+    const char* suffix = strchr(suffixes, *endptr);
+    if (suffix == NULL || endptr[1] != '\0') {
+        return false;
+    }
+
+    const int64_t factor = factors[suffix - suffixes];
+    if (n > INT64_MAX / factor) {
+        return false;
+    }
+    *res = n * factor;
+    return true;
+}
+
+bool str_to_timestamp(const char* str, int64_t* res) {
+    static const char suffixes[] = "smhdw";
+    static const int64_t factors[] = { 1, 60, 60 * 60, 60 * 60 * 24, 60 * 60 * 24 * 7 };
+
+    int64_t n;
+    if (!str_to_scaled_int64(str, suffixes, factors, &n)) {
+        log_print(ERR, "invalid time: %s", str);
+        return false;
+    }
+
+    const char last = str[strlen(str) - 1];
+    *res = (last >= '0' && last <= '9') ? n : time(NULL) - n;
+    return true;
+}
+
+bool str_to_size(const char* str, int64_t* res) {
+    static const char suffixes[] = "KMG";
+    static const int64_t factors[] = { 1024, 1024 * 1024, 1024 * 1024 * 1024 };
+
+    if (!str_to_scaled_int64(str, suffixes, factors, res)) {
+        log_print(ERR, "invalid size: %s", str);
+        return false;
+    }
+    return true;
+}
+
 bool int64_from_stdin(int64_t* res) {
     int64_t res_tmp;
     if (scanf("%ld", &res_tmp) != 1) {
@@ -57,92 +112,6 @@ bool get_id(const char* str, int64_t* res) {
     }
 }
 
-int build_field_list(char* raw_list, enum select_fields out_fields[SELECT_FIELDS_COUNT]) {
-    #define FOR_LIST_OF_FIELDS(DO) \
-        DO(ID, "id", "rowid") \
-        DO(PREVIEW, "preview") \
-        DO(MIME_TYPE, "mime_type", "mime", "type") \
-        DO(DATA_SIZE, "data_size", "size") \
-        DO(TIMESTAMP, "timestamp", "time") \
-        DO(TAGS, "tags", "tag")
-
-    #define DEFINE_NAME_ARRAY(name, ...) \
-        static const char* name##_names[] = { __VA_ARGS__ };
-    FOR_LIST_OF_FIELDS(DEFINE_NAME_ARRAY)
-
-    static const struct {
-        const char** names;
-        unsigned names_count;
-    } fields[] = {
-        #define DEFINE_STRUCT_MEMBER(n, ...) \
-            [FIELD_##n] = { .names = n##_names, .names_count = SIZEOF_ARRAY(n##_names) },
-        FOR_LIST_OF_FIELDS(DEFINE_STRUCT_MEMBER)
-    };
-
-    bool seen_fields[SELECT_FIELDS_COUNT];
-    memset(&seen_fields, 0, sizeof(seen_fields));
-
-    int out_fields_count = 0;
-
-    char* token = strtok(raw_list, ",");
-    while (token != NULL) {
-        bool token_valid = false;
-        for (unsigned f = 0; f < SIZEOF_ARRAY(fields); f++) {
-            for (unsigned j = 0; j < fields[f].names_count; j++) {
-                if (STREQ(token, fields[f].names[j])) {
-                    if (seen_fields[f]) {
-                        log_print(ERR, "field %s encountered more than once", token);
-                        return 0;
-                    }
-
-                    seen_fields[f] = true;
-                    out_fields[out_fields_count++] = f;
-                    token_valid = true;
-                    goto loop_out;
-                }
-            }
-        }
-    loop_out:
-
-        if (!token_valid) {
-            log_print(ERR, "invalid field: %s", token);
-            return 0;
-        }
-
-        token = strtok(NULL, ",");
-    }
-
-    return out_fields_count;
-}
-
-bool writev_full(int fd, struct iovec *iov, int iovcnt) {
-    while (iovcnt > 0) {
-        ssize_t written = writev(fd, iov, iovcnt);
-        if (written <= 0) {
-            if (written < 0 && errno == EINTR) {
-                continue;
-            }
-            return false;
-        }
-
-        while (written > 0) {
-            if (iov[0].iov_len <= (size_t)written) {
-                /* entire iov was consumed */
-                written -= iov[0].iov_len;
-                iov += 1;
-                iovcnt -= 1;
-            } else {
-                /* iov was partially consumed */
-                iov[0].iov_base = (char *)iov[0].iov_base + written;
-                iov[0].iov_len -= written;
-                written = 0;
-            }
-        }
-    }
-
-    return true;
-}
-
 bool is_tag_valid(const char* tag) {
     bool has_nonspace = false;
     for (const char* p = tag; *p != '\0'; p++) {
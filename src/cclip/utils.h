@@ -18,37 +18,22 @@
 
 #pragma once
 
-#include <sys/uio.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 bool str_to_int64(const char* str, int64_t* res);
 
-/* if str is "-", tries to read stdin */
-bool get_id(const char* str, int64_t* res);
-
-enum select_fields {
-    FIELD_ID = 0,
-    FIELD_PREVIEW = 1,
-    FIELD_MIME_TYPE = 2,
-    FIELD_DATA_SIZE = 3,
-    FIELD_TIMESTAMP = 4,
-    FIELD_TAGS = 5,
-
-    SELECT_FIELDS_COUNT
-};
-
 /*
- * Returns number of fields in raw_list, puts converted fields into fields array in order.
- * NOTE: mutates raw_list.
+ * Accepts either unix timestamp in seconds or duration with s, m, h, d or w suffix,
+ * in which case the result is current time minus that duration.
  */
-int build_field_list(char* raw_list, enum select_fields fields[SELECT_FIELDS_COUNT]);
+bool str_to_timestamp(const char* str, int64_t* res);
 
-/*
- * writev(2) wrapper that ensure all data gets written
- * NOTE: mutates the iov array
- */
-bool writev_full(int fd, struct iovec *iov, int iovcnt);
+/* Accepts size in bytes with optional K, M or G suffix (powers of 1024) */
+bool str_to_size(const char* str, int64_t* res);
+
+/* if str is "-", tries to read stdin */
+bool get_id(const char* str, int64_t* res);
 
 /*
  * Disallow non-printable ASCII in tags,
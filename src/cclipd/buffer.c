@@ -0,0 +1,47 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "buffer.h"
+#include "xmalloc.h"
+
+struct buffer* buffer_new(void* data, size_t size) {
+    struct buffer* buf = xmalloc(sizeof(*buf));
+    buf->refcount = 1;
+    buf->size = size;
+    buf->data = data;
+
+    return buf;
+}
+
+struct buffer* buffer_ref(struct buffer* buf) {
+    __atomic_add_fetch(&buf->refcount, 1, __ATOMIC_RELAXED);
+    return buf;
+}
+
+void buffer_unref(struct buffer* buf) {
+    if (buf == NULL) {
+        return;
+    }
+
+    if (__atomic_sub_fetch(&buf->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(buf->data);
+        free(buf);
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Reference counted chunk of received clipboard data.
+ * Buffers are shared between the main thread and the db thread,
+ * so refcount is manipulated atomically. Contents must not be modified.
+ */
+struct buffer {
+    int refcount;
+    size_t size;
+    void* data;
+};
+
+/* takes ownership of mallocd data, returned buffer has refcount of 1 */
+struct buffer* buffer_new(void* data, size_t size);
+
+struct buffer* buffer_ref(struct buffer* buf);
+/* frees buffer and its data when refcount drops to 0. Passing NULL is a no-op */
+void buffer_unref(struct buffer* buf);
@@ -0,0 +1,495 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "collections/string.h"
+#include "collections/vec.h"
+#include "xmalloc.h"
+#include "db.h"
+#include "log.h"
+#include "macros.h"
+
+/* initial number of hash buckets, doubled whenever there are more nodes than buckets */
+#define CACHE_MIN_BUCKETS 64
+
+struct node {
+    struct cached_entry e;
+    size_t cost; /* approximate memory usage in bytes */
+    uint64_t generation; /* incremented every time db thread touches the entry */
+    bool valid; /* false until confirmed by cache_revalidate() */
+
+    struct node* prev; /* less recently used */
+    struct node* next; /* more recently used */
+    struct node* bucket_next; /* next node in the same hash bucket */
+};
+
+struct snapshot_entry {
+    int64_t id;
+    uint64_t generation;
+};
+
+struct revalidated_entry {
+    int64_t id;
+    time_t timestamp;
+    int64_t seq;
+    char* tags;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+
+    size_t max_memory;
+    size_t used_memory;
+
+    /* id -> node, chained, size is a power of two */
+    struct node** buckets;
+    size_t nbuckets;
+    size_t count;
+
+    /* LRU list */
+    struct node* oldest;
+    struct node* newest;
+
+    bool dirty;
+    int64_t seq; /* change sequence number after the last commit of db thread */
+
+    uint64_t hits, misses, evictions;
+} cache = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .dirty = true,
+    .seq = -1,
+};
+
+static size_t node_cost(const struct node* n) {
+    size_t cost = sizeof(*n) + strlen(n->e.mime_type) + 1 + strlen(n->e.preview) + 1;
+    if (n->e.tags != NULL) {
+        cost += strlen(n->e.tags) + 1;
+    }
+    if (n->e.data != NULL) {
+        cost += sizeof(*n->e.data) + n->e.data->size;
+    }
+    return cost;
+}
+
+static void node_free(struct node* n) {
+    cached_entry_release(&n->e);
+    free(n);
+}
+
+/* ids are sequential, so low bits alone spread them evenly */
+static struct node** bucket_of(int64_t id) {
+    return &cache.buckets[(uint64_t)id & (cache.nbuckets - 1)];
+}
+
+static struct node* find_node(int64_t id) {
+    if (cache.nbuckets == 0) {
+        return NULL;
+    }
+
+    for (struct node* n = *bucket_of(id); n != NULL; n = n->bucket_next) {
+        if (n->e.id == id) {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+static void rehash(size_t nbuckets) {
+    struct node** old = cache.buckets;
+    const size_t old_nbuckets = cache.nbuckets;
+
+    cache.buckets = xcalloc(nbuckets, sizeof(*cache.buckets));
+    cache.nbuckets = nbuckets;
+
+    for (size_t i = 0; i < old_nbuckets; i++) {
+        struct node* n = old[i];
+        while (n != NULL) {
+            struct node* next = n->bucket_next;
+            struct node** bucket = bucket_of(n->e.id);
+            n->bucket_next = *bucket;
+            *bucket = n;
+            n = next;
+        }
+    }
+
+    free(old);
+}
+
+static void lru_unlink(struct node* n) {
+    if (n->prev != NULL) {
+        n->prev->next = n->next;
+    } else {
+        cache.oldest = n->next;
+    }
+    if (n->next != NULL) {
+        n->next->prev = n->prev;
+    } else {
+        cache.newest = n->prev;
+    }
+    n->prev = n->next = NULL;
+}
+
+static void lru_append(struct node* n) {
+    n->prev = cache.newest;
+    n->next = NULL;
+    if (cache.newest != NULL) {
+        cache.newest->next = n;
+    } else {
+        cache.oldest = n;
+    }
+    cache.newest = n;
+}
+
+static void add_node(struct node* n) {
+    if (cache.count >= cache.nbuckets) {
+        rehash(MAX(cache.nbuckets * 2, (size_t)CACHE_MIN_BUCKETS));
+    }
+
+    struct node** bucket = bucket_of(n->e.id);
+    n->bucket_next = *bucket;
+    *bucket = n;
+    lru_append(n);
+
+    cache.count += 1;
+    cache.used_memory += n->cost;
+}
+
+static void remove_node(struct node* n) {
+    struct node** p = bucket_of(n->e.id);
+    while (*p != n) {
+        p = &(*p)->bucket_next;
+    }
+    *p = n->bucket_next;
+    lru_unlink(n);
+
+    cache.count -= 1;
+    cache.used_memory -= n->cost;
+    node_free(n);
+}
+
+/* moves node to the most recently used end */
+static void touch_node(struct node* n) {
+    lru_unlink(n);
+    lru_append(n);
+}
+
+static void remove_all_nodes(void) {
+    while (cache.oldest != NULL) {
+        remove_node(cache.oldest);
+    }
+}
+
+static void evict(void) {
+    while (cache.used_memory > cache.max_memory && cache.oldest != NULL) {
+        log_print(TRACE, "cache: evicting entry %li", cache.oldest->e.id);
+        remove_node(cache.oldest);
+        cache.evictions += 1;
+    }
+}
+
+void cache_init(size_t max_memory) {
+    cache.max_memory = max_memory;
+}
+
+void cache_cleanup(void) {
+    pthread_mutex_lock(&cache.mutex);
+
+    remove_all_nodes();
+    free(cache.buckets);
+    cache.buckets = NULL;
+    cache.nbuckets = 0;
+
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+void cache_insert(int64_t id, bool inserted, int64_t seq, time_t timestamp,
+                  const char* mime_type, const char* preview, struct buffer* buf) {
+    if (cache.max_memory == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache.mutex);
+
+    struct node* n = find_node(id);
+    if (n != NULL) {
+        touch_node(n);
+        n->e.timestamp = timestamp;
+    } else {
+        n = xcalloc(1, sizeof(*n));
+        n->e.id = id;
+        n->e.timestamp = timestamp;
+        n->e.data_size = buf->size;
+        n->e.mime_type = xstrdup(mime_type);
+        n->e.preview = xstrdup(preview);
+        if (buf->size <= CACHE_MAX_PAYLOAD_SIZE) {
+            n->e.data = buffer_ref(buf);
+        }
+        n->cost = node_cost(n);
+
+        if (n->cost > cache.max_memory) {
+            node_free(n);
+            goto out;
+        }
+
+        add_node(n);
+        evict();
+    }
+
+    n->generation += 1;
+    if (inserted) {
+        /* brand new entry has no tags, so everything about it is known */
+        n->e.seq = seq;
+        n->valid = true;
+    } else {
+        /* duplicate of existing entry, its tags are unknown, wait for revalidation */
+        n->valid = false;
+        cache.dirty = true;
+    }
+
+    log_print(TRACE, "cache: inserted entry %li, using %zu/%zu bytes",
+              id, cache.used_memory, cache.max_memory);
+
+out:
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+void cache_remove(int64_t id) {
+    if (cache.max_memory == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache.mutex);
+    struct node* n = find_node(id);
+    if (n != NULL) {
+        remove_node(n);
+    }
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+void cache_commit(int64_t seq_before, int64_t seq_after) {
+    pthread_mutex_lock(&cache.mutex);
+    if (cache.seq == seq_before || cache.seq == seq_after) {
+        cache.seq = seq_after;
+    } else {
+        /* someone else changed the db since cache was last validated */
+        cache.dirty = true;
+    }
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+bool cache_needs_revalidation(void) {
+    pthread_mutex_lock(&cache.mutex);
+    bool ret = cache.dirty;
+    pthread_mutex_unlock(&cache.mutex);
+
+    return ret;
+}
+
+bool cache_is_current(int64_t seq) {
+    pthread_mutex_lock(&cache.mutex);
+    bool ret = !cache.dirty && seq >= 0 && seq == cache.seq;
+    pthread_mutex_unlock(&cache.mutex);
+
+    return ret;
+}
+
+static int compare_revalidated(const void* a, const void* b) {
+    const struct revalidated_entry* ra = a;
+    const struct revalidated_entry* rb = b;
+    return (ra->id > rb->id) - (ra->id < rb->id);
+}
+
+bool cache_revalidate(struct sqlite3* db, int64_t seq) {
+    bool ret = true;
+    struct string ids = {0};
+    struct sqlite3_stmt* stmt = NULL;
+    VEC(struct snapshot_entry) snapshot = {0};
+    VEC(struct revalidated_entry) results = {0};
+
+    /* remember what we are asking about, db thread may add more entries meanwhile */
+    pthread_mutex_lock(&cache.mutex);
+    cache.dirty = false;
+    cache.seq = seq;
+    string_append(&ids, "[");
+    for (const struct node* n = cache.oldest; n != NULL; n = n->next) {
+        string_appendf(&ids, "%s%li", (VEC_SIZE(&snapshot) > 0) ? "," : "", n->e.id);
+        VEC_APPEND(&snapshot, &((struct snapshot_entry){ n->e.id, n->generation }));
+    }
+    string_append(&ids, "]");
+    pthread_mutex_unlock(&cache.mutex);
+
+    if (VEC_SIZE(&snapshot) == 0) {
+        goto out;
+    }
+
+    const char* sql = TOSTRING(
+        SELECT h.id, h.timestamp, h.seq, group_concat(t.name, ',')
+        FROM history AS h
+        LEFT JOIN history_tags AS ht ON h.id = ht.entry_id
+        LEFT JOIN tags AS t ON ht.tag_id = t.id
+        WHERE h.id IN ( SELECT value FROM json_each(@ids) )
+        GROUP BY h.id
+        ORDER BY h.id
+    );
+    if (!db_prepare_stmt(db, sql, &stmt)) {
+        ret = false;
+        goto out;
+    }
+
+    STMT_BIND(stmt, text, "@ids", ids.str, ids.len, SQLITE_STATIC);
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* tags = (const char*)sqlite3_column_text(stmt, 3);
+        VEC_APPEND(&results, &((struct revalidated_entry){
+            .id = sqlite3_column_int64(stmt, 0),
+            .timestamp = sqlite3_column_int64(stmt, 1),
+            .seq = sqlite3_column_int64(stmt, 2),
+            .tags = (tags != NULL) ? xstrdup(tags) : NULL,
+        }));
+    }
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "cache: failed to revalidate: %s", sqlite3_errmsg(db));
+        ret = false;
+        goto out;
+    }
+
+    pthread_mutex_lock(&cache.mutex);
+    VEC_FOREACH(&snapshot, i) {
+        const struct snapshot_entry* s = &snapshot.data[i];
+
+        struct node* n = find_node(s->id);
+        if (n == NULL) {
+            /* evicted meanwhile */
+            continue;
+        }
+
+        struct revalidated_entry* r = bsearch(&(struct revalidated_entry){ .id = s->id },
+                                              results.data, VEC_SIZE(&results),
+                                              sizeof(*results.data), compare_revalidated);
+        if (r == NULL) {
+            log_print(TRACE, "cache: entry %li was deleted from db", s->id);
+            remove_node(n);
+            continue;
+        }
+
+        if (n->generation != s->generation) {
+            /* db thread touched it while we were querying, our data may be stale */
+            continue;
+        }
+
+        n->e.timestamp = r->timestamp;
+        n->e.seq = r->seq;
+        free(n->e.tags);
+        n->e.tags = r->tags;
+        r->tags = NULL;
+        n->valid = true;
+
+        cache.used_memory -= n->cost;
+        n->cost = node_cost(n);
+        cache.used_memory += n->cost;
+    }
+    evict();
+    pthread_mutex_unlock(&cache.mutex);
+
+    log_print(TRACE, "cache: revalidated %zu entries, %zu still exist",
+              VEC_SIZE(&snapshot), VEC_SIZE(&results));
+
+out:
+    if (!ret) {
+        /* can't tell what is stale, start over */
+        pthread_mutex_lock(&cache.mutex);
+        remove_all_nodes();
+        pthread_mutex_unlock(&cache.mutex);
+    }
+
+    VEC_FOREACH(&results, i) {
+        free(results.data[i].tags);
+    }
+    VEC_FREE(&results);
+    VEC_FREE(&snapshot);
+    string_free(&ids);
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+bool cache_lookup(int64_t id, bool need_data, struct cached_entry* e) {
+    if (cache.max_memory == 0) {
+        return false;
+    }
+
+    bool hit = false;
+
+    pthread_mutex_lock(&cache.mutex);
+
+    struct node* n = find_node(id);
+    if (n != NULL) {
+        if (n->valid && (!need_data || n->e.data != NULL)) {
+            touch_node(n);
+            *e = (struct cached_entry){
+                .id = n->e.id,
+                .timestamp = n->e.timestamp,
+                .data_size = n->e.data_size,
+                .seq = n->e.seq,
+                .mime_type = xstrdup(n->e.mime_type),
+                .preview = xstrdup(n->e.preview),
+                .tags = (n->e.tags != NULL) ? xstrdup(n->e.tags) : NULL,
+                .data = (n->e.data != NULL) ? buffer_ref(n->e.data) : NULL,
+            };
+            hit = true;
+        }
+    }
+
+    if (hit) {
+        cache.hits += 1;
+    } else {
+        cache.misses += 1;
+    }
+
+    pthread_mutex_unlock(&cache.mutex);
+
+    return hit;
+}
+
+void cached_entry_release(struct cached_entry* e) {
+    free(e->mime_type);
+    free(e->preview);
+    free(e->tags);
+    buffer_unref(e->data);
+    *e = (struct cached_entry){0};
+}
+
+void cache_log_stats(void) {
+    if (cache.max_memory == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache.mutex);
+
+    const uint64_t lookups = cache.hits + cache.misses;
+    log_print(INFO, "cache: %lu hits, %lu misses (%.1f%% hit rate), %lu evictions, "
+              "%zu entries using %zu/%zu bytes",
+              cache.hits, cache.misses, (lookups > 0) ? 100.0 * cache.hits / lookups : 0.0,
+              cache.evictions, cache.count, cache.used_memory, cache.max_memory);
+
+    pthread_mutex_unlock(&cache.mutex);
+}
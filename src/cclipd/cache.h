@@ -0,0 +1,90 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+#include "buffer.h"
+
+/*
+ * Cache of most recently inserted/accessed entries, so that the query server
+ * can answer requests for them without touching the database.
+ * Filled by the db thread after it commits an entry, read by the server thread.
+ *
+ * Changes made by db thread itself are applied to the cache directly. Any other
+ * database change (cclip delete/tag/wipe) makes cache_revalidate() necessary,
+ * see cache_is_current(). Entries are only trusted after that.
+ */
+
+/* payloads bigger than this are not kept in memory, only metadata is */
+#define CACHE_MAX_PAYLOAD_SIZE (64 * 1024)
+
+struct cached_entry {
+    int64_t id;
+    time_t timestamp;
+    size_t data_size;
+    char* mime_type;
+    char* preview;
+    char* tags; /* comma separated, NULL if no tags */
+    int64_t seq; /* change sequence number */
+    struct buffer* data; /* NULL if payload was too big to be cached */
+};
+
+/* max_memory of 0 disables the cache */
+void cache_init(size_t max_memory);
+void cache_cleanup(void);
+
+/*
+ * Takes its own reference to buf. inserted is false if entry already existed
+ * (duplicate copied again), seq is change sequence number of a newly inserted entry.
+ */
+void cache_insert(int64_t id, bool inserted, int64_t seq, time_t timestamp,
+                  const char* mime_type, const char* preview, struct buffer* buf);
+/* db thread deleted this entry */
+void cache_remove(int64_t id);
+/*
+ * db thread reports change sequence number before and after its commit, after
+ * updating cache with everything the commit changed. That's how cache tells
+ * its own changes apart from the ones made by others.
+ */
+void cache_commit(int64_t seq_before, int64_t seq_after);
+
+/* true if db thread added something that needs to be revalidated */
+bool cache_needs_revalidation(void);
+/* true if seq is current change sequence number and cache is known to match it */
+bool cache_is_current(int64_t seq);
+/*
+ * Drops entries that no longer exist in db, refreshes their timestamps, tags and seq.
+ * Must be called in the same read transaction seq was read in.
+ */
+bool cache_revalidate(struct sqlite3* db, int64_t seq);
+
+/*
+ * On hit, fills e with copies of cached data which must be released with
+ * cached_entry_release(). If need_data is true, entries without payload are a miss.
+ */
+bool cache_lookup(int64_t id, bool need_data, struct cached_entry* e);
+void cached_entry_release(struct cached_entry* e);
+
+void cache_log_stats(void);
@@ -17,12 +17,21 @@
  */
 
 #include <getopt.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
 #include <stdio.h>
 
 #include "wayland.h"
 #include "log.h"
 #include "db.h"
 #include "sql.h"
+#include "server.h"
+#include "maintenance.h"
+#include "primary.h"
+#include "simhash.h"
+#include "cache.h"
 #include "config.h"
 #include "eventloop.h"
 #include "xmalloc.h"
@@ -48,7 +57,19 @@ static void print_help_and_exit(int exit_status) {
         "                   its size in bytes is not less than SIZE\n"
         "    -c ENTRIES     max count of entries to keep in database\n"
         "    -P PREVIEW_LEN max length of preview to generate in bytes\n"
+        "    -m CACHE_SIZE  memory in bytes to use for caching recent entries,\n"
+        "                   0 disables caching\n"
+        "    -O PROFILE     storage profile: default, blob-heavy, low-memory,\n"
+        "                   durable or fast\n"
+        "    -b BACKUP_DIR  periodically back up database to BACKUP_DIR\n"
+        "    -B HOURS       interval between backups\n"
+        "    -r COUNT       number of backups to keep\n"
+        "    -n DISTANCE    replace recent text entries that differ from\n"
+        "                   new one in at most DISTANCE bits of SimHash (1-7)\n"
         "    -p             also monitor primary selection\n"
+        "    -w SECONDS     only save primary selection after it stays\n"
+        "                   unchanged for SECONDS, 0 saves it right away\n"
+        "    -k             keep serving selection after source client exits\n"
         "    -S             do not ignore data marked as secret (passwords)\n"
         "    -e             error out if database file does not exist\n"
         "    -v             increase verbosity (can be specified multiple times)\n"
@@ -60,10 +81,23 @@ static void print_help_and_exit(int exit_status) {
     exit(exit_status);
 }
 
+/* unlike atoi, rejects anything but a decimal integer from min to max */
+static bool parse_int(const char* arg, long min, long max, int* out) {
+    char* endptr;
+    errno = 0;
+    const long val = strtol(arg, &endptr, 10);
+    if (errno != 0 || *endptr != '\0' || arg[0] == '\0' || val < min || val > max) {
+        return false;
+    }
+
+    *out = val;
+    return true;
+}
+
 static int parse_command_line(int argc, char** argv) {
     int opt;
 
-    while ((opt = getopt(argc, argv, ":d:t:s:c:P:pSevVh")) != -1) {
+    while ((opt = getopt(argc, argv, ":d:t:s:c:P:m:O:b:B:r:n:w:pkSevVh")) != -1) {
         switch (opt) {
         case 'd':
             config.db_path = optarg;
@@ -92,9 +126,63 @@ static int parse_command_line(int argc, char** argv) {
                 return -1;
             }
             break;
+        case 'm': {
+            char* endptr;
+            errno = 0;
+            config.cache_size = strtoull(optarg, &endptr, 10);
+            if (errno != 0 || *endptr != '\0' || optarg[0] == '-' || optarg[0] == '\0') {
+                log_print(ERR, "CACHE_SIZE must be a non-negative integer, got %s", optarg);
+                return -1;
+            }
+            break;
+        }
+        case 'O':
+            if (!db_select_profile(optarg)) {
+                log_print(ERR, "unknown storage profile: %s", optarg);
+                return -1;
+            }
+            break;
+        case 'b':
+            config.backup_dir = optarg;
+            break;
+        case 'B':
+            /* converted to seconds when used */
+            if (!parse_int(optarg, 1, INT_MAX / (60 * 60), &config.backup_interval_hours)) {
+                log_print(ERR, "HOURS must be a positive integer, got %s", optarg);
+                return -1;
+            }
+            break;
+        case 'r':
+            if (!parse_int(optarg, 1, INT_MAX, &config.backup_keep_count)) {
+                log_print(ERR, "COUNT must be a positive integer, got %s", optarg);
+                return -1;
+            }
+            break;
+        case 'n':
+            if (!parse_int(optarg, 1, SIMHASH_MAX_DISTANCE, &config.near_duplicate_distance)) {
+                log_print(ERR, "DISTANCE must be an integer from 1 to %d, got %s",
+                          SIMHASH_MAX_DISTANCE, optarg);
+                return -1;
+            }
+            break;
         case 'p':
             config.primary_selection = true;
             break;
+        case 'w': {
+            char* endptr;
+            errno = 0;
+            const long seconds = strtol(optarg, &endptr, 10);
+            if (errno != 0 || *endptr != '\0' || optarg[0] == '\0'
+                || seconds < 0 || seconds > INT_MAX / 1000) {
+                log_print(ERR, "SECONDS must be a non-negative integer, got %s", optarg);
+                return -1;
+            }
+            config.primary_stable_s = seconds;
+            break;
+        }
+        case 'k':
+            config.persist_selection = true;
+            break;
         case 'S':
             config.ignore_secrets = false;
             break;
@@ -136,6 +224,7 @@ static int on_sigusr1(struct pollen_event_source* src, int sig, void* data) {
     struct sqlite3** pdb = data;
 
     log_print(INFO, "received SIGUSR1, closing and reopening db connection");
+    stop_server_thread();
     stop_db_thread();
     db_close(*pdb);
 
@@ -147,6 +236,7 @@ static int on_sigusr1(struct pollen_event_source* src, int sig, void* data) {
         log_print(ERR, "failed to start db thread");
         return -1;
     }
+    start_server_thread(config.db_path);
 
     return 0;
 }
@@ -170,6 +260,8 @@ int main(int argc, char** argv) {
         VEC_APPEND(&config.accepted_mime_types, &(char *){ "*" });
     }
 
+    cache_init(config.cache_size);
+
     db = db_open(config.db_path, config.create_db_if_not_exists);
     if (db == NULL) {
         log_print(ERR, "failed to open database");
@@ -203,6 +295,11 @@ int main(int argc, char** argv) {
         log_print(INFO, "opened database version %d", user_version);
     }
 
+    /* rebuilding takes a while on big databases, so it is never done behind user's back */
+    if (!db_check_storage_settings(db)) {
+        log_print(WARN, "database storage settings are outdated, run cclip vacuum to update them");
+    }
+
     eventloop = pollen_loop_create();
     if (eventloop == NULL) {
         exit_status = 1;
@@ -214,6 +311,9 @@ int main(int argc, char** argv) {
 
     pollen_loop_add_signal(eventloop, SIGUSR1, on_sigusr1, &db);
 
+    /* clients may close their end of the pipe before we finish sending data */
+    signal(SIGPIPE, SIG_IGN);
+
     /* important to start db thread after blocking signals */
     if (!start_db_thread(db)) {
         log_print(ERR, "failed to start db thread");
@@ -221,6 +321,8 @@ int main(int argc, char** argv) {
         goto cleanup;
     }
 
+    start_server_thread(config.db_path);
+
     wayland_fd = wayland_init();
     if (wayland_fd < 0) {
         log_print(ERR, "failed to init wayland stuff");
@@ -228,14 +330,25 @@ int main(int argc, char** argv) {
         goto cleanup;
     };
 
+    if (!maintenance_init() || !primary_init()) {
+        exit_status = 1;
+        goto cleanup;
+    }
+
     exit_status = pollen_loop_run(eventloop);
 
 cleanup:
+    primary_cleanup();
+    stop_server_thread();
     stop_db_thread();
     db_close(db);
 
+    maintenance_cleanup();
     wayland_cleanup();
 
+    cache_log_stats();
+    cache_cleanup();
+
     return exit_status;
 }
 
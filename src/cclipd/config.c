@@ -17,16 +17,23 @@
  */
 
 #include "config.h"
+#include "preview.h"
 
 struct config config = {
     .accepted_mime_types = {0},
     .min_data_size = 1,
     .db_path = NULL,
     .primary_selection = false,
+    .primary_stable_s = 3,
+    .persist_selection = false,
     .ignore_secrets = true,
     .max_entries_count = 1000,
     .create_db_if_not_exists = true,
-    .preview_len = 128,
+    .preview_len = PREVIEW_DEFAULT_LEN,
+    .cache_size = 4 * 1024 * 1024,
+    .backup_dir = NULL,
+    .backup_interval_hours = 24,
+    .backup_keep_count = 7,
     .loglevel = INFO,
 };
 
@@ -29,10 +29,17 @@ struct config {
     size_t min_data_size;
     const char* db_path;
     bool primary_selection;
+    int primary_stable_s; /* 0 saves primary selection right away */
+    bool persist_selection;
     bool ignore_secrets;
     int max_entries_count;
     bool create_db_if_not_exists;
     size_t preview_len;
+    size_t cache_size;
+    const char* backup_dir; /* NULL if backups are disabled */
+    int backup_interval_hours;
+    int backup_keep_count;
+    int near_duplicate_distance; /* 0 if near-duplicate detection is disabled */
     enum loglevel loglevel;
 };
 
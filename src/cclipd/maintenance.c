@@ -0,0 +1,77 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+
+#include "maintenance.h"
+#include "eventloop.h"
+#include "wayland.h"
+#include "sql.h"
+#include "log.h"
+
+/* if a transfer is in progress, check again after this much time */
+#define MAINTENANCE_RETRY_DELAY_MS 500
+
+static struct pollen_event_source* timer = NULL;
+
+/*
+ * Maintenance itself runs in db thread and is split into small steps, see sql.c.
+ * This only decides when it's a good time to start: nothing is being copied
+ * or pasted and there's nothing waiting to be inserted.
+ */
+static int on_timer(struct pollen_event_source* src, void* data) {
+    if (wayland_transfers_in_flight() || !db_queue_is_empty()) {
+        log_print(TRACE, "maintenance: busy, postponing");
+        maintenance_schedule(MAINTENANCE_RETRY_DELAY_MS);
+        return 0;
+    }
+
+    /* armed before requesting so that db thread can override it if it has work left */
+    maintenance_schedule(MAINTENANCE_PERIOD_MS);
+    request_maintenance();
+
+    return 0;
+}
+
+void maintenance_schedule(unsigned long delay_ms) {
+    if (timer == NULL) {
+        return;
+    }
+
+    if (!pollen_timer_arm_ms(timer, false, delay_ms, 0)) {
+        log_print(ERR, "maintenance: failed to arm timer");
+    }
+}
+
+bool maintenance_init(void) {
+    timer = pollen_loop_add_timer(eventloop, CLOCK_MONOTONIC, on_timer, NULL);
+    if (timer == NULL) {
+        log_print(ERR, "maintenance: failed to create timer");
+        return false;
+    }
+
+    maintenance_schedule(MAINTENANCE_IDLE_DELAY_MS);
+    return true;
+}
+
+void maintenance_cleanup(void) {
+    if (timer != NULL) {
+        pollen_event_source_remove(timer);
+        timer = NULL;
+    }
+}
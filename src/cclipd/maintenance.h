@@ -0,0 +1,32 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+/* how long to wait after last clipboard activity before running maintenance */
+#define MAINTENANCE_IDLE_DELAY_MS 2000
+/* how often to check if something is due when nothing happens */
+#define MAINTENANCE_PERIOD_MS (60 * 60 * 1000)
+
+bool maintenance_init(void);
+void maintenance_cleanup(void);
+
+/* (re)schedules maintenance to run in delay_ms, can be called from any thread */
+void maintenance_schedule(unsigned long delay_ms);
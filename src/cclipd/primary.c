@@ -0,0 +1,137 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "primary.h"
+#include "maintenance.h"
+#include "eventloop.h"
+#include "config.h"
+#include "sql.h"
+#include "xmalloc.h"
+#include "log.h"
+
+struct ring_entry {
+    struct buffer* buf; /* NULL if slot is empty */
+    char* mime_type;
+    bool saved;
+};
+
+static struct {
+    /* newest entry is at head - 1 */
+    struct ring_entry entries[PRIMARY_RING_SIZE];
+    unsigned head;
+    struct pollen_event_source* timer;
+} ring;
+
+static struct ring_entry* newest_entry(void) {
+    return &ring.entries[(ring.head + PRIMARY_RING_SIZE - 1) % PRIMARY_RING_SIZE];
+}
+
+static bool same_data(const struct buffer* a, const struct buffer* b) {
+    return a == b || (a->size == b->size && memcmp(a->data, b->data, a->size) == 0);
+}
+
+static void save_entry(struct ring_entry* e, const char* reason) {
+    if (e->buf == NULL || e->saved) {
+        return;
+    }
+
+    log_print(DEBUG, "primary: saving %zu bytes of %s, %s", e->buf->size, e->mime_type, reason);
+    queue_for_insertion(buffer_ref(e->buf), xstrdup(e->mime_type));
+    maintenance_schedule(MAINTENANCE_IDLE_DELAY_MS);
+    e->saved = true;
+}
+
+static void free_entry(struct ring_entry* e) {
+    buffer_unref(e->buf);
+    free(e->mime_type);
+    *e = (struct ring_entry){0};
+}
+
+static int on_timer(struct pollen_event_source* src, void* data) {
+    save_entry(newest_entry(), "it did not change for a while");
+    return 0;
+}
+
+bool primary_init(void) {
+    ring.timer = pollen_loop_add_timer(eventloop, CLOCK_MONOTONIC, on_timer, NULL);
+    if (ring.timer == NULL) {
+        log_print(ERR, "primary: failed to create timer");
+        return false;
+    }
+
+    return true;
+}
+
+void primary_cleanup(void) {
+    /* its timer won't get to fire anymore, db thread drains the queue before exiting */
+    save_entry(newest_entry(), "cclipd is exiting");
+
+    if (ring.timer != NULL) {
+        pollen_event_source_remove(ring.timer);
+        ring.timer = NULL;
+    }
+
+    for (size_t i = 0; i < PRIMARY_RING_SIZE; i++) {
+        free_entry(&ring.entries[i]);
+    }
+}
+
+void primary_push(struct buffer* buf, const char* mime_type) {
+    if (config.primary_stable_s == 0 || ring.timer == NULL) {
+        queue_for_insertion(buffer_ref(buf), xstrdup(mime_type));
+        maintenance_schedule(MAINTENANCE_IDLE_DELAY_MS);
+        return;
+    }
+
+    /* oldest entry is dropped, unless it was promoted it's never saved */
+    struct ring_entry* e = &ring.entries[ring.head];
+    free_entry(e);
+    e->buf = buffer_ref(buf);
+    e->mime_type = xstrdup(mime_type);
+    ring.head = (ring.head + 1) % PRIMARY_RING_SIZE;
+
+    log_print(TRACE, "primary: keeping %zu bytes of %s in memory", buf->size, mime_type);
+
+    if (!pollen_timer_arm_ms(ring.timer, false, config.primary_stable_s * 1000ul, 0)) {
+        log_print(ERR, "primary: failed to arm timer");
+    }
+}
+
+void primary_pasted(const struct buffer* buf) {
+    for (size_t i = 0; i < PRIMARY_RING_SIZE; i++) {
+        struct ring_entry* e = &ring.entries[i];
+        if (e->buf != NULL && same_data(e->buf, buf)) {
+            save_entry(e, "it was pasted");
+        }
+    }
+}
+
+void primary_copied(const struct buffer* buf) {
+    for (size_t i = 0; i < PRIMARY_RING_SIZE; i++) {
+        struct ring_entry* e = &ring.entries[i];
+        if (e->buf != NULL && !e->saved && same_data(e->buf, buf)) {
+            log_print(DEBUG, "primary: %zu bytes of %s were copied to regular selection",
+                      e->buf->size, e->mime_type);
+            e->saved = true;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "buffer.h"
+
+/*
+ * Primary selection changes with every highlight, so entries received from it are
+ * first kept in a small ring in memory. An entry is only saved to db once it is
+ * promoted: pasted while we are serving it, copied to regular selection, or left
+ * as primary selection for config.primary_stable_s seconds.
+ */
+
+#define PRIMARY_RING_SIZE 16
+
+bool primary_init(void);
+/* saves newest entry unless it was saved already, so must be called before db thread stops */
+void primary_cleanup(void);
+
+/* new contents of primary selection, takes its own reference to buf */
+void primary_push(struct buffer* buf, const char* mime_type);
+/* buf, which is current primary selection, was pasted from us */
+void primary_pasted(const struct buffer* buf);
+/* buf was received from regular selection and is being saved from there */
+void primary_copied(const struct buffer* buf);
@@ -0,0 +1,1521 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+#include "server.h"
+#include "cache.h"
+#include "sql.h"
+#include "config.h"
+#include "db.h"
+#include "query.h"
+#include "snapshot.h"
+#include "proto.h"
+#include "pollen.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "log.h"
+
+/* number of distinct prepared statements kept around */
+#define STMT_CACHE_SIZE 16
+/* snapshot is rebuilt this long after the first change, so bursts of changes cause one rebuild */
+#define SNAPSHOT_REBUILD_DELAY_MS 200
+/* how much is read from client socket at once */
+#define CLIENT_READ_SIZE ((size_t)16 * 1024)
+/* watcher that has this much output it didn't read yet is considered stuck and dropped */
+#define WATCH_MAX_BACKLOG ((size_t)4 * 1024 * 1024)
+
+struct cached_stmt {
+    char* sql;
+    struct sqlite3_stmt* stmt;
+};
+
+struct passed_fd {
+    int fd;
+    size_t offset; /* sent along with output byte at this offset */
+};
+
+/*
+ * Client sockets are non-blocking. Replies are framed into client output buffer
+ * and written as socket becomes writable, so a client that doesn't read doesn't stall
+ * anyone else. Next request is not handled until reply to the previous one is written.
+ */
+struct client {
+    struct pollen_event_source* source;
+    int fd;
+    uint32_t events; /* what we currently wait for on fd */
+    bool greeted;
+    bool closing; /* drop once output is written */
+    bool dead; /* drop on next event, see kill_client */
+
+    VEC(uint8_t) in; /* received bytes that don't make a complete request yet */
+    VEC(uint8_t) out; /* framed replies not yet written to socket */
+    size_t out_pos; /* how much of out was written */
+    VEC(struct passed_fd) fds; /* fds attached to out, ordered by offset */
+
+    bool watching;
+    struct get_query watch; /* fields to print for each change */
+
+    bool suspending; /* db writes are suspended on behalf of this client */
+    bool waiting_backup;
+
+    struct query_job* job; /* list or search run by query thread, NULL if none */
+};
+
+/* list or search request handed over to query thread */
+struct query_job {
+    struct client* client; /* NULL once client is gone, protected by query.mutex */
+    struct proto_msg request;
+    bool ok;
+    VEC(uint8_t) out; /* output not split into frames yet */
+    char error[256]; /* set when ok is false */
+};
+
+struct change {
+    enum proto_change_type type;
+    int64_t id;
+};
+
+static struct {
+    bool running;
+    pthread_t thread;
+
+    struct pollen_loop* loop;
+    struct pollen_event_source* quit_efd;
+
+    int listen_fd;
+    struct sockaddr_un addr;
+
+    char db_path[PATH_MAX];
+    struct sqlite3* db;
+    int64_t data_version;
+
+    VEC(struct cached_stmt) stmts;
+    VEC(struct client *) clients;
+
+    struct proto_msg request;
+    VEC(uint8_t) out;
+
+    /*
+     * Preformatted output of plain list, see snapshot.h.
+     * Building it lists the whole history, which takes time proportional to its size,
+     * so it is done by a separate thread with its own connection while server thread
+     * keeps answering queries (from the old snapshot as long as it is current).
+     */
+    struct {
+        char* path;
+        int fd;
+        struct pollen_event_source* timer;
+        bool rebuild_pending;
+
+        pthread_t thread;
+        bool thread_running;
+        /* fields below are protected by mutex */
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        bool requested;
+        bool quit;
+        int built_fd; /* new snapshot not yet picked up by server thread */
+        struct pollen_event_source* efd;
+    } snapshot;
+
+    /*
+     * List and search queries may visit the whole history too, so they are run
+     * one after another by query thread with its own connection, and their output
+     * is queued to client once complete. Server thread keeps answering others meanwhile.
+     */
+    struct {
+        struct sqlite3* db;
+        pthread_t thread;
+        bool thread_running;
+        /* fields below are protected by mutex */
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        VEC(struct query_job *) queued;
+        VEC(struct query_job *) done;
+        bool quit;
+        struct pollen_event_source* efd;
+    } query;
+
+    /* changes reported by db thread, protected by mutex */
+    struct {
+        pthread_mutex_t mutex;
+        struct pollen_event_source* efd;
+        VEC(struct change) pending;
+    } changes;
+
+    /* result of the last backup reported by db thread, protected by mutex */
+    struct {
+        pthread_mutex_t mutex;
+        struct pollen_event_source* efd;
+        bool ok;
+        char path[PATH_MAX];
+    } backup;
+} server = {
+    .listen_fd = -1,
+    .data_version = -1,
+    .snapshot.fd = -1,
+    .snapshot.mutex = PTHREAD_MUTEX_INITIALIZER,
+    .snapshot.cond = PTHREAD_COND_INITIALIZER,
+    .snapshot.built_fd = -1,
+    .query.mutex = PTHREAD_MUTEX_INITIALIZER,
+    .query.cond = PTHREAD_COND_INITIALIZER,
+    .changes.mutex = PTHREAD_MUTEX_INITIALIZER,
+    .backup.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static struct sqlite3_stmt* get_stmt(const char* sql) {
+    VEC_FOREACH(&server.stmts, i) {
+        struct cached_stmt* cs = &server.stmts.data[i];
+        if (STREQ(cs->sql, sql)) {
+            return cs->stmt;
+        }
+    }
+
+    struct sqlite3_stmt* stmt = NULL;
+    if (!db_prepare_stmt(server.db, sql, &stmt)) {
+        return NULL;
+    }
+
+    if (VEC_SIZE(&server.stmts) >= STMT_CACHE_SIZE) {
+        /* evict the oldest one */
+        struct cached_stmt* oldest = &server.stmts.data[0];
+        sqlite3_finalize(oldest->stmt);
+        free(oldest->sql);
+        VEC_ERASE(&server.stmts, 0);
+    }
+
+    struct cached_stmt* cs = VEC_EMPLACE_BACK(&server.stmts);
+    cs->sql = xstrdup(sql);
+    cs->stmt = stmt;
+    log_print(TRACE, "server: prepared and cached statement %s", sql);
+
+    return stmt;
+}
+
+static void release_stmt(struct sqlite3_stmt* stmt) {
+    /* resetting is important: this ends the read transaction */
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+static void queue_frame(struct client* client, uint8_t type, const void* data, size_t size) {
+    uint8_t* dst = VEC_EMPLACE_BACK_N(&client->out, PROTO_HEADER_SIZE + size);
+    proto_write_header(dst, type, size);
+    if (size > 0) {
+        memcpy(&dst[PROTO_HEADER_SIZE], data, size);
+    }
+}
+
+/* queues frame without payload with a duplicate of fd attached to it */
+static bool queue_frame_fd(struct client* client, uint8_t type, int fd) {
+    const int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dup_fd < 0) {
+        log_print(WARN, "server: failed to dup fd %d: %s", fd, strerror(errno));
+        return false;
+    }
+
+    struct passed_fd pfd = { .fd = dup_fd, .offset = VEC_SIZE(&client->out) };
+    VEC_APPEND(&client->fds, &pfd);
+    queue_frame(client, type, NULL, 0);
+
+    return true;
+}
+
+static void send_error(struct client* client, const char* fmt, ...) {
+    char buf[512];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    struct proto_msg msg = {0};
+    proto_msg_reset(&msg, PROTO_ERROR);
+    proto_put_str(&msg, buf);
+    queue_frame(client, msg.type, msg.payload.data, msg.payload.size);
+    proto_msg_free(&msg);
+}
+
+static void send_end(struct client* client) {
+    queue_frame(client, PROTO_END, NULL, 0);
+}
+
+/* sends data split into frames no bigger than PROTO_MAX_DATA_SIZE */
+static void send_data(struct client* client, const uint8_t* data, size_t size) {
+    for (size_t off = 0; off < size; off += PROTO_MAX_DATA_SIZE) {
+        const size_t chunk = MIN(size - off, PROTO_MAX_DATA_SIZE);
+        queue_frame(client, PROTO_DATA, &data[off], chunk);
+    }
+}
+
+static void flush_output(struct client* client) {
+    /* buffer may overshoot frame size limit by up to one row, split it */
+    send_data(client, server.out.data, server.out.size);
+    VEC_CLEAR(&server.out);
+}
+
+static void output_row(struct client* client, struct sqlite3_stmt* stmt, int ncols) {
+    struct iovec iov[SELECT_FIELDS_COUNT * 2];
+    query_row_to_iov(stmt, ncols, iov);
+
+    for (int i = 0; i < ncols * 2; i++) {
+        memcpy(VEC_EMPLACE_BACK_N(&server.out, iov[i].iov_len),
+               iov[i].iov_base, iov[i].iov_len);
+    }
+
+    if (VEC_SIZE(&server.out) >= PROTO_MAX_DATA_SIZE) {
+        flush_output(client);
+    }
+}
+
+static size_t client_backlog(const struct client* client) {
+    return VEC_SIZE(&client->out) - client->out_pos;
+}
+
+/* writes as much output as socket takes without blocking, returns false on error */
+static bool client_write(struct client* client) {
+    while (client_backlog(client) > 0) {
+        const uint8_t* data = &client->out.data[client->out_pos];
+        size_t size = client_backlog(client);
+
+        int passed_fd = -1;
+        if (VEC_SIZE(&client->fds) > 0) {
+            const struct passed_fd* pfd = &client->fds.data[0];
+            if (pfd->offset == client->out_pos) {
+                passed_fd = pfd->fd;
+            } else {
+                /* fd has to travel with the first byte of its frame */
+                size = MIN(size, pfd->offset - client->out_pos);
+            }
+        }
+
+        ssize_t ret;
+        if (passed_fd >= 0) {
+            ret = proto_send_with_fd(client->fd, data, size, passed_fd);
+        } else {
+            ret = send(client->fd, data, size, MSG_NOSIGNAL);
+        }
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            log_print(DEBUG, "server: failed to write to client on fd %d: %s",
+                      client->fd, strerror(errno));
+            return false;
+        }
+
+        if (passed_fd >= 0) {
+            close(passed_fd);
+            VEC_ERASE(&client->fds, 0);
+        }
+        client->out_pos += ret;
+    }
+
+    if (client_backlog(client) == 0) {
+        VEC_FREE(&client->out);
+        client->out_pos = 0;
+    } else if (client->out_pos >= VEC_SIZE(&client->out) / 2) {
+        /* don't let buffer of a client that never catches up grow forever */
+        VEC_ERASE_N(&client->out, 0, client->out_pos);
+        VEC_FOREACH(&client->fds, i) {
+            client->fds.data[i].offset -= client->out_pos;
+        }
+        client->out_pos = 0;
+    }
+
+    return true;
+}
+
+/*
+ * Wait for socket to become writable while there is output, for requests otherwise.
+ * While query thread runs client's request there's nothing to do but notice hangup,
+ * which is reported regardless of requested events.
+ */
+static void client_update_events(struct client* client) {
+    uint32_t events;
+    if (client->job != NULL) {
+        events = 0;
+    } else {
+        events = (client_backlog(client) > 0) ? EPOLLOUT : EPOLLIN;
+    }
+    if (events != client->events && pollen_fd_modify_events(client->source, events)) {
+        client->events = events;
+    }
+}
+
+/*
+ * Only client's own fd callback can free it because another event for it
+ * might be pending in the same loop iteration. Shutting socket down
+ * makes sure that callback runs soon.
+ */
+static void kill_client(struct client* client) {
+    client->dead = true;
+    shutdown(client->fd, SHUT_RDWR);
+}
+
+/*
+ * Makes sure cache reflects changes made to db by anyone (including cclip delete/tag/wipe).
+ * data_version only changes when some other connection commits, so as long as
+ * nobody touches the db this doesn't read any pages. db thread updates cache with
+ * its own changes, so after its commits only change sequence number has to be read.
+ */
+static void sync_cache(void) {
+    struct sqlite3_stmt* stmt = get_stmt("PRAGMA data_version");
+    if (stmt == NULL) {
+        return;
+    }
+
+    int64_t data_version = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        data_version = sqlite3_column_int64(stmt, 0);
+    }
+    release_stmt(stmt);
+
+    if (data_version == server.data_version && data_version >= 0
+            && !cache_needs_revalidation()) {
+        return;
+    }
+
+    /* sequence number and revalidation query must see the same db state */
+    if (sqlite3_exec(server.db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+        return;
+    }
+
+    int64_t seq = -1;
+    stmt = get_stmt("SELECT value FROM sequence");
+    if (stmt != NULL && sqlite3_step(stmt) == SQLITE_ROW) {
+        seq = sqlite3_column_int64(stmt, 0);
+    }
+    if (stmt != NULL) {
+        release_stmt(stmt);
+    }
+
+    if (seq >= 0 && (cache_is_current(seq) || cache_revalidate(server.db, seq))) {
+        server.data_version = data_version;
+    }
+
+    sqlite3_exec(server.db, "COMMIT", NULL, NULL, NULL);
+}
+
+static void output_cached_entry(const struct cached_entry* e,
+                                const enum select_fields* fields, int nfields) {
+    for (int i = 0; i < nfields; i++) {
+        char buf[32];
+        const char* str = NULL;
+
+        switch (fields[i]) {
+        case FIELD_ID:
+            snprintf(buf, sizeof(buf), "%li", e->id);
+            str = buf;
+            break;
+        case FIELD_PREVIEW:
+            str = e->preview;
+            break;
+        case FIELD_MIME_TYPE:
+            str = e->mime_type;
+            break;
+        case FIELD_DATA_SIZE:
+            snprintf(buf, sizeof(buf), "%zu", e->data_size);
+            str = buf;
+            break;
+        case FIELD_TIMESTAMP:
+            snprintf(buf, sizeof(buf), "%li", (int64_t)e->timestamp);
+            str = buf;
+            break;
+        case FIELD_TAGS:
+            str = (e->tags != NULL) ? e->tags : "";
+            break;
+        case FIELD_SEQ:
+            snprintf(buf, sizeof(buf), "%li", e->seq);
+            str = buf;
+            break;
+        default:
+            str = "";
+            break;
+        }
+
+        const size_t len = strlen(str);
+        uint8_t* dst = VEC_EMPLACE_BACK_N(&server.out, len + 1);
+        memcpy(dst, str, len);
+        dst[len] = (i < nfields - 1) ? '\t' : '\n';
+    }
+}
+
+/* returns false on cache miss */
+static bool handle_get_cached(struct client* client, const struct get_query* q) {
+    struct cached_entry e;
+    if (!cache_lookup(q->id, q->nfields == 0, &e)) {
+        return false;
+    }
+
+    if (q->nfields == 0) {
+        send_data(client, e.data->data, e.data->size);
+    } else {
+        output_cached_entry(&e, q->fields, q->nfields);
+        flush_output(client);
+    }
+    send_end(client);
+
+    cached_entry_release(&e);
+
+    return true;
+}
+
+static struct sqlite3_stmt* runner_prepare(struct query_runner* r, const char* sql) {
+    return get_stmt(sql);
+}
+
+static void runner_release(struct query_runner* r, struct sqlite3_stmt* stmt) {
+    release_stmt(stmt);
+}
+
+static void* snapshot_thread_entrypoint(void* data) {
+    struct sqlite3* db = db_open_readonly(server.db_path);
+    if (db == NULL) {
+        log_print(WARN, "server: failed to open database for list snapshots");
+        return NULL;
+    }
+
+    struct query_runner runner;
+    query_runner_init(&runner, db, -1);
+
+    pthread_mutex_lock(&server.snapshot.mutex);
+    while (true) {
+        while (!server.snapshot.requested && !server.snapshot.quit) {
+            pthread_cond_wait(&server.snapshot.cond, &server.snapshot.mutex);
+        }
+        if (server.snapshot.quit) {
+            break;
+        }
+        server.snapshot.requested = false;
+        pthread_mutex_unlock(&server.snapshot.mutex);
+
+        int64_t seq;
+        const int fd = snapshot_build(&runner, server.snapshot.path, &seq);
+        if (fd < 0) {
+            log_print(WARN, "server: failed to rebuild list snapshot");
+        } else {
+            log_print(DEBUG, "server: rebuilt list snapshot at change sequence %li", seq);
+        }
+
+        pthread_mutex_lock(&server.snapshot.mutex);
+        if (fd >= 0) {
+            if (server.snapshot.built_fd >= 0) {
+                close(server.snapshot.built_fd);
+            }
+            server.snapshot.built_fd = fd;
+            pollen_efd_trigger(server.snapshot.efd);
+        }
+    }
+    pthread_mutex_unlock(&server.snapshot.mutex);
+
+    db_close(db);
+    return NULL;
+}
+
+static int on_snapshot_built(struct pollen_event_source* src, uint64_t val, void* data) {
+    pthread_mutex_lock(&server.snapshot.mutex);
+    const int fd = server.snapshot.built_fd;
+    server.snapshot.built_fd = -1;
+    pthread_mutex_unlock(&server.snapshot.mutex);
+
+    if (fd < 0) {
+        return 0;
+    }
+
+    if (server.snapshot.fd >= 0) {
+        close(server.snapshot.fd);
+    }
+    server.snapshot.fd = fd;
+
+    return 0;
+}
+
+static void rebuild_snapshot(void) {
+    server.snapshot.rebuild_pending = false;
+
+    /* if a rebuild is already running, another one follows it */
+    pthread_mutex_lock(&server.snapshot.mutex);
+    server.snapshot.requested = true;
+    pthread_cond_signal(&server.snapshot.cond);
+    pthread_mutex_unlock(&server.snapshot.mutex);
+}
+
+static void stop_snapshot_thread(void) {
+    if (!server.snapshot.thread_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&server.snapshot.mutex);
+    server.snapshot.quit = true;
+    pthread_cond_signal(&server.snapshot.cond);
+    pthread_mutex_unlock(&server.snapshot.mutex);
+
+    pthread_join(server.snapshot.thread, NULL);
+    server.snapshot.thread_running = false;
+}
+
+static int on_snapshot_timer(struct pollen_event_source* src, void* data) {
+    rebuild_snapshot();
+    return 0;
+}
+
+static void schedule_snapshot_rebuild(void) {
+    if (server.snapshot.rebuild_pending) {
+        return;
+    }
+
+    if (pollen_timer_arm_ms(server.snapshot.timer, false, SNAPSHOT_REBUILD_DELAY_MS, 0)) {
+        server.snapshot.rebuild_pending = true;
+    }
+}
+
+static bool job_write(struct query_runner* r, const struct iovec* iov, int iovcnt) {
+    struct query_job* job = r->data;
+
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(VEC_EMPLACE_BACK_N(&job->out, iov[i].iov_len), iov[i].iov_base, iov[i].iov_len);
+    }
+
+    return true;
+}
+
+static void run_query_job(struct query_job* job, struct query_runner* r) {
+    struct proto_msg* msg = &job->request;
+    r->data = job;
+
+    if (msg->type == PROTO_LIST) {
+        struct list_query q;
+        if (!list_query_decode(&q, msg)) {
+            snprintf(r->error, sizeof(r->error), "malformed list request");
+            job->ok = false;
+        } else {
+            job->ok = list_query_run(&q, r);
+        }
+    } else {
+        struct search_query q;
+        if (!search_query_decode(&q, msg)) {
+            snprintf(r->error, sizeof(r->error), "malformed search request");
+            job->ok = false;
+        } else {
+            job->ok = search_query_run(&q, r);
+        }
+    }
+
+    if (!job->ok) {
+        /* drop partial output, error replaces it */
+        VEC_FREE(&job->out);
+        snprintf(job->error, sizeof(job->error), "%s", r->error);
+    }
+}
+
+static void* query_thread_entrypoint(void* data) {
+    struct query_runner runner;
+    query_runner_init(&runner, server.query.db, -1);
+    runner.write = job_write;
+
+    pthread_mutex_lock(&server.query.mutex);
+    while (true) {
+        while (VEC_SIZE(&server.query.queued) == 0 && !server.query.quit) {
+            pthread_cond_wait(&server.query.cond, &server.query.mutex);
+        }
+        if (server.query.quit) {
+            break;
+        }
+        struct query_job* job = server.query.queued.data[0];
+        VEC_ERASE(&server.query.queued, 0);
+        /* nobody is waiting for output of a client that disconnected */
+        const bool wanted = job->client != NULL;
+        pthread_mutex_unlock(&server.query.mutex);
+
+        if (wanted) {
+            run_query_job(job, &runner);
+        }
+
+        pthread_mutex_lock(&server.query.mutex);
+        VEC_APPEND(&server.query.done, &job);
+        pollen_efd_trigger(server.query.efd);
+    }
+    pthread_mutex_unlock(&server.query.mutex);
+
+    return NULL;
+}
+
+static void free_query_job(struct query_job* job) {
+    proto_msg_free(&job->request);
+    VEC_FREE(&job->out);
+    free(job);
+}
+
+static void start_query_job(struct client* client, const struct proto_msg* msg) {
+    struct query_job* job = xcalloc(1, sizeof(*job));
+    job->client = client;
+    proto_msg_reset(&job->request, msg->type);
+    VEC_APPEND_N(&job->request.payload, msg->payload.data, msg->payload.size);
+    client->job = job;
+
+    pthread_mutex_lock(&server.query.mutex);
+    VEC_APPEND(&server.query.queued, &job);
+    pthread_cond_signal(&server.query.cond);
+    pthread_mutex_unlock(&server.query.mutex);
+}
+
+static bool client_handle_input(struct client* client);
+
+static void finish_query_job(struct client* client, struct query_job* job) {
+    client->job = NULL;
+
+    if (job->ok) {
+        send_data(client, job->out.data, VEC_SIZE(&job->out));
+        send_end(client);
+    } else {
+        send_error(client, "%s", job->error);
+    }
+
+    /* requests that arrived meanwhile are still buffered */
+    if (!client_write(client) || !client_handle_input(client)) {
+        kill_client(client);
+        return;
+    }
+    client_update_events(client);
+}
+
+static int on_query_done(struct pollen_event_source* src, uint64_t val, void* data) {
+    while (true) {
+        pthread_mutex_lock(&server.query.mutex);
+        if (VEC_SIZE(&server.query.done) == 0) {
+            pthread_mutex_unlock(&server.query.mutex);
+            break;
+        }
+        struct query_job* job = server.query.done.data[0];
+        VEC_ERASE(&server.query.done, 0);
+        struct client* client = job->client;
+        pthread_mutex_unlock(&server.query.mutex);
+
+        if (client != NULL) {
+            finish_query_job(client, job);
+        }
+        free_query_job(job);
+    }
+
+    return 0;
+}
+
+static void stop_query_thread(void) {
+    if (!server.query.thread_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&server.query.mutex);
+    server.query.quit = true;
+    pthread_cond_signal(&server.query.cond);
+    pthread_mutex_unlock(&server.query.mutex);
+
+    pthread_join(server.query.thread, NULL);
+    server.query.thread_running = false;
+}
+
+static void handle_list(struct client* client, struct proto_msg* msg) {
+    struct list_query q;
+    if (!list_query_decode(&q, msg)) {
+        send_error(client, "malformed list request");
+        return;
+    }
+
+    if (list_query_is_default(&q)) {
+        struct query_runner runner = {
+            .db = server.db,
+            .fd = -1,
+            .prepare = runner_prepare,
+            .release = runner_release,
+        };
+
+        if (server.snapshot.fd >= 0 && snapshot_is_current(server.snapshot.fd, &runner)
+                && queue_frame_fd(client, PROTO_SNAPSHOT, server.snapshot.fd)) {
+            send_end(client);
+            return;
+        }
+        /* database was changed by someone who didn't tell us */
+        schedule_snapshot_rebuild();
+    }
+
+    start_query_job(client, msg);
+}
+
+static void handle_search(struct client* client, struct proto_msg* msg) {
+    start_query_job(client, msg);
+}
+
+static void handle_get(struct client* client, struct proto_msg* msg) {
+    struct get_query q;
+    if (!get_query_decode(&q, msg)) {
+        send_error(client, "malformed get request");
+        return;
+    }
+
+    sync_cache();
+    if (handle_get_cached(client, &q)) {
+        return;
+    }
+
+    struct string sql = {0};
+    if (!get_query_build_sql(&q, &sql)) {
+        string_free(&sql);
+        send_error(client, "failed to build query");
+        return;
+    }
+
+    struct sqlite3_stmt* stmt = get_stmt(sql.str);
+    string_free(&sql);
+    if (stmt == NULL) {
+        send_error(client, "failed to prepare statement: %s", sqlite3_errmsg(server.db));
+        return;
+    }
+
+    get_query_bind(&q, stmt);
+
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        if (q.nfields == 0) {
+            const uint8_t* data = sqlite3_column_blob(stmt, 0);
+            size_t size = sqlite3_column_bytes(stmt, 0);
+
+            send_data(client, data, size);
+        } else {
+            output_row(client, stmt, sqlite3_column_count(stmt));
+            flush_output(client);
+        }
+        send_end(client);
+    } else if (rc == SQLITE_DONE) {
+        send_error(client, "no entry found with id %li", q.id);
+    } else {
+        send_error(client, "sqlite error: %s", sqlite3_errmsg(server.db));
+    }
+
+    release_stmt(stmt);
+}
+
+/* appends row for entry q->id to output, returns false if there is no such entry */
+static bool append_entry_row(const struct get_query* q) {
+    struct cached_entry e;
+    if (cache_lookup(q->id, false, &e)) {
+        output_cached_entry(&e, q->fields, q->nfields);
+        cached_entry_release(&e);
+        return true;
+    }
+
+    struct string sql = {0};
+    if (!get_query_build_sql(q, &sql)) {
+        string_free(&sql);
+        return false;
+    }
+    struct sqlite3_stmt* stmt = get_stmt(sql.str);
+    string_free(&sql);
+    if (stmt == NULL) {
+        return false;
+    }
+
+    get_query_bind(q, stmt);
+
+    struct iovec iov[SELECT_FIELDS_COUNT * 2];
+    const int ncols = sqlite3_column_count(stmt);
+    const bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        query_row_to_iov(stmt, ncols, iov);
+        for (int i = 0; i < ncols * 2; i++) {
+            memcpy(VEC_EMPLACE_BACK_N(&server.out, iov[i].iov_len),
+                   iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+
+    release_stmt(stmt);
+    return found;
+}
+
+/* formats a change as printed by cclip watch: EVENT TAB ID [TAB FIELDS...] */
+static bool append_change(const struct change* change, struct get_query* q) {
+    const size_t old_size = VEC_SIZE(&server.out);
+
+    char prefix[64];
+    int len = snprintf(prefix, sizeof(prefix), "%s\t%li",
+                       proto_change_name(change->type), change->id);
+    memcpy(VEC_EMPLACE_BACK_N(&server.out, len), prefix, len);
+
+    if (change->type == PROTO_CHANGE_DELETE || q->nfields == 0) {
+        VEC_APPEND(&server.out, &(uint8_t){ '\n' });
+        return true;
+    }
+
+    VEC_APPEND(&server.out, &(uint8_t){ '\t' });
+    q->id = change->id;
+    if (!append_entry_row(q)) {
+        /* deleted before we got to it, delete event will follow */
+        server.out.size = old_size;
+        return false;
+    }
+
+    return true;
+}
+
+static void dispatch_changes(void) {
+    typeof(server.changes.pending) changes;
+
+    pthread_mutex_lock(&server.changes.mutex);
+    changes = server.changes.pending;
+    server.changes.pending = (typeof(server.changes.pending)){0};
+    pthread_mutex_unlock(&server.changes.mutex);
+
+    if (VEC_SIZE(&changes) == 0) {
+        goto out;
+    }
+
+    sync_cache();
+    schedule_snapshot_rebuild();
+
+    VEC_FOREACH(&server.clients, i) {
+        struct client* client = server.clients.data[i];
+        if (!client->watching || client->dead) {
+            continue;
+        }
+
+        VEC_FOREACH(&changes, j) {
+            append_change(&changes.data[j], &client->watch);
+            if (VEC_SIZE(&server.out) >= PROTO_MAX_DATA_SIZE) {
+                flush_output(client);
+            }
+        }
+        flush_output(client);
+
+        if (!client_write(client) || client_backlog(client) > WATCH_MAX_BACKLOG) {
+            log_print(DEBUG, "server: watcher on fd %d is gone or too slow, dropping", client->fd);
+            kill_client(client);
+        } else {
+            client_update_events(client);
+        }
+    }
+
+out:
+    VEC_FREE(&changes);
+}
+
+static void queue_change(enum proto_change_type type, int64_t id) {
+    VEC_APPEND(&server.changes.pending, &((struct change){ .type = type, .id = id }));
+}
+
+static int on_changes(struct pollen_event_source* src, uint64_t val, void* data) {
+    dispatch_changes();
+    return 0;
+}
+
+static void handle_watch(struct client* client, struct proto_msg* msg) {
+    if (!get_query_decode(&client->watch, msg)) {
+        send_error(client, "malformed watch request");
+        return;
+    }
+
+    log_print(DEBUG, "server: client on fd %d is now watching for changes", client->fd);
+    client->watching = true;
+}
+
+static void handle_notify(struct proto_msg* msg) {
+    uint8_t type;
+    int64_t id;
+    if (!proto_get_u8(msg, &type) || !proto_get_i64(msg, &id) || type >= PROTO_CHANGE_TYPE_COUNT) {
+        log_print(DEBUG, "server: ignoring malformed notification");
+        return;
+    }
+
+    pthread_mutex_lock(&server.changes.mutex);
+    queue_change(type, id);
+    pthread_mutex_unlock(&server.changes.mutex);
+
+    /* consecutive notifications from the same client are dispatched in one go */
+    pollen_efd_trigger(server.changes.efd);
+}
+
+static void handle_suspend(struct client* client) {
+    if (!client->suspending) {
+        log_print(DEBUG, "server: client on fd %d suspends db writes", client->fd);
+        suspend_db_writes();
+        client->suspending = true;
+    }
+    send_end(client);
+}
+
+static void handle_resume(struct client* client) {
+    if (client->suspending) {
+        log_print(DEBUG, "server: client on fd %d resumes db writes", client->fd);
+        resume_db_writes();
+        client->suspending = false;
+    }
+    send_end(client);
+}
+
+static void handle_backup(struct client* client) {
+    if (config.backup_dir == NULL) {
+        send_error(client, "backups are disabled, start cclipd with -b");
+        return;
+    }
+
+    log_print(DEBUG, "server: client on fd %d requested backup", client->fd);
+    client->waiting_backup = true;
+    request_backup();
+}
+
+static int on_backup_done(struct pollen_event_source* src, uint64_t val, void* data) {
+    char path[PATH_MAX];
+
+    pthread_mutex_lock(&server.backup.mutex);
+    const bool ok = server.backup.ok;
+    memcpy(path, server.backup.path, sizeof(path));
+    pthread_mutex_unlock(&server.backup.mutex);
+
+    VEC_FOREACH(&server.clients, i) {
+        struct client* client = server.clients.data[i];
+        if (!client->waiting_backup || client->dead) {
+            continue;
+        }
+        client->waiting_backup = false;
+
+        if (ok) {
+            VEC_APPEND_N(&server.out, (uint8_t*)path, strlen(path));
+            VEC_APPEND(&server.out, &(uint8_t){ '\n' });
+            flush_output(client);
+            send_end(client);
+        } else {
+            send_error(client, "backup failed, see cclipd log for details");
+        }
+
+        if (client_write(client)) {
+            client_update_events(client);
+        } else {
+            kill_client(client);
+        }
+    }
+
+    return 0;
+}
+
+/* returns false if client should be disconnected */
+static bool handle_hello(struct client* client, struct proto_msg* msg) {
+    uint32_t version;
+    const char* db_path;
+    if (!proto_get_u32(msg, &version) || !proto_get_str(msg, &db_path) || db_path == NULL) {
+        send_error(client, "malformed hello");
+        return false;
+    }
+
+    if (version != PROTO_VERSION) {
+        send_error(client, "protocol version mismatch (client %u, server %u)",
+                   version, PROTO_VERSION);
+        return false;
+    }
+    if (!STREQ(db_path, server.db_path)) {
+        send_error(client, "database mismatch (client %s, server %s)", db_path, server.db_path);
+        return false;
+    }
+
+    client->greeted = true;
+    queue_frame(client, PROTO_OK, NULL, 0);
+    return true;
+}
+
+/* returns false if client should be disconnected once reply is written */
+static bool handle_request(struct client* client, struct proto_msg* msg) {
+    if (msg->type == PROTO_HELLO) {
+        return handle_hello(client, msg);
+    } else if (!client->greeted) {
+        send_error(client, "expected hello");
+        return false;
+    }
+
+    switch (msg->type) {
+    case PROTO_LIST:
+        handle_list(client, msg);
+        break;
+    case PROTO_GET:
+        handle_get(client, msg);
+        break;
+    case PROTO_SEARCH:
+        handle_search(client, msg);
+        break;
+    case PROTO_WATCH:
+        handle_watch(client, msg);
+        break;
+    case PROTO_NOTIFY:
+        handle_notify(msg);
+        break;
+    case PROTO_SUSPEND:
+        handle_suspend(client);
+        break;
+    case PROTO_RESUME:
+        handle_resume(client);
+        break;
+    case PROTO_BACKUP:
+        handle_backup(client);
+        break;
+    default:
+        send_error(client, "unknown request type %d", msg->type);
+        break;
+    }
+
+    return true;
+}
+
+static void free_client(struct client* client) {
+    if (client->suspending) {
+        resume_db_writes();
+    }
+
+    if (client->job != NULL) {
+        /* job is freed once query thread is done with it */
+        pthread_mutex_lock(&server.query.mutex);
+        client->job->client = NULL;
+        pthread_mutex_unlock(&server.query.mutex);
+    }
+
+    VEC_FOREACH(&client->fds, i) {
+        close(client->fds.data[i].fd);
+    }
+    VEC_FREE(&client->fds);
+    VEC_FREE(&client->in);
+    VEC_FREE(&client->out);
+    free(client);
+}
+
+static void drop_client(struct client* client) {
+    VEC_FOREACH(&server.clients, i) {
+        if (server.clients.data[i] == client) {
+            VEC_ERASE(&server.clients, i);
+            break;
+        }
+    }
+
+    pollen_event_source_remove(client->source);
+    free_client(client);
+}
+
+/* returns false on error, *eof is set when client closed connection */
+static bool client_read(struct client* client, bool* eof) {
+    VEC_RESERVE(&client->in, VEC_SIZE(&client->in) + CLIENT_READ_SIZE);
+
+    ssize_t ret;
+    do {
+        ret = recv(client->fd, &client->in.data[client->in.size], CLIENT_READ_SIZE, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        }
+        log_print(DEBUG, "server: failed to read from client on fd %d: %s",
+                  client->fd, strerror(errno));
+        return false;
+    }
+
+    *eof = ret == 0;
+    client->in.size += ret;
+    return true;
+}
+
+/*
+ * Handles complete requests from input buffer for as long as their replies are
+ * written right away and none of them is handed to query thread.
+ */
+static bool client_handle_input(struct client* client) {
+    struct proto_msg* msg = &server.request;
+    size_t pos = 0;
+    bool ok = true;
+
+    while (ok && !client->closing && client->job == NULL && client_backlog(client) == 0) {
+        const size_t avail = VEC_SIZE(&client->in) - pos;
+        if (avail < PROTO_HEADER_SIZE) {
+            break;
+        }
+
+        uint8_t type;
+        size_t size;
+        proto_read_header(&client->in.data[pos], &type, &size);
+        if (size > PROTO_MAX_REQUEST_SIZE) {
+            log_print(ERR, "server: request of size %zu is too big (max %zu)",
+                      size, PROTO_MAX_REQUEST_SIZE);
+            ok = false;
+            break;
+        }
+        if (avail - PROTO_HEADER_SIZE < size) {
+            break;
+        }
+
+        proto_msg_reset(msg, type);
+        VEC_APPEND_N(&msg->payload, &client->in.data[pos + PROTO_HEADER_SIZE], size);
+        pos += PROTO_HEADER_SIZE + size;
+
+        client->closing = !handle_request(client, msg);
+        ok = client_write(client);
+    }
+
+    if (pos > 0) {
+        VEC_ERASE_N(&client->in, 0, pos);
+    }
+
+    return ok;
+}
+
+static int on_client_ready(struct pollen_event_source* src, int fd, uint32_t ev, void* data) {
+    struct client* client = data;
+    bool eof = false;
+
+    if (client->dead) {
+        goto drop;
+    }
+
+    if ((ev & EPOLLOUT) && !client_write(client)) {
+        goto drop;
+    }
+    if ((ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !client_read(client, &eof)) {
+        goto drop;
+    }
+    if (!client_handle_input(client)) {
+        goto drop;
+    }
+
+    if (eof) {
+        log_print(TRACE, "server: client on fd %d disconnected", fd);
+        goto drop;
+    }
+    if (client->closing && client_backlog(client) == 0) {
+        log_print(DEBUG, "server: dropping client on fd %d", fd);
+        goto drop;
+    }
+
+    client_update_events(client);
+    return 0;
+
+drop:
+    drop_client(client);
+    return 0;
+}
+
+static int on_listen_ready(struct pollen_event_source* src, int fd, uint32_t ev, void* data) {
+    int client_fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (client_fd < 0) {
+        log_print(WARN, "server: failed to accept connection: %s", strerror(errno));
+        return 0;
+    }
+
+    struct client* client = xcalloc(1, sizeof(*client));
+    client->fd = client_fd;
+    client->events = EPOLLIN;
+    client->source = pollen_loop_add_fd(server.loop, client_fd, client->events, true,
+                                        on_client_ready, client);
+    if (client->source == NULL) {
+        log_print(ERR, "server: failed to add client fd to event loop: %s", strerror(errno));
+        close(client_fd);
+        free(client);
+        return 0;
+    }
+    VEC_APPEND(&server.clients, &client);
+
+    log_print(TRACE, "server: accepted client on fd %d", client_fd);
+    return 0;
+}
+
+static int on_quit(struct pollen_event_source* src, uint64_t val, void* data) {
+    pollen_loop_quit(server.loop, 0);
+    return 0;
+}
+
+static void* thread_entrypoint(void* data) {
+    rebuild_snapshot();
+    pollen_loop_run(server.loop);
+    return NULL;
+}
+
+static bool create_socket(const char* path) {
+    server.addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(server.addr.sun_path)) {
+        log_print(WARN, "server: socket path %s is too long", path);
+        return false;
+    }
+    strcpy(server.addr.sun_path, path);
+
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server.listen_fd < 0) {
+        log_print(WARN, "server: failed to create socket: %s", strerror(errno));
+        return false;
+    }
+
+    if (bind(server.listen_fd, (struct sockaddr *)&server.addr, sizeof(server.addr)) < 0) {
+        if (errno != EADDRINUSE) {
+            log_print(WARN, "server: failed to bind to %s: %s", path, strerror(errno));
+            return false;
+        }
+
+        /* either another cclipd is running, or it's a leftover from crashed one */
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int ret = connect(fd, (struct sockaddr *)&server.addr, sizeof(server.addr));
+        close(fd);
+        if (ret == 0) {
+            log_print(WARN, "server: another cclipd is already listening on %s", path);
+            return false;
+        }
+
+        log_print(DEBUG, "server: removing stale socket %s", path);
+        unlink(path);
+        if (bind(server.listen_fd, (struct sockaddr *)&server.addr, sizeof(server.addr)) < 0) {
+            log_print(WARN, "server: failed to bind to %s: %s", path, strerror(errno));
+            return false;
+        }
+    }
+    chmod(path, 0600);
+
+    if (listen(server.listen_fd, 16) < 0) {
+        log_print(WARN, "server: failed to listen on %s: %s", path, strerror(errno));
+        unlink(path);
+        return false;
+    }
+
+    return true;
+}
+
+static void cleanup(void) {
+    /* these use event loop and snapshot path */
+    stop_snapshot_thread();
+    stop_query_thread();
+
+    VEC_FOREACH(&server.clients, i) {
+        free_client(server.clients.data[i]);
+    }
+    VEC_FREE(&server.clients);
+
+    VEC_FOREACH(&server.query.queued, i) {
+        free_query_job(server.query.queued.data[i]);
+    }
+    VEC_FREE(&server.query.queued);
+    VEC_FOREACH(&server.query.done, i) {
+        free_query_job(server.query.done.data[i]);
+    }
+    VEC_FREE(&server.query.done);
+    server.query.efd = NULL;
+    server.query.quit = false;
+    if (server.query.db != NULL) {
+        db_close(server.query.db);
+        server.query.db = NULL;
+    }
+
+    /* this also closes client fds */
+    pollen_loop_cleanup(server.loop);
+    server.loop = NULL;
+
+    if (server.listen_fd >= 0) {
+        close(server.listen_fd);
+        unlink(server.addr.sun_path);
+        server.listen_fd = -1;
+    }
+
+    VEC_FOREACH(&server.stmts, i) {
+        sqlite3_finalize(server.stmts.data[i].stmt);
+        free(server.stmts.data[i].sql);
+    }
+    VEC_FREE(&server.stmts);
+
+    if (server.db != NULL) {
+        db_close(server.db);
+        server.db = NULL;
+    }
+
+    proto_msg_free(&server.request);
+    VEC_FREE(&server.out);
+
+    if (server.snapshot.fd >= 0) {
+        close(server.snapshot.fd);
+        server.snapshot.fd = -1;
+    }
+    free(server.snapshot.path);
+    server.snapshot.path = NULL;
+    server.snapshot.timer = NULL;
+    server.snapshot.rebuild_pending = false;
+    if (server.snapshot.built_fd >= 0) {
+        close(server.snapshot.built_fd);
+        server.snapshot.built_fd = -1;
+    }
+    server.snapshot.efd = NULL;
+    server.snapshot.requested = false;
+    server.snapshot.quit = false;
+
+    pthread_mutex_lock(&server.changes.mutex);
+    server.changes.efd = NULL;
+    VEC_FREE(&server.changes.pending);
+    pthread_mutex_unlock(&server.changes.mutex);
+
+    pthread_mutex_lock(&server.backup.mutex);
+    server.backup.efd = NULL;
+    pthread_mutex_unlock(&server.backup.mutex);
+}
+
+bool start_server_thread(const char* db_path) {
+    if (realpath(db_get_path(db_path), server.db_path) == NULL) {
+        log_print(WARN, "server: failed to resolve database path: %s", strerror(errno));
+        return false;
+    }
+
+    const char* socket_path = proto_socket_path(server.db_path);
+    if (socket_path == NULL) {
+        log_print(WARN, "XDG_RUNTIME_DIR is not set, not starting query server");
+        return false;
+    }
+
+    server.db = db_open_readonly(server.db_path);
+    if (server.db == NULL) {
+        goto err;
+    }
+
+    server.query.db = db_open_readonly(server.db_path);
+    if (server.query.db == NULL) {
+        goto err;
+    }
+
+    if (!create_socket(socket_path)) {
+        goto err;
+    }
+
+    server.loop = pollen_loop_create();
+    if (server.loop == NULL) {
+        goto err;
+    }
+
+    if (pollen_loop_add_fd(server.loop, server.listen_fd, EPOLLIN, false,
+                           on_listen_ready, NULL) == NULL) {
+        goto err;
+    }
+
+    server.quit_efd = pollen_loop_add_efd(server.loop, on_quit, NULL);
+    if (server.quit_efd == NULL) {
+        goto err;
+    }
+
+    server.snapshot.path = snapshot_path(server.db_path);
+    server.snapshot.timer = pollen_loop_add_timer(server.loop, CLOCK_MONOTONIC,
+                                                  on_snapshot_timer, NULL);
+    if (server.snapshot.timer == NULL) {
+        goto err;
+    }
+
+    server.snapshot.efd = pollen_loop_add_efd(server.loop, on_snapshot_built, NULL);
+    if (server.snapshot.efd == NULL) {
+        goto err;
+    }
+
+    server.query.efd = pollen_loop_add_efd(server.loop, on_query_done, NULL);
+    if (server.query.efd == NULL) {
+        goto err;
+    }
+
+    pthread_mutex_lock(&server.changes.mutex);
+    server.changes.efd = pollen_loop_add_efd(server.loop, on_changes, NULL);
+    pthread_mutex_unlock(&server.changes.mutex);
+    if (server.changes.efd == NULL) {
+        goto err;
+    }
+
+    pthread_mutex_lock(&server.backup.mutex);
+    server.backup.efd = pollen_loop_add_efd(server.loop, on_backup_done, NULL);
+    pthread_mutex_unlock(&server.backup.mutex);
+    if (server.backup.efd == NULL) {
+        goto err;
+    }
+
+    int ret = pthread_create(&server.snapshot.thread, NULL, snapshot_thread_entrypoint, NULL);
+    if (ret != 0) {
+        log_print(ERR, "failed to create thread: %s", strerror(ret));
+        goto err;
+    }
+    server.snapshot.thread_running = true;
+
+    ret = pthread_create(&server.query.thread, NULL, query_thread_entrypoint, NULL);
+    if (ret != 0) {
+        log_print(ERR, "failed to create thread: %s", strerror(ret));
+        goto err;
+    }
+    server.query.thread_running = true;
+
+    log_print(DEBUG, "starting server thread, listening on %s", socket_path);
+    ret = pthread_create(&server.thread, NULL, thread_entrypoint, NULL);
+    if (ret != 0) {
+        log_print(ERR, "failed to create thread: %s", strerror(ret));
+        goto err;
+    }
+
+    server.running = true;
+    return true;
+
+err:
+    cleanup();
+    return false;
+}
+
+void stop_server_thread(void) {
+    if (!server.running) {
+        return;
+    }
+
+    log_print(DEBUG, "stopping server thread");
+
+    pollen_efd_trigger(server.quit_efd);
+    pthread_join(server.thread, NULL);
+    server.running = false;
+
+    cleanup();
+}
+
+void server_notify_change(enum proto_change_type type, int64_t id) {
+    pthread_mutex_lock(&server.changes.mutex);
+    if (server.changes.efd != NULL) {
+        queue_change(type, id);
+        pollen_efd_trigger(server.changes.efd);
+    }
+    pthread_mutex_unlock(&server.changes.mutex);
+}
+
+void server_backup_done(const char* path) {
+    pthread_mutex_lock(&server.backup.mutex);
+    if (server.backup.efd != NULL) {
+        server.backup.ok = path != NULL;
+        snprintf(server.backup.path, sizeof(server.backup.path), "%s", path ? path : "");
+        pollen_efd_trigger(server.backup.efd);
+    }
+    pthread_mutex_unlock(&server.backup.mutex);
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "proto.h"
+
+/*
+ * Query server: answers read-only requests from cclip over a unix socket,
+ * so that cclip does not have to open the database itself.
+ * Runs in its own thread with its own read-only database connection.
+ */
+
+/*
+ * Not being able to start the server is not fatal, cclip will just read db directly.
+ * Reason of failure is logged.
+ */
+bool start_server_thread(const char* db_path);
+void stop_server_thread(void);
+
+/*
+ * Reports a change made by db thread to clients running cclip watch.
+ * Can be called from any thread, no-op if server is not running.
+ */
+void server_notify_change(enum proto_change_type type, int64_t id);
+
+/*
+ * Reports that backup made by db thread is complete (path is NULL if it failed),
+ * so that clients waiting in cclip backup can be answered. Can be called from any thread.
+ */
+void server_backup_done(const char* path);
@@ -0,0 +1,58 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <xxhash.h>
+
+#include "simhash.h"
+
+/* features are overlapping sequences of this many bytes */
+#define SIMHASH_SHINGLE_SIZE 4
+
+uint64_t simhash_text(const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    int64_t weights[64] = {0};
+
+    const size_t nshingles = (size > SIMHASH_SHINGLE_SIZE) ? size - SIMHASH_SHINGLE_SIZE + 1 : 1;
+    for (size_t i = 0; i < nshingles; i++) {
+        const size_t len = (size < SIMHASH_SHINGLE_SIZE) ? size : SIMHASH_SHINGLE_SIZE;
+        const uint64_t hash = XXH3_64bits(bytes + i, len);
+        for (int bit = 0; bit < 64; bit++) {
+            weights[bit] += ((hash >> bit) & 1) ? 1 : -1;
+        }
+    }
+
+    uint64_t simhash = 0;
+    for (int bit = 0; bit < 64; bit++) {
+        if (weights[bit] > 0) {
+            simhash |= 1ull << bit;
+        }
+    }
+
+    return simhash;
+}
+
+int64_t simhash_bucket(uint64_t simhash, int band) {
+    const int band_bits = 64 / SIMHASH_BANDS;
+    const uint64_t mask = (1ull << band_bits) - 1;
+
+    return ((int64_t)band << band_bits) | ((simhash >> (band * band_bits)) & mask);
+}
+
+int simhash_distance(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * SimHash signatures of text, used to find entries that are almost the same.
+ * Similar texts get signatures that differ only in a few bits.
+ *
+ * For lookups, signature is split into SIMHASH_BANDS bands, and entry is stored in
+ * one bucket per band. Two signatures that differ in less than SIMHASH_BANDS bits
+ * have at least one band in common, so it's enough to only look at entries that
+ * share a bucket with the new one.
+ */
+
+#define SIMHASH_BANDS 8
+#define SIMHASH_MAX_DISTANCE (SIMHASH_BANDS - 1)
+
+uint64_t simhash_text(const void* data, size_t size);
+
+/* bucket of signature in given band, unique across all bands */
+int64_t simhash_bucket(uint64_t simhash, int band);
+
+/* number of bits that differ */
+int simhash_distance(uint64_t a, uint64_t b);
@@ -17,25 +17,34 @@
  */
 
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <errno.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
 
 #include <sqlite3.h>
-#include <xxhash.h>
 
 #include "db.h"
 #include "sql.h"
+#include "backup.h"
+#include "cache.h"
+#include "server.h"
 #include "config.h"
 #include "preview.h"
+#include "simhash.h"
+#include "maintenance.h"
 #include "xmalloc.h"
 #include "log.h"
 #include "macros.h"
 
 struct queue_entry {
-    void* data;
-    size_t size;
+    struct buffer* buf;
     char* mime;
+    uint64_t hash; /* computed by db thread */
 };
 
 static struct thread_state {
@@ -45,27 +54,141 @@ static struct thread_state {
     } queue;
 
     bool should_exit;
+    bool maintenance_requested;
+    bool backup_requested; /* accessed atomically */
+    /* number of queued entries, can be read without holding the mutex */
+    unsigned pending;
+
+    /*
+     * While nonzero, nothing is written to db and new entries just wait in the queue.
+     * Only changed with mutex held, but also read without it by the busy handler.
+     */
+    unsigned suspended;
+    /* true while processing an entry or doing maintenance with mutex released */
+    bool busy;
 
     pthread_t thread;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
+    pthread_cond_t idle_cond; /* signalled when busy becomes false */
 } thread_state = {
     .mutex = PTHREAD_MUTEX_INITIALIZER,
     .cond = PTHREAD_COND_INITIALIZER,
+    .idle_cond = PTHREAD_COND_INITIALIZER,
 };
 
-struct db_entry {
-    const void* data; /* arbitrary data */
-    int64_t data_size; /* size of data in bytes */
-    uint64_t data_hash; /* xxhash3 */
-    char* preview; /* string */
-    const char* mime_type; /* string */
-    time_t timestamp; /* unix seconds */
+struct id_list {
+    VEC(int64_t) ids;
 };
 
+/*
+ * Deleted entries are remembered so that cclip list --since can report them.
+ * Clients that are behind more than this many deletions have to reload everything.
+ */
+#define TOMBSTONES_KEEP_COUNT 10000
+/*
+ * Tombstones are pruned by eviction, and also by their own maintenance task at this
+ * interval, since without -c nothing is evicted but cclip can still delete entries.
+ */
+#define TOMBSTONES_PRUNE_INTERVAL_S (10 * 60)
+/* tombstones deleted per transaction by maintenance, time is checked between them */
+#define TOMBSTONES_PRUNE_CHUNK_SIZE 1024
+
+/*
+ * Maintenance is split into steps, each one is given this much time and is
+ * interrupted early if something gets queued for insertion in the meantime.
+ */
+#define MAINTENANCE_BUDGET_MS 50
+/* if there's still work left after running out of time, continue after this delay */
+#define MAINTENANCE_CONTINUE_DELAY_MS 100
+/* entries deleted per transaction when evicting old entries, time is checked between them */
+#define EVICTION_CHUNK_SIZE 32
+/*
+ * Old entries are normally evicted during maintenance. If it doesn't get to run
+ * because clipboard is constantly busy, they are evicted inline after this many insertions.
+ */
+#define EVICTION_INLINE_PERIOD 100
+#define OPTIMIZE_INTERVAL_S (6 * 60 * 60)
+/* incremental vacuum is only run if there's at least this many free pages */
+#define INCREMENTAL_VACUUM_MIN_PAGES 256
+#define INCREMENTAL_VACUUM_STEP_PAGES 64
+/* pages copied per backup step, time is checked between steps */
+#define BACKUP_STEP_PAGES 64
+
+/*
+ * With -n, new text entry replaces entries captured up to this many seconds before it
+ * if their signatures are close enough. Only entries in this size range are checked:
+ * tiny ones are too easy to mistake for each other, huge ones take too long to hash.
+ */
+#define NEAR_DUPLICATE_WINDOW_S (15 * 60)
+#define NEAR_DUPLICATE_MIN_SIZE 32
+#define NEAR_DUPLICATE_MAX_SIZE (64 * 1024)
+
+/* state of maintenance tasks, only touched by db thread */
+static struct {
+    unsigned commits_since_checkpoint;
+    unsigned inserts_since_eviction;
+    time_t last_optimize;
+    time_t last_tombstone_prune;
+    bool pruning_tombstones; /* ran out of time, continue regardless of interval */
+    int64_t deadline_ms;
+    struct backup* backup; /* in progress, if any */
+    time_t last_backup; /* -1 if not known yet */
+} maintenance = {
+    .last_backup = -1,
+};
+
+/*
+ * Hashes of recently saved entries. Copying one of them again only bumps timestamp of
+ * the existing entry, without generating preview or running the insert, and bumps made
+ * within BUMP_COALESCE_MS of the first one are written together in one transaction.
+ * Table is direct-mapped: colliding hashes replace each other. It can also be stale if
+ * cclip deleted an entry, bump notices that and the entry is inserted normally.
+ */
+#define RECENT_HASHES_SIZE 4096
+#define BUMP_COALESCE_MS 500
+#define BUMP_MAX_PENDING 64
+
+/* only touched by db thread, and by start_db_thread before it's started */
+static struct {
+    uint64_t hash;
+    int64_t id; /* 0 if slot is empty */
+} recent_hashes[RECENT_HASHES_SIZE];
+
+struct pending_bump {
+    struct queue_entry entry; /* kept until bump is written in case entry is gone */
+    int64_t id;
+    time_t timestamp;
+    bool gone; /* entry was deleted since its hash was remembered */
+};
+
+static struct {
+    VEC(struct pending_bump) list;
+    int64_t deadline_ms;
+} bumps;
+
+/*
+ * If the db stays locked for longer than busy timeout (someone is running a big
+ * cclip wipe or vacuum), insertion is retried this many times before giving up,
+ * with delay doubling after each attempt.
+ */
+#define INSERT_RETRY_COUNT 5
+#define INSERT_RETRY_DELAY_MS 1000
+
 enum {
     STMT_INSERT,
+    STMT_INSERT_FTS,
     STMT_DELETE_OLDEST,
+    STMT_ADVANCE_HORIZON,
+    STMT_PRUNE_TOMBSTONES,
+    STMT_BUMP,
+    STMT_RECENT_HASHES,
+    STMT_SET_SIMHASH,
+    STMT_ADD_LSH,
+    STMT_TOUCH_LSH,
+    STMT_FIND_NEAR,
+    STMT_DELETE_ENTRY,
+    STMT_GET_SEQ,
     STMT_BEGIN,
     STMT_COMMIT,
     STMT_ROLLBACK,
@@ -75,11 +198,8 @@ static struct {
     const char *src;
     struct sqlite3_stmt* stmt;
 } statements[] = {
-    [STMT_INSERT] = { .src = TOSTRING(
-        INSERT INTO history ( data, data_hash, data_size, preview, mime_type, timestamp )
-        VALUES ( @data, @data_hash, @data_size, @preview, @mime_type, @timestamp )
-        ON CONFLICT ( data_hash ) DO UPDATE SET timestamp=excluded.timestamp
-    )},
+    [STMT_INSERT] = { .src = DB_INSERT_SQL },
+    [STMT_INSERT_FTS] = { .src = DB_FTS_INSERT_SQL },
     [STMT_DELETE_OLDEST] = { .src = TOSTRING(
         DELETE FROM history
         WHERE id IN (
@@ -88,11 +208,59 @@ static struct {
                 SELECT entry_id FROM history_tags
             )
             ORDER BY timestamp DESC
-            LIMIT -1 OFFSET @keep_count
+            LIMIT @limit OFFSET @keep_count
+        )
+        RETURNING id;
+    )},
+    [STMT_ADVANCE_HORIZON] = { .src = TOSTRING(
+        UPDATE sequence SET horizon = (
+            SELECT seq FROM tombstones ORDER BY seq DESC LIMIT 1 OFFSET @keep_count
+        )
+        WHERE EXISTS (
+            SELECT seq FROM tombstones ORDER BY seq DESC LIMIT 1 OFFSET @keep_count
         );
     )},
+    [STMT_PRUNE_TOMBSTONES] = { .src = TOSTRING(
+        DELETE FROM tombstones WHERE seq IN (
+            SELECT seq FROM tombstones WHERE seq <= ( SELECT horizon FROM sequence )
+            ORDER BY seq LIMIT @limit
+        );
+    )},
+    [STMT_BUMP] = { .src = TOSTRING(
+        UPDATE history SET timestamp = @timestamp
+        WHERE id = @id AND data_hash = @data_hash
+        RETURNING id;
+    )},
+    [STMT_RECENT_HASHES] = { .src = TOSTRING(
+        SELECT data_hash, id FROM history ORDER BY timestamp DESC LIMIT @limit;
+    )},
+    [STMT_SET_SIMHASH] = { .src = TOSTRING(
+        UPDATE history SET simhash = @simhash WHERE id = @id;
+    )},
+    [STMT_ADD_LSH] = { .src = TOSTRING(
+        INSERT INTO history_lsh ( bucket, timestamp, entry_id ) VALUES ( @bucket, @timestamp, @id );
+    )},
+    [STMT_TOUCH_LSH] = { .src = TOSTRING(
+        UPDATE history_lsh SET timestamp = @timestamp WHERE entry_id = @id;
+    )},
+    /* one bucket per band, see SIMHASH_BANDS */
+    [STMT_FIND_NEAR] = { .src = TOSTRING(
+        SELECT DISTINCT h.id, h.simhash FROM history_lsh AS l
+        JOIN history AS h ON h.id = l.entry_id
+        WHERE l.bucket IN ( @b0, @b1, @b2, @b3, @b4, @b5, @b6, @b7 )
+        AND l.timestamp >= @since
+        AND l.entry_id != @id
+        AND NOT EXISTS ( SELECT 1 FROM history_tags WHERE entry_id = h.id );
+    )},
+    [STMT_DELETE_ENTRY] = { .src = TOSTRING(
+        DELETE FROM history WHERE id = @id;
+    )},
+    /* current change sequence number and the one of entry @id */
+    [STMT_GET_SEQ] = { .src = TOSTRING(
+        SELECT value, ( SELECT seq FROM history WHERE id = @id ) FROM sequence;
+    )},
     [STMT_BEGIN] = { .src = TOSTRING(
-        BEGIN
+        BEGIN IMMEDIATE
     )},
     [STMT_COMMIT] = { .src = TOSTRING(
         COMMIT
@@ -126,7 +294,9 @@ static bool begin_transaction(struct sqlite3* db) {
     log_print(TRACE, "beginning transaction");
     int rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
-        log_print(ERR, "sql: failed to begin transaction: %s", sqlite3_errmsg(db));
+        /* busy handler warns itself on timeout, and aborted lock waits are retried by callers */
+        log_print(db_is_busy_error(rc) ? DEBUG : ERR,
+                  "sql: failed to begin transaction: %s", sqlite3_errmsg(db));
         ret = false;
     }
 
@@ -164,99 +334,622 @@ static bool commit_transaction(struct sqlite3* db) {
     return ret;
 }
 
-static bool do_insert(struct sqlite3* db, const struct db_entry* e) {
-    struct sqlite3_stmt* const stmt = statements[STMT_INSERT].stmt;
+/* deletes at most limit (-1 for no limit) entries, ids of deleted entries are appended to deleted */
+static bool do_delete_oldest(struct sqlite3* db, int keep_count, int limit, struct id_list* deleted) {
+    struct sqlite3_stmt* const stmt = statements[STMT_DELETE_OLDEST].stmt;
     bool ret = true;
 
-    STMT_BIND(stmt, blob, "@data", e->data, e->data_size, SQLITE_STATIC);
-    STMT_BIND(stmt, int64, "@data_hash", *(int64_t *)&e->data_hash);
-    STMT_BIND(stmt, int64, "@data_size", e->data_size);
-    STMT_BIND(stmt, text, "@preview", e->preview, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, text, "@mime_type", e->mime_type, -1, SQLITE_STATIC);
-    STMT_BIND(stmt, int64, "@timestamp", e->timestamp);
+    STMT_BIND(stmt, int, "@keep_count", keep_count);
+    STMT_BIND(stmt, int, "@limit", limit);
 
-    int rc = sqlite3_step(stmt);
+    log_print(TRACE, "sql: deleting oldest entries");
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        VEC_APPEND(&deleted->ids, &(int64_t){ sqlite3_column_int64(stmt, 0) });
+    }
     if (rc != SQLITE_DONE) {
-        log_print(ERR, "sql: failed to insert entry into db: %s", sqlite3_errmsg(db));
+        log_print(ERR, "sql: failed to delete oldest entries: %s", sqlite3_errmsg(db));
         ret = false;
-    } else {
-        log_print(DEBUG, "record inserted successfully");
     }
+    log_print(TRACE, "sql: %zu oldest entries deleted", VEC_SIZE(&deleted->ids));
 
     sqlite3_reset(stmt);
     sqlite3_clear_bindings(stmt);
     return ret;
 }
 
-static bool do_delete_oldest(struct sqlite3* db, int keep_count) {
-    struct sqlite3_stmt* const stmt = statements[STMT_DELETE_OLDEST].stmt;
-    bool ret = true;
+/* prunes at most limit tombstones (-1 for all), returns how many or -1 on error */
+static int do_prune_tombstones(struct sqlite3* db, int keep_count, int limit) {
+    struct sqlite3_stmt* stmt = statements[STMT_ADVANCE_HORIZON].stmt;
 
     STMT_BIND(stmt, int, "@keep_count", keep_count);
 
-    log_print(TRACE, "sql: deleting oldest entries");
+    log_print(TRACE, "sql: pruning tombstones");
     int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
     if (rc != SQLITE_DONE) {
-        log_print(ERR, "sql: failed to delete oldest entries: %s", sqlite3_errmsg(db));
+        log_print(ERR, "sql: failed to advance tombstone horizon: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    /* horizon may have been advanced earlier without pruning everything below it */
+    stmt = statements[STMT_PRUNE_TOMBSTONES].stmt;
+    STMT_BIND(stmt, int, "@limit", limit);
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "sql: failed to prune tombstones: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    const int pruned = sqlite3_changes(db);
+    log_print(TRACE, "sql: %d tombstones pruned", pruned);
+    return pruned;
+}
+
+/* *entry_seq can be NULL */
+static bool get_seq(struct sqlite3* db, int64_t id, int64_t* seq, int64_t* entry_seq) {
+    struct sqlite3_stmt* const stmt = statements[STMT_GET_SEQ].stmt;
+    bool ret = true;
+
+    STMT_BIND(stmt, int64, "@id", id);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        *seq = sqlite3_column_int64(stmt, 0);
+        if (entry_seq != NULL) {
+            *entry_seq = sqlite3_column_int64(stmt, 1);
+        }
+    } else {
+        log_print(ERR, "sql: failed to get change sequence: %s", sqlite3_errmsg(db));
+        ret = false;
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return ret;
+}
+
+static bool step_done(struct sqlite3* db, int stmt_index, const char* what) {
+    struct sqlite3_stmt* const stmt = statements[stmt_index].stmt;
+
+    const int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "sql: failed to %s: %s", what, sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Deletes recent untagged text entries that are almost the same as new entry id (see -n)
+ * and stores its signature. Ids of deleted entries are appended to deleted.
+ */
+static bool collapse_near_duplicates(struct sqlite3* db, const struct db_entry* e,
+                                     int64_t id, bool inserted, struct id_list* deleted) {
+    if (!inserted) {
+        /* exact duplicate was bumped, it's recent again */
+        struct sqlite3_stmt* const stmt = statements[STMT_TOUCH_LSH].stmt;
+        STMT_BIND(stmt, int64, "@timestamp", e->timestamp);
+        STMT_BIND(stmt, int64, "@id", id);
+        return step_done(db, STMT_TOUCH_LSH, "update near-duplicate index");
+    }
+
+    if (strncmp(e->mime_type, "text/", 5) != 0
+        || e->data_size < NEAR_DUPLICATE_MIN_SIZE || e->data_size > NEAR_DUPLICATE_MAX_SIZE) {
+        return true;
+    }
+
+    const uint64_t simhash = simhash_text(e->data, e->data_size);
+    VEC(int64_t) near = {0};
+    bool ret = false;
+
+    struct sqlite3_stmt* stmt = statements[STMT_FIND_NEAR].stmt;
+    for (int band = 0; band < SIMHASH_BANDS; band++) {
+        char name[8];
+        snprintf(name, sizeof(name), "@b%d", band);
+        STMT_BIND(stmt, int64, name, simhash_bucket(simhash, band));
+    }
+    STMT_BIND(stmt, int64, "@since", e->timestamp - NEAR_DUPLICATE_WINDOW_S);
+    STMT_BIND(stmt, int64, "@id", id);
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int64_t candidate = sqlite3_column_int64(stmt, 0);
+        const int distance = simhash_distance(simhash, sqlite3_column_int64(stmt, 1));
+        log_print(TRACE, "sql: entry %li is %d bits away from new entry", candidate, distance);
+        if (distance <= config.near_duplicate_distance) {
+            VEC_APPEND(&near, &candidate);
+        }
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "sql: failed to look up near duplicates: %s", sqlite3_errmsg(db));
+        goto out;
+    }
+
+    VEC_FOREACH(&near, i) {
+        log_print(DEBUG, "sql: replacing entry %li with its near duplicate %li",
+                  near.data[i], id);
+        STMT_BIND(statements[STMT_DELETE_ENTRY].stmt, int64, "@id", near.data[i]);
+        if (!step_done(db, STMT_DELETE_ENTRY, "delete near duplicate")) {
+            goto out;
+        }
+        VEC_APPEND(&deleted->ids, &near.data[i]);
+    }
+
+    stmt = statements[STMT_SET_SIMHASH].stmt;
+    STMT_BIND(stmt, int64, "@simhash", simhash);
+    STMT_BIND(stmt, int64, "@id", id);
+    if (!step_done(db, STMT_SET_SIMHASH, "store signature")) {
+        goto out;
+    }
+
+    stmt = statements[STMT_ADD_LSH].stmt;
+    for (int band = 0; band < SIMHASH_BANDS; band++) {
+        STMT_BIND(stmt, int64, "@bucket", simhash_bucket(simhash, band));
+        STMT_BIND(stmt, int64, "@timestamp", e->timestamp);
+        STMT_BIND(stmt, int64, "@id", id);
+        if (!step_done(db, STMT_ADD_LSH, "update near-duplicate index")) {
+            goto out;
+        }
+    }
+
+    ret = true;
+
+out:
+    VEC_FREE(&near);
+    return ret;
+}
+
+static size_t recent_hashes_slot(uint64_t hash) {
+    return hash % RECENT_HASHES_SIZE;
+}
+
+static void recent_hashes_add(uint64_t hash, int64_t id) {
+    recent_hashes[recent_hashes_slot(hash)].hash = hash;
+    recent_hashes[recent_hashes_slot(hash)].id = id;
+}
+
+static void recent_hashes_forget(uint64_t hash) {
+    if (recent_hashes[recent_hashes_slot(hash)].hash == hash) {
+        recent_hashes[recent_hashes_slot(hash)].id = 0;
+    }
+}
+
+/* returns id of entry with this hash, 0 if it's not known */
+static int64_t recent_hashes_lookup(uint64_t hash) {
+    const size_t slot = recent_hashes_slot(hash);
+    return (recent_hashes[slot].hash == hash) ? recent_hashes[slot].id : 0;
+}
+
+static bool prime_recent_hashes(struct sqlite3* db) {
+    struct sqlite3_stmt* const stmt = statements[STMT_RECENT_HASHES].stmt;
+    size_t count = 0;
+    bool ret = true;
+
+    memset(recent_hashes, 0, sizeof(recent_hashes));
+
+    STMT_BIND(stmt, int, "@limit", RECENT_HASHES_SIZE);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const uint64_t hash = sqlite3_column_int64(stmt, 0);
+        /* newest entries come first, don't let older ones push them out */
+        if (recent_hashes[recent_hashes_slot(hash)].id == 0) {
+            recent_hashes_add(hash, sqlite3_column_int64(stmt, 1));
+            count += 1;
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "sql: failed to load recent hashes: %s", sqlite3_errmsg(db));
         ret = false;
     }
-    log_print(TRACE, "sql: %d oldest entries deleted", sqlite3_changes(db));
+    log_print(DEBUG, "sql: loaded %zu recent hashes", count);
 
     sqlite3_reset(stmt);
     sqlite3_clear_bindings(stmt);
     return ret;
 }
 
-static bool process_queue_entry(struct sqlite3* db, struct queue_entry* e) {
-    const uint64_t hash = XXH3_64bits(e->data, e->size);
+/* returns SQLITE_OK on success or sqlite error code on failure */
+static int process_queue_entry(struct sqlite3* db, void* data) {
+    struct queue_entry* e = data;
+    const uint64_t hash = e->hash;
     const time_t timestamp = time(NULL);
-    char* const preview = generate_preview(e->data, e->size, e->mime);
+    char* const preview = generate_preview(e->buf->data, e->buf->size, e->mime,
+                                           config.preview_len);
+    struct id_list deleted = {0};
+    int ret = SQLITE_ERROR;
 
     if (!begin_transaction(db)) {
-        free(preview);
-        return false;
+        ret = sqlite3_extended_errcode(db);
+        goto out;
+    }
+
+    /* lets cache tell our changes from those made by others, see cache_commit() */
+    int64_t seq_before, seq_after, entry_seq;
+    if (!get_seq(db, -1, &seq_before, NULL)) {
+        goto rollback;
     }
 
     const struct db_entry entry = {
-        .data = e->data,
-        .data_size = e->size,
+        .data = e->buf->data,
+        .data_size = e->buf->size,
         .mime_type = e->mime,
         .data_hash = hash,
         .preview = preview,
         .timestamp = timestamp,
     };
-    if (!do_insert(db, &entry)) {
+    int64_t id = -1;
+    bool inserted = false;
+    if (!db_insert_entry(db, statements[STMT_INSERT].stmt, statements[STMT_INSERT_FTS].stmt,
+                         &entry, &id, &inserted)) {
         goto rollback;
-    } else if (config.max_entries_count > 0) {
-        /* only run cleanup every `period` insertions */
-        const int period = 10;
-        static int counter = 0;
-        if (counter++ % period == 0) {
-            if (!do_delete_oldest(db, config.max_entries_count)) {
-                goto rollback;
-            }
+    } else if (config.near_duplicate_distance > 0
+               && !collapse_near_duplicates(db, &entry, id, inserted, &deleted)) {
+        goto rollback;
+    } else if (config.max_entries_count > 0
+               && ++maintenance.inserts_since_eviction >= EVICTION_INLINE_PERIOD) {
+        if (!do_delete_oldest(db, config.max_entries_count, -1, &deleted)) {
+            goto rollback;
         }
+        if (do_prune_tombstones(db, TOMBSTONES_KEEP_COUNT, -1) < 0) {
+            goto rollback;
+        }
+        maintenance.inserts_since_eviction = 0;
+    }
+
+    if (!get_seq(db, id, &seq_after, &entry_seq)) {
+        goto rollback;
     }
 
     if (!commit_transaction(db)) {
         goto rollback;
     }
+    maintenance.commits_since_checkpoint += 1;
 
-    free(preview);
-    return true;
+    recent_hashes_add(hash, id);
+    VEC_FOREACH(&deleted.ids, i) {
+        cache_remove(deleted.ids.data[i]);
+    }
+    cache_insert(id, inserted, entry_seq, timestamp, e->mime, preview, e->buf);
+    cache_commit(seq_before, seq_after);
+
+    server_notify_change(inserted ? PROTO_CHANGE_INSERT : PROTO_CHANGE_BUMP, id);
+    VEC_FOREACH(&deleted.ids, i) {
+        server_notify_change(PROTO_CHANGE_DELETE, deleted.ids.data[i]);
+    }
+
+    ret = SQLITE_OK;
+    goto out;
 
 rollback:
-    free(preview);
+    ret = sqlite3_extended_errcode(db);
     rollback_transaction(db);
+out:
+    VEC_FREE(&deleted.ids);
+    free(preview);
+    return ret;
+}
+
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* true if current maintenance step should stop */
+static bool maintenance_should_yield(void) {
+    return __atomic_load_n(&thread_state.pending, __ATOMIC_RELAXED) > 0
+        || monotonic_ms() >= maintenance.deadline_ms;
+}
+
+static int maintenance_progress_handler(void* data) {
+    return maintenance_should_yield();
+}
+
+/* stops waiting for the lock once writes are suspended, so suspend_db_writes() returns quickly */
+static bool writes_suspended(void* data) {
+    return __atomic_load_n(&thread_state.suspended, __ATOMIC_RELAXED) > 0;
+}
+
+/* maintenance step shouldn't sit in busy handler past its deadline or when an entry arrives */
+static bool maintenance_busy_abort(void* data) {
+    return writes_suspended(data) || maintenance_should_yield();
+}
+
+/* makes long running statements fail with SQLITE_INTERRUPT when it's time to yield */
+static void enable_interrupts(struct sqlite3* db) {
+    sqlite3_progress_handler(db, 1000, maintenance_progress_handler, NULL);
+}
+
+static void disable_interrupts(struct sqlite3* db) {
+    sqlite3_progress_handler(db, 0, NULL, NULL);
+}
+
+static int64_t query_int(struct sqlite3* db, const char* sql) {
+    struct sqlite3_stmt* stmt = NULL;
+    int64_t ret = -1;
+
+    if (!db_prepare_stmt(db, sql, &stmt)) {
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        ret = sqlite3_column_int64(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+/* returns false if there's work left */
+static bool maintenance_evict(struct sqlite3* db) {
+    if (config.max_entries_count <= 0 || maintenance.inserts_since_eviction == 0) {
+        return true;
+    }
+
+    bool done = false;
+    while (!done && !maintenance_should_yield()) {
+        struct id_list deleted = {0};
+
+        if (!begin_transaction(db)) {
+            /* if waiting for the lock was cut short, try again later */
+            return !maintenance_should_yield();
+        }
+        if (!do_delete_oldest(db, config.max_entries_count, EVICTION_CHUNK_SIZE, &deleted)
+            || do_prune_tombstones(db, TOMBSTONES_KEEP_COUNT, -1) < 0
+            || !commit_transaction(db)) {
+            rollback_transaction(db);
+            VEC_FREE(&deleted.ids);
+            return true;
+        }
+        maintenance.commits_since_checkpoint += 1;
+
+        VEC_FOREACH(&deleted.ids, i) {
+            server_notify_change(PROTO_CHANGE_DELETE, deleted.ids.data[i]);
+        }
+        done = VEC_SIZE(&deleted.ids) < EVICTION_CHUNK_SIZE;
+        VEC_FREE(&deleted.ids);
+    }
+
+    if (done) {
+        log_print(DEBUG, "maintenance: evicted old entries");
+        maintenance.inserts_since_eviction = 0;
+    }
+    return done;
+}
+
+/* returns false if there's work left */
+static bool maintenance_prune_tombstones(struct sqlite3* db) {
+    const time_t now = time(NULL);
+    if (!maintenance.pruning_tombstones
+        && now - maintenance.last_tombstone_prune < TOMBSTONES_PRUNE_INTERVAL_S) {
+        return true;
+    }
+    maintenance.last_tombstone_prune = now;
+
+    bool done = false;
+    while (!done && !maintenance_should_yield()) {
+        if (!begin_transaction(db)) {
+            break;
+        }
+        const int pruned = do_prune_tombstones(db, TOMBSTONES_KEEP_COUNT,
+                                               TOMBSTONES_PRUNE_CHUNK_SIZE);
+        if (pruned < 0 || !commit_transaction(db)) {
+            rollback_transaction(db);
+            break;
+        }
+        if (pruned > 0) {
+            maintenance.commits_since_checkpoint += 1;
+        }
+        done = pruned < TOMBSTONES_PRUNE_CHUNK_SIZE;
+    }
+
+    /* failures are not retried until next interval */
+    maintenance.pruning_tombstones = !done && maintenance_should_yield();
+    if (done) {
+        log_print(DEBUG, "maintenance: pruned tombstones");
+    }
+    return !maintenance.pruning_tombstones;
+}
+
+static bool maintenance_incremental_vacuum(struct sqlite3* db) {
+    /* only possible if auto_vacuum is INCREMENTAL */
+    if (query_int(db, "PRAGMA auto_vacuum") != 2
+        || query_int(db, "PRAGMA freelist_count") < INCREMENTAL_VACUUM_MIN_PAGES) {
+        return true;
+    }
+
+    char sql[64];
+    snprintf(sql, sizeof(sql), "PRAGMA incremental_vacuum(%d)", INCREMENTAL_VACUUM_STEP_PAGES);
+
+    int64_t free_pages = 0;
+    while (!maintenance_should_yield()) {
+        enable_interrupts(db);
+        const int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+        disable_interrupts(db);
+        if (rc != SQLITE_OK) {
+            log_print(DEBUG, "maintenance: incremental vacuum stopped: %s", sqlite3_errmsg(db));
+            break;
+        }
+        maintenance.commits_since_checkpoint += 1;
+
+        if ((free_pages = query_int(db, "PRAGMA freelist_count")) <= 0) {
+            log_print(DEBUG, "maintenance: incremental vacuum done");
+            return true;
+        }
+    }
+
+    log_print(DEBUG, "maintenance: incremental vacuum ran out of time, %li pages left", free_pages);
     return false;
 }
 
+static bool maintenance_optimize(struct sqlite3* db) {
+    const time_t now = time(NULL);
+    if (now - maintenance.last_optimize < OPTIMIZE_INTERVAL_S) {
+        return true;
+    }
+    /* if it gets interrupted it is not retried until next interval, analysis_limit keeps it cheap */
+    maintenance.last_optimize = now;
+
+    enable_interrupts(db);
+    const int rc = sqlite3_exec(db, "PRAGMA analysis_limit = 400; PRAGMA optimize",
+                                NULL, NULL, NULL);
+    disable_interrupts(db);
+    if (rc != SQLITE_OK) {
+        log_print(DEBUG, "maintenance: optimize stopped: %s", sqlite3_errmsg(db));
+    } else {
+        log_print(DEBUG, "maintenance: optimize done");
+    }
+
+    return true;
+}
+
+static bool maintenance_checkpoint(struct sqlite3* db) {
+    if (maintenance.commits_since_checkpoint == 0) {
+        return true;
+    }
+
+    /*
+     * Passive checkpoint can't be interrupted, but it never waits for readers or writers
+     * and there isn't much in the WAL after a burst of insertions anyway.
+     */
+    int wal_frames, checkpointed;
+    const int rc = sqlite3_wal_checkpoint_v2(db, NULL, SQLITE_CHECKPOINT_PASSIVE,
+                                             &wal_frames, &checkpointed);
+    if (rc != SQLITE_OK) {
+        log_print(DEBUG, "maintenance: checkpoint failed: %s", sqlite3_errmsg(db));
+        return true;
+    }
+
+    log_print(DEBUG, "maintenance: checkpointed %d of %d WAL frames", checkpointed, wal_frames);
+    if (checkpointed == wal_frames) {
+        maintenance.commits_since_checkpoint = 0;
+    }
+    return true;
+}
+
+static void finish_backup(bool ok) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", backup_path(maintenance.backup));
+
+    ok = backup_finish(maintenance.backup, ok);
+    maintenance.backup = NULL;
+    /* failed backups are not retried until next interval either */
+    maintenance.last_backup = time(NULL);
+
+    if (ok) {
+        backup_rotate(config.backup_dir, config.backup_keep_count);
+    }
+    server_backup_done(ok ? path : NULL);
+}
+
+static bool start_backup(struct sqlite3* db) {
+    char path[PATH_MAX];
+
+    if (mkdir(config.backup_dir, 0700) < 0 && errno != EEXIST) {
+        log_print(ERR, "failed to create backup directory %s: %s",
+                  config.backup_dir, strerror(errno));
+        return false;
+    }
+    if (!backup_make_path(config.backup_dir, path, sizeof(path))) {
+        log_print(ERR, "backup path is too long");
+        return false;
+    }
+
+    maintenance.backup = backup_start(db, path);
+    return maintenance.backup != NULL;
+}
+
+/*
+ * Copies the db a few pages at a time. Pages changed by this connection between steps
+ * are updated in the copy by sqlite, changes made by cclip make the backup start over.
+ */
+static bool maintenance_backup(struct sqlite3* db) {
+    if (config.backup_dir == NULL) {
+        return true;
+    }
+
+    const bool requested = __atomic_exchange_n(&thread_state.backup_requested, false,
+                                               __ATOMIC_RELAXED);
+    if (maintenance.backup == NULL) {
+        if (maintenance.last_backup < 0) {
+            maintenance.last_backup = backup_newest(config.backup_dir);
+        }
+        if (!requested
+            && time(NULL) - maintenance.last_backup < config.backup_interval_hours * 60 * 60) {
+            return true;
+        }
+
+        if (!start_backup(db)) {
+            maintenance.last_backup = time(NULL);
+            server_backup_done(NULL);
+            return true;
+        }
+    }
+
+    int rc;
+    do {
+        rc = backup_step(maintenance.backup, BACKUP_STEP_PAGES);
+    } while (rc == SQLITE_OK && !maintenance_should_yield());
+
+    if (rc == SQLITE_DONE) {
+        finish_backup(true);
+        return true;
+    } else if (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED) {
+        finish_backup(false);
+        return true;
+    }
+
+    int copied, total;
+    backup_progress(maintenance.backup, &copied, &total);
+    log_print(DEBUG, "maintenance: backup ran out of time, %d of %d pages copied", copied, total);
+    return false;
+}
+
+static void run_maintenance(struct sqlite3* db) {
+    static bool (*const tasks[])(struct sqlite3*) = {
+        maintenance_evict,
+        maintenance_prune_tombstones,
+        maintenance_incremental_vacuum,
+        maintenance_optimize,
+        maintenance_checkpoint,
+        maintenance_backup,
+    };
+
+    db_set_busy_abort(db, maintenance_busy_abort, NULL);
+
+    bool done = true;
+    bool interrupted = false;
+    for (size_t i = 0; i < SIZEOF_ARRAY(tasks) && !interrupted; i++) {
+        maintenance.deadline_ms = monotonic_ms() + MAINTENANCE_BUDGET_MS;
+        done = tasks[i](db) && done;
+
+        if (__atomic_load_n(&thread_state.pending, __ATOMIC_RELAXED) > 0) {
+            /* new entry arrived, wayland code will reschedule maintenance */
+            log_print(DEBUG, "maintenance: interrupted by new entry");
+            interrupted = true;
+        }
+    }
+
+    db_set_busy_abort(db, writes_suspended, NULL);
+
+    if (!done && !interrupted) {
+        maintenance_schedule(MAINTENANCE_CONTINUE_DELAY_MS);
+    }
+}
+
 static void queue_entry_free_contents(struct queue_entry* e) {
-    free(e->data);
+    buffer_unref(e->buf);
     free(e->mime);
 }
 
-static void queue_push(struct queue_entry entry) {
+/* makes room for one more entry, mutex must be held */
+static void queue_reserve(void) {
     struct queue* q = &thread_state.queue;
 
     if ((q->write + 1) % q->size == q->read) {
@@ -278,13 +971,31 @@ static void queue_push(struct queue_entry entry) {
         q->read = 0;
         q->write = i;
     }
+}
 
+static void queue_push(struct queue_entry entry) {
+    struct queue* q = &thread_state.queue;
+
+    queue_reserve();
     q->ring[q->write] = entry;
     q->write = (q->write + 1) % q->size;
+    __atomic_add_fetch(&thread_state.pending, 1, __ATOMIC_RELAXED);
 
     log_print(TRACE, "added entry to queue, write %u read %u", q->write, q->read);
 }
 
+/* puts entry back at the head of the queue, so that it is popped next */
+static void queue_unpop(struct queue_entry entry) {
+    struct queue* q = &thread_state.queue;
+
+    queue_reserve();
+    q->read = (q->read + q->size - 1) % q->size;
+    q->ring[q->read] = entry;
+    __atomic_add_fetch(&thread_state.pending, 1, __ATOMIC_RELAXED);
+
+    log_print(TRACE, "put entry back to queue, write %u read %u", q->write, q->read);
+}
+
 static bool queue_pop(struct queue_entry* entry) {
     struct queue* q = &thread_state.queue;
 
@@ -294,43 +1005,328 @@ static bool queue_pop(struct queue_entry* entry) {
 
     *entry = q->ring[q->read];
     q->read = (q->read + 1) % q->size;
+    __atomic_sub_fetch(&thread_state.pending, 1, __ATOMIC_RELAXED);
 
     log_print(TRACE, "removed entry from queue, write %u read %u", q->write, q->read);
 
     return true;
 }
 
+/* takes ownership of e if it's a copy of a recent entry, it's bumped later by flush_bumps() */
+static bool try_bump(struct queue_entry* e) {
+    const int64_t id = recent_hashes_lookup(e->hash);
+    if (id <= 0) {
+        return false;
+    }
+
+    log_print(DEBUG, "sql: entry %li is already saved, bumping it", id);
+    const time_t timestamp = time(NULL);
+    VEC_FOREACH(&bumps.list, i) {
+        struct pending_bump* b = VEC_AT(&bumps.list, i);
+        if (b->id == id) {
+            queue_entry_free_contents(&b->entry);
+            b->entry = *e;
+            b->timestamp = timestamp;
+            return true;
+        }
+    }
+
+    if (VEC_SIZE(&bumps.list) == 0) {
+        bumps.deadline_ms = monotonic_ms() + BUMP_COALESCE_MS;
+    }
+    VEC_APPEND(&bumps.list, &((struct pending_bump){
+        .entry = *e,
+        .id = id,
+        .timestamp = timestamp,
+    }));
+
+    return true;
+}
+
+static bool bumps_due(void) {
+    return VEC_SIZE(&bumps.list) >= BUMP_MAX_PENDING
+        || (VEC_SIZE(&bumps.list) > 0 && monotonic_ms() >= bumps.deadline_ms);
+}
+
+/* returns SQLITE_OK on success or sqlite error code on failure */
+static int write_bumps(struct sqlite3* db, void* data) {
+    int rc;
+
+    if (!begin_transaction(db)) {
+        return sqlite3_extended_errcode(db);
+    }
+
+    VEC_FOREACH(&bumps.list, i) {
+        struct pending_bump* b = VEC_AT(&bumps.list, i);
+        struct sqlite3_stmt* const stmt = statements[STMT_BUMP].stmt;
+
+        STMT_BIND(stmt, int64, "@timestamp", b->timestamp);
+        STMT_BIND(stmt, int64, "@id", b->id);
+        STMT_BIND(stmt, int64, "@data_hash", b->entry.hash);
+        rc = sqlite3_step(stmt);
+        b->gone = rc != SQLITE_ROW;
+        if (rc == SQLITE_ROW) {
+            rc = sqlite3_step(stmt);
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        if (rc != SQLITE_DONE) {
+            log_print(ERR, "sql: failed to bump entry: %s", sqlite3_errmsg(db));
+            goto rollback;
+        }
+
+        if (!b->gone && config.near_duplicate_distance > 0) {
+            struct sqlite3_stmt* const touch = statements[STMT_TOUCH_LSH].stmt;
+            STMT_BIND(touch, int64, "@timestamp", b->timestamp);
+            STMT_BIND(touch, int64, "@id", b->id);
+            if (!step_done(db, STMT_TOUCH_LSH, "update near-duplicate index")) {
+                goto rollback;
+            }
+        }
+    }
+
+    if (!commit_transaction(db)) {
+        goto rollback;
+    }
+    maintenance.commits_since_checkpoint += 1;
+
+    return SQLITE_OK;
+
+rollback:
+    rc = sqlite3_extended_errcode(db);
+    rollback_transaction(db);
+    return rc;
+}
+
+enum retry_result {
+    RETRY_OK,
+    RETRY_FAILED, /* gave up, entry is lost */
+    RETRY_SUSPENDED, /* writes were suspended while waiting to retry, try again on resume */
+};
+
+static enum retry_result run_with_retries(struct sqlite3* db,
+                                          int (*fn)(struct sqlite3* db, void* data), void* data);
+
+/*
+ * Writes pending bumps, entries that turned out to be deleted are queued again.
+ * Returns false if writes were suspended before bumps could be written, they are kept then.
+ */
+static bool flush_bumps(struct sqlite3* db) {
+    if (VEC_SIZE(&bumps.list) == 0) {
+        return true;
+    }
+
+    log_print(DEBUG, "sql: writing %zu bumps", VEC_SIZE(&bumps.list));
+    const enum retry_result result = run_with_retries(db, write_bumps, NULL);
+    if (result == RETRY_SUSPENDED) {
+        return false;
+    }
+    const bool ok = result == RETRY_OK;
+
+    VEC_FOREACH(&bumps.list, i) {
+        struct pending_bump* b = VEC_AT(&bumps.list, i);
+        if (ok && b->gone) {
+            log_print(DEBUG, "sql: entry %li is gone, saving it again", b->id);
+            recent_hashes_forget(b->entry.hash);
+            pthread_mutex_lock(&thread_state.mutex);
+            queue_push(b->entry);
+            pthread_mutex_unlock(&thread_state.mutex);
+            continue;
+        } else if (ok) {
+            server_notify_change(PROTO_CHANGE_BUMP, b->id);
+        }
+        queue_entry_free_contents(&b->entry);
+    }
+    VEC_CLEAR(&bumps.list);
+
+    return true;
+}
+
+/*
+ * Waits until timeout expires, thread is asked to exit or writes are suspended.
+ * Mutex must be held. Thread is not busy while it waits, so that suspending
+ * writes doesn't have to wait for the lock to be released by someone else.
+ */
+static enum retry_result wait_before_retry(int64_t delay_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += delay_ms / 1000;
+    deadline.tv_nsec += (delay_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    thread_state.busy = false;
+    pthread_cond_broadcast(&thread_state.idle_cond);
+
+    /* cond is also signalled when new entries are queued, so keep waiting */
+    while (!thread_state.should_exit && thread_state.suspended == 0) {
+        if (pthread_cond_timedwait(&thread_state.cond, &thread_state.mutex, &deadline) != 0) {
+            break;
+        }
+    }
+
+    if (thread_state.should_exit) {
+        return RETRY_FAILED;
+    } else if (thread_state.suspended > 0) {
+        return RETRY_SUSPENDED;
+    }
+
+    thread_state.busy = true;
+    return RETRY_OK;
+}
+
+/* runs fn until it succeeds or fails with something other than db being locked */
+static enum retry_result run_with_retries(struct sqlite3* db,
+                                          int (*fn)(struct sqlite3* db, void* data), void* data) {
+    int64_t delay = INSERT_RETRY_DELAY_MS;
+
+    for (int attempt = 0; ; attempt++) {
+        const int rc = fn(db, data);
+        if (rc == SQLITE_OK || !db_is_busy_error(rc)) {
+            return (rc == SQLITE_OK) ? RETRY_OK : RETRY_FAILED;
+        }
+
+        if (attempt == INSERT_RETRY_COUNT) {
+            log_print(ERR, "db is still locked after %d retries, entry is lost", attempt);
+            return RETRY_FAILED;
+        }
+
+        log_print(WARN, "db is locked, retrying insertion in %lims", delay);
+        pthread_mutex_lock(&thread_state.mutex);
+        const enum retry_result result = wait_before_retry(delay);
+        pthread_mutex_unlock(&thread_state.mutex);
+        if (result == RETRY_FAILED) {
+            log_print(WARN, "exiting while db is locked, entry is lost");
+            return RETRY_FAILED;
+        } else if (result == RETRY_SUSPENDED) {
+            log_print(DEBUG, "db writes were suspended while waiting to retry");
+            return RETRY_SUSPENDED;
+        }
+
+        delay *= 2;
+    }
+}
+
+/* waits until monotonic deadline or until cond is signalled, mutex must be held */
+static void wait_until(int64_t deadline_ms) {
+    const int64_t delay_ms = MAX(deadline_ms - monotonic_ms(), 0);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += delay_ms / 1000;
+    deadline.tv_nsec += (delay_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_cond_timedwait(&thread_state.cond, &thread_state.mutex, &deadline);
+}
+
 static void* thread_entrypoint(void* data) {
     struct sqlite3* db = data;
 
-    pthread_mutex_lock(&thread_state.mutex);
-    while (!thread_state.should_exit) {
-        /* wait for new entry to be queued (mutex must be held by us) */
-        pthread_cond_wait(&thread_state.cond, &thread_state.mutex);
+    db_set_busy_abort(db, writes_suspended, NULL);
 
-        /* we are now holding the mutex */
+    pthread_mutex_lock(&thread_state.mutex);
+    while (true) {
+        /* we are holding the mutex here */
 
         struct queue_entry entry;
-        if (!queue_pop(&entry)) {
-            /* if we woke up but queue is empty we most likely were asked to die. */
+        if (thread_state.suspended == 0 && queue_pop(&entry)) {
+            /* release the mutex so that other thread can keep feeding data */
+            thread_state.busy = true;
+            pthread_mutex_unlock(&thread_state.mutex);
+
+            entry.hash = db_hash_data(entry.buf->data, entry.buf->size);
+            bool postponed = false;
+            if (!try_bump(&entry)) {
+                /* keep changes in order */
+                postponed = !flush_bumps(db)
+                    || run_with_retries(db, process_queue_entry, &entry) == RETRY_SUSPENDED;
+                if (!postponed) {
+                    queue_entry_free_contents(&entry);
+                }
+            } else if (bumps_due()) {
+                flush_bumps(db);
+            }
+
+            pthread_mutex_lock(&thread_state.mutex);
+            if (postponed) {
+                /* will be the first thing written after resume */
+                queue_unpop(entry);
+            }
+            thread_state.busy = false;
+            pthread_cond_broadcast(&thread_state.idle_cond);
             continue;
         }
 
-        do {
-            /* release the mutex so that other thread can keep feeding data */
+        if (thread_state.suspended == 0 && VEC_SIZE(&bumps.list) > 0
+            && (thread_state.should_exit || bumps_due())) {
+            thread_state.busy = true;
             pthread_mutex_unlock(&thread_state.mutex);
 
-            process_queue_entry(db, &entry);
-            queue_entry_free_contents(&entry);
+            flush_bumps(db);
 
-            /* check for more entries in the buffer */
             pthread_mutex_lock(&thread_state.mutex);
-        } while (queue_pop(&entry));
+            thread_state.busy = false;
+            pthread_cond_broadcast(&thread_state.idle_cond);
+            continue;
+        }
+
+        if (thread_state.should_exit) {
+            break;
+        }
+
+        /* only runs when queue is empty, insertions always come first */
+        if (thread_state.suspended == 0 && thread_state.maintenance_requested) {
+            thread_state.maintenance_requested = false;
+            thread_state.busy = true;
+            pthread_mutex_unlock(&thread_state.mutex);
+
+            run_maintenance(db);
+
+            pthread_mutex_lock(&thread_state.mutex);
+            thread_state.busy = false;
+            pthread_cond_broadcast(&thread_state.idle_cond);
+            continue;
+        }
+
+        /* wait for new entry to be queued, for maintenance request or for bumps to be due */
+        if (thread_state.suspended == 0 && VEC_SIZE(&bumps.list) > 0) {
+            wait_until(bumps.deadline_ms);
+        } else {
+            pthread_cond_wait(&thread_state.cond, &thread_state.mutex);
+        }
+    }
+
+    if (thread_state.pending > 0 || VEC_SIZE(&bumps.list) > 0) {
+        log_print(WARN, "exiting while db writes are suspended, %zu entries are lost",
+                  thread_state.pending + VEC_SIZE(&bumps.list));
     }
 
     pthread_mutex_unlock(&thread_state.mutex);
+
+    VEC_FOREACH(&bumps.list, i) {
+        queue_entry_free_contents(&VEC_AT(&bumps.list, i)->entry);
+    }
+    VEC_FREE(&bumps.list);
+
+    if (maintenance.backup != NULL) {
+        log_print(WARN, "backup was interrupted");
+        finish_backup(false);
+    }
     cleanup_statements();
 
+    struct db_lock_stats stats;
+    db_get_lock_stats(&stats);
+    if (stats.waits > 0) {
+        log_print(INFO, "waited for db lock %lu times, %lums total, %lu timeouts",
+                  stats.waits, stats.wait_ms, stats.timeouts);
+    }
+
     struct queue *q = &thread_state.queue;
     free(q->ring);
     q->ring = NULL;
@@ -344,7 +1340,7 @@ bool start_db_thread(struct sqlite3* db) {
     q->size = 16;
     q->ring = xcalloc(q->size, sizeof(q->ring[0]));
 
-    if (!prepare_statements(db)) {
+    if (!prepare_statements(db) || !prime_recent_hashes(db)) {
         goto err;
     }
 
@@ -377,16 +1373,18 @@ void stop_db_thread(void) {
 
     log_print(DEBUG, "stopping db thread");
 
+    /* under mutex, otherwise thread could check it right before it starts waiting */
+    pthread_mutex_lock(&thread_state.mutex);
     thread_state.should_exit = true;
+    pthread_mutex_unlock(&thread_state.mutex);
     pthread_cond_signal(&thread_state.cond);
     pthread_join(thread_state.thread, NULL);
 }
 
-void queue_for_insertion(void *data, size_t size, char *mime) {
+void queue_for_insertion(struct buffer *buf, char *mime) {
     pthread_mutex_lock(&thread_state.mutex);
     queue_push((struct queue_entry){
-        .data = data,
-        .size = size,
+        .buf = buf,
         .mime = mime,
     });
     pthread_mutex_unlock(&thread_state.mutex);
@@ -394,3 +1392,43 @@ void queue_for_insertion(void *data, size_t size, char *mime) {
     pthread_cond_signal(&thread_state.cond);
 }
 
+bool db_queue_is_empty(void) {
+    return __atomic_load_n(&thread_state.pending, __ATOMIC_RELAXED) == 0;
+}
+
+void request_maintenance(void) {
+    pthread_mutex_lock(&thread_state.mutex);
+    thread_state.maintenance_requested = true;
+    pthread_mutex_unlock(&thread_state.mutex);
+
+    pthread_cond_signal(&thread_state.cond);
+}
+
+void request_backup(void) {
+    __atomic_store_n(&thread_state.backup_requested, true, __ATOMIC_RELAXED);
+    request_maintenance();
+}
+
+void suspend_db_writes(void) {
+    pthread_mutex_lock(&thread_state.mutex);
+    __atomic_add_fetch(&thread_state.suspended, 1, __ATOMIC_RELAXED);
+    while (thread_state.busy) {
+        pthread_cond_wait(&thread_state.idle_cond, &thread_state.mutex);
+    }
+    pthread_mutex_unlock(&thread_state.mutex);
+
+    log_print(INFO, "db writes suspended");
+}
+
+void resume_db_writes(void) {
+    pthread_mutex_lock(&thread_state.mutex);
+    if (thread_state.suspended > 0) {
+        __atomic_sub_fetch(&thread_state.suspended, 1, __ATOMIC_RELAXED);
+    }
+    const unsigned pending = thread_state.pending;
+    pthread_mutex_unlock(&thread_state.mutex);
+
+    pthread_cond_signal(&thread_state.cond);
+
+    log_print(INFO, "db writes resumed, %u entries were queued meanwhile", pending);
+}
@@ -23,9 +23,26 @@
 
 #include <sqlite3.h>
 
+#include "buffer.h"
+
 bool start_db_thread(struct sqlite3* db);
 void stop_db_thread(void);
 
-/* expects mallocd pointers and takes ownership of both of them */
-void queue_for_insertion(void *data, size_t size, char *mime);
+/* takes ownership of one reference to buf and of mallocd mime */
+void queue_for_insertion(struct buffer *buf, char *mime);
+
+/* true if there's nothing waiting to be inserted */
+bool db_queue_is_empty(void);
+
+/* asks db thread to run maintenance tasks that are due once the queue is empty */
+void request_maintenance(void);
 
+/* asks db thread to make a backup now, server_backup_done() is called once it's done */
+void request_backup(void);
+
+/*
+ * Stops writing to db until resume_db_writes() is called, entries are queued meanwhile.
+ * Waits for insertion or maintenance that is in progress to finish. Calls can be nested.
+ */
+void suspend_db_writes(void);
+void resume_db_writes(void);
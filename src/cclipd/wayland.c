@@ -29,6 +29,9 @@
 
 #include "wayland.h"
 #include "sql.h"
+#include "maintenance.h"
+#include "primary.h"
+#include "buffer.h"
 #include "log.h"
 #include "config.h"
 #include "macros.h"
@@ -56,10 +59,40 @@ struct clipboard_offer {
     VEC(struct mime_type) mime_types;
 };
 
+/*
+ * Per-selection state, tracked separately for regular and primary selection.
+ * Used to take over the selection (see -k) when the source client goes away.
+ */
+struct selection {
+    bool primary;
+    /* incremented on every selection change not caused by us */
+    unsigned generation;
+    bool transfer_pending;
+    /* selection was cleared before the transfer finished, take over once it does */
+    bool restore_pending;
+
+    /* last fully received data for current generation */
+    struct buffer* buf;
+    struct mime_type type;
+
+    /* non-NULL if we currently own this selection */
+    struct zwlr_data_control_source_v1* source;
+    /* next selection event is the result of us setting the selection */
+    bool expect_own_offer;
+};
+
 struct clipboard_offer_data {
     VEC(uint8_t) data;
     struct mime_type type;
     struct pollen_event_source* fd_source;
+    struct selection* selection;
+    unsigned generation;
+};
+
+/* data being sent to a client that requested selection owned by us */
+struct outgoing_transfer {
+    struct buffer* buf;
+    size_t offset;
 };
 
 static struct {
@@ -71,10 +104,29 @@ static struct {
     struct zwlr_data_control_device_v1* data_control_device;
 
     struct clipboard_offer offer;
+
+    struct selection regular;
+    struct selection primary;
+
+    /* incoming and outgoing pipes currently being read or written */
+    unsigned transfers;
 } wayland = {
-    .fd = -1
+    .fd = -1,
+    .regular = { .primary = false },
+    .primary = { .primary = true },
 };
 
+static void selection_take_over(struct selection* sel);
+
+static void selection_set_data(struct selection* sel, struct buffer* buf,
+                               const struct mime_type* type) {
+    buffer_unref(sel->buf);
+    sel->buf = buf;
+    if (type != NULL) {
+        sel->type = *type;
+    }
+}
+
 static int on_pipe_ready(struct pollen_event_source* source, int fd, uint32_t ev, void* data) {
     struct clipboard_offer_data* od = data;
     bool free_vec = true;
@@ -101,15 +153,43 @@ static int on_pipe_ready(struct pollen_event_source* source, int fd, uint32_t ev
 
     if (ev & EPOLLHUP) {
         /* writing client closed its end of the pipe - finalize transfer */
+        struct selection* sel = od->selection;
+        const bool current = (od->generation == sel->generation);
+        if (current) {
+            sel->transfer_pending = false;
+        }
+
         if (od->data.size == 0) {
             log_print(WARN, "nothing was received!");
-        } else if (od->data.size < config.min_data_size) {
+            goto free;
+        }
+
+        struct buffer* buf = buffer_new(od->data.data, od->data.size);
+        free_vec = false;
+
+        if (od->data.size < config.min_data_size) {
             log_print(DEBUG, "received %d bytes which is less than %d, not saving",
                       od->data.size, config.min_data_size);
+        } else if (sel->primary) {
+            /* superseded primary selection is not worth keeping */
+            if (current) {
+                primary_push(buf, od->type.name);
+            }
         } else {
-            queue_for_insertion(od->data.data, od->data.size, xstrdup(od->type.name));
-            free_vec = false;
+            primary_copied(buf);
+            queue_for_insertion(buffer_ref(buf), xstrdup(od->type.name));
+            maintenance_schedule(MAINTENANCE_IDLE_DELAY_MS);
+        }
+
+        if (config.persist_selection && current) {
+            selection_set_data(sel, buffer_ref(buf), &od->type);
+            if (sel->restore_pending) {
+                sel->restore_pending = false;
+                selection_take_over(sel);
+            }
         }
+
+        buffer_unref(buf);
         goto free;
     }
 
@@ -117,6 +197,7 @@ static int on_pipe_ready(struct pollen_event_source* source, int fd, uint32_t ev
 
 free:
     pollen_event_source_remove(source);
+    wayland.transfers -= 1;
     if (free_vec) {
         VEC_FREE(&od->data);
     }
@@ -125,6 +206,123 @@ free:
     return 0;
 }
 
+static int on_send_ready(struct pollen_event_source* source, int fd, uint32_t ev, void* data) {
+    struct outgoing_transfer* t = data;
+    const struct buffer* buf = t->buf;
+
+    if (ev & EPOLLERR) {
+        log_print(DEBUG, "receiving client closed the pipe before transfer completed");
+        goto done;
+    }
+
+    while (t->offset < buf->size) {
+        ssize_t ret = write(fd, (char*)buf->data + t->offset, buf->size - t->offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN) {
+                /* pipe is full, wait until client reads some */
+                return 0;
+            }
+            log_print(WARN, "failed to send selection data: %s", strerror(errno));
+            goto done;
+        }
+        t->offset += ret;
+    }
+
+    log_print(TRACE, "sent %zu bytes of selection data", t->offset);
+
+done:
+    pollen_event_source_remove(source);
+    wayland.transfers -= 1;
+    buffer_unref(t->buf);
+    free(t);
+
+    return 0;
+}
+
+static void on_source_send(void* data, struct zwlr_data_control_source_v1* source,
+                           const char* mime_type, int32_t fd) {
+    struct selection* sel = data;
+
+    if (sel->buf == NULL) {
+        close(fd);
+        return;
+    }
+
+    log_print(DEBUG, "sending %zu bytes as %s", sel->buf->size, mime_type);
+    if (sel->primary) {
+        primary_pasted(sel->buf);
+    }
+
+    /* don't let a slow reader block the whole daemon */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    struct outgoing_transfer* t = xcalloc(1, sizeof(*t));
+    t->buf = buffer_ref(sel->buf);
+
+    if (pollen_loop_add_fd(eventloop, fd, EPOLLOUT, true, on_send_ready, t) == NULL) {
+        log_print(ERR, "failed to add pipe fd to event loop: %s", strerror(errno));
+        buffer_unref(t->buf);
+        free(t);
+        close(fd);
+        return;
+    }
+    wayland.transfers += 1;
+}
+
+static void on_source_cancelled(void* data, struct zwlr_data_control_source_v1* source) {
+    struct selection* sel = data;
+
+    log_print(DEBUG, "our %s selection source was replaced",
+              sel->primary ? "primary" : "regular");
+    if (sel->source == source) {
+        sel->source = NULL;
+    }
+    zwlr_data_control_source_v1_destroy(source);
+}
+
+static const struct zwlr_data_control_source_v1_listener data_control_source_listener = {
+    .send = on_source_send,
+    .cancelled = on_source_cancelled,
+};
+
+static void selection_take_over(struct selection* sel) {
+    /* some clients only ask for one of the text aliases, offer all of them */
+    static const char* const text_aliases[] = {
+        "text/plain", "text/plain;charset=utf-8", "TEXT", "STRING", "UTF8_STRING",
+    };
+
+    log_print(DEBUG, "source of %s selection went away, serving %zu bytes of %s ourselves",
+              sel->primary ? "primary" : "regular", sel->buf->size, sel->type.name);
+
+    struct zwlr_data_control_source_v1* source =
+        zwlr_data_control_manager_v1_create_data_source(wayland.data_control_manager);
+    if (source == NULL) {
+        log_print(ERR, "couldn't create a data_control_source");
+        return;
+    }
+    zwlr_data_control_source_v1_add_listener(source, &data_control_source_listener, sel);
+
+    zwlr_data_control_source_v1_offer(source, sel->type.name);
+    if (fnmatch("text/plain*", sel->type.name, 0) == 0) {
+        for (size_t i = 0; i < SIZEOF_ARRAY(text_aliases); i++) {
+            if (!STREQ(text_aliases[i], sel->type.name)) {
+                zwlr_data_control_source_v1_offer(source, text_aliases[i]);
+            }
+        }
+    }
+
+    sel->source = source;
+    sel->expect_own_offer = true;
+
+    if (sel->primary) {
+        zwlr_data_control_device_v1_set_primary_selection(wayland.data_control_device, source);
+    } else {
+        zwlr_data_control_device_v1_set_selection(wayland.data_control_device, source);
+    }
+}
+
 static bool is_secret(struct clipboard_offer* co) {
     bool has_password_manager_hint = false;
     VEC_FOREACH(&co->mime_types, i) {
@@ -164,7 +362,7 @@ static bool is_secret(struct clipboard_offer* co) {
     return false;
 }
 
-static void receive_offer(struct clipboard_offer* co) {
+static void receive_offer(struct clipboard_offer* co, struct selection* sel) {
     struct clipboard_offer_data* od = NULL;
     struct pipe p = { .fds = { -1, -1 } };
 
@@ -213,6 +411,8 @@ loop_out:
 
     od = xcalloc(1, sizeof(*od));
     od->type = *selected_type;
+    od->selection = sel;
+    od->generation = sel->generation;
 
     od->fd_source = pollen_loop_add_fd(eventloop, p.read, EPOLLIN, true, on_pipe_ready, od);
     if (od->fd_source == NULL) {
@@ -220,6 +420,8 @@ loop_out:
         goto err;
     }
 
+    sel->transfer_pending = true;
+    wayland.transfers += 1;
     return;
 
 err:
@@ -235,10 +437,21 @@ err:
 }
 
 static void common_selection_handler(struct clipboard_offer* co, bool primary) {
-    if (!primary || config.primary_selection) {
-        receive_offer(co);
-    } else {
+    struct selection* sel = primary ? &wayland.primary : &wayland.regular;
+
+    if (primary && !config.primary_selection) {
         log_print(DEBUG, "ignoring primary selection event for offer %p", (void*)co);
+    } else if (sel->expect_own_offer) {
+        /* this is the data we are serving ourselves, no need to read it back */
+        log_print(DEBUG, "ignoring offer %p created by us", (void*)co->offer);
+        sel->expect_own_offer = false;
+    } else {
+        sel->generation += 1;
+        sel->transfer_pending = false;
+        sel->restore_pending = false;
+        selection_set_data(sel, NULL, NULL);
+
+        receive_offer(co, sel);
     }
 
     log_print(TRACE, "destroying offer %p", (void*)co->offer);
@@ -246,10 +459,28 @@ static void common_selection_handler(struct clipboard_offer* co, bool primary) {
     co->offer = NULL;
 }
 
+static void selection_cleared(bool primary) {
+    struct selection* sel = primary ? &wayland.primary : &wayland.regular;
+
+    if (!config.persist_selection || (primary && !config.primary_selection)) {
+        return;
+    }
+
+    sel->expect_own_offer = false;
+    if (sel->buf != NULL) {
+        selection_take_over(sel);
+    } else if (sel->transfer_pending) {
+        /* source exited right after we started reading, take over once transfer completes */
+        log_print(DEBUG, "selection cleared while transfer is in flight, will restore later");
+        sel->restore_pending = true;
+    }
+}
+
 static void selection_handler(void* data, struct zwlr_data_control_device_v1* device,
                               struct zwlr_data_control_offer_v1* offer) {
     log_print(DEBUG, "got selection event for offer %p", (void*)offer);
     if (offer == NULL) {
+        selection_cleared(false);
         return;
     }
 
@@ -261,6 +492,7 @@ static void primary_selection_handler(void* data, struct zwlr_data_control_devic
                                       struct zwlr_data_control_offer_v1* offer) {
     log_print(DEBUG, "got primary selection event for offer %p", (void*)offer);
     if (offer == NULL) {
+        selection_cleared(true);
         return;
     }
 
@@ -389,6 +621,14 @@ int wayland_init(void) {
 }
 
 void wayland_cleanup(void) {
+    struct selection* selections[] = { &wayland.regular, &wayland.primary };
+    for (size_t i = 0; i < SIZEOF_ARRAY(selections); i++) {
+        if (selections[i]->source) {
+            zwlr_data_control_source_v1_destroy(selections[i]->source);
+        }
+        selection_set_data(selections[i], NULL, NULL);
+    }
+
     if (wayland.data_control_device) {
         zwlr_data_control_device_v1_destroy(wayland.data_control_device);
     }
@@ -406,3 +646,6 @@ void wayland_cleanup(void) {
     }
 }
 
+bool wayland_transfers_in_flight(void) {
+    return wayland.transfers > 0;
+}
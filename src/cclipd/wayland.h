@@ -18,7 +18,11 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 int wayland_init(void);
 void wayland_cleanup(void);
 int wayland_process_events(void);
 
+/* true if selection data is being received from or sent to a client right now */
+bool wayland_transfers_in_flight(void);
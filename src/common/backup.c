@@ -0,0 +1,187 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <limits.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "backup.h"
+#include "xmalloc.h"
+#include "log.h"
+
+#define BACKUP_PREFIX "cclip-"
+#define BACKUP_SUFFIX ".sqlite3"
+#define BACKUP_TIME_FORMAT "%Y%m%d-%H%M%S"
+
+struct backup {
+    struct sqlite3* dest;
+    struct sqlite3_backup* backup;
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+};
+
+struct backup* backup_start(struct sqlite3* db, const char* path) {
+    struct backup* b = xcalloc(1, sizeof(*b));
+
+    if (snprintf(b->path, sizeof(b->path), "%s", path) >= (int)sizeof(b->path)
+        || snprintf(b->tmp_path, sizeof(b->tmp_path), "%s.part", path) >= (int)sizeof(b->tmp_path)) {
+        log_print(ERR, "backup path is too long");
+        goto err;
+    }
+
+    /* leftover of a backup that was interrupted */
+    if (unlink(b->tmp_path) < 0 && errno != ENOENT) {
+        log_print(ERR, "failed to remove %s: %s", b->tmp_path, strerror(errno));
+        goto err;
+    }
+
+    int rc = sqlite3_open_v2(b->tmp_path, &b->dest,
+                             SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (rc != SQLITE_OK) {
+        log_print(ERR, "failed to create %s: %s", b->tmp_path, sqlite3_errstr(rc));
+        goto err;
+    }
+
+    b->backup = sqlite3_backup_init(b->dest, "main", db, "main");
+    if (b->backup == NULL) {
+        log_print(ERR, "failed to start backup: %s", sqlite3_errmsg(b->dest));
+        goto err;
+    }
+
+    log_print(DEBUG, "started backup to %s", b->path);
+    return b;
+
+err:
+    backup_finish(b, false);
+    return NULL;
+}
+
+int backup_step(struct backup* b, int pages) {
+    const int rc = sqlite3_backup_step(b->backup, pages);
+    if (rc != SQLITE_OK && rc != SQLITE_DONE && rc != SQLITE_BUSY && rc != SQLITE_LOCKED) {
+        log_print(ERR, "backup to %s failed: %s", b->path, sqlite3_errstr(rc));
+    }
+    return rc;
+}
+
+void backup_progress(struct backup* b, int* copied, int* total) {
+    *total = sqlite3_backup_pagecount(b->backup);
+    *copied = *total - sqlite3_backup_remaining(b->backup);
+}
+
+const char* backup_path(struct backup* b) {
+    return b->path;
+}
+
+bool backup_finish(struct backup* b, bool commit) {
+    bool ret = !commit;
+
+    if (b->backup != NULL && sqlite3_backup_finish(b->backup) != SQLITE_OK && commit) {
+        log_print(ERR, "backup to %s failed: %s", b->path, sqlite3_errmsg(b->dest));
+        commit = false;
+    }
+    /* closing last connection also checkpoints and removes WAL if the copy is in WAL mode */
+    if (b->dest != NULL && sqlite3_close(b->dest) != SQLITE_OK && commit) {
+        log_print(ERR, "failed to close %s", b->tmp_path);
+        commit = false;
+    }
+
+    if (commit) {
+        if (rename(b->tmp_path, b->path) < 0) {
+            log_print(ERR, "failed to move backup to %s: %s", b->path, strerror(errno));
+        } else {
+            log_print(INFO, "saved backup to %s", b->path);
+            ret = true;
+        }
+    }
+    if (!ret || !commit) {
+        unlink(b->tmp_path);
+    }
+
+    free(b);
+    return ret;
+}
+
+bool backup_make_path(const char* dir, char* buf, size_t size) {
+    char timestr[32];
+    const time_t now = time(NULL);
+    strftime(timestr, sizeof(timestr), BACKUP_TIME_FORMAT, localtime(&now));
+
+    return snprintf(buf, size, "%s/" BACKUP_PREFIX "%s" BACKUP_SUFFIX, dir, timestr) < (int)size;
+}
+
+static int filter_backups(const struct dirent* e) {
+    const size_t len = strlen(e->d_name);
+    return len > strlen(BACKUP_PREFIX) + strlen(BACKUP_SUFFIX)
+        && strncmp(e->d_name, BACKUP_PREFIX, strlen(BACKUP_PREFIX)) == 0
+        && strcmp(&e->d_name[len - strlen(BACKUP_SUFFIX)], BACKUP_SUFFIX) == 0;
+}
+
+/* names sort in chronological order, oldest first */
+static int list_backups(const char* dir, struct dirent*** entries) {
+    const int n = scandir(dir, entries, filter_backups, alphasort);
+    if (n < 0 && errno != ENOENT) {
+        log_print(WARN, "failed to list backups in %s: %s", dir, strerror(errno));
+    }
+    return n;
+}
+
+void backup_rotate(const char* dir, int keep) {
+    struct dirent** entries = NULL;
+    const int n = list_backups(dir, &entries);
+
+    for (int i = 0; i < n; i++) {
+        if (i < n - keep) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+            if (unlink(path) < 0) {
+                log_print(WARN, "failed to remove old backup %s: %s", path, strerror(errno));
+            } else {
+                log_print(DEBUG, "removed old backup %s", path);
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+time_t backup_newest(const char* dir) {
+    struct dirent** entries = NULL;
+    const int n = list_backups(dir, &entries);
+    time_t ret = 0;
+
+    if (n > 0) {
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[n - 1]->d_name);
+        if (stat(path, &st) == 0) {
+            ret = st.st_mtime;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        free(entries[i]);
+    }
+    free(entries);
+    return ret;
+}
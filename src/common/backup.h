@@ -0,0 +1,66 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+/*
+ * Online backups with sqlite3 backup api. Copy is written to a temporary file next to
+ * the destination and only renamed into place when complete, so a backup that is
+ * interrupted halfway never looks like a valid one.
+ */
+
+struct backup;
+
+/* starts copying db to path, returns NULL on failure */
+struct backup* backup_start(struct sqlite3* db, const char* path);
+
+/*
+ * Copies up to pages pages (all if negative). Returns SQLITE_OK if there's more to copy,
+ * SQLITE_DONE if backup is complete, SQLITE_BUSY or SQLITE_LOCKED if it should be retried later
+ * and other error codes if it failed.
+ */
+int backup_step(struct backup* b, int pages);
+
+/* pages copied so far and total page count of source db */
+void backup_progress(struct backup* b, int* copied, int* total);
+
+/* final path of the backup, valid until backup_finish() */
+const char* backup_path(struct backup* b);
+
+/*
+ * Moves complete backup into place if commit is true, removes temporary file otherwise.
+ * Frees b. Returns false if backup was to be committed but that failed.
+ */
+bool backup_finish(struct backup* b, bool commit);
+
+/*
+ * Scheduled backups live in a directory and are named after the time they were started.
+ * Writes path of a new backup in dir to buf, returns false if it doesn't fit.
+ */
+bool backup_make_path(const char* dir, char* buf, size_t size);
+
+/* removes all but keep newest backups in dir */
+void backup_rotate(const char* dir, int keep);
+
+/* returns modification time of newest backup in dir, 0 if there are none */
+time_t backup_newest(const char* dir);
@@ -23,6 +23,9 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <time.h>
+
+#include <xxhash.h>
 
 #include "db.h"
 #include "macros.h"
@@ -128,6 +131,124 @@
  *     AND NOT EXISTS ( SELECT 1 FROM history_tags WHERE tag_id = OLD.tag_id );
  * END;
  *
+ * Schema version 5: cclip 3.3.0-next (change sequence and tombstones added)
+ *
+ * CREATE TABLE history (
+ *     id        INTEGER PRIMARY KEY,
+ *     data      BLOB    NOT NULL,
+ *     data_hash INTEGER NOT NULL UNIQUE,
+ *     data_size INTEGER NOT NULL,
+ *     preview   TEXT    NOT NULL,
+ *     mime_type TEXT    NOT NULL,
+ *     timestamp INTEGER NOT NULL,
+ *     seq       INTEGER NOT NULL DEFAULT 0
+ * );
+ *
+ * CREATE INDEX idx_history_timestamp ON history ( timestamp );
+ * CREATE INDEX idx_history_seq ON history ( seq );
+ *
+ * CREATE TABLE tags (
+ *     id   INTEGER PRIMARY KEY,
+ *     name TEXT    NOT NULL UNIQUE
+ * );
+ *
+ * CREATE TABLE history_tags (
+ *     tag_id   INTEGER,
+ *     entry_id INTEGER,
+ *
+ *     PRIMARY KEY ( tag_id, entry_id ),
+ *     FOREIGN KEY ( entry_id ) REFERENCES history ( id ) ON DELETE CASCADE,
+ *     FOREIGN KEY ( tag_id ) REFERENCES tags ( id ) ON DELETE RESTRICT
+ * ) WITHOUT ROWID;
+ *
+ * CREATE INDEX idx_history_tags_entry_id ON history_tags ( entry_id );
+ *
+ * CREATE TRIGGER cleanup_orphaned_tags AFTER DELETE ON history_tags FOR EACH ROW BEGIN
+ *     DELETE FROM tags
+ *     WHERE id = OLD.tag_id
+ *     AND NOT EXISTS ( SELECT 1 FROM history_tags WHERE tag_id = OLD.tag_id );
+ * END;
+ *
+ * -- value is the last assigned change sequence number,
+ * -- tombstones with seq <= horizon were pruned
+ * CREATE TABLE sequence (
+ *     id      INTEGER PRIMARY KEY CHECK ( id = 0 ),
+ *     value   INTEGER NOT NULL,
+ *     horizon INTEGER NOT NULL
+ * );
+ *
+ * CREATE TABLE tombstones (
+ *     seq      INTEGER PRIMARY KEY,
+ *     entry_id INTEGER NOT NULL
+ * );
+ *
+ * CREATE TRIGGER seq_history_insert AFTER INSERT ON history FOR EACH ROW BEGIN
+ *     UPDATE sequence SET value = value + 1;
+ *     UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.id;
+ * END;
+ *
+ * CREATE TRIGGER seq_history_update AFTER UPDATE OF timestamp ON history FOR EACH ROW BEGIN
+ *     UPDATE sequence SET value = value + 1;
+ *     UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.id;
+ * END;
+ *
+ * CREATE TRIGGER seq_history_delete AFTER DELETE ON history FOR EACH ROW BEGIN
+ *     UPDATE sequence SET value = value + 1;
+ *     INSERT INTO tombstones ( seq, entry_id ) VALUES ( ( SELECT value FROM sequence ), OLD.id );
+ * END;
+ *
+ * CREATE TRIGGER seq_history_tags_insert AFTER INSERT ON history_tags FOR EACH ROW BEGIN
+ *     UPDATE sequence SET value = value + 1;
+ *     UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.entry_id;
+ * END;
+ *
+ * CREATE TRIGGER seq_history_tags_delete AFTER DELETE ON history_tags FOR EACH ROW BEGIN
+ *     UPDATE sequence SET value = value + 1;
+ *     UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = OLD.entry_id;
+ * END;
+ *
+ * Schema version 6: cclip 3.3.0-next (indexes for list filters added)
+ *
+ * Same as version 5, plus:
+ *
+ * CREATE INDEX idx_history_mime_type_timestamp ON history ( mime_type, timestamp );
+ * CREATE INDEX idx_history_data_size ON history ( data_size );
+ *
+ * Schema version 7: cclip 3.3.0-next (full text search index added)
+ *
+ * Same as version 6, plus:
+ *
+ * CREATE VIRTUAL TABLE history_fts USING fts5 (
+ *     data, content = 'history', content_rowid = 'id', tokenize = 'trigram'
+ * );
+ *
+ * CREATE TRIGGER fts_history_delete AFTER DELETE ON history FOR EACH ROW
+ * WHEN substr(OLD.mime_type, 1, 5) = 'text/' BEGIN
+ *     INSERT INTO history_fts ( history_fts, rowid, data ) VALUES ( 'delete', OLD.id, OLD.data );
+ * END;
+ *
+ * Entries are added to history_fts by whoever inserts them (see DB_FTS_INSERT_SQL).
+ *
+ * Schema version 8: cclip 3.3.0-next (near-duplicate detection added)
+ *
+ * Same as version 7, plus:
+ *
+ * -- SimHash signature of text, NULL if it was not computed (see cclipd -n)
+ * ALTER TABLE history ADD COLUMN simhash INTEGER;
+ *
+ * -- one row per band of signature, timestamp is copied from history so that
+ * -- recent entries in a bucket can be found with a range scan
+ * CREATE TABLE history_lsh (
+ *     bucket    INTEGER NOT NULL,
+ *     timestamp INTEGER NOT NULL,
+ *     entry_id  INTEGER NOT NULL,
+ *
+ *     PRIMARY KEY ( bucket, timestamp, entry_id ),
+ *     FOREIGN KEY ( entry_id ) REFERENCES history ( id ) ON DELETE CASCADE
+ * ) WITHOUT ROWID;
+ *
+ * CREATE INDEX idx_history_lsh_entry_id ON history_lsh ( entry_id );
+ *
  */
 
 static const char* get_default_db_path(void) {
@@ -149,8 +270,178 @@ static const char* get_default_db_path(void) {
     return db_path;
 }
 
+const char* db_get_path(const char* path) {
+    return (path == NULL) ? get_default_db_path() : path;
+}
+
+static const struct db_profile profile_default = {
+    /* sqlite defaults */
+    .name = "default",
+    .page_size = 0,
+    .mmap_size = 0,
+    .cache_size = -2000,
+    .synchronous = 2,
+    .temp_store = 0,
+    .journal_size_limit = -1,
+};
+
+static const struct db_profile profile_blob_heavy = {
+    /* big images: fewer overflow pages per entry, read payloads straight from page cache */
+    .name = "blob-heavy",
+    .page_size = 16384,
+    .mmap_size = 256 * 1024 * 1024,
+    .cache_size = -8192,
+    .synchronous = 1,
+    .temp_store = 0,
+    .journal_size_limit = 64 * 1024 * 1024,
+};
+
+static const struct db_profile profile_low_memory = {
+    .name = "low-memory",
+    .page_size = 4096,
+    .mmap_size = 0,
+    .cache_size = -256,
+    .synchronous = 1,
+    .temp_store = 1,
+    .journal_size_limit = 4 * 1024 * 1024,
+};
+
+static const struct db_profile profile_durable = {
+    /* every commit is synced, no mmap so that I/O errors are reported instead of SIGBUS */
+    .name = "durable",
+    .page_size = 4096,
+    .mmap_size = 0,
+    .cache_size = -2000,
+    .synchronous = 3,
+    .temp_store = 0,
+    .journal_size_limit = -1,
+};
+
+static const struct db_profile profile_fast = {
+    /* last commits may be lost on power loss, but db is never corrupted */
+    .name = "fast",
+    .page_size = 8192,
+    .mmap_size = 1024 * 1024 * 1024,
+    .cache_size = -16384,
+    .synchronous = 1,
+    .temp_store = 2,
+    .journal_size_limit = 64 * 1024 * 1024,
+};
+
+const struct db_profile* const db_profiles[] = {
+    &profile_default,
+    &profile_blob_heavy,
+    &profile_low_memory,
+    &profile_durable,
+    &profile_fast,
+    NULL,
+};
+
+static const struct db_profile* profile = &profile_default;
+
+bool db_select_profile(const char* name) {
+    for (const struct db_profile* const* p = db_profiles; *p != NULL; p++) {
+        if (STREQ((*p)->name, name)) {
+            profile = *p;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const struct db_profile* db_get_profile(void) {
+    return profile;
+}
+
+static bool apply_profile(struct sqlite3* db) {
+    char sql[512];
+    snprintf(sql, sizeof(sql),
+             "PRAGMA mmap_size = %li;"
+             "PRAGMA cache_size = %d;"
+             "PRAGMA synchronous = %d;"
+             "PRAGMA temp_store = %d;"
+             "PRAGMA journal_size_limit = %li;",
+             profile->mmap_size, profile->cache_size, profile->synchronous,
+             profile->temp_store, profile->journal_size_limit);
+
+    log_print(DEBUG, "applying storage profile %s", profile->name);
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to apply storage profile %s: %s", profile->name, sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+static struct db_lock_stats lock_stats;
+
+/* start of current wait, busy handler runs in the thread that uses the connection */
+static _Thread_local int64_t busy_start_ms;
+static _Thread_local unsigned int busy_seed;
+
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+struct busy_abort {
+    bool (*fn)(void* data);
+    void* data;
+};
+
+static int busy_handler(void* data, int n) {
+    const struct busy_abort* abort = data;
+    const int64_t now = monotonic_ms();
+
+    if (abort != NULL && abort->fn(abort->data)) {
+        log_print(DEBUG, "stopped waiting for database lock");
+        return 0;
+    }
+
+    if (n == 0) {
+        busy_start_ms = now;
+        __atomic_add_fetch(&lock_stats.waits, 1, __ATOMIC_RELAXED);
+        log_print(DEBUG, "database is locked, waiting");
+    }
+
+    const int64_t waited = now - busy_start_ms;
+    if (waited >= DB_BUSY_TIMEOUT_MS) {
+        __atomic_add_fetch(&lock_stats.timeouts, 1, __ATOMIC_RELAXED);
+        log_print(WARN, "database is still locked after %lims, giving up", waited);
+        return 0;
+    }
+
+    if (busy_seed == 0) {
+        busy_seed = (unsigned int)getpid() ^ (unsigned int)now ^ (uintptr_t)&busy_seed;
+    }
+
+    /* sleep for somewhere between half and full delay */
+    const int64_t delay = MIN(DB_BUSY_MAX_DELAY_MS, 1 << MIN(n, 16));
+    const int64_t sleep = MIN(DB_BUSY_TIMEOUT_MS - waited,
+                              delay / 2 + rand_r(&busy_seed) % (delay / 2 + 1));
+    usleep(sleep * 1000);
+
+    __atomic_add_fetch(&lock_stats.wait_ms, monotonic_ms() - now, __ATOMIC_RELAXED);
+    return 1;
+}
+
+void db_set_busy_abort(struct sqlite3* db, bool (*fn)(void* data), void* data) {
+    static struct busy_abort abort;
+
+    abort = (struct busy_abort){ .fn = fn, .data = data };
+    sqlite3_busy_handler(db, busy_handler, (fn != NULL) ? &abort : NULL);
+}
+
+void db_get_lock_stats(struct db_lock_stats* stats) {
+    stats->waits = __atomic_load_n(&lock_stats.waits, __ATOMIC_RELAXED);
+    stats->wait_ms = __atomic_load_n(&lock_stats.wait_ms, __ATOMIC_RELAXED);
+    stats->timeouts = __atomic_load_n(&lock_stats.timeouts, __ATOMIC_RELAXED);
+}
+
 struct sqlite3* db_open(const char *_path, bool create_if_not_exists) {
-    const char* path = (_path == NULL) ? get_default_db_path() : _path;
+    const char* path = db_get_path(_path);
     if (path == NULL) {
         log_print(ERR, "failed to determine database path");
         return NULL;
@@ -188,6 +479,9 @@ struct sqlite3* db_open(const char *_path, bool create_if_not_exists) {
         return NULL;
     }
 
+    /* cclip and cclipd write to the same database, wait for each other instead of failing */
+    sqlite3_busy_handler(db, busy_handler, NULL);
+
     /* must be enabled explicitly per connection */
     if (sqlite3_exec(db, "PRAGMA foreign_keys = 1", NULL, NULL, NULL) != SQLITE_OK) {
         log_print(ERR, "failed to enable foreign key support: %s", sqlite3_errmsg(db));
@@ -195,6 +489,29 @@ struct sqlite3* db_open(const char *_path, bool create_if_not_exists) {
         return NULL;
     }
 
+    if (!apply_profile(db)) {
+        sqlite3_close(db);
+        return NULL;
+    }
+
+    return db;
+}
+
+struct sqlite3* db_open_readonly(const char* path) {
+    log_print(DEBUG, "opening database at %s in read-only mode", path);
+    struct sqlite3* db = NULL;
+    int rc = sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL);
+    if (rc != SQLITE_OK) {
+        log_print(ERR, "failed to open database at %s: %s", path, sqlite3_errstr(rc));
+        sqlite3_close(db);
+        return NULL;
+    }
+
+    if (!apply_profile(db)) {
+        sqlite3_close(db);
+        return NULL;
+    }
+
     return db;
 }
 
@@ -208,6 +525,22 @@ bool db_close(struct sqlite3* db) {
 }
 
 bool db_init(struct sqlite3* db) {
+    /* lets cclipd give free pages back to the filesystem without full VACUUM */
+    if (sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to set auto_vacuum: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    /* must be set before anything is written, can't be changed in WAL mode later */
+    if (profile->page_size > 0) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA page_size = %d", profile->page_size);
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+            log_print(ERR, "failed to set page size: %s", sqlite3_errmsg(db));
+            return false;
+        }
+    }
+
     static const char sql[] = TOSTRING(
         PRAGMA journal_mode = WAL;
 
@@ -218,10 +551,15 @@ bool db_init(struct sqlite3* db) {
             data_hash INTEGER NOT NULL UNIQUE,
             preview   TEXT    NOT NULL,
             mime_type TEXT    NOT NULL,
-            timestamp INTEGER NOT NULL
+            timestamp INTEGER NOT NULL,
+            seq       INTEGER NOT NULL DEFAULT 0,
+            simhash   INTEGER
         );
 
         CREATE INDEX idx_history_timestamp ON history ( timestamp );
+        CREATE INDEX idx_history_seq ON history ( seq );
+        CREATE INDEX idx_history_mime_type_timestamp ON history ( mime_type, timestamp );
+        CREATE INDEX idx_history_data_size ON history ( data_size );
 
         CREATE TABLE tags (
             id   INTEGER PRIMARY KEY,
@@ -245,7 +583,65 @@ bool db_init(struct sqlite3* db) {
             AND NOT EXISTS ( SELECT 1 FROM history_tags WHERE tag_id = OLD.tag_id );
         END;
 
-        PRAGMA user_version = 4;
+        CREATE TABLE sequence (
+            id      INTEGER PRIMARY KEY CHECK ( id = 0 ),
+            value   INTEGER NOT NULL,
+            horizon INTEGER NOT NULL
+        );
+
+        CREATE TABLE tombstones (
+            seq      INTEGER PRIMARY KEY,
+            entry_id INTEGER NOT NULL
+        );
+
+        CREATE TRIGGER seq_history_insert AFTER INSERT ON history FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.id;
+        END;
+
+        CREATE TRIGGER seq_history_update AFTER UPDATE OF timestamp ON history FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.id;
+        END;
+
+        CREATE TRIGGER seq_history_delete AFTER DELETE ON history FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            INSERT INTO tombstones ( seq, entry_id ) VALUES ( ( SELECT value FROM sequence ), OLD.id );
+        END;
+
+        CREATE TRIGGER seq_history_tags_insert AFTER INSERT ON history_tags FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.entry_id;
+        END;
+
+        CREATE TRIGGER seq_history_tags_delete AFTER DELETE ON history_tags FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = OLD.entry_id;
+        END;
+
+        INSERT INTO sequence ( id, value, horizon ) VALUES ( 0, 0, 0 );
+
+        CREATE VIRTUAL TABLE history_fts USING fts5 (
+            data, content = 'history', content_rowid = 'id', tokenize = 'trigram'
+        );
+
+        CREATE TRIGGER fts_history_delete AFTER DELETE ON history FOR EACH ROW
+        WHEN substr(OLD.mime_type, 1, 5) = 'text/' BEGIN
+            INSERT INTO history_fts ( history_fts, rowid, data ) VALUES ( 'delete', OLD.id, OLD.data );
+        END;
+
+        CREATE TABLE history_lsh (
+            bucket    INTEGER NOT NULL,
+            timestamp INTEGER NOT NULL,
+            entry_id  INTEGER NOT NULL,
+
+            PRIMARY KEY ( bucket, timestamp, entry_id ),
+            FOREIGN KEY ( entry_id ) REFERENCES history ( id ) ON DELETE CASCADE
+        ) WITHOUT ROWID;
+
+        CREATE INDEX idx_history_lsh_entry_id ON history_lsh ( entry_id );
+
+        PRAGMA user_version = 8;
     );
 
     int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
@@ -332,6 +728,139 @@ bool db_set_secure_delete(struct sqlite3* db, bool enable) {
     return ret;
 }
 
+static bool migrate_from_7_to_8(struct sqlite3* db) {
+    static const char sql[] = TOSTRING(
+        ALTER TABLE history ADD COLUMN simhash INTEGER;
+
+        CREATE TABLE history_lsh (
+            bucket    INTEGER NOT NULL,
+            timestamp INTEGER NOT NULL,
+            entry_id  INTEGER NOT NULL,
+
+            PRIMARY KEY ( bucket, timestamp, entry_id ),
+            FOREIGN KEY ( entry_id ) REFERENCES history ( id ) ON DELETE CASCADE
+        ) WITHOUT ROWID;
+
+        CREATE INDEX idx_history_lsh_entry_id ON history_lsh ( entry_id );
+
+        PRAGMA user_version = 8;
+    );
+
+    int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        log_print(ERR, "migration: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+static bool migrate_from_6_to_7(struct sqlite3* db) {
+    static const char sql[] = TOSTRING(
+        CREATE VIRTUAL TABLE history_fts USING fts5 (
+            data, content = 'history', content_rowid = 'id', tokenize = 'trigram'
+        );
+
+        CREATE TRIGGER fts_history_delete AFTER DELETE ON history FOR EACH ROW
+        WHEN substr(OLD.mime_type, 1, 5) = 'text/' BEGIN
+            INSERT INTO history_fts ( history_fts, rowid, data ) VALUES ( 'delete', OLD.id, OLD.data );
+        END;
+
+        INSERT INTO history_fts ( rowid, data )
+        SELECT id, data FROM history WHERE substr(mime_type, 1, 5) = 'text/';
+
+        PRAGMA user_version = 7;
+    );
+
+    int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        log_print(ERR, "migration: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+static bool migrate_from_5_to_6(struct sqlite3* db) {
+    static const char sql[] = TOSTRING(
+        CREATE INDEX idx_history_mime_type_timestamp ON history ( mime_type, timestamp );
+        CREATE INDEX idx_history_data_size ON history ( data_size );
+
+        PRAGMA user_version = 6;
+    );
+
+    int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        log_print(ERR, "migration: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+static bool migrate_from_4_to_5(struct sqlite3* db) {
+    /* existing entries get sequence numbers in the order they were last copied */
+    static const char sql[] = TOSTRING(
+        ALTER TABLE history ADD COLUMN seq INTEGER NOT NULL DEFAULT 0;
+
+        UPDATE history SET seq = ranked.rank FROM (
+            SELECT id, row_number() OVER ( ORDER BY timestamp, id ) AS rank FROM history
+        ) AS ranked WHERE history.id = ranked.id;
+
+        CREATE INDEX idx_history_seq ON history ( seq );
+
+        CREATE TABLE sequence (
+            id      INTEGER PRIMARY KEY CHECK ( id = 0 ),
+            value   INTEGER NOT NULL,
+            horizon INTEGER NOT NULL
+        );
+
+        CREATE TABLE tombstones (
+            seq      INTEGER PRIMARY KEY,
+            entry_id INTEGER NOT NULL
+        );
+
+        CREATE TRIGGER seq_history_insert AFTER INSERT ON history FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.id;
+        END;
+
+        CREATE TRIGGER seq_history_update AFTER UPDATE OF timestamp ON history FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.id;
+        END;
+
+        CREATE TRIGGER seq_history_delete AFTER DELETE ON history FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            INSERT INTO tombstones ( seq, entry_id ) VALUES ( ( SELECT value FROM sequence ), OLD.id );
+        END;
+
+        CREATE TRIGGER seq_history_tags_insert AFTER INSERT ON history_tags FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = NEW.entry_id;
+        END;
+
+        CREATE TRIGGER seq_history_tags_delete AFTER DELETE ON history_tags FOR EACH ROW BEGIN
+            UPDATE sequence SET value = value + 1;
+            UPDATE history SET seq = ( SELECT value FROM sequence ) WHERE id = OLD.entry_id;
+        END;
+
+        INSERT INTO sequence ( id, value, horizon ) VALUES (
+            0, ( SELECT coalesce(max(seq), 0) FROM history ), 0
+        );
+
+        PRAGMA user_version = 5;
+    );
+
+    int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        log_print(ERR, "migration: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
 static bool migrate_from_3_to_4(struct sqlite3* db) {
     static const char sql[] = TOSTRING(
         CREATE INDEX idx_history_tags_entry_id ON history_tags ( entry_id );
@@ -453,6 +982,10 @@ static const migration_function_t migration_functions[] = {
     [1] = migrate_from_1_to_2,
     [2] = migrate_from_2_to_3,
     [3] = migrate_from_3_to_4,
+    [4] = migrate_from_4_to_5,
+    [5] = migrate_from_5_to_6,
+    [6] = migrate_from_6_to_7,
+    [7] = migrate_from_7_to_8,
 };
 
 bool db_migrate(struct sqlite3 *db, int32_t from, int32_t to) {
@@ -460,8 +993,7 @@ bool db_migrate(struct sqlite3 *db, int32_t from, int32_t to) {
 
     int rc;
 
-    rc = sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
+    if (!db_begin_write(db)) {
         log_print(ERR, "migration: failed to start transaction");
         return false;
     }
@@ -500,3 +1032,149 @@ bool db_prepare_stmt(struct sqlite3* db, const char* sql, struct sqlite3_stmt**
     return true;
 }
 
+uint64_t db_hash_data(const void* data, size_t size) {
+    return XXH3_64bits(data, size);
+}
+
+bool db_insert_entry(struct sqlite3* db, struct sqlite3_stmt* insert_stmt,
+                     struct sqlite3_stmt* fts_stmt, const struct db_entry* e,
+                     int64_t* id, bool* inserted) {
+    bool ret = false;
+
+    /* not changed by upsert that ends up updating existing row */
+    sqlite3_set_last_insert_rowid(db, 0);
+
+    STMT_BIND(insert_stmt, blob, "@data", e->data, e->data_size, SQLITE_STATIC);
+    STMT_BIND(insert_stmt, int64, "@data_hash", (int64_t)e->data_hash);
+    STMT_BIND(insert_stmt, int64, "@data_size", e->data_size);
+    STMT_BIND(insert_stmt, text, "@preview", e->preview, -1, SQLITE_STATIC);
+    STMT_BIND(insert_stmt, text, "@mime_type", e->mime_type, -1, SQLITE_STATIC);
+    STMT_BIND(insert_stmt, int64, "@timestamp", e->timestamp);
+
+    int rc = sqlite3_step(insert_stmt);
+    if (rc == SQLITE_ROW) {
+        *id = sqlite3_column_int64(insert_stmt, 0);
+        *inserted = sqlite3_last_insert_rowid(db) == *id;
+        rc = sqlite3_step(insert_stmt);
+    }
+    sqlite3_reset(insert_stmt);
+    sqlite3_clear_bindings(insert_stmt);
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "failed to insert entry into db: %s", sqlite3_errmsg(db));
+        return false;
+    }
+    log_print(DEBUG, "record inserted successfully with id %li", *id);
+
+    if (!*inserted) {
+        return true;
+    }
+
+    STMT_BIND(fts_stmt, int64, "@id", *id);
+    rc = sqlite3_step(fts_stmt);
+    if (rc != SQLITE_DONE) {
+        log_print(ERR, "failed to add entry to search index: %s", sqlite3_errmsg(db));
+    } else {
+        ret = true;
+    }
+
+    sqlite3_reset(fts_stmt);
+    sqlite3_clear_bindings(fts_stmt);
+    return ret;
+}
+
+bool db_begin_write(struct sqlite3* db) {
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to begin transaction: %s", sqlite3_errmsg(db));
+        return false;
+    }
+
+    return true;
+}
+
+bool db_is_busy_error(int rc) {
+    return (rc & 0xFF) == SQLITE_BUSY || (rc & 0xFF) == SQLITE_LOCKED;
+}
+
+int db_get_page_size(struct sqlite3* db) {
+    struct sqlite3_stmt* stmt = NULL;
+    int page_size = -1;
+
+    if (!db_prepare_stmt(db, "PRAGMA page_size", &stmt)) {
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        page_size = sqlite3_column_int(stmt, 0);
+    } else {
+        log_print(ERR, "failed to get page size: %s", sqlite3_errmsg(db));
+    }
+
+    sqlite3_finalize(stmt);
+    return page_size;
+}
+
+bool db_rebuild(struct sqlite3* db, int page_size) {
+    char sql[64];
+    bool ret = false;
+
+    log_print(INFO, "rebuilding database with page size %d", page_size);
+
+    /* page size can't be changed in WAL mode, even by VACUUM */
+    if (sqlite3_exec(db, "PRAGMA journal_mode = DELETE", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to leave WAL mode (is database used by someone else?): %s",
+                  sqlite3_errmsg(db));
+        return false;
+    }
+
+    snprintf(sql, sizeof(sql), "PRAGMA page_size = %d", page_size);
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to set page size: %s", sqlite3_errmsg(db));
+        goto out;
+    }
+
+    if (sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to set auto_vacuum: %s", sqlite3_errmsg(db));
+        goto out;
+    }
+
+    if (sqlite3_exec(db, "VACUUM", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to rebuild database: %s", sqlite3_errmsg(db));
+        goto out;
+    }
+
+    ret = true;
+
+out:
+    if (sqlite3_exec(db, "PRAGMA journal_mode = WAL", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to switch database back to WAL mode: %s", sqlite3_errmsg(db));
+        ret = false;
+    }
+
+    return ret;
+}
+
+bool db_check_storage_settings(struct sqlite3* db) {
+    const int page_size = db_get_page_size(db);
+    if (page_size < 0) {
+        return false;
+    } else if (profile->page_size > 0 && page_size != profile->page_size) {
+        log_print(INFO, "database page size is %d, profile %s wants %d",
+                  page_size, profile->name, profile->page_size);
+        return false;
+    }
+
+    struct sqlite3_stmt* stmt = NULL;
+    int auto_vacuum = -1;
+    if (!db_prepare_stmt(db, "PRAGMA auto_vacuum", &stmt)) {
+        return false;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        auto_vacuum = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    /* 2 is INCREMENTAL, databases created before it was enabled don't have it */
+    if (auto_vacuum >= 0 && auto_vacuum != 2) {
+        log_print(INFO, "database does not have incremental auto_vacuum enabled");
+    }
+    return auto_vacuum == 2;
+}
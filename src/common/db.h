@@ -20,14 +20,85 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 
 #include <sqlite3.h>
 
-#define DB_USER_SCHEMA_VERSION 4
+#define DB_USER_SCHEMA_VERSION 8
+
+/*
+ * Inserts new entry, or only updates timestamp if entry with the same data is already there.
+ * Returns id of the entry. See db_insert_entry().
+ */
+#define DB_INSERT_SQL \
+    "INSERT INTO history ( data, data_hash, data_size, preview, mime_type, timestamp ) " \
+    "VALUES ( @data, @data_hash, @data_size, @preview, @mime_type, @timestamp ) " \
+    "ON CONFLICT ( data_hash ) DO UPDATE SET timestamp=excluded.timestamp " \
+    "RETURNING id"
+
+/*
+ * Adds entry @id to full text search index if it is text. Must be run after inserting
+ * a new entry; removal is handled by a trigger whose condition matches this one.
+ */
+#define DB_FTS_INSERT_SQL \
+    "INSERT INTO history_fts ( rowid, data ) " \
+    "SELECT id, data FROM history WHERE id = @id AND substr(mime_type, 1, 5) = 'text/'"
+
+/*
+ * Same for every entry whose id is returned by subquery ids. Much faster than running
+ * DB_FTS_INSERT_SQL for each entry, because fts5 flushes its index after every statement.
+ */
+#define DB_FTS_INSERT_MANY_SQL(ids) \
+    "INSERT INTO history_fts ( rowid, data ) " \
+    "SELECT id, data FROM history WHERE id IN ( " ids " ) AND substr(mime_type, 1, 5) = 'text/'"
+
+/*
+ * How long to wait for other connections to release the lock. Waiting is done
+ * with exponential backoff from 1ms up to DB_BUSY_MAX_DELAY_MS, with jitter so
+ * that cclip and cclipd don't keep waking up at the same time.
+ */
+#define DB_BUSY_TIMEOUT_MS 5000
+#define DB_BUSY_MAX_DELAY_MS 100
+
+/* lock contention statistics, summed over all connections of this process */
+struct db_lock_stats {
+    uint64_t waits; /* how many times a connection had to wait for the lock */
+    uint64_t wait_ms; /* total time spent waiting */
+    uint64_t timeouts; /* how many times waiting was given up on */
+};
+
+/*
+ * Storage profile, controls pragmas that are set on every connection.
+ * Page size is stored in the db file itself, so it is only set on a new db or
+ * when the db is rebuilt with db_rebuild(); 0 keeps whatever the file has.
+ */
+struct db_profile {
+    const char* name;
+    int page_size;
+    int64_t mmap_size; /* bytes */
+    int cache_size; /* same as in PRAGMA cache_size, negative is KiB */
+    int synchronous; /* 0 OFF, 1 NORMAL, 2 FULL, 3 EXTRA */
+    int temp_store; /* 0 DEFAULT, 1 FILE, 2 MEMORY */
+    int64_t journal_size_limit; /* bytes, -1 for no limit */
+};
+
+/* NULL-terminated list of available profiles, first one is the default */
+extern const struct db_profile* const db_profiles[];
+
+/* selects profile for all connections opened after this call, false if name is unknown */
+bool db_select_profile(const char* name);
+const struct db_profile* db_get_profile(void);
+
+/* returns path or, if path is NULL, default database path (NULL on failure) */
+const char* db_get_path(const char* path);
 
 /* opens the database at path (or default path is NULL) */
 struct sqlite3* db_open(const char *path, bool create_if_not_exists);
 
+/* opens existing database at path for reading only */
+struct sqlite3* db_open_readonly(const char* path);
+
 /* close the db connection */
 bool db_close(struct sqlite3* db);
 
@@ -61,8 +132,63 @@ bool db_set_secure_delete(struct sqlite3* db, bool enable);
 /* perform migration */
 bool db_migrate(struct sqlite3* db, int32_t from, int32_t to);
 
+/*
+ * Rebuilds the db with a different page size. Needs exclusive access, so fails
+ * if anyone else (for example cclipd) has the db open.
+ */
+bool db_rebuild(struct sqlite3* db, int page_size);
+
+/* returns -1 on error */
+int db_get_page_size(struct sqlite3* db);
+
+/*
+ * Returns false if selected profile wants page size different from what db has,
+ * or if db was created without incremental auto_vacuum (or on error). Either can
+ * only be changed by rebuilding the db, which cclip vacuum does.
+ */
+bool db_check_storage_settings(struct sqlite3* db);
+
+void db_get_lock_stats(struct db_lock_stats* stats);
+
+/*
+ * Makes waiting for the lock on db give up early (with SQLITE_BUSY) once fn returns true.
+ * fn is called from the busy handler, at most every DB_BUSY_MAX_DELAY_MS.
+ * Only one connection in the process can have it set, NULL fn removes it.
+ */
+void db_set_busy_abort(struct sqlite3* db, bool (*fn)(void* data), void* data);
+
 /* some helpers for common sqlite operations */
 
+/*
+ * Starts a write transaction. Unlike plain BEGIN this takes the write lock upfront,
+ * so it is waited for in the busy handler instead of failing halfway through.
+ */
+bool db_begin_write(struct sqlite3* db);
+
+/* true if rc (possibly extended) means that the db was locked by someone else */
+bool db_is_busy_error(int rc);
+
+struct db_entry {
+    const void* data; /* arbitrary data */
+    int64_t data_size; /* size of data in bytes */
+    uint64_t data_hash; /* see db_hash_data() */
+    const char* preview; /* string */
+    const char* mime_type; /* string */
+    time_t timestamp; /* unix seconds */
+};
+
+/* entries with the same hash are considered duplicates */
+uint64_t db_hash_data(const void* data, size_t size);
+
+/*
+ * Runs insert_stmt (prepared from DB_INSERT_SQL) and fts_stmt (from DB_FTS_INSERT_SQL)
+ * if entry is new. *inserted is set to false if entry already existed and only its
+ * timestamp was updated. Must be called inside a write transaction.
+ */
+bool db_insert_entry(struct sqlite3* db, struct sqlite3_stmt* insert_stmt,
+                     struct sqlite3_stmt* fts_stmt, const struct db_entry* e,
+                     int64_t* id, bool* inserted);
+
 /* tries to prepare statement and logs errors */
 bool db_prepare_stmt(struct sqlite3* db, const char* sql, struct sqlite3_stmt** stmt);
 
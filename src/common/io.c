@@ -0,0 +1,66 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+
+#include "io.h"
+
+bool writev_full(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        while (written > 0) {
+            if (iov[0].iov_len <= (size_t)written) {
+                /* entire iov was consumed */
+                written -= iov[0].iov_len;
+                iov += 1;
+                iovcnt -= 1;
+            } else {
+                /* iov was partially consumed */
+                iov[0].iov_base = (char *)iov[0].iov_base + written;
+                iov[0].iov_len -= written;
+                written = 0;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool read_full(int fd, void *buf, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t ret = read(fd, (char *)buf + total, size - total);
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        total += ret;
+    }
+
+    return true;
+}
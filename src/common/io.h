@@ -0,0 +1,32 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <sys/uio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * writev(2) wrapper that ensure all data gets written
+ * NOTE: mutates the iov array
+ */
+bool writev_full(int fd, struct iovec *iov, int iovcnt);
+
+/* read(2) wrapper that reads exactly size bytes, fails on EOF */
+bool read_full(int fd, void *buf, size_t size);
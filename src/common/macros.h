@@ -25,3 +25,15 @@
 #define STREQ(a, b) (strcmp((a), (b)) == 0)
 #define STRNEQ(a, b, len) (strncmp((a), (b), (len)) == 0)
 
+
+#define MIN(a, b) ({ \
+    const __typeof__(a) _a = (a); \
+    const __typeof__(b) _b = (b); \
+    _a < _b ? _a : _b; \
+})
+
+#define MAX(a, b) ({ \
+    const __typeof__(a) _a = (a); \
+    const __typeof__(b) _b = (b); \
+    _a > _b ? _a : _b; \
+})
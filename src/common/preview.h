@@ -20,5 +20,9 @@
 
 #include <stddef.h>
 
-char* generate_preview(const void* data, size_t data_size, const char* mime_type);
+#define PREVIEW_DEFAULT_LEN 128
+
+/* preview_len includes terminating NUL, result must be freed */
+char* generate_preview(const void* data, size_t data_size, const char* mime_type,
+                       size_t preview_len);
 
@@ -0,0 +1,284 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/socket.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "proto.h"
+#include "db.h"
+#include "io.h"
+#include "macros.h"
+#include "log.h"
+
+struct proto_header {
+    uint32_t size;
+    uint8_t type;
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct proto_header) == PROTO_HEADER_SIZE, "bad PROTO_HEADER_SIZE");
+
+void proto_write_header(uint8_t* buf, uint8_t type, size_t size) {
+    const struct proto_header header = {
+        .size = size,
+        .type = type,
+    };
+    memcpy(buf, &header, sizeof(header));
+}
+
+void proto_read_header(const uint8_t* buf, uint8_t* type, size_t* size) {
+    struct proto_header header;
+    memcpy(&header, buf, sizeof(header));
+    *type = header.type;
+    *size = header.size;
+}
+
+void proto_msg_reset(struct proto_msg* msg, uint8_t type) {
+    msg->type = type;
+    msg->pos = 0;
+    VEC_CLEAR(&msg->payload);
+}
+
+void proto_msg_free(struct proto_msg* msg) {
+    VEC_FREE(&msg->payload);
+    msg->pos = 0;
+}
+
+static void put(struct proto_msg* msg, const void* data, size_t size) {
+    memcpy(VEC_EMPLACE_BACK_N(&msg->payload, size), data, size);
+}
+
+void proto_put_u8(struct proto_msg* msg, uint8_t val) {
+    put(msg, &val, sizeof(val));
+}
+
+void proto_put_u32(struct proto_msg* msg, uint32_t val) {
+    put(msg, &val, sizeof(val));
+}
+
+void proto_put_i64(struct proto_msg* msg, int64_t val) {
+    put(msg, &val, sizeof(val));
+}
+
+void proto_put_str(struct proto_msg* msg, const char* str) {
+    /* length 0 means NULL, otherwise length includes null terminator */
+    if (str == NULL) {
+        proto_put_u32(msg, 0);
+    } else {
+        const size_t len = strlen(str) + 1;
+        proto_put_u32(msg, len);
+        put(msg, str, len);
+    }
+}
+
+static bool get(struct proto_msg* msg, void* out, size_t size) {
+    if (msg->payload.size - msg->pos < size) {
+        return false;
+    }
+
+    memcpy(out, &msg->payload.data[msg->pos], size);
+    msg->pos += size;
+
+    return true;
+}
+
+bool proto_get_u8(struct proto_msg* msg, uint8_t* val) {
+    return get(msg, val, sizeof(*val));
+}
+
+bool proto_get_u32(struct proto_msg* msg, uint32_t* val) {
+    return get(msg, val, sizeof(*val));
+}
+
+bool proto_get_i64(struct proto_msg* msg, int64_t* val) {
+    return get(msg, val, sizeof(*val));
+}
+
+bool proto_get_str(struct proto_msg* msg, const char** str) {
+    uint32_t len;
+    if (!proto_get_u32(msg, &len)) {
+        return false;
+    }
+
+    if (len == 0) {
+        *str = NULL;
+        return true;
+    }
+
+    if (msg->payload.size - msg->pos < len) {
+        return false;
+    }
+
+    const char* s = (const char *)&msg->payload.data[msg->pos];
+    if (s[len - 1] != '\0') {
+        return false;
+    }
+
+    *str = s;
+    msg->pos += len;
+
+    return true;
+}
+
+bool proto_send_raw(int fd, uint8_t type, const void* data, size_t size) {
+    struct proto_header header = {
+        .size = size,
+        .type = type,
+    };
+    struct iovec iov[2] = {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = (void *)data, .iov_len = size },
+    };
+
+    return writev_full(fd, iov, size > 0 ? 2 : 1);
+}
+
+bool proto_send(int fd, const struct proto_msg* msg) {
+    return proto_send_raw(fd, msg->type, msg->payload.data, msg->payload.size);
+}
+
+ssize_t proto_send_with_fd(int fd, const void* data, size_t size, int passed_fd) {
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = size };
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr mh = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+
+    return sendmsg(fd, &mh, MSG_NOSIGNAL);
+}
+
+/* reads header with recvmsg to catch a file descriptor sent along with it */
+static bool recv_header(int fd, struct proto_header* header, int* passed_fd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct iovec iov = { .iov_base = header, .iov_len = sizeof(*header) };
+    struct msghdr mh = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    ssize_t ret;
+    do {
+        ret = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+    } while (ret < 0 && errno == EINTR);
+    if (ret <= 0) {
+        return false;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh); cmsg != NULL; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int received;
+            memcpy(&received, CMSG_DATA(cmsg), sizeof(int));
+            if (passed_fd != NULL && *passed_fd < 0) {
+                *passed_fd = received;
+            } else {
+                close(received);
+            }
+        }
+    }
+
+    return read_full(fd, (char *)header + ret, sizeof(*header) - ret);
+}
+
+bool proto_recv_fd(int fd, struct proto_msg* msg, size_t max_size, int* passed_fd) {
+    struct proto_header header;
+
+    if (passed_fd != NULL) {
+        *passed_fd = -1;
+    }
+
+    if (!recv_header(fd, &header, passed_fd)) {
+        goto err;
+    }
+
+    if (header.size > max_size) {
+        log_print(ERR, "message of size %u is too big (max %zu)", header.size, max_size);
+        goto err;
+    }
+
+    proto_msg_reset(msg, header.type);
+    VEC_RESERVE(&msg->payload, header.size);
+    if (!read_full(fd, msg->payload.data, header.size)) {
+        goto err;
+    }
+    msg->payload.size = header.size;
+
+    return true;
+
+err:
+    if (passed_fd != NULL && *passed_fd >= 0) {
+        close(*passed_fd);
+        *passed_fd = -1;
+    }
+    return false;
+}
+
+bool proto_recv(int fd, struct proto_msg* msg, size_t max_size) {
+    return proto_recv_fd(fd, msg, max_size, NULL);
+}
+
+const char* proto_socket_path(const char* db_path) {
+    static char path[PATH_MAX];
+
+    const char* xdg_runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (xdg_runtime_dir == NULL) {
+        return NULL;
+    }
+
+    /* full db path might not fit into sun_path */
+    const uint64_t hash = db_hash_data(db_path, strlen(db_path));
+    snprintf(path, sizeof(path), "%s/cclipd-%016lx.sock", xdg_runtime_dir, hash);
+    return path;
+}
+
+const char* proto_change_name(enum proto_change_type type) {
+    static const char* const names[] = {
+        [PROTO_CHANGE_INSERT] = "insert",
+        [PROTO_CHANGE_BUMP] = "bump",
+        [PROTO_CHANGE_DELETE] = "delete",
+        [PROTO_CHANGE_TAG] = "tag",
+    };
+
+    if (type >= PROTO_CHANGE_TYPE_COUNT) {
+        return "unknown";
+    }
+    return names[type];
+}
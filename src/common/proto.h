@@ -0,0 +1,134 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "collections/vec.h"
+
+/*
+ * Protocol spoken between cclip and cclipd over a unix socket.
+ *
+ * Every message is a frame consisting of a header (u32 payload length,
+ * u8 message type) followed by payload. All integers are in host byte order.
+ * Client sends PROTO_HELLO first and waits for PROTO_OK, after that it can
+ * send any number of requests. Server replies to each request with zero or more
+ * PROTO_DATA frames that contain output bytes, followed by either
+ * PROTO_END (success) or PROTO_ERROR (failure, payload is an error message).
+ *
+ * Exceptions are PROTO_WATCH, which is answered with an endless stream of
+ * PROTO_DATA frames, one line per change, and PROTO_NOTIFY, which is not answered at all.
+ *
+ * PROTO_SUSPEND makes server stop writing to the database (new entries are kept in memory)
+ * until the same client sends PROTO_RESUME or disconnects. It is answered once server
+ * has finished whatever write it was doing.
+ */
+
+/* bump whenever format of any message changes, including encoded queries */
+#define PROTO_VERSION 2
+
+/* requests bigger than this are rejected */
+#define PROTO_MAX_REQUEST_SIZE ((size_t)64 * 1024)
+/* max size of a single PROTO_DATA frame sent by server */
+#define PROTO_MAX_DATA_SIZE ((size_t)64 * 1024)
+
+enum proto_msg_type {
+    /* client -> server */
+    PROTO_HELLO = 1, /* u32 version, str db_path */
+    PROTO_LIST = 2, /* encoded list_query */
+    PROTO_GET = 3, /* encoded get_query */
+    PROTO_WATCH = 4, /* encoded get_query, id is ignored */
+    PROTO_NOTIFY = 5, /* u8 change type, i64 entry id */
+    PROTO_SEARCH = 6, /* encoded search_query */
+    PROTO_SUSPEND = 7, /* no payload */
+    PROTO_RESUME = 8, /* no payload */
+    PROTO_BACKUP = 9, /* no payload, answered with path of the backup once it is done */
+
+    /* server -> client */
+    PROTO_OK = 64,
+    PROTO_DATA = 65, /* raw bytes */
+    PROTO_END = 66,
+    PROTO_ERROR = 67, /* str message */
+    PROTO_SNAPSHOT = 68, /* no payload, list snapshot fd attached, see snapshot.h */
+};
+
+enum proto_change_type {
+    PROTO_CHANGE_INSERT = 0, /* new entry */
+    PROTO_CHANGE_BUMP = 1, /* duplicate copied again, timestamp updated */
+    PROTO_CHANGE_DELETE = 2,
+    PROTO_CHANGE_TAG = 3, /* tag added or removed */
+
+    PROTO_CHANGE_TYPE_COUNT
+};
+
+/* name as printed by cclip watch */
+const char* proto_change_name(enum proto_change_type type);
+
+struct proto_msg {
+    uint8_t type;
+    VEC(uint8_t) payload;
+    size_t pos; /* read position in payload */
+};
+
+void proto_msg_reset(struct proto_msg* msg, uint8_t type);
+void proto_msg_free(struct proto_msg* msg);
+
+void proto_put_u8(struct proto_msg* msg, uint8_t val);
+void proto_put_u32(struct proto_msg* msg, uint32_t val);
+void proto_put_i64(struct proto_msg* msg, int64_t val);
+/* str can be NULL */
+void proto_put_str(struct proto_msg* msg, const char* str);
+
+/* getters return false if there is not enough data left in payload */
+bool proto_get_u8(struct proto_msg* msg, uint8_t* val);
+bool proto_get_u32(struct proto_msg* msg, uint32_t* val);
+bool proto_get_i64(struct proto_msg* msg, int64_t* val);
+/* returned string points into payload and is valid until msg is modified */
+bool proto_get_str(struct proto_msg* msg, const char** str);
+
+/* size of frame header: u32 payload length, u8 message type */
+#define PROTO_HEADER_SIZE 5
+
+/* for those who buffer frames themselves, buf must be PROTO_HEADER_SIZE bytes long */
+void proto_write_header(uint8_t* buf, uint8_t type, size_t size);
+void proto_read_header(const uint8_t* buf, uint8_t* type, size_t* size);
+
+bool proto_send(int fd, const struct proto_msg* msg);
+/* send a frame without building proto_msg first */
+bool proto_send_raw(int fd, uint8_t type, const void* data, size_t size);
+bool proto_recv(int fd, struct proto_msg* msg, size_t max_size);
+
+/*
+ * Single sendmsg(2) of up to size bytes with passed_fd attached (SCM_RIGHTS).
+ * Returns number of bytes sent or -1 with errno set, like send(2).
+ * Receiver gets the fd along with the first byte of data.
+ */
+ssize_t proto_send_with_fd(int fd, const void* data, size_t size, int passed_fd);
+/* same as proto_recv, *passed_fd is set to -1 if message did not carry a file descriptor */
+bool proto_recv_fd(int fd, struct proto_msg* msg, size_t max_size, int* passed_fd);
+
+/*
+ * Returns path of socket of cclipd that uses database at db_path (which must be
+ * already resolved with realpath), or NULL if XDG_RUNTIME_DIR is not set.
+ * Socket name is derived from db_path, so several cclipd can run side by side.
+ */
+const char* proto_socket_path(const char* db_path);
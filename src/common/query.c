@@ -0,0 +1,838 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "query.h"
+#include "io.h"
+#include "db.h"
+#include "macros.h"
+#include "log.h"
+
+int build_field_list(char* raw_list, enum select_fields out_fields[SELECT_FIELDS_COUNT]) {
+    #define FOR_LIST_OF_FIELDS(DO) \
+        DO(ID, "id", "rowid") \
+        DO(PREVIEW, "preview") \
+        DO(MIME_TYPE, "mime_type", "mime", "type") \
+        DO(DATA_SIZE, "data_size", "size") \
+        DO(TIMESTAMP, "timestamp", "time") \
+        DO(TAGS, "tags", "tag") \
+        DO(SEQ, "seq")
+
+    #define DEFINE_NAME_ARRAY(name, ...) \
+        static const char* name##_names[] = { __VA_ARGS__ };
+    FOR_LIST_OF_FIELDS(DEFINE_NAME_ARRAY)
+
+    static const struct {
+        const char** names;
+        unsigned names_count;
+    } fields[] = {
+        #define DEFINE_STRUCT_MEMBER(n, ...) \
+            [FIELD_##n] = { .names = n##_names, .names_count = SIZEOF_ARRAY(n##_names) },
+        FOR_LIST_OF_FIELDS(DEFINE_STRUCT_MEMBER)
+    };
+
+    bool seen_fields[SELECT_FIELDS_COUNT];
+    memset(&seen_fields, 0, sizeof(seen_fields));
+
+    int out_fields_count = 0;
+
+    char* token = strtok(raw_list, ",");
+    while (token != NULL) {
+        bool token_valid = false;
+        for (unsigned f = 0; f < SIZEOF_ARRAY(fields); f++) {
+            for (unsigned j = 0; j < fields[f].names_count; j++) {
+                if (STREQ(token, fields[f].names[j])) {
+                    if (seen_fields[f]) {
+                        log_print(ERR, "field %s encountered more than once", token);
+                        return 0;
+                    }
+
+                    seen_fields[f] = true;
+                    out_fields[out_fields_count++] = f;
+                    token_valid = true;
+                    goto loop_out;
+                }
+            }
+        }
+    loop_out:
+
+        if (!token_valid) {
+            log_print(ERR, "invalid field: %s", token);
+            return 0;
+        }
+
+        token = strtok(NULL, ",");
+    }
+
+    return out_fields_count;
+}
+
+static bool append_fields(struct string* sql, const enum select_fields* fields, int nfields) {
+    for (int i = 0; i < nfields; i++) {
+        switch (fields[i]) {
+        case FIELD_ID:
+            string_append(sql, " h.id,");
+            break;
+        case FIELD_PREVIEW:
+            string_append(sql, " h.preview,");
+            break;
+        case FIELD_MIME_TYPE:
+            string_append(sql, " h.mime_type,");
+            break;
+        case FIELD_DATA_SIZE:
+            string_append(sql, " h.data_size,");
+            break;
+        case FIELD_TIMESTAMP:
+            string_append(sql, " h.timestamp,");
+            break;
+        case FIELD_TAGS: {
+            static const char tags[] = TOSTRING(
+                (
+                    SELECT group_concat(t.name, ',')
+                    FROM history_tags AS ht
+                    INNER JOIN tags AS t ON ht.tag_id = t.id
+                    WHERE ht.entry_id = h.id
+                ) AS tags,
+            );
+            string_append(sql, " ");
+            string_appendn(sql, tags, strlen(tags));
+            break;
+        }
+        case FIELD_SEQ:
+            string_append(sql, " h.seq,");
+            break;
+        default:
+            log_print(ERR, "invalid field enum value: %d (BUG)", fields[i]);
+            return false;
+        }
+    }
+    sql->str[sql->len - 1] = ' ';
+
+    return true;
+}
+
+static void tag_matches(const struct list_query* q, bool has[TAG_MATCH_COUNT]) {
+    memset(has, 0, sizeof(bool) * TAG_MATCH_COUNT);
+    for (int i = 0; i < q->ntags; i++) {
+        has[q->tags[i].match] = true;
+    }
+}
+
+/* how tag filters are evaluated, see append_filters() */
+struct tag_plan {
+    enum {
+        TAG_PLAN_PROBE, /* check every entry with primary key lookups */
+        TAG_PLAN_DRIVE_ALL, /* start from entries that have tag at index driver */
+        TAG_PLAN_DRIVE_ANY, /* start from entries that have any of TAG_MATCH_ANY tags */
+    } type;
+    int driver;
+};
+
+/* appends SELECT of ids of entries which have tag at index i, or any of tags with match m if i < 0 */
+static void append_tagged_ids(struct string* sql, const struct list_query* q,
+                              enum tag_match m, int i) {
+    if (i >= 0) {
+        string_appendf(sql, "SELECT ht.entry_id FROM history_tags AS ht WHERE ht.tag_id = "
+                            "(SELECT t.id FROM tags AS t WHERE t.name = @tag_%d)", i);
+        return;
+    }
+
+    bool first = true;
+    string_append(sql, "SELECT ht.entry_id FROM history_tags AS ht WHERE ht.tag_id IN "
+                       "(SELECT t.id FROM tags AS t WHERE t.name IN (");
+    for (int j = 0; j < q->ntags; j++) {
+        if (q->tags[j].match == m) {
+            string_appendf(sql, "%s@tag_%d", first ? "" : ", ", j);
+            first = false;
+        }
+    }
+    string_append(sql, "))");
+}
+
+/*
+ * Appends WHERE clause for all filters in q, except for the after_id cursor.
+ *
+ * Tag names are resolved to ids with the UNIQUE index on tags, and matching entries
+ * are found with history_tags primary key (tag_id, entry_id). Depending on plan,
+ * either ids of entries that have the rarest tag are collected first and only those
+ * history rows are read, or history is walked newest first and each row is checked
+ * with primary key lookups, which is faster with LIMIT when tags are common.
+ */
+static void append_filters(const struct list_query* q, const struct tag_plan* plan,
+                           struct string* sql) {
+    bool has_where = false;
+    #define AND() string_append(sql, has_where ? " AND " : " WHERE "); has_where = true
+
+    bool has_tag_match[TAG_MATCH_COUNT];
+    tag_matches(q, has_tag_match);
+
+    if (plan->type != TAG_PLAN_PROBE) {
+        AND();
+        string_append(sql, " h.id IN (");
+        if (plan->type == TAG_PLAN_DRIVE_ALL) {
+            append_tagged_ids(sql, q, TAG_MATCH_ALL, plan->driver);
+        } else {
+            append_tagged_ids(sql, q, TAG_MATCH_ANY, -1);
+        }
+        string_append(sql, ") ");
+    }
+
+    for (int i = 0; i < q->ntags; i++) {
+        if (q->tags[i].match != TAG_MATCH_ALL
+            || (plan->type == TAG_PLAN_DRIVE_ALL && plan->driver == i)) {
+            continue;
+        }
+        AND();
+        string_append(sql, " EXISTS (");
+        append_tagged_ids(sql, q, TAG_MATCH_ALL, i);
+        string_append(sql, " AND ht.entry_id = h.id) ");
+    }
+
+    for (enum tag_match m = TAG_MATCH_ANY; m <= TAG_MATCH_NONE; m++) {
+        if (!has_tag_match[m] || (m == TAG_MATCH_ANY && plan->type == TAG_PLAN_DRIVE_ANY)) {
+            continue;
+        }
+        AND();
+        string_append(sql, (m == TAG_MATCH_ANY) ? " EXISTS (" : " NOT EXISTS (");
+        append_tagged_ids(sql, q, m, -1);
+        string_append(sql, " AND ht.entry_id = h.id) ");
+    }
+
+    if (q->only_tagged && !has_tag_match[TAG_MATCH_ALL] && !has_tag_match[TAG_MATCH_ANY]) {
+        static const char tagged_filter[] = TOSTRING(
+            EXISTS (SELECT 1 FROM history_tags AS ht WHERE ht.entry_id = h.id)
+        );
+        AND();
+        string_appendn(sql, tagged_filter, strlen(tagged_filter));
+    }
+
+    /*
+     * Without index statistics sqlite has to guess how many rows each filter matches.
+     * Most entries are text and big entries are rare, so tell it that: this makes it walk
+     * idx_history_timestamp for --text-only and idx_history_data_size for --min-size.
+     */
+    if (q->mime_type != NULL) {
+        AND();
+        string_append(sql, " h.mime_type GLOB @mime_type ");
+    }
+    if (q->text_only) {
+        AND();
+        string_append(sql, " likely(h.mime_type GLOB 'text/*') ");
+    }
+    if (q->from >= 0) {
+        AND();
+        string_append(sql, " h.timestamp >= @from ");
+    }
+    if (q->until >= 0) {
+        AND();
+        string_append(sql, " h.timestamp <= @until ");
+    }
+    if (q->min_size >= 0) {
+        AND();
+        string_append(sql, " unlikely(h.data_size >= @min_size) ");
+    }
+    if (q->max_size >= 0) {
+        AND();
+        string_append(sql, " h.data_size <= @max_size ");
+    }
+
+    if (q->since >= 0) {
+        AND();
+        string_append(sql, " h.seq > @since ");
+    }
+
+    /*
+     * Cursors compare (timestamp, id) pairs so that entries with equal timestamps
+     * are neither skipped nor repeated, this matches ORDER BY and idx_history_timestamp.
+     */
+    if (q->before_id >= 0) {
+        AND();
+        string_append(sql, " (h.timestamp, h.id) < "
+                           "(SELECT timestamp, id FROM history WHERE id = @before_id) ");
+    }
+    if (q->after_id >= 0) {
+        AND();
+        string_append(sql, " (h.timestamp, h.id) > "
+                           "(SELECT timestamp, id FROM history WHERE id = @after_id) ");
+    }
+
+    #undef AND
+}
+
+static void append_limit(const struct list_query* q, struct string* sql) {
+    if (q->limit >= 0) {
+        string_append(sql, " LIMIT @limit ");
+    } else if (q->offset > 0) {
+        string_append(sql, " LIMIT -1 ");
+    }
+    if (q->offset > 0) {
+        string_append(sql, " OFFSET @offset ");
+    }
+}
+
+static bool build_list_sql(const struct list_query* q, const struct tag_plan* plan,
+                           struct string* sql) {
+    /*
+     * Tags are selected with a correlated subquery and tag filters are subqueries too,
+     * so there are no joins that could produce duplicate rows and no DISTINCT or GROUP BY
+     * is needed. This lets LIMIT stop the scan of idx_history_timestamp early.
+     */
+    string_append(sql, "SELECT");
+
+    if (!append_fields(sql, q->fields, q->nfields)) {
+        return false;
+    }
+
+    string_append(sql, " FROM history AS h ");
+
+    if (q->after_id >= 0 && (q->limit >= 0 || q->offset > 0)) {
+        /* limit must apply to entries closest to the cursor, which come last in usual order */
+        string_append(sql, " WHERE h.id IN (SELECT h.id FROM history AS h ");
+        append_filters(q, plan, sql);
+        string_append(sql, " ORDER BY h.timestamp ASC, h.id ASC ");
+        append_limit(q, sql);
+        string_append(sql, ") ORDER BY h.timestamp DESC, h.id DESC");
+    } else {
+        append_filters(q, plan, sql);
+        string_append(sql, " ORDER BY h.timestamp DESC, h.id DESC ");
+        append_limit(q, sql);
+    }
+
+    return true;
+}
+
+bool list_query_is_default(const struct list_query* q) {
+    static const enum select_fields default_fields[] = {
+        FIELD_ID, FIELD_MIME_TYPE, FIELD_PREVIEW,
+    };
+
+    if (q->only_tagged || q->ntags > 0 || q->since >= 0) {
+        return false;
+    }
+    if (q->limit >= 0 || q->offset > 0 || q->before_id >= 0 || q->after_id >= 0) {
+        return false;
+    }
+    if (q->mime_type != NULL || q->text_only || q->from >= 0 || q->until >= 0
+        || q->min_size >= 0 || q->max_size >= 0) {
+        return false;
+    }
+    if ((size_t)q->nfields != SIZEOF_ARRAY(default_fields)) {
+        return false;
+    }
+    return memcmp(q->fields, default_fields, sizeof(default_fields)) == 0;
+}
+
+static void bind_list_params(const struct list_query* q, struct sqlite3_stmt* stmt) {
+    for (int i = 0; i < q->ntags; i++) {
+        char param[16];
+        snprintf(param, sizeof(param), "@tag_%d", i);
+        STMT_BIND(stmt, text, param, q->tags[i].name, -1, SQLITE_STATIC);
+    }
+    if (q->mime_type != NULL) {
+        STMT_BIND(stmt, text, "@mime_type", q->mime_type, -1, SQLITE_STATIC);
+    }
+    if (q->from >= 0) {
+        STMT_BIND(stmt, int64, "@from", q->from);
+    }
+    if (q->until >= 0) {
+        STMT_BIND(stmt, int64, "@until", q->until);
+    }
+    if (q->min_size >= 0) {
+        STMT_BIND(stmt, int64, "@min_size", q->min_size);
+    }
+    if (q->max_size >= 0) {
+        STMT_BIND(stmt, int64, "@max_size", q->max_size);
+    }
+    if (q->since >= 0) {
+        STMT_BIND(stmt, int64, "@since", q->since);
+    }
+    if (q->before_id >= 0) {
+        STMT_BIND(stmt, int64, "@before_id", q->before_id);
+    }
+    if (q->after_id >= 0) {
+        STMT_BIND(stmt, int64, "@after_id", q->after_id);
+    }
+    if (q->limit >= 0) {
+        STMT_BIND(stmt, int64, "@limit", q->limit);
+    }
+    if (q->offset > 0) {
+        STMT_BIND(stmt, int64, "@offset", q->offset);
+    }
+}
+
+static struct sqlite3_stmt* direct_prepare(struct query_runner* r, const char* sql) {
+    struct sqlite3_stmt* stmt = NULL;
+    db_prepare_stmt(r->db, sql, &stmt);
+    return stmt;
+}
+
+static void direct_release(struct query_runner* r, struct sqlite3_stmt* stmt) {
+    sqlite3_finalize(stmt);
+}
+
+static bool direct_write(struct query_runner* r, const struct iovec* iov, int iovcnt) {
+    /* writev_full mutates iov */
+    struct iovec copy[1 + SELECT_FIELDS_COUNT * 2];
+    if (iovcnt > (int)SIZEOF_ARRAY(copy)) {
+        snprintf(r->error, sizeof(r->error), "too many iovecs: %d (BUG)", iovcnt);
+        return false;
+    }
+    memcpy(copy, iov, sizeof(*iov) * iovcnt);
+
+    if (!writev_full(r->fd, copy, iovcnt)) {
+        snprintf(r->error, sizeof(r->error), "failed to write output: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void query_runner_init(struct query_runner* r, struct sqlite3* db, int fd) {
+    *r = (struct query_runner){
+        .db = db,
+        .fd = fd,
+        .prepare = direct_prepare,
+        .release = direct_release,
+        .write = direct_write,
+    };
+}
+
+static bool run_error(struct query_runner* r, const char* what) {
+    snprintf(r->error, sizeof(r->error), "%s: %s", what, sqlite3_errmsg(r->db));
+    return false;
+}
+
+static bool write_str(struct query_runner* r, const char* str) {
+    struct iovec iov = { .iov_base = (void*)str, .iov_len = strlen(str) };
+    return r->write(r, &iov, 1);
+}
+
+/* writes deleted entries and returns since value to use for listing, -1 on reset */
+static bool list_changes_header(struct query_runner* r, int64_t since, int64_t* list_since) {
+    char line[64];
+
+    struct sqlite3_stmt* stmt = r->prepare(r, "SELECT value, horizon FROM sequence");
+    if (stmt == NULL) {
+        return run_error(r, "failed to prepare statement");
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        r->release(r, stmt);
+        return run_error(r, "failed to get change sequence");
+    }
+    const int64_t value = sqlite3_column_int64(stmt, 0);
+    const int64_t horizon = sqlite3_column_int64(stmt, 1);
+    r->release(r, stmt);
+
+    snprintf(line, sizeof(line), "seq\t%li\n", value);
+    if (!write_str(r, line)) {
+        return false;
+    }
+
+    if (since < horizon) {
+        /* some tombstones we need were already pruned, start over */
+        *list_since = -1;
+        return write_str(r, "reset\n");
+    }
+    *list_since = since;
+
+    stmt = r->prepare(r, "SELECT entry_id FROM tombstones WHERE seq > @since ORDER BY seq");
+    if (stmt == NULL) {
+        return run_error(r, "failed to prepare statement");
+    }
+    STMT_BIND(stmt, int64, "@since", since);
+
+    int rc;
+    bool ok = true;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        snprintf(line, sizeof(line), "-\t%li\n", (int64_t)sqlite3_column_int64(stmt, 0));
+        ok = write_str(r, line);
+    }
+    if (ok && rc != SQLITE_DONE) {
+        ok = run_error(r, "failed to list deleted entries");
+    }
+    r->release(r, stmt);
+
+    return ok;
+}
+
+static bool count_tagged(const struct list_query* q, struct query_runner* r,
+                         enum tag_match m, int i, int64_t* count) {
+    struct string sql = {0};
+    string_append(&sql, "SELECT count(*) FROM (");
+    append_tagged_ids(&sql, q, m, i);
+    string_append(&sql, ")");
+
+    struct sqlite3_stmt* stmt = r->prepare(r, sql.str);
+    string_free(&sql);
+    if (stmt == NULL) {
+        return run_error(r, "failed to prepare statement");
+    }
+    bind_list_params(q, stmt);
+
+    const bool ok = sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok) {
+        *count = sqlite3_column_int64(stmt, 0);
+    }
+    r->release(r, stmt);
+
+    return ok ? true : run_error(r, "failed to count tagged entries");
+}
+
+/*
+ * Decides how to evaluate tag filters, see append_filters(). Counting entries per tag
+ * is cheap since only history_tags primary key is used. Starting from the rarest tag
+ * visits that many entries, while walking history newest first visits about
+ * limit * total / matches entries; pick whichever is smaller.
+ */
+static bool plan_tags(const struct list_query* q, struct query_runner* r, struct tag_plan* plan) {
+    bool has_tag_match[TAG_MATCH_COUNT];
+    tag_matches(q, has_tag_match);
+
+    *plan = (struct tag_plan){ .type = TAG_PLAN_PROBE, .driver = -1 };
+    if (!has_tag_match[TAG_MATCH_ALL] && !has_tag_match[TAG_MATCH_ANY]) {
+        /* nothing to start from, excluding tags usually leaves most entries */
+        return true;
+    }
+
+    int64_t matches = INT64_MAX;
+    if (has_tag_match[TAG_MATCH_ALL]) {
+        for (int i = 0; i < q->ntags; i++) {
+            int64_t count;
+            if (q->tags[i].match != TAG_MATCH_ALL) {
+                continue;
+            } else if (!count_tagged(q, r, TAG_MATCH_ALL, i, &count)) {
+                return false;
+            }
+            if (count < matches) {
+                matches = count;
+                plan->driver = i;
+            }
+        }
+        plan->type = TAG_PLAN_DRIVE_ALL;
+    }
+    if (has_tag_match[TAG_MATCH_ANY]) {
+        int64_t count;
+        if (!count_tagged(q, r, TAG_MATCH_ANY, -1, &count)) {
+            return false;
+        }
+        if (count < matches) {
+            matches = count;
+            plan->type = TAG_PLAN_DRIVE_ANY;
+        }
+    }
+
+    if (q->limit < 0) {
+        return true;
+    }
+
+    struct sqlite3_stmt* stmt = r->prepare(r, "SELECT coalesce(max(id), 0) FROM history");
+    if (stmt == NULL) {
+        return run_error(r, "failed to prepare statement");
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        r->release(r, stmt);
+        return run_error(r, "failed to count entries");
+    }
+    /* estimate, ids are never reused */
+    const double total = sqlite3_column_int64(stmt, 0);
+    r->release(r, stmt);
+
+    if ((double)matches * matches > (double)(q->limit + q->offset) * total) {
+        plan->type = TAG_PLAN_PROBE;
+    }
+    return true;
+}
+
+static bool list_query_run_rows(const struct list_query* q, struct query_runner* r) {
+    struct list_query query = *q;
+    struct string sql = {0};
+    bool ok = true;
+
+    if (q->since >= 0 && !list_changes_header(r, q->since, &query.since)) {
+        return false;
+    }
+
+    struct tag_plan plan;
+    if (!plan_tags(&query, r, &plan)) {
+        return false;
+    }
+
+    if (!build_list_sql(&query, &plan, &sql)) {
+        snprintf(r->error, sizeof(r->error), "failed to build query");
+        string_free(&sql);
+        return false;
+    }
+
+    struct sqlite3_stmt* stmt = r->prepare(r, sql.str);
+    string_free(&sql);
+    if (stmt == NULL) {
+        return run_error(r, "failed to prepare statement");
+    }
+
+    bind_list_params(&query, stmt);
+
+    /* optional prefix + field + tab + field + tab + field + newline */
+    const int ncols = sqlite3_column_count(stmt);
+    struct iovec iov[1 + SELECT_FIELDS_COUNT * 2] = {
+        [0] = { .iov_base = "+\t", .iov_len = 2 },
+    };
+    const int skip = (q->since >= 0) ? 0 : 1;
+
+    int rc;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        query_row_to_iov(stmt, ncols, &iov[1]);
+        ok = r->write(r, &iov[skip], 1 - skip + ncols * 2);
+    }
+    if (ok && rc != SQLITE_DONE) {
+        ok = run_error(r, "failed to list rows");
+    }
+    r->release(r, stmt);
+
+    return ok;
+}
+
+bool list_query_run(const struct list_query* q, struct query_runner* r) {
+    /*
+     * With since, printed seq must match the deletions and rows that follow it,
+     * so read them all from one snapshot unless caller already holds one.
+     */
+    const bool own_transaction = q->since >= 0 && sqlite3_get_autocommit(r->db);
+    if (own_transaction && sqlite3_exec(r->db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+        return run_error(r, "failed to begin transaction");
+    }
+
+    const bool ok = list_query_run_rows(q, r);
+
+    if (own_transaction) {
+        sqlite3_exec(r->db, ok ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL);
+    }
+    return ok;
+}
+
+static void encode_fields(const enum select_fields* fields, int nfields, struct proto_msg* msg) {
+    proto_put_u8(msg, nfields);
+    for (int i = 0; i < nfields; i++) {
+        proto_put_u8(msg, fields[i]);
+    }
+}
+
+static bool decode_fields(enum select_fields* fields, int* nfields, struct proto_msg* msg) {
+    uint8_t n, f;
+    if (!proto_get_u8(msg, &n) || n > SELECT_FIELDS_COUNT) {
+        return false;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!proto_get_u8(msg, &f) || f >= SELECT_FIELDS_COUNT) {
+            return false;
+        }
+        fields[i] = f;
+    }
+    *nfields = n;
+
+    return true;
+}
+
+void list_query_encode(const struct list_query* q, struct proto_msg* msg) {
+    encode_fields(q->fields, q->nfields, msg);
+    proto_put_u8(msg, q->only_tagged);
+    proto_put_u8(msg, q->ntags);
+    for (int i = 0; i < q->ntags; i++) {
+        proto_put_u8(msg, q->tags[i].match);
+        proto_put_str(msg, q->tags[i].name);
+    }
+    proto_put_str(msg, q->mime_type);
+    proto_put_u8(msg, q->text_only);
+    proto_put_i64(msg, q->from);
+    proto_put_i64(msg, q->until);
+    proto_put_i64(msg, q->min_size);
+    proto_put_i64(msg, q->max_size);
+    proto_put_i64(msg, q->since);
+    proto_put_i64(msg, q->limit);
+    proto_put_i64(msg, q->offset);
+    proto_put_i64(msg, q->before_id);
+    proto_put_i64(msg, q->after_id);
+}
+
+static bool decode_tags(struct list_query* q, struct proto_msg* msg) {
+    uint8_t ntags, match;
+    if (!proto_get_u8(msg, &ntags) || ntags > LIST_QUERY_MAX_TAGS) {
+        return false;
+    }
+
+    for (int i = 0; i < ntags; i++) {
+        if (!proto_get_u8(msg, &match) || match >= TAG_MATCH_COUNT
+            || !proto_get_str(msg, &q->tags[i].name) || q->tags[i].name == NULL) {
+            return false;
+        }
+        q->tags[i].match = match;
+    }
+    q->ntags = ntags;
+
+    return true;
+}
+
+bool list_query_decode(struct list_query* q, struct proto_msg* msg) {
+    uint8_t only_tagged, text_only;
+
+    *q = (struct list_query){0};
+    if (!decode_fields(q->fields, &q->nfields, msg)
+        || !proto_get_u8(msg, &only_tagged)
+        || !decode_tags(q, msg)
+        || !proto_get_str(msg, &q->mime_type)
+        || !proto_get_u8(msg, &text_only)
+        || !proto_get_i64(msg, &q->from)
+        || !proto_get_i64(msg, &q->until)
+        || !proto_get_i64(msg, &q->min_size)
+        || !proto_get_i64(msg, &q->max_size)
+        || !proto_get_i64(msg, &q->since)
+        || !proto_get_i64(msg, &q->limit)
+        || !proto_get_i64(msg, &q->offset)
+        || !proto_get_i64(msg, &q->before_id)
+        || !proto_get_i64(msg, &q->after_id)) {
+        return false;
+    }
+    q->only_tagged = only_tagged;
+    q->text_only = text_only;
+
+    return true;
+}
+
+bool search_query_run(const struct search_query* q, struct query_runner* r) {
+    static const char sql[] = TOSTRING(
+        SELECT
+            rowid,
+            replace(replace(
+                snippet(history_fts, 0, '', '', '...', 64),
+            char(9), ' '), char(10), ' ')
+        FROM history_fts
+        WHERE history_fts MATCH @query
+        ORDER BY rank
+        LIMIT @limit
+    );
+
+    struct string query = {0};
+    if (q->raw) {
+        string_append(&query, q->text);
+    } else {
+        if (strlen(q->text) < SEARCH_QUERY_MIN_LENGTH) {
+            snprintf(r->error, sizeof(r->error),
+                     "search query must be at least %d bytes long", SEARCH_QUERY_MIN_LENGTH);
+            return false;
+        }
+
+        /* match as a single phrase, which is a plain substring match with trigram tokenizer */
+        string_append(&query, "\"");
+        for (const char* p = q->text; *p != '\0'; p++) {
+            string_appendn(&query, p, 1);
+            if (*p == '"') {
+                string_appendn(&query, p, 1);
+            }
+        }
+        string_append(&query, "\"");
+    }
+
+    bool ok = true;
+    struct sqlite3_stmt* stmt = r->prepare(r, sql);
+    if (stmt == NULL) {
+        string_free(&query);
+        return run_error(r, "failed to prepare statement");
+    }
+    STMT_BIND(stmt, text, "@query", query.str, query.len, SQLITE_STATIC);
+    STMT_BIND(stmt, int64, "@limit", q->limit);
+
+    struct iovec iov[4];
+    int rc;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        query_row_to_iov(stmt, 2, iov);
+        ok = r->write(r, iov, SIZEOF_ARRAY(iov));
+    }
+    if (ok && rc != SQLITE_DONE) {
+        ok = run_error(r, "search failed");
+    }
+    r->release(r, stmt);
+    string_free(&query);
+
+    return ok;
+}
+
+void search_query_encode(const struct search_query* q, struct proto_msg* msg) {
+    proto_put_str(msg, q->text);
+    proto_put_u8(msg, q->raw);
+    proto_put_i64(msg, q->limit);
+}
+
+bool search_query_decode(struct search_query* q, struct proto_msg* msg) {
+    uint8_t raw;
+
+    *q = (struct search_query){0};
+    if (!proto_get_str(msg, &q->text) || q->text == NULL
+        || !proto_get_u8(msg, &raw)
+        || !proto_get_i64(msg, &q->limit)) {
+        return false;
+    }
+    q->raw = raw;
+
+    return true;
+}
+
+bool get_query_build_sql(const struct get_query* q, struct string* sql) {
+    if (q->nfields == 0) {
+        string_append(sql, "SELECT data FROM history WHERE id = @entry_id");
+        return true;
+    }
+
+    string_append(sql, "SELECT ");
+
+    if (!append_fields(sql, q->fields, q->nfields)) {
+        return false;
+    }
+
+    string_append(sql, " FROM history AS h WHERE h.id = @entry_id");
+
+    return true;
+}
+
+void get_query_bind(const struct get_query* q, struct sqlite3_stmt* stmt) {
+    STMT_BIND(stmt, int64, "@entry_id", q->id);
+}
+
+void get_query_encode(const struct get_query* q, struct proto_msg* msg) {
+    proto_put_i64(msg, q->id);
+    encode_fields(q->fields, q->nfields, msg);
+}
+
+bool get_query_decode(struct get_query* q, struct proto_msg* msg) {
+    *q = (struct get_query){0};
+    return proto_get_i64(msg, &q->id) && decode_fields(q->fields, &q->nfields, msg);
+}
+
+void query_row_to_iov(struct sqlite3_stmt* stmt, int ncols, struct iovec* iov) {
+    for (int i = 0; i < ncols; i++) {
+        iov[i * 2] = (struct iovec){
+            .iov_base = (void *)sqlite3_column_blob(stmt, i),
+            .iov_len = sqlite3_column_bytes(stmt, i),
+        };
+        iov[(i * 2) + 1] = (struct iovec){
+            .iov_base = (i < ncols - 1) ? "\t" : "\n",
+            .iov_len = 1,
+        };
+    }
+}
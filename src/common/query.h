@@ -0,0 +1,172 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <sys/uio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sqlite3.h>
+
+#include "collections/string.h"
+#include "proto.h"
+
+/*
+ * SQL generation for read-only queries, shared between cclip
+ * (which runs them directly) and cclipd (which runs them on behalf of cclip).
+ */
+
+enum select_fields {
+    FIELD_ID = 0,
+    FIELD_PREVIEW = 1,
+    FIELD_MIME_TYPE = 2,
+    FIELD_DATA_SIZE = 3,
+    FIELD_TIMESTAMP = 4,
+    FIELD_TAGS = 5,
+    FIELD_SEQ = 6,
+
+    SELECT_FIELDS_COUNT
+};
+
+/*
+ * Returns number of fields in raw_list, puts converted fields into fields array in order.
+ * NOTE: mutates raw_list.
+ */
+int build_field_list(char* raw_list, enum select_fields fields[SELECT_FIELDS_COUNT]);
+
+/* max number of tags in all tag filters of a single list query */
+#define LIST_QUERY_MAX_TAGS 32
+
+enum tag_match {
+    TAG_MATCH_ALL = 0, /* entry must have every one of these tags */
+    TAG_MATCH_ANY = 1, /* entry must have at least one of these tags */
+    TAG_MATCH_NONE = 2, /* entry must have none of these tags */
+
+    TAG_MATCH_COUNT
+};
+
+struct tag_filter {
+    enum tag_match match;
+    const char* name;
+};
+
+struct list_query {
+    enum select_fields fields[SELECT_FIELDS_COUNT];
+    int nfields;
+
+    bool only_tagged;
+    struct tag_filter tags[LIST_QUERY_MAX_TAGS];
+    int ntags;
+
+    const char* mime_type; /* glob pattern, NULL if unset */
+    bool text_only; /* only text MIME types */
+    /* inclusive ranges, -1 if unset */
+    int64_t from, until; /* unix timestamps */
+    int64_t min_size, max_size;
+
+    /*
+     * If not negative, only entries changed after this change sequence number are listed,
+     * see list_query_run() for output format.
+     */
+    int64_t since;
+
+    /* -1 if unset */
+    int64_t limit;
+    int64_t offset; /* 0 if unset */
+    /*
+     * Keyset cursors: only list entries older (before_id) or newer (after_id) than
+     * the entry with given id, which must exist. With limit and after_id, entries
+     * closest to the cursor are listed. -1 if unset.
+     */
+    int64_t before_id;
+    int64_t after_id;
+};
+
+/* true if q is plain "cclip list" with default fields and no filters, see snapshot.h */
+bool list_query_is_default(const struct list_query* q);
+
+/*
+ * Environment in which queries are run: cclip prepares statements and writes to stdout,
+ * cclipd reuses cached statements and writes to a socket.
+ */
+struct query_runner {
+    struct sqlite3* db;
+    int fd; /* output goes here */
+    struct sqlite3_stmt* (*prepare)(struct query_runner* r, const char* sql);
+    void (*release)(struct query_runner* r, struct sqlite3_stmt* stmt);
+    bool (*write)(struct query_runner* r, const struct iovec* iov, int iovcnt);
+    char error[256]; /* set when run function returns false */
+    void* data; /* for use by callbacks */
+};
+
+/* runner that prepares a new statement for every query and writes to fd directly */
+void query_runner_init(struct query_runner* r, struct sqlite3* db, int fd);
+
+/*
+ * Runs list query and writes its output, one entry per line, fields separated with tabs.
+ * If q->since is not negative, output starts with "seq<TAB>N" line where N is the
+ * current change sequence number. It is followed by either "reset" line, if changes
+ * since q->since are no longer known and all entries are listed, or by "-<TAB>ID" lines
+ * for deleted entries. Then, each entry line is prefixed with "+<TAB>". Filters other than
+ * id cursors must not be set together with q->since, as entries that stop matching
+ * them would not be reported.
+ */
+bool list_query_run(const struct list_query* q, struct query_runner* r);
+
+void list_query_encode(const struct list_query* q, struct proto_msg* msg);
+/* strings in q point into msg payload */
+bool list_query_decode(struct list_query* q, struct proto_msg* msg);
+
+/* minimal length of non-raw search query, shorter strings can't be looked up in trigram index */
+#define SEARCH_QUERY_MIN_LENGTH 3
+
+struct search_query {
+    const char* text; /* substring to look for, or FTS5 query if raw is true */
+    bool raw;
+    int64_t limit; /* -1 if unset */
+};
+
+/*
+ * Searches full text of text entries, writes "ID<TAB>SNIPPET" lines, best matches first.
+ * Tabs and newlines in snippets are replaced with spaces.
+ */
+bool search_query_run(const struct search_query* q, struct query_runner* r);
+
+void search_query_encode(const struct search_query* q, struct proto_msg* msg);
+bool search_query_decode(struct search_query* q, struct proto_msg* msg);
+
+struct get_query {
+    int64_t id;
+
+    /* if nfields is 0, raw entry data is selected */
+    enum select_fields fields[SELECT_FIELDS_COUNT];
+    int nfields;
+};
+
+bool get_query_build_sql(const struct get_query* q, struct string* sql);
+void get_query_bind(const struct get_query* q, struct sqlite3_stmt* stmt);
+
+void get_query_encode(const struct get_query* q, struct proto_msg* msg);
+bool get_query_decode(struct get_query* q, struct proto_msg* msg);
+
+/*
+ * Fills 2 * ncols iovecs with current row of stmt formatted as
+ * field + tab + field + tab + field + newline
+ */
+void query_row_to_iov(struct sqlite3_stmt* stmt, int ncols, struct iovec* iov);
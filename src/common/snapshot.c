@@ -0,0 +1,304 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "snapshot.h"
+#include "collections/vec.h"
+#include "db.h"
+#include "io.h"
+#include "xmalloc.h"
+#include "macros.h"
+#include "log.h"
+
+#define SNAPSHOT_SUFFIX "-list"
+#define SNAPSHOT_WRITE_BUFFER_SIZE (64 * 1024)
+
+struct snapshot_writer {
+    struct query_runner runner; /* must be first */
+    int fd;
+    VEC(uint8_t) buf;
+    uint64_t written;
+};
+
+char* snapshot_path(const char* db_path) {
+    const size_t len = strlen(db_path);
+    char* path = xmalloc(len + sizeof(SNAPSHOT_SUFFIX));
+    memcpy(path, db_path, len);
+    memcpy(path + len, SNAPSHOT_SUFFIX, sizeof(SNAPSHOT_SUFFIX));
+    return path;
+}
+
+static bool flush_buffer(struct snapshot_writer* w) {
+    struct iovec iov = { .iov_base = w->buf.data, .iov_len = VEC_SIZE(&w->buf) };
+    const bool ok = writev_full(w->fd, &iov, 1);
+    w->written += VEC_SIZE(&w->buf);
+    VEC_CLEAR(&w->buf);
+    return ok;
+}
+
+static bool writer_write(struct query_runner* r, const struct iovec* iov, int iovcnt) {
+    struct snapshot_writer* w = (struct snapshot_writer *)r;
+
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(VEC_EMPLACE_BACK_N(&w->buf, iov[i].iov_len), iov[i].iov_base, iov[i].iov_len);
+    }
+
+    if (VEC_SIZE(&w->buf) >= SNAPSHOT_WRITE_BUFFER_SIZE && !flush_buffer(w)) {
+        snprintf(r->error, sizeof(r->error), "failed to write snapshot: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+static bool get_seq(struct query_runner* r, int64_t* seq) {
+    struct sqlite3_stmt* stmt = r->prepare(r, "SELECT value FROM sequence");
+    if (stmt == NULL) {
+        return false;
+    }
+
+    const bool ok = sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok) {
+        *seq = sqlite3_column_int64(stmt, 0);
+    } else {
+        snprintf(r->error, sizeof(r->error), "failed to get change sequence: %s",
+                 sqlite3_errmsg(r->db));
+    }
+    r->release(r, stmt);
+
+    return ok;
+}
+
+static bool get_db_ino(struct sqlite3* db, uint64_t* ino) {
+    struct stat st;
+    const char* db_path = sqlite3_db_filename(db, "main");
+    if (db_path == NULL || db_path[0] == '\0' || stat(db_path, &st) < 0) {
+        return false;
+    }
+
+    *ino = st.st_ino;
+    return true;
+}
+
+int snapshot_build(struct query_runner* r, const char* path, int64_t* seq) {
+    char default_fields[] = "rowid,mime_type,preview";
+    struct list_query q = {
+        .from = -1,
+        .until = -1,
+        .min_size = -1,
+        .max_size = -1,
+        .since = -1,
+        .limit = -1,
+        .before_id = -1,
+        .after_id = -1,
+    };
+    q.nfields = build_field_list(default_fields, q.fields);
+
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+        log_print(ERR, "snapshot path is too long");
+        return -1;
+    }
+
+    struct snapshot_writer w = { .runner = *r, .fd = -1 };
+    w.runner.write = writer_write;
+    bool in_transaction = false;
+    int fd = -1;
+
+    struct snapshot_header header = {
+        .magic = SNAPSHOT_MAGIC,
+    };
+    if (!get_db_ino(r->db, &header.db_ino)) {
+        log_print(ERR, "failed to stat database file: %s", strerror(errno));
+        goto err;
+    }
+
+    w.fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (w.fd < 0) {
+        log_print(ERR, "failed to open %s: %s", tmp_path, strerror(errno));
+        goto err;
+    }
+
+    /* sequence number and list must come from the same read transaction */
+    if (sqlite3_exec(r->db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+        log_print(ERR, "failed to begin transaction: %s", sqlite3_errmsg(r->db));
+        goto err;
+    }
+    in_transaction = true;
+
+    if (!get_seq(&w.runner, &header.seq)) {
+        log_print(ERR, "%s", w.runner.error);
+        goto err;
+    }
+
+    memcpy(VEC_EMPLACE_BACK_N(&w.buf, sizeof(header)), &header, sizeof(header));
+    if (!list_query_run(&q, &w.runner)) {
+        log_print(ERR, "%s", w.runner.error);
+        goto err;
+    }
+
+    sqlite3_exec(r->db, "COMMIT", NULL, NULL, NULL);
+    in_transaction = false;
+
+    if (!flush_buffer(&w)) {
+        log_print(ERR, "failed to write snapshot: %s", strerror(errno));
+        goto err;
+    }
+    header.size = w.written - sizeof(header);
+    if (pwrite(w.fd, &header, sizeof(header), 0) != sizeof(header)) {
+        log_print(ERR, "failed to write snapshot: %s", strerror(errno));
+        goto err;
+    }
+    close(w.fd);
+    w.fd = -1;
+
+    if (rename(tmp_path, path) < 0) {
+        log_print(ERR, "failed to rename %s to %s: %s", tmp_path, path, strerror(errno));
+        goto err;
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_print(ERR, "failed to open %s: %s", path, strerror(errno));
+        goto err;
+    }
+
+    VEC_FREE(&w.buf);
+    *seq = header.seq;
+    return fd;
+
+err:
+    if (in_transaction) {
+        sqlite3_exec(r->db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    if (w.fd >= 0) {
+        close(w.fd);
+        unlink(tmp_path);
+    }
+    VEC_FREE(&w.buf);
+    return -1;
+}
+
+bool snapshot_is_current(int fd, struct query_runner* r) {
+    struct snapshot_header header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        return false;
+    }
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size != sizeof(header) + header.size) {
+        return false;
+    }
+
+    uint64_t db_ino;
+    if (!get_db_ino(r->db, &db_ino) || db_ino != header.db_ino) {
+        return false;
+    }
+
+    int64_t seq;
+    if (!get_seq(r, &seq)) {
+        log_print(DEBUG, "%s", r->error);
+        return false;
+    }
+
+    return seq == header.seq;
+}
+
+int snapshot_open(struct query_runner* r) {
+    const char* db_path = sqlite3_db_filename(r->db, "main");
+    if (db_path == NULL || db_path[0] == '\0') {
+        return -1;
+    }
+
+    char* path = snapshot_path(db_path);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        goto out;
+    }
+
+    if (!snapshot_is_current(fd, r)) {
+        log_print(DEBUG, "snapshot %s is stale", path);
+        close(fd);
+        fd = -1;
+    }
+
+out:
+    free(path);
+    return fd;
+}
+
+/* for when sendfile doesn't work with given out_fd */
+static bool copy_fallback(int fd, int out_fd, off_t offset, off_t end) {
+    char buf[SNAPSHOT_WRITE_BUFFER_SIZE];
+
+    while (offset < end) {
+        ssize_t n = pread(fd, buf, MIN((off_t)sizeof(buf), end - offset), offset);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        struct iovec iov = { .iov_base = buf, .iov_len = n };
+        if (!writev_full(out_fd, &iov, 1)) {
+            return false;
+        }
+        offset += n;
+    }
+
+    return true;
+}
+
+bool snapshot_send(int fd, int out_fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return false;
+    }
+
+    off_t offset = sizeof(struct snapshot_header);
+    while (offset < st.st_size) {
+        ssize_t sent = sendfile(out_fd, fd, &offset, st.st_size - offset);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EINVAL || errno == ENOSYS) {
+                return copy_fallback(fd, out_fd, offset, st.st_size);
+            }
+            return false;
+        } else if (sent == 0) {
+            /* file was truncated under us */
+            return false;
+        }
+    }
+
+    return true;
+}
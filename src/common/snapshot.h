@@ -0,0 +1,61 @@
+/*
+ * This file is part of cclip, clipboard manager for wayland
+ * Copyright (C) 2026  heather7283
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "query.h"
+
+/*
+ * Preformatted output of plain "cclip list" (default fields, no filters), kept by cclipd
+ * in a file next to the database so it can be copied to stdout without running any queries.
+ *
+ * File starts with struct snapshot_header, followed by list output as is.
+ * Snapshot is only valid while change sequence number in the database
+ * matches the one in the header; stale snapshots are never served.
+ */
+
+#define SNAPSHOT_MAGIC "CCLIPLS1"
+
+struct snapshot_header {
+    char magic[8];
+    int64_t seq; /* change sequence number snapshot was taken at */
+    uint64_t db_ino; /* inode of the database file, in case it was replaced */
+    uint64_t size; /* of list output following the header, catches truncated files */
+};
+
+/* returns path to snapshot file of the database at db_path, free() it */
+char* snapshot_path(const char* db_path);
+
+/*
+ * Writes new snapshot of r->db to path, replacing the old one atomically.
+ * r->fd and r->write are ignored.
+ * Returns read-only fd of the new snapshot or -1 on failure, *seq is set to its sequence number.
+ */
+int snapshot_build(struct query_runner* r, const char* path, int64_t* seq);
+
+/* checks that snapshot opened as fd is up to date with r->db */
+bool snapshot_is_current(int fd, struct query_runner* r);
+
+/* opens snapshot of r->db if it exists and is up to date, returns -1 otherwise */
+int snapshot_open(struct query_runner* r);
+
+/* copies list output from snapshot opened as fd to out_fd, does not change file offset */
+bool snapshot_send(int fd, int out_fd);
@@ -0,0 +1,51 @@
+#!/bin/sh
+
+# Regression test for the literal prefilter of cclip grep: patterns with
+# bracket expressions must match the same entries as plain regcomp does.
+#
+# usage: grep-brackets.sh [path to cclip] [path to cclipd]
+
+cclip="${1:-cclip}"
+cclipd="${2:-cclipd}"
+
+dir="$(mktemp -d)" || exit 1
+trap 'rm -rf "$dir"' EXIT
+# keep a running cclipd out of this
+export XDG_RUNTIME_DIR="$dir"
+db="$dir/db"
+
+# cclipd creates and initialises the database before it connects to the
+# compositor, so let it fail on a display that doesn't exist
+WAYLAND_DISPLAY=cclip-test-no-such-display "$cclipd" -d "$db" 2>/dev/null
+[ -f "$db" ] || { echo "FAIL: could not create database" >&2; exit 1; }
+
+failed=0
+
+add() {
+    printf '%s' "$1" | "$cclip" -d "$db" add >/dev/null || exit 1
+}
+
+# expect PATTERN NUMBER_OF_MATCHES
+expect() {
+    n="$("$cclip" -d "$db" grep "$1" rowid | wc -l)"
+    if [ "$n" -ne "$2" ]; then
+        echo "FAIL: grep '$1' matched $n entries, expected $2" >&2
+        failed=1
+    fi
+}
+
+add 'a x'
+add 'a]foo'
+add 'tab	x'
+add 'b.c'
+
+expect 'a[[:space:]]x' 1
+expect '[[:space:]]x' 2
+expect '[[:alpha:]]]foo' 1
+expect '[^[:digit:]]]foo' 1
+expect '[[=a=]][[:space:]]x' 1
+expect 'a[[.].]]foo' 1
+expect '[]]foo' 1
+expect 'b[.]c' 1
+
+exit "$failed"
@@ -0,0 +1,118 @@
+#!/bin/sh
+
+# Stress test for concurrent writers: cclipd captures a stream of clipboard
+# changes while several cclip processes add, tag, untag and delete entries in
+# the same database. Fails if any writer ran into a locked database, if cclipd
+# lost an entry, or if an entry added with cclip add is missing afterwards.
+#
+# Needs a running wayland compositor that supports data control, and wl-copy.
+# usage: stress-writers.sh [path to cclip] [path to cclipd]
+#
+# STRESS_WRITERS, STRESS_ROUNDS and STRESS_COPIES change how much work is done.
+
+cclip="${1:-cclip}"
+cclipd="${2:-cclipd}"
+writers="${STRESS_WRITERS:-4}"
+rounds="${STRESS_ROUNDS:-100}"
+copies="${STRESS_COPIES:-200}"
+
+if [ -z "$WAYLAND_DISPLAY" ] || ! command -v wl-copy >/dev/null; then
+    echo "SKIP: needs a wayland session and wl-copy" >&2
+    exit 77
+fi
+
+dir="$(mktemp -d)" || exit 1
+daemon_pid=
+cleanup() {
+    [ -n "$daemon_pid" ] && kill "$daemon_pid" 2>/dev/null
+    wait
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+
+# cclipd socket goes to XDG_RUNTIME_DIR, keep compositor socket reachable
+case "$WAYLAND_DISPLAY" in
+    (/*) ;;
+    (*) export WAYLAND_DISPLAY="$XDG_RUNTIME_DIR/$WAYLAND_DISPLAY" ;;
+esac
+export XDG_RUNTIME_DIR="$dir"
+db="$dir/db"
+
+"$cclipd" -d "$db" -c 1000000 2>"$dir/cclipd.log" &
+daemon_pid=$!
+i=0
+while ! ls "$dir"/cclipd-*.sock >/dev/null 2>&1; do
+    i=$((i + 1))
+    if [ "$i" -gt 50 ] || ! kill -0 "$daemon_pid" 2>/dev/null; then
+        echo "FAIL: cclipd did not start" >&2
+        cat "$dir/cclipd.log" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+# failures are expected (entry deleted by another writer), lock errors are not
+run() {
+    "$cclip" -d "$db" "$@" >/dev/null 2>>"$dir/errors"
+}
+
+writer() {
+    i=0
+    while [ "$i" -lt "$rounds" ]; do
+        i=$((i + 1))
+        if ! printf 'stress add %d %d' "$1" "$i" | "$cclip" -d "$db" add >/dev/null 2>>"$dir/errors"; then
+            echo "FAIL: cclip add failed in writer $1" >&2
+        fi
+
+        id="$("$cclip" -d "$db" list rowid,preview | grep 'stress copy' | shuf -n 1 | cut -f 1)"
+        [ -n "$id" ] || continue
+        case $((i % 3)) in
+            (0) run tag "$id" "w$1" ;;
+            (1) run tag -d "$id" "w$1" ;;
+            (2) run delete "$id" ;;
+        esac
+    done
+}
+
+copier() {
+    i=0
+    while [ "$i" -lt "$copies" ]; do
+        i=$((i + 1))
+        printf 'stress copy %d' "$i" | wl-copy
+        sleep 0.02
+    done
+}
+
+copier &
+pids=$!
+w=0
+while [ "$w" -lt "$writers" ]; do
+    w=$((w + 1))
+    writer "$w" &
+    pids="$pids $!"
+done
+# shellcheck disable=SC2086
+wait $pids
+
+failed=0
+
+if grep -i 'locked' "$dir/errors" >&2; then
+    echo "FAIL: cclip ran into a locked database" >&2
+    failed=1
+fi
+
+kill "$daemon_pid"
+wait "$daemon_pid"
+daemon_pid=
+if grep 'is lost' "$dir/cclipd.log" >&2; then
+    echo "FAIL: cclipd lost entries" >&2
+    failed=1
+fi
+
+added="$("$cclip" -d "$db" list preview | grep -c '^stress add')"
+if [ "$added" -ne $((writers * rounds)) ]; then
+    echo "FAIL: $added entries added with cclip add are left, expected $((writers * rounds))" >&2
+    failed=1
+fi
+
+exit "$failed"